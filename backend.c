@@ -1,73 +1,1705 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
 #include "backend.h"
+#include "wal.h"
+#include "outbuf.h"
+#include "span.h"
+#include "metrics.h"
+#include "memstats.h"
+#include "timer_wheel.h"
 
 // ### Internal ###
 
+#define SHELF_LETTERS 26
+#define SHELF_NUMBERS 100
+#define SHELF_SLOTS (SHELF_LETTERS * SHELF_NUMBERS)
+#define SHELF_BITMAP_WORDS ((SHELF_SLOTS + 63) / 64)
+
+#define MERCH_SLOTS_INITIAL_CAPACITY 16
+#define MERCH_SLOT_NONE UINT32_MAX
+#define MERCH_ID_INDEX(id) ((uint32_t)((id) & 0xFFFFFFFF))
+#define MERCH_ID_GENERATION(id) ((uint32_t)((id) >> 32))
+#define RESERVATION(version, reserved) (((uint64_t)(version) << 32) | (uint32_t)(reserved))
+#define RESERVATION_VERSION(word) ((uint32_t)((word) >> 32))
+#define RESERVATION_QUANTITY(word) ((int)(uint32_t)(word))
+
+#define MERCH_ID(index, generation) (((merch_id_t)(generation) << 32) | (index))
+
+#define CART_SLOTS_INITIAL_CAPACITY 16
+#define CART_SLOT_NONE UINT32_MAX
+#define CART_ID_INDEX_BITS 24
+#define CART_ID_GENERATION_MASK 0x7F // the generation takes the bits of a positive int above the index
+#define CART_SLOTS_MAX ((1u << CART_ID_INDEX_BITS) - 1)
+#define CART_ID_INDEX(id) (((uint32_t)(id) & CART_SLOTS_MAX) - 1) // CART_SLOT_NONE for the index bits 0
+#define CART_ID_GENERATION(id) ((uint32_t)(id) >> CART_ID_INDEX_BITS)
+#define CART_ID(index, generation) ((int)(((generation) << CART_ID_INDEX_BITS) | ((index) + 1)))
+
+#define CART_INLINE_LINES 5 // lines a cart holds in itself, a cart with more moves them to a hash table
+#define CART_OF_EXPIRY(timer) ((shopping_carts_t *)((char *)(timer) - offsetof(shopping_carts_t, expiry)))
+
+typedef struct shelf_slot shelf_slot_t;
+typedef struct merch_slot merch_slot_t;
+typedef struct cart_slot cart_slot_t;
+typedef struct snapshot_progress snapshot_progress_t;
+typedef struct cart_walk cart_walk_t;
+typedef struct merch_demand merch_demand_t;
+typedef struct cart_line cart_line_t;
+typedef struct cart_entry cart_entry_t;
+
 struct merch
 {
-  char *name;
-  char *desc;
-  int price;
-  ioopm_list_t *locations;
-};
+  merch_id_t id; // handle into db->merch_slots, DB_NO_MERCH_ID until the merch is added to a webstore
+  char *name;
+  char *desc;
+  int price;
+  ioopm_list_t *locations;
+  ioopm_hash_table_t *carts; // reverse index key=>cart_id, value=>cart of the carts holding the merch, NULL until first needed
+  _Atomic int stock;              // the sum of the quantities of locations, written under lock
+  _Atomic uint64_t reservation;   // a version stamp and the sum of the quantities in all carts, see RESERVATION
+  bool removed;                   // set when the merch is removed from a concurrent webstore, see db_remove_merch
+  bool name_mapped;               // name points into the snapshot the webstore was loaded from and is not freed
+  bool desc_mapped;               // same for desc
+  pthread_mutex_t lock;           // guards the quantities of locations, carts and removed
+};
+
+struct shelf_slot
+{
+  merch_t *owner; // the merchandise stored on the shelf, NULL if the shelf is free
+  shelf_t *shelf; // the shelf itself, owned by owner->locations
+};
+
+struct merch_slot
+{
+  merch_t *merch;      // the merchandise in the slot, NULL if the slot is free
+  uint32_t generation; // increased every time the slot is freed so that old handles become stale
+  uint32_t next_free;  // the next slot on the free list, MERCH_SLOT_NONE if this is the last one
+};
+
+/// Cart ids are handed out like merch handles, but packed into a positive int: the index of the
+/// slot plus one in the low CART_ID_INDEX_BITS, so no cart has id 0, and the generation above it.
+/// Freed slots are handed out again oldest first, so an id only comes back after its slot has been
+/// reused CART_ID_GENERATION_MASK + 1 times.
+struct cart_slot
+{
+  shopping_carts_t *cart; // the cart in the slot, NULL if the slot is free
+  uint32_t generation;    // increased every time the slot is freed, wrapping at CART_ID_GENERATION_MASK
+  uint32_t next_free;     // the slot freed after this one, CART_SLOT_NONE if this is the last one
+};
+
+/// Used when iterating over the lines of a cart or over the carts holding a merchandise
+struct cart_walk
+{
+  webstore_t *db;
+  merch_t *merch;
+  shopping_carts_t *cart;
+  int counter;
+};
+
+/// Types of the records in the write-ahead log, the fields of each are listed after it
+enum log_type
+{
+  LOG_ADD_MERCH = 1,     // name, desc, price
+  LOG_REMOVE_MERCH,      // name
+  LOG_UPDATE_MERCH,      // old name, name, desc, price
+  LOG_ADD_LOCATION,      // merch name, shelf name, quantity
+  LOG_EDIT_LOCATION,     // merch name, shelf name, quantity
+  LOG_ADD_CART,          // cart id
+  LOG_REMOVE_CART,       // cart id
+  LOG_SET_CART_LINE,     // cart id, merch name, quantity
+  LOG_ADD_TO_CART_LINE,  // cart id, merch name, quantity
+  LOG_REMOVE_CART_LINE,  // cart id, merch name
+  LOG_CHECKOUT,          // cart id
+};
+
+/// A line of a cart resolved to its merchandise, used by db_checkout to lock the merchandises in order
+struct cart_line
+{
+  merch_t *merch;
+  int quantity;
+};
+
+/// Scratch entry per merch slot used by db_checkout_batch to aggregate demand across carts
+struct merch_demand
+{
+  uint32_t batch; // the batch the entry was filled in, entries from earlier batches are stale
+  int available;  // quantity in the merchandise's locations when it was first seen in the batch
+  int demand;     // quantity accepted so far in the batch
+};
+
+/// Shared between a webstore and the process writing its background snapshot
+struct snapshot_progress
+{
+  _Atomic uint64_t merchs_written;
+  uint64_t merch_count;
+};
+
+/// In a concurrent webstore locks are always taken in the order merchs_lock, carts_lock, a cart's
+/// lock and last the locks of merchandises in increasing handle order. Changes to carts hold
+/// merchs_lock for reading, so holding it for writing stops every change.
+struct webstore
+{
+  bool concurrent;               // true if the webstore is shared between threads, see db_create_concurrent_webstore
+  pthread_rwlock_t merchs_lock;  // guards merchs, merch_slots, the shelf index and the checkout batch scratch
+  pthread_rwlock_t carts_lock;   // guards cart_slots, cart_quantity, cart_wheel and cart_ttl_ms
+  ioopm_list_t *retired_merchs;  // merchs removed from a concurrent webstore, freed with the webstore
+  wal_t *wal;                    // the write-ahead log of every change, NULL if the webstore is not durable
+  void *snapshot;                // the snapshot the webstore was loaded from, mapped for as long as merch strings point into it
+  size_t snapshot_size;
+  pthread_mutex_t snapshot_lock;           // guards the background snapshot fields below, taken before merchs_lock
+  pid_t snapshot_child;                    // the process writing a background snapshot, 0 if none runs
+  snapshot_state_t snapshot_state;         // the state of the latest background snapshot
+  snapshot_progress_t *snapshot_progress;  // mapped shared with the child, NULL before the first background snapshot
+  wal_position_t snapshot_position;        // the log position the background snapshot was taken at
+  ioopm_hash_table_t *merchs;
+  cart_slot_t *cart_slots;     // slot map from cart id to cart, see CART_ID
+  uint32_t cart_slots_capacity;
+  uint32_t cart_slots_used;    // slots below this index have been handed out at least once
+  uint32_t cart_free_head;     // the free slot handed out next, CART_SLOT_NONE if none is free
+  uint32_t cart_free_tail;     // the free slot freed last
+  int cart_quantity;
+  timer_wheel_t cart_wheel;    // the expiry of every cart while cart_ttl_ms is set, in milliseconds
+  uint64_t cart_ttl_ms;        // carts idle this long are removed by db_expire_carts, 0 if they never are
+  _Atomic uint64_t cart_clock_ms; // the time of the latest db_expire_carts, carts are touched at this time
+  merch_slot_t *merch_slots;   // slot map from merch_id_t to merch, the index of an id is the position in the array
+  uint32_t merch_slots_capacity;
+  uint32_t merch_slots_used;   // slots below this index have been handed out at least once
+  uint32_t merch_free_head;    // first slot on the free list, MERCH_SLOT_NONE if empty
+  merch_demand_t *demand;      // checkout batch scratch, indexed like merch_slots
+  uint32_t *demand_touched;    // slot indices with an entry in the current batch
+  uint32_t demand_capacity;
+  uint32_t demand_touched_count;
+  uint32_t batch;              // id of the latest checkout batch
+  shelf_slot_t shelves[SHELF_SLOTS];            // every possible shelf name [A-Z][0-9][0-9] indexed directly
+  uint64_t shelves_occupied[SHELF_BITMAP_WORDS]; // one bit per slot in shelves, set if the shelf is taken
+};
+
+struct shelf
+{
+  char *name;
+  int quantity;
+};
+
+/// A line of a cart that is held in the cart itself
+struct cart_entry
+{
+  merch_id_t merch;
+  int quantity;
+};
+
+/// Most carts hold a few lines, which are kept unordered in the cart and found by a linear scan.
+/// A cart that gets more lines than fit moves them all to a hash table, until it is emptied.
+///
+/// Using a cart only stores the time in touched. Its timer is left where it was scheduled, and
+/// when it fires db_expire_carts schedules it again from touched if the cart has been used since,
+/// so a busy cart costs the wheel one move per TTL instead of one per use.
+struct shopping_carts
+{
+  int id;                                // the cart's id in db->cart_slots, 0 until the cart is added to a webstore
+  int line_count;                        // the lines in lines, while table is NULL
+  webstore_t *db;                        // the webstore the cart is added to, NULL until then
+  cart_entry_t lines[CART_INLINE_LINES]; // the lines of a small cart
+  ioopm_hash_table_t *table;             // key=>merch_id_t, value=>quantity, NULL while the lines fit in lines
+  pthread_mutex_t lock;                  // guards line_count, lines and table
+  _Atomic uint64_t touched;              // when the cart was last used, by db->cart_clock_ms
+  wheel_timer_t expiry;                  // in db->cart_wheel while a TTL is set, guarded by db->carts_lock
+};
+
+/// FNV-1a, masked to be non-negative. The hashes are stored in snapshots, see SNAPSHOT_VERSION.
+int string_hash(elem_t e)
+{
+  unsigned char *str = e.p;
+  uint32_t result = 2166136261u;
+
+  for (; *str != '\0'; str++)
+  {
+    result = (result ^ *str) * 16777619u;
+  }
+  return (int)(result & INT32_MAX);
+}
+
+/// Appends a record to the write-ahead log of a durable webstore. Callers hold the locks
+/// that order the change, so the log has the changes in the order they were made.
+static void log_change(webstore_t *db, enum log_type type, const char *fields, ...)
+{
+  if (db != NULL && db->wal != NULL)
+  {
+    va_list args;
+    va_start(args, fields);
+    wal_vappend(db->wal, type, fields, args);
+    va_end(args);
+  }
+}
+
+static void merchs_read_lock(webstore_t *db)
+{
+  if (db->concurrent)
+  {
+    pthread_rwlock_rdlock(&db->merchs_lock);
+  }
+}
+
+static void merchs_write_lock(webstore_t *db)
+{
+  if (db->concurrent)
+  {
+    pthread_rwlock_wrlock(&db->merchs_lock);
+  }
+}
+
+static void merchs_unlock(webstore_t *db)
+{
+  if (db->concurrent)
+  {
+    pthread_rwlock_unlock(&db->merchs_lock);
+  }
+}
+
+/// Marks a cart as used now, by the clock of db_expire_carts
+static void cart_touch(shopping_carts_t *cart)
+{
+  if (cart->db != NULL)
+  {
+    uint64_t now = atomic_load_explicit(&cart->db->cart_clock_ms, memory_order_relaxed);
+    atomic_store_explicit(&cart->touched, now, memory_order_relaxed);
+  }
+}
+
+/// Changes to a cart hold the merchs lock of the cart's webstore for reading, which orders them
+/// against db_remove_merch and db_save_snapshot
+static void cart_change_lock(shopping_carts_t *cart)
+{
+  if (cart->db != NULL)
+  {
+    merchs_read_lock(cart->db);
+  }
+  pthread_mutex_lock(&cart->lock);
+  cart_touch(cart);
+}
+
+static void cart_change_unlock(shopping_carts_t *cart)
+{
+  pthread_mutex_unlock(&cart->lock);
+  if (cart->db != NULL)
+  {
+    merchs_unlock(cart->db);
+  }
+}
+
+static void carts_read_lock(webstore_t *db)
+{
+  if (db->concurrent)
+  {
+    pthread_rwlock_rdlock(&db->carts_lock);
+  }
+}
+
+static void carts_write_lock(webstore_t *db)
+{
+  if (db->concurrent)
+  {
+    pthread_rwlock_wrlock(&db->carts_lock);
+  }
+}
+
+static void carts_unlock(webstore_t *db)
+{
+  if (db->concurrent)
+  {
+    pthread_rwlock_unlock(&db->carts_lock);
+  }
+}
+
+/// Maps a shelf name on the form [A-Z][0-9][0-9] to its slot in db->shelves, -1 if the name is not a valid shelf
+static int shelf_slot(char *shelf_name)
+{
+  if (!is_valid_shelf(shelf_name))
+  {
+    return -1;
+  }
+  return (shelf_name[0] - 'A') * SHELF_NUMBERS + (shelf_name[1] - '0') * 10 + (shelf_name[2] - '0');
+}
+
+static bool shelf_slot_is_occupied(webstore_t *db, int slot)
+{
+  return (db->shelves_occupied[slot / 64] >> (slot % 64)) & 1;
+}
+
+static void shelf_index_insert(webstore_t *db, merch_t *merch, shelf_t *shelf)
+{
+  int slot = shelf_slot(shelf->name);
+  if (slot < 0)
+  {
+    return;
+  }
+  db->shelves[slot] = (shelf_slot_t){.owner = merch, .shelf = shelf};
+  db->shelves_occupied[slot / 64] |= (uint64_t)1 << (slot % 64);
+}
+
+static void shelf_index_remove(webstore_t *db, shelf_t *shelf)
+{
+  int slot = shelf_slot(shelf->name);
+  if (slot < 0)
+  {
+    return;
+  }
+  db->shelves[slot] = (shelf_slot_t){.owner = NULL, .shelf = NULL};
+  db->shelves_occupied[slot / 64] &= ~((uint64_t)1 << (slot % 64));
+}
+
+static int merch_id_hash(elem_t e)
+{
+  return (int)((MERCH_ID_INDEX(e.s) ^ (MERCH_ID_GENERATION(e.s) << 16)) & 0x7FFFFFFF);
+}
+
+// The lines of a cart, whether they are inline or in a table. The caller holds the cart's lock.
+
+static size_t cart_lines_size(const shopping_carts_t *cart)
+{
+  return cart->table != NULL ? ioopm_hash_table_size(cart->table) : (size_t)cart->line_count;
+}
+
+/// The position of a merch in the inline lines, -1 if the cart does not hold it
+static int cart_entry_find(const shopping_carts_t *cart, merch_id_t merch)
+{
+  for (int i = 0; i < cart->line_count; i++)
+  {
+    if (cart->lines[i].merch == merch)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static bool cart_lines_lookup(const shopping_carts_t *cart, merch_id_t merch, int *quantity)
+{
+  if (cart->table != NULL)
+  {
+    elem_t value;
+    bool found = ioopm_hash_table_lookup(cart->table, size_elem(merch), &value);
+    *quantity = found ? value.i : *quantity;
+    return found;
+  }
+
+  int i = cart_entry_find(cart, merch);
+  *quantity = i >= 0 ? cart->lines[i].quantity : *quantity;
+  return i >= 0;
+}
+
+/// Moves the inline lines of a full cart to a hash table
+static void cart_lines_grow(shopping_carts_t *cart)
+{
+  cart->table = ioopm_hash_table_create(ioopm_compare_size_elems, ioopm_compare_int_elems, merch_id_hash);
+  ioopm_hash_table_account_to(cart->table, MEMSTATS_CART_TABLES);
+
+  for (int i = 0; i < cart->line_count; i++)
+  {
+    ioopm_hash_table_insert(cart->table, size_elem(cart->lines[i].merch), int_elem(cart->lines[i].quantity));
+  }
+  cart->line_count = 0;
+}
+
+static void cart_lines_set(shopping_carts_t *cart, merch_id_t merch, int quantity)
+{
+  int i = cart->table == NULL ? cart_entry_find(cart, merch) : -1;
+
+  if (i >= 0)
+  {
+    cart->lines[i].quantity = quantity;
+    return;
+  }
+  if (cart->table == NULL && cart->line_count == CART_INLINE_LINES)
+  {
+    cart_lines_grow(cart);
+  }
+
+  if (cart->table != NULL)
+  {
+    ioopm_hash_table_insert(cart->table, size_elem(merch), int_elem(quantity));
+  }
+  else
+  {
+    cart->lines[cart->line_count++] = (cart_entry_t){.merch = merch, .quantity = quantity};
+  }
+}
+
+static bool cart_lines_remove(shopping_carts_t *cart, merch_id_t merch, int *quantity)
+{
+  if (cart->table != NULL)
+  {
+    elem_t value;
+    bool removed = ioopm_hash_table_remove(cart->table, size_elem(merch), &value);
+    *quantity = removed ? value.i : *quantity;
+    return removed;
+  }
+
+  int i = cart_entry_find(cart, merch);
+  if (i < 0)
+  {
+    return false;
+  }
+  *quantity = cart->lines[i].quantity;
+  // The last line takes the place of the removed one
+  cart->lines[i] = cart->lines[--cart->line_count];
+  return true;
+}
+
+/// Calls fun with every line as merch_id => quantity, like ioopm_hash_table_apply_to_all
+static void cart_lines_apply(shopping_carts_t *cart, ioopm_apply_function fun, void *extra)
+{
+  if (cart->table != NULL)
+  {
+    ioopm_hash_table_apply_to_all(cart->table, fun, extra);
+    return;
+  }
+
+  for (int i = 0; i < cart->line_count; i++)
+  {
+    elem_t quantity = int_elem(cart->lines[i].quantity);
+    fun(size_elem(cart->lines[i].merch), &quantity, extra);
+    cart->lines[i].quantity = quantity.i;
+  }
+}
+
+/// True if pred holds for every line, like ioopm_hash_table_all
+static bool cart_lines_all(const shopping_carts_t *cart, ioopm_predicate pred, void *extra)
+{
+  if (cart->table != NULL)
+  {
+    return ioopm_hash_table_all(cart->table, pred, extra);
+  }
+
+  for (int i = 0; i < cart->line_count; i++)
+  {
+    if (!pred(size_elem(cart->lines[i].merch), int_elem(cart->lines[i].quantity), extra))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// Empties a cart, which holds its lines inline again after
+static void cart_lines_clear(shopping_carts_t *cart)
+{
+  if (cart->table != NULL)
+  {
+    ioopm_hash_table_destroy(cart->table);
+    cart->table = NULL;
+  }
+  cart->line_count = 0;
+}
+
+/// Moves db->merch_slots to an array of capacity slots, which holds every slot handed out
+static void merch_slots_resize(webstore_t *db, uint32_t capacity)
+{
+  memstats_free(MEMSTATS_MERCH_SLOTS, db->merch_slots_capacity * sizeof(merch_slot_t));
+  db->merch_slots_capacity = capacity;
+  db->merch_slots = realloc(db->merch_slots, db->merch_slots_capacity * sizeof(merch_slot_t));
+  memstats_alloc(MEMSTATS_MERCH_SLOTS, db->merch_slots_capacity * sizeof(merch_slot_t));
+}
+
+/// Hands out a slot in db->merch_slots for merch and returns its handle
+static merch_id_t merch_slot_alloc(webstore_t *db, merch_t *merch)
+{
+  uint32_t index = db->merch_free_head;
+
+  if (index != MERCH_SLOT_NONE)
+  {
+    db->merch_free_head = db->merch_slots[index].next_free;
+  }
+  else
+  {
+    if (db->merch_slots_used == db->merch_slots_capacity)
+    {
+      merch_slots_resize(db, db->merch_slots_capacity * 2);
+    }
+    index = db->merch_slots_used++;
+    db->merch_slots[index].generation = 1;
+  }
+
+  db->merch_slots[index].merch = merch;
+  db->merch_slots[index].next_free = MERCH_SLOT_NONE;
+
+  return MERCH_ID(index, db->merch_slots[index].generation);
+}
+
+static void merch_slot_free(webstore_t *db, merch_id_t id)
+{
+  merch_slot_t *slot = &db->merch_slots[MERCH_ID_INDEX(id)];
+
+  slot->merch = NULL;
+  slot->generation++;
+  slot->next_free = db->merch_free_head;
+  db->merch_free_head = MERCH_ID_INDEX(id);
+}
+
+/// Hands out a slot in db->cart_slots for cart and returns its id, 0 if every slot is taken.
+/// The caller holds db->carts_lock for writing.
+static int cart_slot_alloc(webstore_t *db, shopping_carts_t *cart)
+{
+  uint32_t index = db->cart_free_head;
+
+  if (index != CART_SLOT_NONE)
+  {
+    db->cart_free_head = db->cart_slots[index].next_free;
+    db->cart_free_tail = db->cart_free_head == CART_SLOT_NONE ? CART_SLOT_NONE : db->cart_free_tail;
+  }
+  else if (db->cart_slots_used == CART_SLOTS_MAX)
+  {
+    return 0;
+  }
+  else
+  {
+    if (db->cart_slots_used == db->cart_slots_capacity)
+    {
+      memstats_free(MEMSTATS_CART_SLOTS, db->cart_slots_capacity * sizeof(cart_slot_t));
+      db->cart_slots_capacity *= 2;
+      db->cart_slots = realloc(db->cart_slots, db->cart_slots_capacity * sizeof(cart_slot_t));
+      memstats_alloc(MEMSTATS_CART_SLOTS, db->cart_slots_capacity * sizeof(cart_slot_t));
+    }
+    index = db->cart_slots_used++;
+    db->cart_slots[index].generation = 0;
+  }
+
+  db->cart_slots[index].cart = cart;
+  db->cart_slots[index].next_free = CART_SLOT_NONE;
+
+  return CART_ID(index, db->cart_slots[index].generation);
+}
+
+/// Puts a slot last on the free list, the caller holds db->carts_lock for writing
+static void cart_slot_free(webstore_t *db, uint32_t index)
+{
+  cart_slot_t *slot = &db->cart_slots[index];
+
+  slot->cart = NULL;
+  slot->generation = (slot->generation + 1) & CART_ID_GENERATION_MASK;
+  slot->next_free = CART_SLOT_NONE;
+
+  if (db->cart_free_tail != CART_SLOT_NONE)
+  {
+    db->cart_slots[db->cart_free_tail].next_free = index;
+  }
+  else
+  {
+    db->cart_free_head = index;
+  }
+  db->cart_free_tail = index;
+}
+
+/// Resolves a cart id, the caller holds db->carts_lock
+static shopping_carts_t *cart_from_id(webstore_t *db, int id)
+{
+  uint32_t index = CART_ID_INDEX(id);
+
+  if (id <= 0 || index >= db->cart_slots_used || db->cart_slots[index].generation != CART_ID_GENERATION(id))
+  {
+    return NULL;
+  }
+  return db->cart_slots[index].cart;
+}
+
+/// Resolves a handle, the caller holds db->merchs_lock
+static merch_t *merch_from_id(webstore_t *db, merch_id_t id)
+{
+  uint32_t index = MERCH_ID_INDEX(id);
+
+  if (index >= db->merch_slots_used || db->merch_slots[index].generation != MERCH_ID_GENERATION(id))
+  {
+    return NULL;
+  }
+  return db->merch_slots[index].merch;
+}
+
+/// The quantity in all locations of a merch
+static int merch_stock(merch_t *merch)
+{
+  return atomic_load(&merch->stock);
+}
+
+/// Adds delta to the stock of a merch, the caller holds merch->lock. The version is bumped after
+/// the stock so that a db_try_reserve that read the old stock fails its swap.
+static void merch_add_stock(merch_t *merch, int delta)
+{
+  atomic_fetch_add(&merch->stock, delta);
+  atomic_fetch_add(&merch->reservation, RESERVATION(1, 0));
+}
+
+/// Adds delta to the quantity reserved by carts and bumps the version
+static void merch_add_reserved(merch_t *merch, int delta)
+{
+  uint64_t old = atomic_load(&merch->reservation);
+  uint64_t new;
+
+  do
+  {
+    new = RESERVATION(RESERVATION_VERSION(old) + 1, RESERVATION_QUANTITY(old) + delta);
+  } while (!atomic_compare_exchange_weak(&merch->reservation, &old, new));
+}
+
+/// Takes quantity units from the locations of a merch in order, the caller holds merch->lock
+static void merch_take_stock(merch_t *merch, int quantity)
+{
+  int size = (int)ioopm_linked_list_size(merch->locations);
+  merch_add_stock(merch, -(quantity < merch_stock(merch) ? quantity : merch_stock(merch)));
+
+  for (int i = 0; i < size && quantity > 0; i++)
+  {
+    shelf_t *location = ioopm_linked_list_get(merch->locations, i).p;
+
+    if (quantity > location->quantity)
+    {
+      quantity = quantity - location->quantity;
+      location->quantity = 0;
+    }
+    else // if(location->quantity > quantity)
+    {
+      location->quantity = location->quantity - quantity;
+      quantity = 0;
+    }
+  }
+}
+
+/// Counts a name or description of a merchandise in memstats, unless it is in a mapped snapshot
+static void count_merch_string(const char *string, bool mapped, bool taken)
+{
+  if (!mapped)
+  {
+    (taken ? memstats_alloc : memstats_free)(MEMSTATS_MERCH_STRINGS, strlen(string) + 1);
+  }
+}
+
+/// Creates a merchandise whose strings may point into a mapped snapshot, see db_create_merch
+static merch_t *merch_create(char *name, char *desc, int price, bool mapped)
+{
+  merch_t *new_merch = calloc(1, sizeof(merch_t));
+  memstats_alloc(MEMSTATS_MERCHS, sizeof(merch_t));
+
+  new_merch->name = name;
+  new_merch->desc = desc;
+  new_merch->name_mapped = mapped;
+  new_merch->desc_mapped = mapped;
+  count_merch_string(name, mapped, true);
+  count_merch_string(desc, mapped, true);
+  new_merch->price = price;
+  new_merch->locations = ioopm_linked_list_create(ioopm_compare_ptr_elems);
+  atomic_init(&new_merch->stock, 0);
+  atomic_init(&new_merch->reservation, RESERVATION(0, 0));
+  pthread_mutex_init(&new_merch->lock, NULL);
+
+  return new_merch;
+}
+
+// Carts are keyed by their address, as a cart has no id until it is added to a webstore
+static int cart_ptr_hash(elem_t e)
+{
+  uint64_t address = (uintptr_t)e.p;
+  return (int)((address ^ (address >> 32)) & 0x7FFFFFFF);
+}
+
+static void merch_link_cart(merch_t *merch, shopping_carts_t *cart)
+{
+  if (merch->carts == NULL)
+  {
+    merch->carts = ioopm_hash_table_create(ioopm_compare_ptr_elems, ioopm_compare_ptr_elems, cart_ptr_hash);
+  }
+  ioopm_hash_table_insert(merch->carts, ptr_elem(cart), ptr_elem(cart));
+}
+
+static void merch_unlink_cart(merch_t *merch, shopping_carts_t *cart)
+{
+  if (merch->carts != NULL)
+  {
+    ioopm_hash_table_remove(merch->carts, ptr_elem(cart), NULL);
+  }
+}
+
+/// Empties a cart and removes it from the reverse index of every merchandise it holds.
+/// The caller holds db->merchs_lock and cart->lock.
+static void cart_clear(webstore_t *db, shopping_carts_t *cart);
+
+/// Removes a cart from the webstore and destroys it, the caller holds db->merchs_lock
+static bool remove_cart(webstore_t *db, int id_choice);
+
+/// Sets the quantity of a cart line, adding quantity to the existing line if add is true
+static void set_cart_line(shopping_carts_t *cart, merch_t *merch, int quantity, bool add);
+
+// ### Internal ###
+
+webstore_t *db_create_webstore(void)
+{
+  webstore_t *db = calloc(1, sizeof(webstore_t));
+
+  db->merchs = ioopm_hash_table_create(key_equiv, ioopm_compare_ptr_elems, string_hash);
+  db->cart_slots_capacity = CART_SLOTS_INITIAL_CAPACITY;
+  db->cart_slots = calloc(db->cart_slots_capacity, sizeof(cart_slot_t));
+  memstats_alloc(MEMSTATS_CART_SLOTS, db->cart_slots_capacity * sizeof(cart_slot_t));
+  db->cart_free_head = CART_SLOT_NONE;
+  db->cart_free_tail = CART_SLOT_NONE;
+  db->merch_slots_capacity = MERCH_SLOTS_INITIAL_CAPACITY;
+  db->merch_slots = calloc(db->merch_slots_capacity, sizeof(merch_slot_t));
+  memstats_alloc(MEMSTATS_MERCH_SLOTS, db->merch_slots_capacity * sizeof(merch_slot_t));
+  db->merch_free_head = MERCH_SLOT_NONE;
+  db->retired_merchs = ioopm_linked_list_create(ioopm_compare_ptr_elems);
+  pthread_rwlock_init(&db->merchs_lock, NULL);
+  pthread_rwlock_init(&db->carts_lock, NULL);
+  pthread_mutex_init(&db->snapshot_lock, NULL);
+
+  return db;
+}
+
+webstore_t *db_create_concurrent_webstore(void)
+{
+  webstore_t *db = db_create_webstore();
+  db->concurrent = true;
+  return db;
+}
+
+/// Applies one record of the write-ahead log. Records that refer to merchandise or carts
+/// that no longer exist are skipped, like the changes they describe were. Returns false if a
+/// cart gets another id than the logged one, the later records would then change the wrong carts.
+static bool replay_change(wal_record_t *record, void *db_ptr)
+{
+  webstore_t *db = db_ptr;
+
+  if (record->type == LOG_ADD_MERCH)
+  {
+    char *name = wal_record_string(record);
+    char *desc = wal_record_string(record);
+    db_add_merch(db, db_create_merch(name, desc, wal_record_int(record)));
+  }
+  else if (record->type == LOG_ADD_CART)
+  {
+    // The cart slots are as they were when the cart was added, so the cart gets the logged id
+    // unless the log does not belong to the snapshot
+    int id = wal_record_int(record);
+    shopping_carts_t *cart = db_create_cart();
+    if (!db_add_cart(db, cart))
+    {
+      fprintf(stderr, "the log adds cart %d to a webstore without room for it\n", id);
+      db_destroy_a_cart(cart);
+      return false;
+    }
+    if (cart->id != id)
+    {
+      fprintf(stderr, "the log adds cart %d where cart %d was handed out\n", id, cart->id);
+      return false;
+    }
+  }
+  else if (record->type == LOG_REMOVE_CART)
+  {
+    db_remove_cart(db, wal_record_int(record));
+  }
+  else if (record->type == LOG_CHECKOUT)
+  {
+    shopping_carts_t *cart = db_get_cart_from_id(db, wal_record_int(record));
+    if (cart != NULL)
+    {
+      db_checkout(db, cart);
+    }
+  }
+  else if (record->type == LOG_SET_CART_LINE || record->type == LOG_ADD_TO_CART_LINE || record->type == LOG_REMOVE_CART_LINE)
+  {
+    shopping_carts_t *cart = db_get_cart_from_id(db, wal_record_int(record));
+    char *name = wal_record_string(record);
+    merch_t *merch = db_get_merch(db, name);
+
+    if (cart != NULL && merch != NULL)
+    {
+      if (record->type == LOG_REMOVE_CART_LINE)
+      {
+        db_remove_merch_from_cart(cart, merch);
+      }
+      else
+      {
+        set_cart_line(cart, merch, wal_record_int(record), record->type == LOG_ADD_TO_CART_LINE);
+      }
+    }
+    free(name);
+  }
+  else
+  {
+    // The rest refer to a merch by name
+    char *name = wal_record_string(record);
+    merch_t *merch = db_get_merch(db, name);
+
+    if (merch != NULL && record->type == LOG_REMOVE_MERCH)
+    {
+      db_remove_merch(db, name);
+    }
+    else if (merch != NULL && record->type == LOG_UPDATE_MERCH)
+    {
+      char *new_name = wal_record_string(record);
+      char *new_desc = wal_record_string(record);
+      int new_price = wal_record_int(record);
+
+      if (strcmp(new_name, name) == 0)
+      {
+        free(new_name);
+        new_name = NULL;
+      }
+      db_update_merch(db, merch, new_name, new_desc, new_price);
+    }
+    else if (merch != NULL && (record->type == LOG_ADD_LOCATION || record->type == LOG_EDIT_LOCATION))
+    {
+      char *shelf_name = wal_record_string(record);
+      int quantity = wal_record_int(record);
+
+      if (record->type == LOG_EDIT_LOCATION)
+      {
+        db_edit_location_quantity(db, merch, shelf_name, quantity);
+        free(shelf_name);
+      }
+      else
+      {
+        db_add_location_to_merch(db, merch, shelf_name, quantity);
+      }
+    }
+    free(name);
+  }
+  return true;
+}
+
+/// Snapshot layout, all integers in host byte order:
+///   snapshot_header_t
+///   per merch: snapshot_merch_t, name and desc NUL terminated and padded to 4 bytes, snapshot_shelf_t per shelf
+///   per cart: snapshot_cart_t, snapshot_line_t per line
+///   cart slots: snapshot_cart_slot_t per slot handed out, so ids are handed out as before the snapshot
+///   index: snapshot_index_t per merch, sorted by the bucket of the hash in a table of index_capacity
+///   snapshot_footer_t
+/// The footer is written last, so the file is written in one pass. Bump SNAPSHOT_VERSION when
+/// the layout or string_hash changes.
+#define SNAPSHOT_MAGIC "WEBSNAP\0"
+#define SNAPSHOT_VERSION 3
+#define SNAPSHOT_BUFFER_SIZE (1 << 20)
+#define SNAPSHOT_ALIGN(size) (((size) + 3) & ~(uint64_t)3)
+#define SNAPSHOT_TABLE_CAPACITY(merch_count) ((merch_count) * 4 / 3 + 17)
+
+typedef struct snapshot_header snapshot_header_t;
+typedef struct snapshot_merch snapshot_merch_t;
+typedef struct snapshot_shelf snapshot_shelf_t;
+typedef struct snapshot_cart snapshot_cart_t;
+typedef struct snapshot_line snapshot_line_t;
+typedef struct snapshot_cart_slot snapshot_cart_slot_t;
+typedef struct snapshot_index snapshot_index_t;
+typedef struct snapshot_bucket snapshot_bucket_t;
+typedef struct snapshot_footer snapshot_footer_t;
+typedef struct snapshot_writer snapshot_writer_t;
+typedef struct export_writer export_writer_t;
+
+struct snapshot_header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t unused;
+};
+
+struct snapshot_merch
+{
+  int32_t price;
+  uint32_t name_length;
+  uint32_t desc_length;
+  uint32_t shelf_count;
+};
+
+struct snapshot_shelf
+{
+  char name[4];
+  int32_t quantity;
+};
+
+struct snapshot_cart
+{
+  int32_t id;
+  uint32_t line_count;
+};
+
+struct snapshot_line
+{
+  uint32_t merch; // the position of the merch in the snapshot
+  int32_t quantity;
+};
+
+struct snapshot_cart_slot
+{
+  uint32_t generation;
+  uint32_t next_free;
+};
+
+/// The merch table is rebuilt bucket by bucket from the index, so the loader neither rehashes
+/// names nor jumps around the bucket array
+struct snapshot_index
+{
+  uint32_t hash;
+  uint32_t merch; // the position of the merch in the snapshot
+};
+
+/// An index entry with the bucket it is sorted by
+struct snapshot_bucket
+{
+  uint32_t bucket;
+  snapshot_index_t entry;
+};
+
+struct snapshot_footer
+{
+  uint64_t merch_count;
+  uint64_t index_capacity;
+  uint64_t cart_count;
+  uint64_t carts_offset;
+  uint64_t cart_slots_offset;
+  uint64_t index_offset;
+  uint64_t wal_generation; // the log position the snapshot was taken at, the records before it are in the snapshot
+  uint64_t wal_offset;
+  uint32_t cart_slots_used;
+  uint32_t cart_free_head;
+  uint32_t cart_free_tail;
+  uint32_t version;
+  char magic[8];
+};
+
+/// Used when the carts are written
+struct snapshot_writer
+{
+  webstore_t *db;
+  outbuf_t *out;
+  uint32_t *positions; // the position in the snapshot of the merch in every slot
+};
+
+static void write_snapshot_line(elem_t merch_id, elem_t *quantity, void *writer_ptr)
+{
+  snapshot_writer_t *writer = writer_ptr;
+  snapshot_line_t line = {.merch = writer->positions[MERCH_ID_INDEX(merch_id.s)], .quantity = quantity->i};
+
+  outbuf_write(writer->out, &line, sizeof(line));
+}
+
+static void write_snapshot_cart(snapshot_writer_t *writer, shopping_carts_t *cart)
+{
+  snapshot_cart_t record = {.id = cart->id, .line_count = (uint32_t)cart_lines_size(cart)};
+
+  outbuf_write(writer->out, &record, sizeof(record));
+  cart_lines_apply(cart, write_snapshot_line, writer);
+}
+
+static int compare_snapshot_buckets(const void *a, const void *b)
+{
+  const snapshot_bucket_t *bucket_a = a;
+  const snapshot_bucket_t *bucket_b = b;
+
+  if (bucket_a->bucket != bucket_b->bucket)
+  {
+    return bucket_a->bucket < bucket_b->bucket ? -1 : 1;
+  }
+  return (bucket_a->entry.hash > bucket_b->entry.hash) - (bucket_a->entry.hash < bucket_b->entry.hash);
+}
+
+/// Streams a snapshot taken at a log position. The caller holds merchs_lock and carts_lock for
+/// writing, or is the child of a background snapshot.
+static void stream_snapshot(webstore_t *db, outbuf_t *out, wal_position_t taken_at, snapshot_progress_t *progress)
+{
+  // Offsets in the snapshot are counted from its header, wherever it starts in out
+  uint64_t start = outbuf_offset(out);
+  snapshot_header_t header = {.magic = SNAPSHOT_MAGIC, .version = SNAPSHOT_VERSION};
+  outbuf_write(out, &header, sizeof(header));
+
+  size_t merch_count = ioopm_hash_table_size(db->merchs);
+  uint64_t index_capacity = SNAPSHOT_TABLE_CAPACITY(merch_count);
+  snapshot_bucket_t *buckets = calloc(merch_count + 1, sizeof(snapshot_bucket_t));
+  snapshot_writer_t writer = {.db = db, .out = out};
+  writer.positions = calloc(db->merch_slots_used + 1, sizeof(uint32_t));
+  uint32_t position = 0;
+  static const char padding[4] = {0};
+
+  // Merchs are written in slot order, which needs no list of the merchs
+  for (uint32_t i = 0; i < db->merch_slots_used; i++)
+  {
+    merch_t *merch = db->merch_slots[i].merch;
+    if (merch == NULL)
+    {
+      continue;
+    }
+
+    uint32_t shelf_count = (uint32_t)ioopm_linked_list_size(merch->locations);
+    snapshot_merch_t record = {.price = merch->price, .name_length = (uint32_t)strlen(merch->name),
+                               .desc_length = (uint32_t)strlen(merch->desc), .shelf_count = shelf_count};
+    uint64_t strings_size = record.name_length + 1 + record.desc_length + 1;
+
+    outbuf_write(out, &record, sizeof(record));
+    outbuf_write(out, merch->name, record.name_length + 1);
+    outbuf_write(out, merch->desc, record.desc_length + 1);
+    outbuf_write(out, padding, SNAPSHOT_ALIGN(strings_size) - strings_size);
+
+    for (uint32_t j = 0; j < shelf_count; j++)
+    {
+      shelf_t *location = ioopm_linked_list_get(merch->locations, j).p;
+      snapshot_shelf_t shelf = {.quantity = location->quantity};
+      strncpy(shelf.name, location->name, sizeof(shelf.name) - 1);
+      outbuf_write(out, &shelf, sizeof(shelf));
+    }
+
+    uint32_t hash = (uint32_t)string_hash(ptr_elem(merch->name));
+    buckets[position] = (snapshot_bucket_t){.bucket = hash % index_capacity, .entry = {.hash = hash, .merch = position}};
+    writer.positions[i] = position++;
+
+    if (progress != NULL)
+    {
+      atomic_store_explicit(&progress->merchs_written, position, memory_order_relaxed);
+    }
+  }
+
+  snapshot_footer_t footer = {.merch_count = merch_count, .index_capacity = index_capacity, .cart_count = db->cart_quantity,
+                              .carts_offset = outbuf_offset(out) - start, .cart_slots_used = db->cart_slots_used,
+                              .cart_free_head = db->cart_free_head, .cart_free_tail = db->cart_free_tail,
+                              .wal_generation = taken_at.generation, .wal_offset = taken_at.offset,
+                              .version = SNAPSHOT_VERSION, .magic = SNAPSHOT_MAGIC};
+  for (uint32_t i = 0; i < db->cart_slots_used; i++)
+  {
+    if (db->cart_slots[i].cart != NULL)
+    {
+      write_snapshot_cart(&writer, db->cart_slots[i].cart);
+    }
+  }
+
+  footer.cart_slots_offset = outbuf_offset(out) - start;
+  for (uint32_t i = 0; i < db->cart_slots_used; i++)
+  {
+    snapshot_cart_slot_t slot = {.generation = db->cart_slots[i].generation, .next_free = db->cart_slots[i].next_free};
+    outbuf_write(out, &slot, sizeof(slot));
+  }
+
+  footer.index_offset = outbuf_offset(out) - start;
+  qsort(buckets, merch_count, sizeof(snapshot_bucket_t), compare_snapshot_buckets);
+  for (size_t i = 0; i < merch_count; i++)
+  {
+    outbuf_write(out, &buckets[i].entry, sizeof(snapshot_index_t));
+  }
+  outbuf_write(out, &footer, sizeof(footer));
+
+  free(buckets);
+  free(writer.positions);
+}
+
+/// Writes a snapshot taken at a log position to a temporary file that replaces path, see stream_snapshot
+static bool write_snapshot(webstore_t *db, const char *path, wal_position_t taken_at, snapshot_progress_t *progress)
+{
+  char *tmp_path = calloc(strlen(path) + 5, sizeof(char));
+  sprintf(tmp_path, "%s.tmp", path);
+
+  int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+  {
+    free(tmp_path);
+    return false;
+  }
+
+  outbuf_t *out = outbuf_create(fd, SNAPSHOT_BUFFER_SIZE);
+  stream_snapshot(db, out, taken_at, progress);
+
+  bool written = outbuf_destroy(out) && fsync(fd) == 0;
+  written = close(fd) == 0 && written;
+  written = written && rename(tmp_path, path) == 0;
+
+  free(tmp_path);
+  return written;
+}
+
+/// The position of the next change in the log, a snapshot taken now holds every change before it
+static wal_position_t snapshot_position(webstore_t *db)
+{
+  return db->wal != NULL ? wal_position(db->wal) : (wal_position_t){0};
+}
+
+/// Collects the process of a finished background snapshot and drops the changes it holds from
+/// the log. Waits for it to finish if wait is true. The caller holds snapshot_lock.
+static void reap_snapshot_child(webstore_t *db, bool wait)
+{
+  if (db->snapshot_child == 0)
+  {
+    return;
+  }
+
+  int status = 0;
+  pid_t pid;
+  do
+  {
+    pid = waitpid(db->snapshot_child, &status, wait ? 0 : WNOHANG);
+  } while (pid < 0 && errno == EINTR);
+
+  if (pid == 0)
+  {
+    return; // still writing
+  }
+
+  bool written = pid == db->snapshot_child && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  db->snapshot_child = 0;
+  db->snapshot_state = written ? SNAPSHOT_DONE : SNAPSHOT_FAILED;
+
+  if (written && db->wal != NULL)
+  {
+    wal_discard(db->wal, db->snapshot_position);
+  }
+}
+
+bool db_save_snapshot(webstore_t *db, const char *path)
+{
+  // Only one snapshot is written at a time
+  pthread_mutex_lock(&db->snapshot_lock);
+  reap_snapshot_child(db, true);
+
+  // Every change waits while the snapshot is written, so it is a single point in the log
+  merchs_write_lock(db);
+  carts_write_lock(db);
+  wal_position_t position = snapshot_position(db);
+  bool written = write_snapshot(db, path, position, NULL);
+  carts_unlock(db);
+  merchs_unlock(db);
+
+  // The snapshot holds every change logged before it
+  if (written && db->wal != NULL)
+  {
+    wal_discard(db->wal, position);
+  }
+
+  pthread_mutex_unlock(&db->snapshot_lock);
+  return written;
+}
+
+bool db_save_snapshot_background(webstore_t *db, const char *path)
+{
+  pthread_mutex_lock(&db->snapshot_lock);
+  reap_snapshot_child(db, false);
+
+  if (db->snapshot_child != 0)
+  {
+    pthread_mutex_unlock(&db->snapshot_lock);
+    return false;
+  }
+
+  if (db->snapshot_progress == NULL)
+  {
+    void *shared = mmap(NULL, sizeof(snapshot_progress_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED)
+    {
+      pthread_mutex_unlock(&db->snapshot_lock);
+      return false;
+    }
+    db->snapshot_progress = shared;
+  }
+
+  // Changes only wait for the fork. The child writes the copy-on-write image of the webstore
+  // as it was then, while the parent goes on changing its own pages.
+  merchs_write_lock(db);
+  carts_write_lock(db);
+  db->snapshot_position = snapshot_position(db);
+  atomic_store(&db->snapshot_progress->merchs_written, 0);
+  db->snapshot_progress->merch_count = ioopm_hash_table_size(db->merchs);
+
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    // Only this thread exists in the child, so it touches neither the log nor stdio buffers of the parent
+    _exit(write_snapshot(db, path, db->snapshot_position, db->snapshot_progress) ? 0 : 1);
+  }
+  carts_unlock(db);
+  merchs_unlock(db);
+
+  if (pid > 0)
+  {
+    db->snapshot_child = pid;
+    db->snapshot_state = SNAPSHOT_RUNNING;
+  }
+  pthread_mutex_unlock(&db->snapshot_lock);
+  return pid > 0;
+}
+
+/// The status of the latest background snapshot, the caller holds snapshot_lock
+static snapshot_status_t snapshot_status(webstore_t *db)
+{
+  snapshot_status_t status = {.state = db->snapshot_state};
+
+  if (db->snapshot_progress != NULL)
+  {
+    status.merchs_written = atomic_load(&db->snapshot_progress->merchs_written);
+    status.merch_count = db->snapshot_progress->merch_count;
+  }
+  return status;
+}
+
+snapshot_status_t db_snapshot_status(webstore_t *db)
+{
+  pthread_mutex_lock(&db->snapshot_lock);
+  reap_snapshot_child(db, false);
+  snapshot_status_t status = snapshot_status(db);
+  pthread_mutex_unlock(&db->snapshot_lock);
+  return status;
+}
 
-struct webstore
+snapshot_status_t db_wait_snapshot(webstore_t *db)
 {
-  ioopm_hash_table_t *merchs;
-  ioopm_hash_table_t *carts;
-  int cart_id;
-  int cart_quantity;
-};
+  pthread_mutex_lock(&db->snapshot_lock);
+  reap_snapshot_child(db, true);
+  snapshot_status_t status = snapshot_status(db);
+  pthread_mutex_unlock(&db->snapshot_lock);
+  return status;
+}
 
-struct shelf
+/// Used when carts are exported
+struct export_writer
 {
-  char *name;
-  int quantity;
+  webstore_t *db;
+  outbuf_t *out;
+  bool first; // no line of the cart has been written yet
 };
 
-struct shopping_carts
+/// Writes a CSV field, quoted if it holds a separator, a quote or a line end
+static void export_csv_string(outbuf_t *out, const char *str)
 {
-  ioopm_hash_table_t *shopping_cart;
-};
+  if (strpbrk(str, ",\"\r\n") == NULL)
+  {
+    outbuf_puts(out, str);
+    return;
+  }
 
-int string_hash(elem_t e)
+  outbuf_putc(out, '"');
+  for (const char *c = str; *c != '\0'; c++)
+  {
+    if (*c == '"')
+    {
+      outbuf_putc(out, '"');
+    }
+    outbuf_putc(out, *c);
+  }
+  outbuf_putc(out, '"');
+}
+
+/// Writes a JSON string, control characters are escaped and other bytes copied as they are.
+/// Runs of bytes that need no escape are copied in one go.
+static void export_json_string(outbuf_t *out, const char *str)
 {
-  char *str = e.p;
-  int result = 0;
-  do
+  static const char hex[] = "0123456789abcdef";
+  const unsigned char *run = (const unsigned char *)str;
+  const unsigned char *c = run;
+
+  outbuf_putc(out, '"');
+  for (; *c != '\0'; c++)
   {
-    result += *str;
-  } while (*++str != '\0');
-  return result;
+    if (*c != '"' && *c != '\\' && *c >= 0x20)
+    {
+      continue;
+    }
+
+    outbuf_write(out, run, c - run);
+    run = c + 1;
+    if (*c < 0x20)
+    {
+      char escape[6] = {'\\', 'u', '0', '0', hex[*c >> 4], hex[*c & 0xF]};
+      outbuf_write(out, escape, sizeof(escape));
+    }
+    else
+    {
+      char escape[2] = {'\\', (char)*c};
+      outbuf_write(out, escape, sizeof(escape));
+    }
+  }
+  outbuf_write(out, run, c - run);
+  outbuf_putc(out, '"');
 }
 
-// ### Internal ###
+/// One row per shelf, or one without a shelf, in the format import_merchs reads
+static void export_csv_merch(outbuf_t *out, merch_t *merch)
+{
+  int size = (int)ioopm_linked_list_size(merch->locations);
 
-webstore_t *db_create_webstore(void)
+  for (int i = 0; i < size || i == 0; i++)
+  {
+    export_csv_string(out, merch->name);
+    outbuf_putc(out, ',');
+    export_csv_string(out, merch->desc);
+    outbuf_putc(out, ',');
+    outbuf_int(out, merch->price);
+    outbuf_putc(out, ',');
+
+    if (size > 0)
+    {
+      shelf_t *shelf = ioopm_linked_list_get(merch->locations, i).p;
+      outbuf_puts(out, shelf->name);
+      outbuf_putc(out, ',');
+      outbuf_int(out, shelf->quantity);
+    }
+    else
+    {
+      outbuf_putc(out, ',');
+    }
+    outbuf_putc(out, '\n');
+  }
+}
+
+static void export_json_merch(outbuf_t *out, merch_t *merch)
 {
-  webstore_t *db = calloc(1, sizeof(webstore_t));
+  int size = (int)ioopm_linked_list_size(merch->locations);
 
-  db->merchs = ioopm_hash_table_create(key_equiv, ioopm_compare_ptr_elems, string_hash);
-  db->carts = ioopm_hash_table_create(ioopm_compare_int_elems, NULL, NULL);
-  db->cart_id = 1;
+  outbuf_puts(out, "{\"name\":");
+  export_json_string(out, merch->name);
+  outbuf_puts(out, ",\"desc\":");
+  export_json_string(out, merch->desc);
+  outbuf_puts(out, ",\"price\":");
+  outbuf_int(out, merch->price);
+  outbuf_puts(out, ",\"shelves\":[");
 
-  return db;
+  for (int i = 0; i < size; i++)
+  {
+    shelf_t *shelf = ioopm_linked_list_get(merch->locations, i).p;
+    outbuf_puts(out, i == 0 ? "{\"shelf\":" : ",{\"shelf\":");
+    export_json_string(out, shelf->name);
+    outbuf_puts(out, ",\"quantity\":");
+    outbuf_int(out, shelf->quantity);
+    outbuf_putc(out, '}');
+  }
+  outbuf_puts(out, "]}\n");
 }
 
-merch_t *db_create_merch(char *name, char *desc, int price)
+static void export_json_line(elem_t merch_id, elem_t *quantity, void *writer_ptr)
 {
-  merch_t *new_merch = calloc(1, sizeof(merch_t));
+  export_writer_t *writer = writer_ptr;
+  merch_t *merch = merch_from_id(writer->db, merch_id.s);
+
+  outbuf_puts(writer->out, writer->first ? "{\"name\":" : ",{\"name\":");
+  export_json_string(writer->out, merch->name);
+  outbuf_puts(writer->out, ",\"quantity\":");
+  outbuf_int(writer->out, quantity->i);
+  outbuf_putc(writer->out, '}');
+  writer->first = false;
+}
 
-  new_merch->name = name;
-  new_merch->desc = desc;
-  new_merch->price = price;
-  new_merch->locations = ioopm_linked_list_create(ioopm_compare_ptr_elems);
+static void export_json_cart(export_writer_t *writer, shopping_carts_t *cart)
+{
+  pthread_mutex_lock(&cart->lock);
+  outbuf_puts(writer->out, "{\"cart\":");
+  outbuf_int(writer->out, cart->id);
+  outbuf_puts(writer->out, ",\"lines\":[");
+  writer->first = true;
+  cart_lines_apply(cart, export_json_line, writer);
+  outbuf_puts(writer->out, "]}\n");
+  pthread_mutex_unlock(&cart->lock);
+}
 
-  return new_merch;
+bool db_export(webstore_t *db, outbuf_t *out, export_format_t format)
+{
+  if (format == EXPORT_SNAPSHOT)
+  {
+    // A single point in the log, like db_save_snapshot, but the log is kept
+    merchs_write_lock(db);
+    carts_write_lock(db);
+    stream_snapshot(db, out, snapshot_position(db), NULL);
+    carts_unlock(db);
+    merchs_unlock(db);
+    return outbuf_flush(out);
+  }
+
+  merchs_read_lock(db);
+  if (format == EXPORT_CSV)
+  {
+    outbuf_puts(out, "name,desc,price,shelf,quantity\n");
+  }
+
+  // Merchs are written in slot order, which needs no list of the merchs
+  for (uint32_t i = 0; i < db->merch_slots_used; i++)
+  {
+    merch_t *merch = db->merch_slots[i].merch;
+    if (merch == NULL)
+    {
+      continue;
+    }
+
+    pthread_mutex_lock(&merch->lock);
+    if (format == EXPORT_CSV)
+    {
+      export_csv_merch(out, merch);
+    }
+    else
+    {
+      export_json_merch(out, merch);
+    }
+    pthread_mutex_unlock(&merch->lock);
+  }
+
+  if (format == EXPORT_JSONL)
+  {
+    export_writer_t writer = {.db = db, .out = out};
+    carts_read_lock(db);
+    for (uint32_t i = 0; i < db->cart_slots_used; i++)
+    {
+      if (db->cart_slots[i].cart != NULL)
+      {
+        export_json_cart(&writer, db->cart_slots[i].cart);
+      }
+    }
+    carts_unlock(db);
+  }
+  merchs_unlock(db);
+
+  return outbuf_flush(out);
+}
+
+void db_export_merch(merch_t *merch, outbuf_t *out)
+{
+  pthread_mutex_lock(&merch->lock);
+  export_json_merch(out, merch);
+  pthread_mutex_unlock(&merch->lock);
+}
+
+void db_export_merchs(webstore_t *db, outbuf_t *out)
+{
+  merchs_read_lock(db);
+  outbuf_int(out, ioopm_hash_table_size(db->merchs));
+  outbuf_putc(out, '\n');
+
+  for (uint32_t i = 0; i < db->merch_slots_used; i++)
+  {
+    if (db->merch_slots[i].merch != NULL)
+    {
+      db_export_merch(db->merch_slots[i].merch, out);
+    }
+  }
+  merchs_unlock(db);
+}
+
+/// True if size bytes at offset lie before end
+static bool snapshot_has(uint64_t offset, uint64_t size, uint64_t end)
+{
+  return offset <= end && size <= end - offset;
+}
+
+/// Loads a snapshot into an empty webstore. Merch names and descriptions point into the
+/// mapped file and the merch table is rebuilt from the index without rehashing. The log position
+/// the snapshot was taken at is stored in position. Returns true if there is no snapshot, false if
+/// the file is not a snapshot or is cut short, whatever was loaded is then only fit to be destroyed.
+static bool load_snapshot(webstore_t *db, const char *path, wal_position_t *position)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    return errno == ENOENT;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(snapshot_header_t) + sizeof(snapshot_footer_t))
+  {
+    close(fd);
+    return false;
+  }
+
+  size_t size = (size_t)st.st_size;
+  char *base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+  {
+    return false;
+  }
+
+  snapshot_header_t header;
+  snapshot_footer_t footer;
+  memcpy(&header, base, sizeof(header));
+  memcpy(&footer, base + size - sizeof(footer), sizeof(footer));
+  uint64_t index_end = size - sizeof(footer);
+
+  if (memcmp(header.magic, SNAPSHOT_MAGIC, 8) != 0 || header.version != SNAPSHOT_VERSION ||
+      memcmp(footer.magic, SNAPSHOT_MAGIC, 8) != 0 || footer.version != SNAPSHOT_VERSION ||
+      footer.carts_offset > footer.cart_slots_offset || footer.cart_slots_used > CART_SLOTS_MAX ||
+      !snapshot_has(footer.cart_slots_offset, footer.cart_slots_used * sizeof(snapshot_cart_slot_t), footer.index_offset) ||
+      footer.index_capacity == 0 ||
+      !snapshot_has(footer.index_offset, footer.merch_count * sizeof(snapshot_index_t), index_end))
+  {
+    fprintf(stderr, "%s is not a webstore snapshot of version %d\n", path, SNAPSHOT_VERSION);
+    munmap(base, size);
+    return false;
+  }
+
+  db->snapshot = base;
+  db->snapshot_size = size;
+  *position = (wal_position_t){.generation = footer.wal_generation, .offset = footer.wal_offset};
+
+  // Sized for every merch up front, so the table never grows during the load
+  ioopm_hash_table_destroy(db->merchs);
+  db->merchs = ioopm_hash_table_create_complex(key_equiv, ioopm_compare_ptr_elems, string_hash,
+                                               footer.index_capacity, 0.75);
+  merch_slots_resize(db, footer.merch_count > MERCH_SLOTS_INITIAL_CAPACITY ? (uint32_t)footer.merch_count : MERCH_SLOTS_INITIAL_CAPACITY);
+
+  merch_t **merchs = calloc(footer.merch_count + 1, sizeof(merch_t *));
+  uint64_t offset = sizeof(header);
+  bool valid = true;
+
+  for (uint64_t i = 0; i < footer.merch_count && valid; i++)
+  {
+    snapshot_merch_t record;
+    valid = snapshot_has(offset, sizeof(record), footer.carts_offset);
+    if (!valid)
+    {
+      break;
+    }
+    memcpy(&record, base + offset, sizeof(record));
+
+    uint64_t strings_size = (uint64_t)record.name_length + 1 + record.desc_length + 1;
+    uint64_t shelves_offset = offset + sizeof(record) + SNAPSHOT_ALIGN(strings_size);
+    valid = snapshot_has(offset + sizeof(record), SNAPSHOT_ALIGN(strings_size), footer.carts_offset) &&
+            snapshot_has(shelves_offset, record.shelf_count * sizeof(snapshot_shelf_t), footer.carts_offset);
+    if (!valid)
+    {
+      break;
+    }
+
+    char *name = base + offset + sizeof(record);
+    char *desc = name + record.name_length + 1;
+    merch_t *merch = merch_create(name, desc, record.price, true);
+    merch->id = merch_slot_alloc(db, merch);
+    merchs[i] = merch;
+
+    for (uint32_t j = 0; j < record.shelf_count; j++)
+    {
+      snapshot_shelf_t shelf;
+      memcpy(&shelf, base + shelves_offset + j * sizeof(shelf), sizeof(shelf));
+
+      shelf_t *location = db_create_shelf(strndup(shelf.name, sizeof(shelf.name)), shelf.quantity);
+      ioopm_linked_list_append(merch->locations, ptr_elem(location));
+      merch_add_stock(merch, shelf.quantity);
+      shelf_index_insert(db, merch, location);
+    }
+    offset = shelves_offset + record.shelf_count * sizeof(snapshot_shelf_t);
+  }
+
+  // Also after a merch was cut short, so the merchs loaded before it are destroyed with the webstore
+  for (uint64_t i = 0; i < footer.merch_count; i++)
+  {
+    snapshot_index_t entry;
+    memcpy(&entry, base + footer.index_offset + i * sizeof(entry), sizeof(entry));
+
+    if (entry.merch < footer.merch_count && merchs[entry.merch] != NULL)
+    {
+      merch_t *merch = merchs[entry.merch];
+      ioopm_hash_table_insert_hashed(db->merchs, (int)entry.hash, ptr_elem(merch->name), ptr_elem(merch));
+    }
+  }
+
+  // The slots are restored before the carts are put back in them, free slots are freed in the same order
+  memstats_free(MEMSTATS_CART_SLOTS, db->cart_slots_capacity * sizeof(cart_slot_t));
+  db->cart_slots_capacity = footer.cart_slots_used > CART_SLOTS_INITIAL_CAPACITY ? footer.cart_slots_used : CART_SLOTS_INITIAL_CAPACITY;
+  db->cart_slots = realloc(db->cart_slots, db->cart_slots_capacity * sizeof(cart_slot_t));
+  memstats_alloc(MEMSTATS_CART_SLOTS, db->cart_slots_capacity * sizeof(cart_slot_t));
+  db->cart_slots_used = footer.cart_slots_used;
+  db->cart_free_head = footer.cart_free_head < footer.cart_slots_used ? footer.cart_free_head : CART_SLOT_NONE;
+  db->cart_free_tail = footer.cart_free_tail < footer.cart_slots_used ? footer.cart_free_tail : CART_SLOT_NONE;
+  for (uint32_t i = 0; i < footer.cart_slots_used; i++)
+  {
+    snapshot_cart_slot_t slot;
+    memcpy(&slot, base + footer.cart_slots_offset + i * sizeof(slot), sizeof(slot));
+    db->cart_slots[i] = (cart_slot_t){.cart = NULL, .generation = slot.generation & CART_ID_GENERATION_MASK,
+                                      .next_free = slot.next_free < footer.cart_slots_used ? slot.next_free : CART_SLOT_NONE};
+  }
+
+  offset = footer.carts_offset;
+  for (uint64_t i = 0; i < footer.cart_count && valid; i++)
+  {
+    snapshot_cart_t record;
+    valid = snapshot_has(offset, sizeof(record), footer.cart_slots_offset);
+    if (!valid)
+    {
+      break;
+    }
+    memcpy(&record, base + offset, sizeof(record));
+    offset = offset + sizeof(record);
+
+    uint32_t index = CART_ID_INDEX(record.id);
+    valid = snapshot_has(offset, record.line_count * sizeof(snapshot_line_t), footer.cart_slots_offset) &&
+            index < db->cart_slots_used && db->cart_slots[index].cart == NULL &&
+            db->cart_slots[index].generation == CART_ID_GENERATION(record.id);
+    if (!valid)
+    {
+      break;
+    }
+
+    shopping_carts_t *cart = db_create_cart();
+    cart->id = record.id;
+    cart->db = db;
+    db->cart_slots[index].cart = cart;
+    db->cart_quantity++;
+
+    for (uint32_t j = 0; j < record.line_count; j++)
+    {
+      snapshot_line_t line;
+      memcpy(&line, base + offset, sizeof(line));
+      offset = offset + sizeof(line);
+
+      if (line.merch < footer.merch_count && merchs[line.merch] != NULL)
+      {
+        set_cart_line(cart, merchs[line.merch], line.quantity, false);
+      }
+    }
+  }
+
+  if (!valid)
+  {
+    fprintf(stderr, "%s is cut short\n", path);
+  }
+  free(merchs);
+  return valid;
+}
+
+webstore_t *db_open_webstore(const char *snapshot_path, const char *wal_path, int latency_ms)
+{
+  webstore_t *db = db_create_webstore();
+  wal_position_t position = {0};
+
+  // A snapshot that can not be loaded is left for someone to look at, the webstore does not
+  // start without it
+  if (snapshot_path != NULL && !load_snapshot(db, snapshot_path, &position))
+  {
+    fprintf(stderr, "%s could not be loaded\n", snapshot_path);
+    db_destroy_webstore(db);
+    return NULL;
+  }
+
+  // The log is attached after the replay, so replayed changes are not logged again. Changes
+  // logged before the snapshot was taken are in it already.
+  if (wal_path != NULL)
+  {
+    if (wal_replay(wal_path, &position, replay_change, db) < 0)
+    {
+      fprintf(stderr, "%s does not match the webstore it is replayed on\n", wal_path);
+      db_destroy_webstore(db);
+      return NULL;
+    }
+    db->wal = wal_open(wal_path, latency_ms);
+  }
+
+  return db;
+}
+
+bool db_sync(webstore_t *db)
+{
+  return db->wal == NULL || wal_sync(db->wal);
+}
+
+merch_t *db_create_merch(char *name, char *desc, int price)
+{
+  return merch_create(name, desc, price, false);
 }
 
 shelf_t *db_create_shelf(char *shelf_name, int shelf_quantity)
 {
   shelf_t *new_shelf = calloc(1, sizeof(shelf_t));
+  memstats_alloc(MEMSTATS_SHELVES, sizeof(shelf_t) + strlen(shelf_name) + 1);
 
   new_shelf->name = shelf_name;
   new_shelf->quantity = shelf_quantity;
@@ -78,64 +1710,109 @@ shelf_t *db_create_shelf(char *shelf_name, int shelf_quantity)
 shopping_carts_t *db_create_cart(void)
 {
   shopping_carts_t *new_cart = calloc(1, sizeof(shopping_carts_t));
+  memstats_alloc(MEMSTATS_CARTS, sizeof(shopping_carts_t));
 
-  new_cart->shopping_cart = ioopm_hash_table_create(ioopm_compare_ptr_elems, ioopm_compare_int_elems, string_hash);
+  pthread_mutex_init(&new_cart->lock, NULL);
 
   return new_cart;
 }
 
 void db_destroy_a_merch(merch_t *merch)
 {
-  free(merch->name);
-  free(merch->desc);
+  count_merch_string(merch->name, merch->name_mapped, false);
+  count_merch_string(merch->desc, merch->desc_mapped, false);
+  if (!merch->name_mapped)
+  {
+    free(merch->name);
+  }
+  if (!merch->desc_mapped)
+  {
+    free(merch->desc);
+  }
 
   int size = (int)ioopm_linked_list_size(merch->locations);
 
   for (int i = 0; i < size; i++)
   {
     shelf_t *location = ioopm_linked_list_get(merch->locations, i).p;
+    memstats_free(MEMSTATS_SHELVES, sizeof(shelf_t) + strlen(location->name) + 1);
     free(location->name);
     free(location);
   }
 
   ioopm_linked_list_destroy(merch->locations);
+  if (merch->carts != NULL)
+  {
+    ioopm_hash_table_destroy(merch->carts);
+  }
+  pthread_mutex_destroy(&merch->lock);
+  memstats_free(MEMSTATS_MERCHS, sizeof(merch_t));
   free(merch);
 }
 
 bool db_has_key(webstore_t *db, char *name)
 {
-  if (ioopm_hash_table_has_key(db->merchs, ptr_elem(name)))
+  uint64_t started = metrics_now();
+  merchs_read_lock(db);
+  bool result = ioopm_hash_table_has_key(db->merchs, ptr_elem(name));
+  merchs_unlock(db);
+
+  metrics_record(METRIC_HAS_KEY, started);
+  return result;
+}
+
+void db_add_merch(webstore_t *db, merch_t *merch)
+{
+  uint64_t started = metrics_now();
+  merchs_write_lock(db);
+  merch->id = merch_slot_alloc(db, merch);
+  ioopm_hash_table_insert(db->merchs, ptr_elem(merch->name), ptr_elem(merch));
+  log_change(db, LOG_ADD_MERCH, "ssi", merch->name, merch->desc, merch->price);
+
+  int size = (int)ioopm_linked_list_size(merch->locations);
+
+  for (int i = 0; i < size; i++)
   {
-    return true;
+    shelf_t *shelf = ioopm_linked_list_get(merch->locations, i).p;
+    shelf_index_insert(db, merch, shelf);
+    log_change(db, LOG_ADD_LOCATION, "ssi", merch->name, shelf->name, shelf->quantity);
   }
-  else
+  merchs_unlock(db);
+  metrics_record(METRIC_ADD_MERCH, started);
+}
+
+void db_reserve_merchs(webstore_t *db, size_t count)
+{
+  merchs_write_lock(db);
+  ioopm_hash_table_reserve(db->merchs, ioopm_hash_table_size(db->merchs) + count);
+
+  // Freed slots are reused first, so this is enough even if none are free
+  size_t slots = db->merch_slots_used + count;
+  if (slots > db->merch_slots_capacity)
   {
-    return false;
+    merch_slots_resize(db, (uint32_t)slots);
   }
+  merchs_unlock(db);
 }
 
-void db_add_merch(webstore_t *db, merch_t *merch)
+int db_merch_count(webstore_t *db)
 {
-  ioopm_hash_table_insert(db->merchs, ptr_elem(merch->name), ptr_elem(merch));
+  merchs_read_lock(db);
+  int count = ioopm_hash_table_size(db->merchs);
+  merchs_unlock(db);
+  return count;
 }
 
-int db_merch_count(webstore_t *db)
+static void list_merch_value(elem_t name_ignored, elem_t *merch, void *extra_ignored)
 {
-  return ioopm_hash_table_size(db->merchs);
+  db_list_a_merch(merch->p);
 }
 
 void db_list_merchs(webstore_t *db)
 {
-  ioopm_list_t *merchs_list = ioopm_hash_table_values(db->merchs);
-  int size = (int)ioopm_linked_list_size(merchs_list);
-
-  for (int i = 0; i < size; i++)
-  {
-    merch_t *merch = ioopm_linked_list_get(merchs_list, i).p;
-    db_list_a_merch(merch);
-  }
-
-  ioopm_linked_list_destroy(merchs_list);
+  merchs_read_lock(db);
+  ioopm_hash_table_apply_to_all(db->merchs, list_merch_value, NULL);
+  merchs_unlock(db);
 }
 
 void db_list_a_merch(merch_t *merch)
@@ -148,73 +1825,176 @@ void db_list_a_merch(merch_t *merch)
 
 merch_t *db_get_merch_from_name(webstore_t *db, char *name)
 {
+  return db_get_merch(db, name);
+}
+
+void db_remove_merch(webstore_t *db, char *name)
+{
+  uint64_t started = metrics_now();
   elem_t ptr;
-  ioopm_hash_table_lookup(db->merchs, ptr_elem(name), &ptr);
-  return ptr.p;
+  merchs_write_lock(db);
+
+  if (!ioopm_hash_table_remove(db->merchs, ptr_elem(name), &ptr))
+  {
+    merchs_unlock(db);
+    metrics_record(METRIC_REMOVE_MERCH, started);
+    return;
+  }
+
+  merch_t *merch = ptr.p;
+  ioopm_list_t *carts_list = NULL;
+
+  pthread_mutex_lock(&merch->lock);
+  merch->removed = true;
+  // Logged under the merch's lock, so no cart line of the merch is logged after it
+  log_change(db, LOG_REMOVE_MERCH, "s", merch->name);
+  if (merch->carts != NULL)
+  {
+    carts_list = ioopm_hash_table_values(merch->carts);
+  }
+  pthread_mutex_unlock(&merch->lock);
+
+  // Only the carts that hold the merchandise are touched
+  if (carts_list != NULL)
+  {
+    int size = (int)ioopm_linked_list_size(carts_list);
+
+    for (int i = 0; i < size; i++)
+    {
+      shopping_carts_t *cart = ioopm_linked_list_get(carts_list, i).p;
+      pthread_mutex_lock(&cart->lock);
+      cart_lines_remove(cart, merch->id, &(int){0});
+      pthread_mutex_unlock(&cart->lock);
+    }
+    ioopm_linked_list_destroy(carts_list);
+  }
+
+  int locations_size = (int)ioopm_linked_list_size(merch->locations);
+
+  for (int i = 0; i < locations_size; i++)
+  {
+    shelf_index_remove(db, ioopm_linked_list_get(merch->locations, i).p);
+  }
+
+  merch_slot_free(db, merch->id);
+
+  // Other threads may still hold a pointer to the merch, so it is kept until the webstore is destroyed
+  if (db->concurrent)
+  {
+    ioopm_linked_list_append(db->retired_merchs, ptr_elem(merch));
+  }
+  else
+  {
+    db_destroy_a_merch(merch);
+  }
+  merchs_unlock(db);
+  metrics_record(METRIC_REMOVE_MERCH, started);
+}
+
+void db_remove_merch_from_cart(shopping_carts_t *cart, merch_t *merch)
+{
+  uint64_t started = metrics_now();
+  int quantity;
+  cart_change_lock(cart);
+  pthread_mutex_lock(&merch->lock);
+
+  if (cart_lines_remove(cart, merch->id, &quantity))
+  {
+    merch_add_reserved(merch, -quantity);
+    merch_unlink_cart(merch, cart);
+    log_change(cart->db, LOG_REMOVE_CART_LINE, "is", cart->id, merch->name);
+  }
+
+  pthread_mutex_unlock(&merch->lock);
+  cart_change_unlock(cart);
+  metrics_record(METRIC_REMOVE_FROM_CART, started);
 }
 
-void db_remove_merch(webstore_t *db, char *name)
+/// Rekeys a merch in db->merchs, the caller holds db->merchs_lock for writing
+/// The name is swapped under the merch's lock, since cart operations read it to log their changes.
+static void rename_merch(webstore_t *db, merch_t *merch, char *new_name)
 {
-  // TODO: This function only removes from db->merchs but it should also remove
-  //  the merchandise from the carts also
-  elem_t ptr;
-  ioopm_hash_table_remove(db->merchs, ptr_elem(name), &ptr);
-
-  ioopm_list_t *carts_list = ioopm_hash_table_values(db->carts);
-  int size = (int)ioopm_linked_list_size(carts_list);
+  ioopm_hash_table_remove(db->merchs, ptr_elem(merch->name), NULL);
 
-  for (int i = 0; i < size; i++)
+  pthread_mutex_lock(&merch->lock);
+  count_merch_string(merch->name, merch->name_mapped, false);
+  count_merch_string(new_name, false, true);
+  if (!merch->name_mapped)
   {
-    shopping_carts_t *cart = ioopm_linked_list_get(carts_list, i).p;
-    db_remove_merch_from_cart(cart, name);
+    free(merch->name);
   }
+  merch->name = new_name;
+  merch->name_mapped = false;
+  pthread_mutex_unlock(&merch->lock);
 
-  db_destroy_a_merch(ptr.p);
-  ioopm_linked_list_destroy(carts_list);
+  ioopm_hash_table_insert(db->merchs, ptr_elem(merch->name), ptr_elem(merch));
 }
 
-void db_remove_merch_from_cart(shopping_carts_t *cart, char *name)
+void db_rename_merch(webstore_t *db, merch_t *merch, char *new_name)
 {
-  elem_t ptr;
-  ioopm_hash_table_remove(cart->shopping_cart, ptr_elem(name), &ptr);
-  ptr.i = 0;
+  merchs_write_lock(db);
+  log_change(db, LOG_UPDATE_MERCH, "sssi", merch->name, new_name, merch->desc, merch->price);
+  rename_merch(db, merch, new_name);
+  merchs_unlock(db);
 }
 
-merch_t *db_edit_merch(webstore_t *db, merch_t *current_merch, char *new_name, char *new_desc, int new_price)
+void db_update_merch(webstore_t *db, merch_t *merch, char *new_name, char *new_desc, int new_price)
 {
-  merch_t *edited_merch = calloc(1, sizeof(merch_t));
-
-  edited_merch->name = new_name;
-  edited_merch->desc = new_desc;
-  edited_merch->price = new_price;
-  edited_merch->locations = ioopm_linked_list_create(ioopm_compare_ptr_elems);
-
-  int size = (int)ioopm_linked_list_size(current_merch->locations);
-
-  for (int i = 0; i < size; i++)
+  uint64_t started = metrics_now();
+  merchs_write_lock(db);
+  log_change(db, LOG_UPDATE_MERCH, "sssi", merch->name, new_name != NULL ? new_name : merch->name,
+             new_desc != NULL ? new_desc : merch->desc, new_price);
+  if (new_name != NULL)
+  {
+    rename_merch(db, merch, new_name);
+  }
+  if (new_desc != NULL)
   {
-    shelf_t *shelf = ioopm_linked_list_get(current_merch->locations, i).p;
-    ioopm_linked_list_append(edited_merch->locations, ptr_elem(shelf));
+    count_merch_string(merch->desc, merch->desc_mapped, false);
+    count_merch_string(new_desc, false, true);
+    if (!merch->desc_mapped)
+    {
+      free(merch->desc);
+    }
+    merch->desc = new_desc;
+    merch->desc_mapped = false;
   }
+  merch->price = new_price;
+  merchs_unlock(db);
+  metrics_record(METRIC_UPDATE_MERCH, started);
+}
 
-  return edited_merch;
+merch_t *db_get_merch_from_id(webstore_t *db, merch_id_t id)
+{
+  merchs_read_lock(db);
+  merch_t *merch = merch_from_id(db, id);
+  merchs_unlock(db);
+  return merch;
 }
 
 merch_t *db_get_merch(webstore_t *db, char *name)
 {
-  elem_t merch_ptr;
+  uint64_t started = metrics_now();
+  elem_t merch_ptr = ptr_elem(NULL);
+  merchs_read_lock(db);
   ioopm_hash_table_lookup(db->merchs, ptr_elem(name), &merch_ptr);
+  merchs_unlock(db);
 
+  metrics_record(METRIC_GET_MERCH, started);
   return merch_ptr.p;
 }
 
 int db_merch_locations_size(merch_t *merch)
 {
-  return (int)ioopm_linked_list_size(merch->locations);
+  pthread_mutex_lock(&merch->lock);
+  int size = (int)ioopm_linked_list_size(merch->locations);
+  pthread_mutex_unlock(&merch->lock);
+  return size;
 }
 
 void db_display_stock(merch_t *merch)
 {
+  pthread_mutex_lock(&merch->lock);
   int size = (int)ioopm_linked_list_size(merch->locations);
 
   if (size == 0)
@@ -229,272 +2009,677 @@ void db_display_stock(merch_t *merch)
       printf("Shelf name: %s | Shelf quantity: %d \n", shelf->name, shelf->quantity);
     }
   }
+  pthread_mutex_unlock(&merch->lock);
 }
 
 bool db_location_name_exists_in_webstore(webstore_t *db, char *shelf_name)
 {
-  ioopm_list_t *merchs_list = ioopm_hash_table_values(db->merchs);
-  int merchs_size = (int)ioopm_linked_list_size(merchs_list);
+  int slot = shelf_slot(shelf_name);
+  merchs_read_lock(db);
+  bool result = slot >= 0 && shelf_slot_is_occupied(db, slot);
+  merchs_unlock(db);
+  return result;
+}
+
+merch_t *db_get_merch_on_shelf(webstore_t *db, char *shelf_name)
+{
+  int slot = shelf_slot(shelf_name);
+
+  if (slot < 0)
+  {
+    return NULL;
+  }
+  merchs_read_lock(db);
+  merch_t *owner = db->shelves[slot].owner;
+  merchs_unlock(db);
+  return owner;
+}
 
-  for (int i = 0; i < merchs_size; i++)
+/// Writes the name of the first free shelf, the caller holds db->merchs_lock
+static bool first_free_shelf(webstore_t *db, char *shelf_name)
+{
+  for (int word = 0; word < SHELF_BITMAP_WORDS; word++)
   {
-    merch_t *merch = ioopm_linked_list_get(merchs_list, i).p;
-    int locations_size = ioopm_linked_list_size(merch->locations);
+    uint64_t free_bits = ~db->shelves_occupied[word];
 
-    for (int j = 0; j < locations_size; j++)
+    if (free_bits != 0)
     {
-      shelf_t *location = ioopm_linked_list_get(merch->locations, i).p;
+      int slot = word * 64 + __builtin_ctzll(free_bits);
 
-      if (strcmp(location->name, shelf_name) == 0)
+      if (slot >= SHELF_SLOTS)
       {
-        ioopm_linked_list_destroy(merchs_list); // hade glömt det här
-        return true;
+        return false;
       }
+
+      shelf_name[0] = 'A' + slot / SHELF_NUMBERS;
+      shelf_name[1] = '0' + (slot % SHELF_NUMBERS) / 10;
+      shelf_name[2] = '0' + slot % 10;
+      shelf_name[3] = '\0';
+      return true;
     }
   }
-  ioopm_linked_list_destroy(merchs_list);
   return false;
 }
 
-void db_add_location_to_merch(merch_t *merch, char *shelf_name, int new_quantity)
+bool db_first_free_shelf(webstore_t *db, char *shelf_name)
+{
+  merchs_read_lock(db);
+  bool result = first_free_shelf(db, shelf_name);
+  merchs_unlock(db);
+  return result;
+}
+
+void db_add_location_to_merch(webstore_t *db, merch_t *merch, char *shelf_name, int new_quantity)
 {
+  uint64_t started = metrics_now();
   shelf_t *shelf = db_create_shelf(shelf_name, new_quantity);
+
+  merchs_write_lock(db);
+  pthread_mutex_lock(&merch->lock);
   ioopm_linked_list_append(merch->locations, ptr_elem(shelf));
+  merch_add_stock(merch, new_quantity);
+  log_change(db, LOG_ADD_LOCATION, "ssi", merch->name, shelf_name, new_quantity);
+  pthread_mutex_unlock(&merch->lock);
+  shelf_index_insert(db, merch, shelf);
+  merchs_unlock(db);
+  metrics_record(METRIC_ADD_LOCATION, started);
 }
 
-bool db_edit_location_quantity(merch_t *merch, char *shelf_name, int new_quantity)
+bool db_edit_location_quantity(webstore_t *db, merch_t *merch, char *shelf_name, int new_quantity)
 {
-  int size = (int)ioopm_linked_list_size(merch->locations);
+  uint64_t started = metrics_now();
+  int slot = shelf_slot(shelf_name);
+  merchs_read_lock(db);
 
-  for (int i = 0; i < size; i++)
+  if (slot < 0 || db->shelves[slot].owner != merch)
   {
-    shelf_t *location = ioopm_linked_list_get(merch->locations, i).p;
+    merchs_unlock(db);
+    metrics_record(METRIC_EDIT_LOCATION, started);
+    return false;
+  }
 
-    if (strcmp(location->name, shelf_name) == 0)
+  pthread_mutex_lock(&merch->lock);
+  merch_add_stock(merch, new_quantity - db->shelves[slot].shelf->quantity);
+  db->shelves[slot].shelf->quantity = new_quantity;
+  log_change(db, LOG_EDIT_LOCATION, "ssi", merch->name, shelf_name, new_quantity);
+  pthread_mutex_unlock(&merch->lock);
+  merchs_unlock(db);
+  metrics_record(METRIC_EDIT_LOCATION, started);
+  return true;
+}
+
+bool db_add_cart(webstore_t *db, shopping_carts_t *cart)
+{
+  uint64_t started = metrics_now();
+  carts_write_lock(db);
+  cart->id = cart_slot_alloc(db, cart);
+  if (cart->id != 0)
+  {
+    cart->db = db;
+    cart_touch(cart);
+    if (db->cart_ttl_ms > 0)
     {
-      location->quantity = new_quantity;
-      return true;
+      timer_wheel_schedule(&db->cart_wheel, &cart->expiry, cart->touched + db->cart_ttl_ms);
     }
+    log_change(db, LOG_ADD_CART, "i", cart->id);
+    db->cart_quantity++;
   }
-  return false;
+  carts_unlock(db);
+  metrics_record(METRIC_ADD_CART, started);
+  return cart->id != 0;
+}
+
+int db_carts_size(webstore_t *db)
+{
+  carts_read_lock(db);
+  int size = db->cart_quantity;
+  carts_unlock(db);
+  return size;
 }
 
-void db_add_cart(webstore_t *db, shopping_carts_t *cart)
+/// Takes a cart out of its slot and the expiry wheel, the caller holds db->carts_lock for writing
+static void detach_cart(webstore_t *db, shopping_carts_t *cart)
 {
-  ioopm_hash_table_insert(db->carts, int_elem(db->cart_id), ptr_elem(cart));
-  db->cart_id++;
-  db->cart_quantity++;
+  timer_wheel_cancel(&db->cart_wheel, &cart->expiry);
+  cart_slot_free(db, CART_ID_INDEX(cart->id));
+  db->cart_quantity--;
+  log_change(db, LOG_REMOVE_CART, "i", cart->id);
 }
 
-int db_carts_size(webstore_t *db)
+/// Releases the reservations of a detached cart and destroys it, the caller holds db->merchs_lock
+static void drop_cart(webstore_t *db, shopping_carts_t *cart)
 {
-  return (int)ioopm_hash_table_size(db->carts);
+  pthread_mutex_lock(&cart->lock);
+  cart_clear(db, cart);
+  pthread_mutex_unlock(&cart->lock);
+  db_destroy_a_cart(cart);
 }
 
-bool db_remove_cart(webstore_t *db, int id_choice)
+static bool remove_cart(webstore_t *db, int id_choice)
 {
-  elem_t cart_ptr;
-  bool result = ioopm_hash_table_remove(db->carts, int_elem(id_choice), &cart_ptr);
+  carts_write_lock(db);
+  shopping_carts_t *cart = cart_from_id(db, id_choice);
 
-  if (result)
+  if (cart != NULL)
   {
-    db_destroy_a_cart(cart_ptr.p);
-    db->cart_quantity--;
+    detach_cart(db, cart);
   }
-  return result;
+  carts_unlock(db);
+
+  if (cart != NULL)
+  {
+    drop_cart(db, cart);
+  }
+  return cart != NULL;
 }
 
-void db_display_cart_ids(webstore_t *db)
+bool db_remove_cart(webstore_t *db, int id_choice)
 {
-  ioopm_list_t *carts_id_list = ioopm_hash_table_keys(db->carts);
-
-  int size = (int)ioopm_linked_list_size(carts_id_list);
+  uint64_t started = metrics_now();
+  merchs_read_lock(db);
+  bool result = remove_cart(db, id_choice);
+  merchs_unlock(db);
+  metrics_record(METRIC_REMOVE_CART, started);
+  return result;
+}
 
-  for (int i = 0; i < size; i++)
+void db_set_cart_ttl(webstore_t *db, uint64_t ttl_ms, uint64_t now_ms)
+{
+  carts_write_lock(db);
+  for (uint32_t i = 0; i < db->cart_slots_used; i++)
   {
-    int cart_id = ioopm_linked_list_get(carts_id_list, i).i;
-    printf("Cart id: %d\n", cart_id);
+    if (db->cart_slots[i].cart != NULL)
+    {
+      timer_wheel_cancel(&db->cart_wheel, &db->cart_slots[i].cart->expiry);
+    }
   }
+  timer_wheel_init(&db->cart_wheel, now_ms);
+  atomic_store(&db->cart_clock_ms, now_ms);
+  db->cart_ttl_ms = ttl_ms;
 
-  ioopm_linked_list_destroy(carts_id_list);
+  // Every cart gets the whole TTL from now, whenever it was last used
+  for (uint32_t i = 0; i < db->cart_slots_used && ttl_ms > 0; i++)
+  {
+    shopping_carts_t *cart = db->cart_slots[i].cart;
+    if (cart != NULL)
+    {
+      atomic_store_explicit(&cart->touched, now_ms, memory_order_relaxed);
+      timer_wheel_schedule(&db->cart_wheel, &cart->expiry, now_ms + ttl_ms);
+    }
+  }
+  carts_unlock(db);
 }
 
-shopping_carts_t *db_get_cart_from_id(webstore_t *db, int id_choice)
+int db_expire_carts(webstore_t *db, uint64_t now_ms)
 {
-  elem_t cart_ptr;
-  bool lookup = ioopm_hash_table_lookup(db->carts, int_elem(id_choice), &cart_ptr);
+  uint64_t started = metrics_now();
+  wheel_timer_t *expired = NULL;
+  int count = 0;
 
-  if (lookup)
+  merchs_read_lock(db);
+  carts_write_lock(db);
+  if (now_ms > atomic_load(&db->cart_clock_ms))
   {
-    return cart_ptr.p;
+    atomic_store(&db->cart_clock_ms, now_ms);
   }
-  else
+
+  wheel_timer_t *fired = timer_wheel_advance(&db->cart_wheel, now_ms);
+  while (fired != NULL)
   {
-    return NULL;
+    wheel_timer_t *timer = fired;
+    fired = fired->next;
+    shopping_carts_t *cart = CART_OF_EXPIRY(timer);
+    uint64_t deadline = atomic_load_explicit(&cart->touched, memory_order_relaxed) + db->cart_ttl_ms;
+
+    if (deadline > now_ms)
+    {
+      timer_wheel_schedule(&db->cart_wheel, timer, deadline);
+    }
+    else
+    {
+      detach_cart(db, cart);
+      timer->next = expired;
+      expired = timer;
+      count++;
+    }
+  }
+  carts_unlock(db);
+
+  // The reservations are released outside carts_lock, like db_remove_cart does
+  while (expired != NULL)
+  {
+    shopping_carts_t *cart = CART_OF_EXPIRY(expired);
+    expired = expired->next;
+    drop_cart(db, cart);
   }
+  merchs_unlock(db);
+  metrics_record(METRIC_EXPIRE_CARTS, started);
+  return count;
 }
 
-int db_lookup_merch_quantity_in_locations(merch_t *merch)
+uint64_t db_now_ms(void)
 {
-  int size = (int)ioopm_linked_list_size(merch->locations);
-  int counter = 0;
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
-  for (int i = 0; i < size; i++)
+void db_display_cart_ids(webstore_t *db)
+{
+  carts_read_lock(db);
+  for (uint32_t i = 0; i < db->cart_slots_used; i++)
   {
-    shelf_t *location = ioopm_linked_list_get(merch->locations, i).p;
-    counter = counter + location->quantity;
+    if (db->cart_slots[i].cart != NULL)
+    {
+      printf("Cart id: %d\n", db->cart_slots[i].cart->id);
+    }
   }
-  return counter;
+  carts_unlock(db);
+}
+
+shopping_carts_t *db_get_cart_from_id(webstore_t *db, int id_choice)
+{
+  uint64_t started = metrics_now();
+  carts_read_lock(db);
+  shopping_carts_t *cart = cart_from_id(db, id_choice);
+  carts_unlock(db);
+
+  metrics_record(METRIC_GET_CART, started);
+  return cart;
 }
 
-int db_lookup_valid_quantity(webstore_t *db, merch_t *merch, char *merch_name)
+int db_lookup_merch_quantity_in_locations(merch_t *merch)
+{
+  return merch_stock(merch);
+}
+
+int db_lookup_valid_quantity(webstore_t *db, merch_t *merch)
+{
+  int reserved = RESERVATION_QUANTITY(atomic_load(&merch->reservation));
+  return merch_stock(merch) - reserved;
+}
+
+bool db_cart_has_key(shopping_carts_t *cart, merch_t *merch)
+{
+  pthread_mutex_lock(&cart->lock);
+  bool result = cart_lines_lookup(cart, merch->id, &(int){0});
+  pthread_mutex_unlock(&cart->lock);
+  return result;
+}
+
+/// Sets the quantity of a cart line, adding quantity to the existing line if add is true
+static void set_cart_line(shopping_carts_t *cart, merch_t *merch, int quantity, bool add)
 {
-  int quantity_in_locations = db_lookup_merch_quantity_in_locations(merch);
-  int quantity_in_carts = db_lookup_merch_quantity_in_carts(db, merch_name);
+  cart_change_lock(cart);
+  pthread_mutex_lock(&merch->lock);
+
+  // A merch removed from a concurrent webstore can no longer be put in carts
+  if (!merch->removed)
+  {
+    int old_quantity = 0;
+    cart_lines_lookup(cart, merch->id, &old_quantity);
+
+    int new_quantity = add ? old_quantity + quantity : quantity;
+
+    cart_lines_set(cart, merch->id, new_quantity);
+    merch_add_reserved(merch, new_quantity - old_quantity);
+    merch_link_cart(merch, cart);
+    log_change(cart->db, add ? LOG_ADD_TO_CART_LINE : LOG_SET_CART_LINE, "isi", cart->id, merch->name, quantity);
+  }
 
-  return quantity_in_locations - quantity_in_carts;
+  pthread_mutex_unlock(&merch->lock);
+  cart_change_unlock(cart);
 }
 
-bool db_cart_has_key(shopping_carts_t *cart, char *merch_name)
+bool db_try_reserve(merch_t *merch, shopping_carts_t *cart, int quantity)
 {
-  //elem_t quantity_ptr;
-  //return ioopm_hash_table_lookup(cart->shopping_cart, ptr_elem(merch_name), &quantity_ptr);
+  uint64_t started = metrics_now();
+  uint64_t old = atomic_load(&merch->reservation);
+  uint64_t new;
 
-  ioopm_list_t *names = ioopm_hash_table_keys(cart->shopping_cart);
-  int size = (int)ioopm_linked_list_size(names);
-  
-  for(int i = 0; i < size; i++)
+  do
   {
-    if(strcmp(merch_name, ioopm_linked_list_get(names, i).str) == 0)
+    int available = merch_stock(merch) - RESERVATION_QUANTITY(old);
+
+    if (quantity < 1 || quantity > available)
     {
-      return true;
+      metrics_record(METRIC_TRY_RESERVE, started);
+      return false;
     }
+    new = RESERVATION(RESERVATION_VERSION(old) + 1, RESERVATION_QUANTITY(old) + quantity);
+  } while (!atomic_compare_exchange_weak(&merch->reservation, &old, new));
+
+  // The units are reserved, what is left is to record them in the cart
+  cart_change_lock(cart);
+  pthread_mutex_lock(&merch->lock);
+  bool recorded = !merch->removed;
+
+  if (recorded)
+  {
+    int old_quantity = 0;
+    cart_lines_lookup(cart, merch->id, &old_quantity);
+    cart_lines_set(cart, merch->id, old_quantity + quantity);
+    merch_link_cart(merch, cart);
+    log_change(cart->db, LOG_ADD_TO_CART_LINE, "isi", cart->id, merch->name, quantity);
   }
-  return false;
+
+  pthread_mutex_unlock(&merch->lock);
+  cart_change_unlock(cart);
+
+  if (!recorded)
+  {
+    merch_add_reserved(merch, -quantity);
+  }
+  metrics_record(METRIC_TRY_RESERVE, started);
+  return recorded;
+}
+
+void db_update_merch_quantity_in_cart(shopping_carts_t *cart, merch_t *merch, int new_quantity)
+{
+  uint64_t started = metrics_now();
+  set_cart_line(cart, merch, new_quantity, true);
+  metrics_record(METRIC_ADD_TO_CART, started);
 }
 
-void db_update_merch_quantity_in_cart(shopping_carts_t *cart, char *merch_name, int new_quantity)
+void db_add_merch_to_cart(shopping_carts_t *cart, merch_t *merch, int new_quantity)
 {
-  elem_t quantity_ptr;
-  ioopm_hash_table_remove(cart->shopping_cart, ptr_elem(merch_name), &quantity_ptr);
+  uint64_t started = metrics_now();
+  set_cart_line(cart, merch, new_quantity, false);
+  metrics_record(METRIC_ADD_TO_CART, started);
+}
 
-  int sum_quantity = quantity_ptr.i + new_quantity;
+int db_lookup_merch_quantity_in_carts(webstore_t *db, merch_t *merch)
+{
+  return RESERVATION_QUANTITY(atomic_load(&merch->reservation));
+}
 
-  ioopm_hash_table_insert(cart->shopping_cart, ptr_elem(merch_name), int_elem(sum_quantity));
+int db_carts_holding_merch(merch_t *merch)
+{
+  pthread_mutex_lock(&merch->lock);
+  int count = merch->carts != NULL ? (int)ioopm_hash_table_size(merch->carts) : 0;
+  pthread_mutex_unlock(&merch->lock);
+  return count;
 }
 
-void db_add_merch_to_cart(shopping_carts_t *cart, char *merch_name, int new_quantity)
+void db_apply_to_carts_holding_merch(merch_t *merch, ioopm_apply_function fun, void *extra)
 {
-  ioopm_hash_table_insert(cart->shopping_cart, ptr_elem(merch_name), int_elem(new_quantity));
+  pthread_mutex_lock(&merch->lock);
+  if (merch->carts != NULL)
+  {
+    ioopm_hash_table_apply_to_all(merch->carts, fun, extra);
+  }
+  pthread_mutex_unlock(&merch->lock);
 }
 
-int db_lookup_merch_quantity_in_carts2(webstore_t *db, char *merch_name)
+static void add_line_cost(elem_t merch_id, elem_t *quantity, void *walk_ptr)
 {
-  ioopm_list_t *carts_list = ioopm_hash_table_values(db->carts);
-  int size = (int)ioopm_linked_list_size(carts_list);
-  int counter = 0;
+  cart_walk_t *walk = walk_ptr;
+  merch_t *merch = merch_from_id(walk->db, merch_id.s);
 
-  for (int i = 0; i < size; i++)
+  // A stale handle means that the merchandise has been removed from the Webstore
+  if (merch != NULL)
   {
-    shopping_carts_t *cart = ioopm_linked_list_get(carts_list, i).p;
-    elem_t quantity_ptr;
-    bool lookup = ioopm_hash_table_lookup(cart->shopping_cart, ptr_elem(merch_name), &quantity_ptr);
+    walk->counter = walk->counter + db_get_price(merch) * quantity->i;
+  }
+}
 
-    if (lookup)
-    {
-      counter = counter + quantity_ptr.i;
-    }
+int db_calculate_cost(webstore_t *db, shopping_carts_t *cart)
+{
+  uint64_t started = metrics_now();
+  SPAN_BEGIN(span, "cost");
+  cart_walk_t walk = {.db = db, .counter = 0};
+
+  merchs_read_lock(db);
+  pthread_mutex_lock(&cart->lock);
+  cart_touch(cart);
+  SPAN_BEGIN(scan, "cost:scan_cart");
+  cart_lines_apply(cart, add_line_cost, &walk);
+  SPAN_END(scan);
+  pthread_mutex_unlock(&cart->lock);
+  merchs_unlock(db);
+
+  SPAN_END(span);
+  metrics_record(METRIC_CALCULATE_COST, started);
+  return walk.counter;
+}
+
+/// Used by db_checkout to collect the lines of a cart into an array
+typedef struct cart_lines cart_lines_t;
+
+struct cart_lines
+{
+  webstore_t *db;
+  cart_line_t *lines;
+  int count;
+};
+
+static void collect_cart_line(elem_t merch_id, elem_t *quantity, void *lines_ptr)
+{
+  cart_lines_t *lines = lines_ptr;
+  merch_t *merch = merch_from_id(lines->db, merch_id.s);
+
+  // Lines of removed merchandise are skipped
+  if (merch != NULL)
+  {
+    lines->lines[lines->count++] = (cart_line_t){.merch = merch, .quantity = quantity->i};
   }
-  ioopm_linked_list_destroy(carts_list);
-  return counter;
 }
 
-int db_lookup_merch_quantity_in_carts(webstore_t *db, char *merch_name)
+static int compare_cart_lines(const void *a, const void *b)
 {
-  ioopm_list_t *carts_list = ioopm_hash_table_values(db->carts);
-  int carts_size = (int)ioopm_linked_list_size(carts_list);
-  int counter = 0;
+  uint32_t index_a = MERCH_ID_INDEX(((const cart_line_t *)a)->merch->id);
+  uint32_t index_b = MERCH_ID_INDEX(((const cart_line_t *)b)->merch->id);
+  return (index_a > index_b) - (index_a < index_b);
+}
 
-  for (int i = 0; i < carts_size; i++)
+bool db_checkout(webstore_t *db, shopping_carts_t *cart)
+{
+  uint64_t started = metrics_now();
+  SPAN_BEGIN(span, "checkout");
+  merchs_read_lock(db);
+  pthread_mutex_lock(&cart->lock);
+  cart_touch(cart);
+
+  SPAN_BEGIN(scan, "checkout:scan_cart");
+  cart_lines_t lines = {.db = db, .count = 0};
+  lines.lines = calloc(cart_lines_size(cart) + 1, sizeof(cart_line_t));
+  cart_lines_apply(cart, collect_cart_line, &lines);
+  SPAN_END(scan);
+
+  // Locking the merchandises in handle order makes concurrent checkouts deadlock free
+  SPAN_BEGIN(lock, "checkout:lock_merchs");
+  qsort(lines.lines, lines.count, sizeof(cart_line_t), compare_cart_lines);
+  for (int i = 0; i < lines.count; i++)
   {
-    shopping_carts_t *cart = ioopm_linked_list_get(carts_list, i).p;
+    pthread_mutex_lock(&lines.lines[i].merch->lock);
+  }
+  SPAN_END(lock);
 
-    ioopm_list_t *names = ioopm_hash_table_keys(cart->shopping_cart);
-    ioopm_list_t *quantities = ioopm_hash_table_values(cart->shopping_cart);
-    int size = (int)ioopm_linked_list_size(names);
+  bool in_stock = true;
+  for (int i = 0; i < lines.count && in_stock; i++)
+  {
+    in_stock = lines.lines[i].quantity <= merch_stock(lines.lines[i].merch);
+  }
 
-    for (int i = 0; i < size; i++)
+  if (in_stock)
+  {
+    SPAN_BEGIN(take, "checkout:take_stock");
+    for (int i = 0; i < lines.count; i++)
     {
-      if(strcmp(merch_name, ioopm_linked_list_get(names, i).p) == 0)
-      {
-        counter = counter + ioopm_linked_list_get(quantities, i).i;
-      }
+      merch_t *merch = lines.lines[i].merch;
+      merch_take_stock(merch, lines.lines[i].quantity);
+      merch_add_reserved(merch, -lines.lines[i].quantity);
+      merch_unlink_cart(merch, cart);
+    }
+    cart_lines_clear(cart);
+    SPAN_END(take);
+    SPAN_BEGIN(logged, "checkout:log");
+    log_change(db, LOG_CHECKOUT, "i", cart->id);
+    SPAN_END(logged);
+  }
+
+  for (int i = lines.count - 1; i >= 0; i--)
+  {
+    pthread_mutex_unlock(&lines.lines[i].merch->lock);
+  }
+  pthread_mutex_unlock(&cart->lock);
+  merchs_unlock(db);
+
+  free(lines.lines);
+  SPAN_END(span);
+  metrics_record(METRIC_CHECKOUT, started);
+  return in_stock;
+}
+
+/// Makes room for every merch slot in the batch scratch and starts a new batch
+static void checkout_batch_begin(webstore_t *db)
+{
+  if (db->demand_capacity < db->merch_slots_used)
+  {
+    if (db->demand_capacity > 0)
+    {
+      memstats_free(MEMSTATS_CHECKOUT_SCRATCH, db->demand_capacity * sizeof(merch_demand_t));
+      memstats_free(MEMSTATS_CHECKOUT_SCRATCH, db->demand_capacity * sizeof(uint32_t));
     }
-    ioopm_linked_list_destroy(names);
-    ioopm_linked_list_destroy(quantities);
+    db->demand_capacity = db->merch_slots_capacity;
+    db->demand = realloc(db->demand, db->demand_capacity * sizeof(merch_demand_t));
+    db->demand_touched = realloc(db->demand_touched, db->demand_capacity * sizeof(uint32_t));
+    memstats_alloc(MEMSTATS_CHECKOUT_SCRATCH, db->demand_capacity * sizeof(merch_demand_t));
+    memstats_alloc(MEMSTATS_CHECKOUT_SCRATCH, db->demand_capacity * sizeof(uint32_t));
+    // A zero batch id never matches a running batch, so new entries start out stale
+    memset(db->demand, 0, db->demand_capacity * sizeof(merch_demand_t));
   }
-  ioopm_linked_list_destroy(carts_list);
-  return counter;
+  db->batch++;
+  db->demand_touched_count = 0;
 }
 
-int db_calculate_cost(webstore_t *db, shopping_carts_t *cart)
+/// Gets the batch entry of a merch, looking up the merch's stock the first time it is seen in the batch
+static merch_demand_t *checkout_batch_entry(webstore_t *db, merch_t *merch)
 {
-  ioopm_list_t *names_list = ioopm_hash_table_keys(cart->shopping_cart);
-  int names_size = (int)ioopm_linked_list_size(names_list);
-  ioopm_list_t *quantities_list = ioopm_hash_table_values(cart->shopping_cart);
-  int counter = 0;
+  uint32_t index = MERCH_ID_INDEX(merch->id);
+  merch_demand_t *entry = &db->demand[index];
 
-  for (int i = 0; i < names_size; i++)
+  if (entry->batch != db->batch)
   {
-    char *merch_name = ioopm_linked_list_get(names_list, i).p;
-    merch_t *merch = db_get_merch_from_name(db, merch_name);
-    int merch_quantity = ioopm_linked_list_get(quantities_list, i).i;
-    int merch_price = db_get_price(merch);
+    pthread_mutex_lock(&merch->lock);
+    *entry = (merch_demand_t){.batch = db->batch, .available = merch_stock(merch), .demand = 0};
+    pthread_mutex_unlock(&merch->lock);
+    db->demand_touched[db->demand_touched_count++] = index;
+  }
+  return entry;
+}
+
+static bool line_fits_batch(elem_t merch_id, elem_t quantity, void *walk_ptr)
+{
+  cart_walk_t *walk = walk_ptr;
+  merch_t *merch = merch_from_id(walk->db, merch_id.s);
 
-    counter = counter + merch_price * merch_quantity;
+  if (merch == NULL)
+  {
+    return true;
   }
-  ioopm_linked_list_destroy(names_list);
-  ioopm_linked_list_destroy(quantities_list);
 
-  return counter;
+  merch_demand_t *entry = checkout_batch_entry(walk->db, merch);
+  return entry->demand + quantity.i <= entry->available;
 }
 
-void db_checkout(webstore_t *db, shopping_carts_t *cart)
+static void add_line_to_batch(elem_t merch_id, elem_t *quantity, void *walk_ptr)
 {
-  int cart_size = (int)ioopm_hash_table_size(cart->shopping_cart);
-  ioopm_list_t *names_list = ioopm_hash_table_keys(cart->shopping_cart);
-  for (int i = 0; i < cart_size; i++)
-  {
-    elem_t merch_name = ioopm_linked_list_get(names_list, i);
-    elem_t quantity_ptr;
-    bool lookup = ioopm_hash_table_lookup(cart->shopping_cart, merch_name, &quantity_ptr);
+  cart_walk_t *walk = walk_ptr;
+  merch_t *merch = merch_from_id(walk->db, merch_id.s);
 
-    if (lookup)
-    {
-      merch_t *merch = db_get_merch_from_name(db, merch_name.p);
-      db_decrease_locations_quantities(merch, quantity_ptr.i);
-    }
+  if (merch != NULL)
+  {
+    checkout_batch_entry(walk->db, merch)->demand += quantity->i;
   }
-  ioopm_linked_list_destroy(names_list);
 }
 
-void db_decrease_locations_quantities(merch_t *merch, int quantity)
+int db_checkout_batch(webstore_t *db, int *cart_ids, int count, bool *results)
 {
-  for (int i = 0; quantity > 0; i++)
+  uint64_t started = metrics_now();
+  SPAN_BEGIN(span, "checkout_batch");
+  cart_walk_t walk = {.db = db, .counter = 0};
+
+  // The batch has the scratch and the stock of every merchandise to itself
+  merchs_write_lock(db);
+  checkout_batch_begin(db);
+
+  for (int i = 0; i < count; i++)
   {
-    shelf_t *location = ioopm_linked_list_get(merch->locations, i).p;
+    shopping_carts_t *cart = db_get_cart_from_id(db, cart_ids[i]);
 
-    if (quantity > location->quantity)
+    if (cart != NULL)
     {
-      quantity = quantity - location->quantity;
-      location->quantity = 0;
+      pthread_mutex_lock(&cart->lock);
+      results[i] = cart_lines_all(cart, line_fits_batch, &walk);
+      if (results[i])
+      {
+        cart_lines_apply(cart, add_line_to_batch, &walk);
+      }
+      pthread_mutex_unlock(&cart->lock);
     }
-    else // if(location->quantity > quantity)
+    else
     {
-      location->quantity = location->quantity - quantity;
-      quantity = 0;
+      results[i] = false;
+    }
+
+    if (results[i])
+    {
+      // The demand is recorded, so the cart can go right away. This also makes a repeated id fail.
+      // Replaying the accepted checkouts one by one gives the same stock as the batch.
+      log_change(db, LOG_CHECKOUT, "i", cart_ids[i]);
+      remove_cart(db, cart_ids[i]);
+      walk.counter++;
+    }
+  }
+
+  for (uint32_t i = 0; i < db->demand_touched_count; i++)
+  {
+    merch_demand_t *entry = &db->demand[db->demand_touched[i]];
+
+    if (entry->demand > 0)
+    {
+      merch_t *merch = db->merch_slots[db->demand_touched[i]].merch;
+      pthread_mutex_lock(&merch->lock);
+      merch_take_stock(merch, entry->demand);
+      pthread_mutex_unlock(&merch->lock);
     }
   }
+
+  merchs_unlock(db);
+  SPAN_END(span);
+  metrics_record(METRIC_CHECKOUT_BATCH, started);
+  return walk.counter;
+}
+
+static void unlink_cart_line(elem_t merch_id, elem_t *quantity, void *walk_ptr)
+{
+  cart_walk_t *walk = walk_ptr;
+  merch_t *merch = merch_from_id(walk->db, merch_id.s);
+
+  if (merch != NULL)
+  {
+    pthread_mutex_lock(&merch->lock);
+    merch_add_reserved(merch, -quantity->i);
+    merch_unlink_cart(merch, walk->cart);
+    pthread_mutex_unlock(&merch->lock);
+  }
+}
+
+static void cart_clear(webstore_t *db, shopping_carts_t *cart)
+{
+  SPAN_BEGIN(span, "cart_clear");
+  cart_walk_t walk = {.db = db, .cart = cart};
+  cart_lines_apply(cart, unlink_cart_line, &walk);
+  cart_lines_clear(cart);
+  SPAN_END(span);
+}
+
+void db_decrease_locations_quantities(merch_t *merch, int quantity)
+{
+  pthread_mutex_lock(&merch->lock);
+  merch_take_stock(merch, quantity);
+  pthread_mutex_unlock(&merch->lock);
 }
 
 //
@@ -502,44 +2687,84 @@ void db_decrease_locations_quantities(merch_t *merch, int quantity)
 //
 void db_destroy_webstore(webstore_t *db)
 {
+  // A background snapshot is finished, so its changes can be dropped from the log
+  pthread_mutex_lock(&db->snapshot_lock);
+  reap_snapshot_child(db, true);
+  pthread_mutex_unlock(&db->snapshot_lock);
+  pthread_mutex_destroy(&db->snapshot_lock);
+
+  if (db->snapshot_progress != NULL)
+  {
+    munmap(db->snapshot_progress, sizeof(snapshot_progress_t));
+  }
+
+  if (db->wal != NULL)
+  {
+    wal_close(db->wal);
+  }
+
   db_destroy_merchs(db->merchs);
-  db_destroy_carts(db->carts);
-  free(db); // hade glömt det här, orsakde 16b stillreachable
-}
+  db_destroy_carts(db);
 
-void db_destroy_merchs(ioopm_hash_table_t *merchs)
-{
-  ioopm_list_t *merchs_list = ioopm_hash_table_values(merchs);
-  int size = (int)ioopm_linked_list_size(merchs_list);
+  int retired_size = (int)ioopm_linked_list_size(db->retired_merchs);
+  for (int i = 0; i < retired_size; i++)
+  {
+    db_destroy_a_merch(ioopm_linked_list_get(db->retired_merchs, i).p);
+  }
+  ioopm_linked_list_destroy(db->retired_merchs);
+  pthread_rwlock_destroy(&db->merchs_lock);
+  pthread_rwlock_destroy(&db->carts_lock);
 
-  for (int i = 0; i < size; i++)
+  if (db->snapshot != NULL)
   {
-    merch_t *merch = ioopm_linked_list_get(merchs_list, i).p;
-    db_destroy_a_merch(merch);
+    munmap(db->snapshot, db->snapshot_size);
   }
 
-  ioopm_linked_list_destroy(merchs_list);
-  ioopm_hash_table_destroy(merchs); // Hade glömt det här, orsakde still reachable error i valgrind
+  memstats_free(MEMSTATS_MERCH_SLOTS, db->merch_slots_capacity * sizeof(merch_slot_t));
+  free(db->merch_slots);
+  memstats_free(MEMSTATS_CART_SLOTS, db->cart_slots_capacity * sizeof(cart_slot_t));
+  free(db->cart_slots);
+  if (db->demand_capacity > 0)
+  {
+    memstats_free(MEMSTATS_CHECKOUT_SCRATCH, db->demand_capacity * sizeof(merch_demand_t));
+    memstats_free(MEMSTATS_CHECKOUT_SCRATCH, db->demand_capacity * sizeof(uint32_t));
+  }
+  free(db->demand);
+  free(db->demand_touched);
+  free(db); // hade glömt det här, orsakde 16b stillreachable
 }
 
-void db_destroy_carts(ioopm_hash_table_t *carts)
+static void destroy_merch_value(elem_t name_ignored, elem_t *merch, void *extra_ignored)
 {
-  ioopm_list_t *carts_list = ioopm_hash_table_values(carts);
-  int size = (int)ioopm_linked_list_size(carts_list);
+  db_destroy_a_merch(merch->p);
+}
 
-  for (int i = 0; i < size; i++)
+void db_destroy_merchs(ioopm_hash_table_t *merchs)
+{
+  // Walks the table directly, a list of the values would make this quadratic through get
+  ioopm_hash_table_apply_to_all(merchs, destroy_merch_value, NULL);
+  ioopm_hash_table_destroy(merchs); // Hade glömt det här, orsakde still reachable error i valgrind
+}
+
+void db_destroy_carts(webstore_t *db)
+{
+  for (uint32_t i = 0; i < db->cart_slots_used; i++)
   {
-    shopping_carts_t *cart = ioopm_linked_list_get(carts_list, i).p;
-    db_destroy_a_cart(cart);
+    if (db->cart_slots[i].cart != NULL)
+    {
+      timer_wheel_cancel(&db->cart_wheel, &db->cart_slots[i].cart->expiry);
+      db_destroy_a_cart(db->cart_slots[i].cart);
+      cart_slot_free(db, i);
+    }
   }
-
-  ioopm_linked_list_destroy(carts_list);
-  ioopm_hash_table_destroy(carts);
+  db->cart_quantity = 0;
 }
 
 void db_destroy_a_cart(shopping_carts_t *cart)
 {
-  ioopm_hash_table_destroy(cart->shopping_cart);
+  cart_lines_clear(cart);
+  pthread_mutex_destroy(&cart->lock);
+  memstats_free(MEMSTATS_CARTS, sizeof(shopping_carts_t));
   free(cart);
 }
 
@@ -562,7 +2787,9 @@ int db_get_price(merch_t *merch)
 
 int db_get_merch_location_quantity(merch_t *merch, char *shelf_name)
 {
+  pthread_mutex_lock(&merch->lock);
   int size = (int)ioopm_linked_list_size(merch->locations);
+  int quantity = -1;
 
   for (int i = 0; i < size; i++)
   {
@@ -570,23 +2797,29 @@ int db_get_merch_location_quantity(merch_t *merch, char *shelf_name)
 
     if (strcmp(location->name, shelf_name) == 0)
     {
-      return location->quantity;
+      quantity = location->quantity;
+      break;
     }
   }
-  return -1;
+  pthread_mutex_unlock(&merch->lock);
+  return quantity;
 }
 
-int db_get_merch_quantity_in_a_cart(shopping_carts_t *cart, char *merch_name)
+merch_id_t db_get_merch_id(merch_t *merch)
 {
-  elem_t quantity_ptr;
-  bool lookup = ioopm_hash_table_lookup(cart->shopping_cart, ptr_elem(merch_name), &quantity_ptr);
+  return merch->id;
+}
 
-  if (lookup)
-  {
-    return quantity_ptr.i;
-  }
-  else
-  {
-    return 0;
-  }
+int db_get_merch_quantity_in_a_cart(shopping_carts_t *cart, merch_t *merch)
+{
+  int quantity = 0;
+  pthread_mutex_lock(&cart->lock);
+  cart_lines_lookup(cart, merch->id, &quantity);
+  pthread_mutex_unlock(&cart->lock);
+  return quantity;
+}
+
+int db_get_cart_id(shopping_carts_t *cart)
+{
+  return cart->id;
 }
\ No newline at end of file
@@ -1,13 +1,47 @@
+#pragma once
+#include <stdint.h>
 #include "common.h"
 #include "linked_list.h"
 #include "hash_table.h"
 #include "iterator.h"
+#include "outbuf.h"
 
 typedef struct merch merch_t;
 typedef struct shelf shelf_t;
 typedef struct webstore webstore_t;
 typedef struct shopping_carts shopping_carts_t;
 
+/// Stable handle to a merchandise in a Webstore. The low 32 bits are a slot index and the high 32 bits
+/// a generation counter, so a handle to a removed merchandise never resolves to a merchandise added later.
+typedef size_t merch_id_t;
+
+#define DB_NO_MERCH_ID ((merch_id_t)0)
+
+typedef struct snapshot_status snapshot_status_t;
+
+typedef enum export_format
+{
+  EXPORT_CSV,      // the catalog, one row per shelf, in the format import_merchs reads
+  EXPORT_JSONL,    // one JSON object per merchandise, then one per cart
+  EXPORT_SNAPSHOT  // the binary snapshot format of db_save_snapshot
+} export_format_t;
+
+typedef enum snapshot_state
+{
+  SNAPSHOT_IDLE,    // no background snapshot has been started
+  SNAPSHOT_RUNNING,
+  SNAPSHOT_DONE,
+  SNAPSHOT_FAILED
+} snapshot_state_t;
+
+/// The state and progress of the latest background snapshot
+struct snapshot_status
+{
+  snapshot_state_t state;
+  size_t merchs_written;
+  size_t merch_count;
+};
+
 
 
 /**
@@ -24,6 +58,78 @@ int string_hash(elem_t e);
 /// @return A webstore consisting of two hastables db->merches and db->carts
 webstore_t *db_create_webstore(void);
 
+/// @brief Creates a Webstore that can be shared between threads. The tables are guarded by
+/// reader-writer locks and every merchandise by its own lock, so operations on different
+/// merchandises run in parallel. A cart must only be used by one thread at a time and
+/// removed merchandises are kept until the webstore is destroyed.
+/// @return A webstore where every db_* function is thread safe
+webstore_t *db_create_concurrent_webstore(void);
+
+/// @brief Creates a durable Webstore. The snapshot at snapshot_path is loaded and the changes
+/// recorded in the write-ahead log at wal_path since then are replayed. Every later change is
+/// appended to the log. Records are written and synced in batches, at the latest latency_ms after
+/// they were made, so a crash loses at most that window.
+/// @param snapshot_path The path of the snapshot, may be NULL or not exist
+/// @param wal_path The path of the write-ahead log, created if it does not exist. If NULL the
+/// webstore is not durable.
+/// @param latency_ms The longest time a change waits before it is synced to disk
+/// @return The webstore as it was when the log was last written, NULL if the snapshot exists but
+/// can not be loaded or the log does not match it
+webstore_t *db_open_webstore(const char *snapshot_path, const char *wal_path, int latency_ms);
+
+/// @brief Writes a binary snapshot of the merchandise, shelves and carts in one pass, to a
+/// temporary file that replaces path when it is synced. The changes in the snapshot are then
+/// dropped from the write-ahead log. Every change waits meanwhile, and a running background
+/// snapshot is waited for first.
+/// @param db The webstore
+/// @param path The path of the snapshot
+/// @return True if the snapshot was written
+bool db_save_snapshot(webstore_t *db, const char *path);
+
+/// @brief Starts writing a snapshot like db_save_snapshot in a forked process, which sees the
+/// webstore as it was at the fork through copy-on-write. Changes only wait for the fork. The
+/// changes in the snapshot are dropped from the log when it is found finished by
+/// db_snapshot_status, db_wait_snapshot or db_destroy_webstore.
+/// @param db The webstore
+/// @param path The path of the snapshot
+/// @return False if a background snapshot is running already or the process could not be forked
+bool db_save_snapshot_background(webstore_t *db, const char *path);
+
+/// @brief Returns the state and progress of the latest background snapshot without waiting
+/// @param db The webstore
+/// @return The status, with the state SNAPSHOT_IDLE if none has been started
+snapshot_status_t db_snapshot_status(webstore_t *db);
+
+/// @brief Waits until a running background snapshot is finished
+/// @param db The webstore
+/// @return The status of the latest background snapshot
+snapshot_status_t db_wait_snapshot(webstore_t *db);
+
+/// @brief Streams the merchandise, shelves and carts of a webstore to an output buffer. Carts are
+/// not part of the CSV format. Merchandise is written in the order it was added, except that
+/// the places of removed merchandise are reused.
+/// @param db The webstore
+/// @param out The buffer, flushed when the export is written
+/// @param format The format of the export
+/// @return False if writing to the file descriptor of out failed
+bool db_export(webstore_t *db, outbuf_t *out, export_format_t format);
+
+/// @brief Appends a merchandise and its shelves to an output buffer as a line of JSON, like in EXPORT_JSONL
+/// @param merch The merchandise
+/// @param out The buffer
+void db_export_merch(merch_t *merch, outbuf_t *out);
+
+/// @brief Appends the number of merchandises on a line of its own, then every merchandise like
+/// db_export_merch. Both are taken at the same time, so they agree even in a concurrent webstore.
+/// @param db The webstore
+/// @param out The buffer
+void db_export_merchs(webstore_t *db, outbuf_t *out);
+
+/// @brief Waits until every change made so far is synced to the write-ahead log
+/// @param db The webstore, nothing is done if it is not durable
+/// @return False if the log could not be written, the changes since then are not durable
+bool db_sync(webstore_t *db);
+
 /// @brief Allocates memory for a merchandise
 /// @param name the merchandises name
 /// @param desc the description of the merchandise
@@ -52,11 +158,16 @@ void db_destroy_a_merch(merch_t *merch);
 /// @return True if the given name does not exist in the Webstore
 bool db_has_key(webstore_t *db, char *name);
 
-/// @brief Inserts a new merchandise into the Webstore
+/// @brief Inserts a new merchandise into the Webstore and registers its locations in the shelf index
 /// @param  db The Webstore
 /// @param merch A merchandise
 void db_add_merch(webstore_t *db, merch_t *merch);
 
+/// @brief Makes room for more merchandise, so adding them does not grow the tables one step at a time
+/// @param db The Webstore
+/// @param count The number of merchandises that will be added
+void db_reserve_merchs(webstore_t *db, size_t count);
+
 /// @brief Checks the number of merchandises in the Webstore
 /// @param db The webstore to check
 /// @return The number of merchandises in the Webstore
@@ -77,24 +188,38 @@ void db_list_a_merch(merch_t *merch);
 /// @pre A merchandise with the given name exists
 merch_t *db_get_merch_from_name(webstore_t *db, char *name);
 
-/// @brief Removes a merchandise from everywhere
+/// @brief Removes a merchandise from everywhere. Only the carts that hold the merchandise are visited.
 /// @param db The webstore
 /// @param name The name of the merchandise
 void db_remove_merch(webstore_t *db, char *name);
 
 /// @brief Removes a merchandise from the shopping cart
-/// @param db the shopping cart
-/// @param name The name of the merchandise
-void db_remove_merch_from_cart(shopping_carts_t *cart, char *name);
+/// @param cart the shopping cart
+/// @param merch The merchandise
+void db_remove_merch_from_cart(shopping_carts_t *cart, merch_t *merch);
 
-/// @brief Edits the name, description and price of an existing merchandise.
+/// @brief Renames a merchandise in place by rekeying its entry in the Webstore. Its locations and
+/// handle are kept, so shopping carts holding the merchandise stay valid.
 /// @param db the Webstore
-/// @param current_merch currently existing merch
-/// @param new_name the new name of the current merchandise
-/// @param new_desc the new description of the current merchandise
-/// @param new_price the new price of the current merchandise
-/// @return Returns the edited merchandise
-merch_t *db_edit_merch(webstore_t *db, merch_t *current_merch, char *new_name, char *new_desc, int new_price);
+/// @param merch currently existing merch
+/// @param new_name the new name, the merchandise takes ownership of it and frees the old name
+/// @pre new_name does not exist in the Webstore
+void db_rename_merch(webstore_t *db, merch_t *merch, char *new_name);
+
+/// @brief Edits the name, description and price of an existing merchandise in place.
+/// @param db the Webstore
+/// @param merch currently existing merch
+/// @param new_name the new name of the merchandise, NULL to keep the current name
+/// @param new_desc the new description of the merchandise, NULL to keep the current description
+/// @param new_price the new price of the merchandise
+/// @pre new_name does not exist in the Webstore
+void db_update_merch(webstore_t *db, merch_t *merch, char *new_name, char *new_desc, int new_price);
+
+/// @brief Resolves a merchandise handle in O(1) time without any string hashing
+/// @param db The webstore
+/// @param id The handle of the merchandise
+/// @return The merchandise, NULL if the handle is stale (the merchandise has been removed)
+merch_t *db_get_merch_from_id(webstore_t *db, merch_id_t id);
 
 /// @brief  Gets a merchandise from its name
 /// @param db The webstore
@@ -112,29 +237,47 @@ int db_merch_locations_size(merch_t *merch);
 /// @param merch The merchandise to display
 void db_display_stock(merch_t *merch);
 
-/// @brief Iterates through the Webstore to check if a location with shelf_name exists
+/// @brief Checks in O(1) time if a location with shelf_name is taken by any merchandise in the Webstore
 /// @param db The Webstore
 /// @param shelf_name The new shelf name
 /// @return True if there is a location(shelf) with the same name as shelf_name
 bool db_location_name_exists_in_webstore(webstore_t *db, char *shelf_name);
 
-/// @brief Adds a new location(shelf) to a merchandise
+/// @brief Looks up in O(1) time which merchandise is stored on a shelf
+/// @param db The Webstore
+/// @param shelf_name The shelf name
+/// @return The merchandise on the shelf, NULL if the shelf is free or shelf_name is not a valid shelf
+merch_t *db_get_merch_on_shelf(webstore_t *db, char *shelf_name);
+
+/// @brief Finds the first shelf, in the order A00, A01, ..., Z99, that is not taken by any merchandise
+/// @param db The Webstore
+/// @param shelf_name Buffer of at least 4 chars where the name of the free shelf is written
+/// @return True if a free shelf was found, false if every shelf is taken
+bool db_first_free_shelf(webstore_t *db, char *shelf_name);
+
+/// @brief Adds a new location(shelf) to a merchandise and registers the shelf in the Webstore's shelf index
+/// @param db The Webstore
 /// @param merch The merchandise
 /// @param shelf_name The name of the new location
 /// @param new_quantity The quantity of the new location
-void db_add_location_to_merch(merch_t *merch, char *shelf_name, int new_quantity);
+/// @pre shelf_name is not taken by any merchandise in the Webstore
+void db_add_location_to_merch(webstore_t *db, merch_t *merch, char *shelf_name, int new_quantity);
 
 /// @brief Attempts to edit and existing location(shelf) of a merchandise
+/// @param db The Webstore
 /// @param merch The merchandise
 /// @param shelf_name The location's name
 /// @param new_quantity The new quantity of the location
-/// @return True if a location with given name exists
-bool db_edit_location_quantity(merch_t *merch, char *shelf_name, int new_quantity);
+/// @return True if a location with given name exists and belongs to merch
+bool db_edit_location_quantity(webstore_t *db, merch_t *merch, char *shelf_name, int new_quantity);
 
-/// @brief Adds a new shopping cart to the Webstore
+/// @brief Adds a new shopping cart to the Webstore and gives it an id. The id of a removed cart
+/// is not given to another cart until its slot has been reused 128 times.
 /// @param db The webstore
 /// @param cart the new cart
-void db_add_cart(webstore_t *db, shopping_carts_t *cart);
+/// @return False if the webstore already holds 16777215 carts, the cart's id then stays 0 and it
+/// still belongs to the caller
+bool db_add_cart(webstore_t *db, shopping_carts_t *cart);
 
 /// @brief Checks the amount of carts in the Webstore
 /// @param db The webstore
@@ -147,6 +290,27 @@ int db_carts_size(webstore_t *db);
 /// @return True if a cart with id is removed
 bool db_remove_cart(webstore_t *db, int id_choice);
 
+/// @brief Starts removing the carts that have not been used for a while, or stops it. A cart is
+/// used when it is added, when its lines change and by db_calculate_cost and db_checkout. Time
+/// only moves when db_expire_carts is called, so a cart is last used at the time of the latest call.
+/// @param db The webstore
+/// @param ttl_ms How long a cart may go unused, 0 to keep carts forever
+/// @param now_ms The current time in milliseconds, on the clock db_expire_carts is called with.
+/// Every cart in the webstore counts as used now.
+void db_set_cart_ttl(webstore_t *db, uint64_t ttl_ms, uint64_t now_ms);
+
+/// @brief Removes every cart that has gone unused for the TTL of db_set_cart_ttl, as
+/// db_remove_cart does, releasing what they reserved. Each expired cart costs O(1) amortized,
+/// the carts that are not due are not looked at.
+/// @param db The webstore
+/// @param now_ms The current time in milliseconds, an earlier time than the latest call is ignored
+/// @return The number of carts removed
+int db_expire_carts(webstore_t *db, uint64_t now_ms);
+
+/// @brief Reads the clock servers expire carts by
+/// @return Milliseconds on the monotonic clock
+uint64_t db_now_ms(void);
+
 /// @brief Prints the active cart ids in the Webstore
 /// @param db The webstore
 void db_display_cart_ids(webstore_t *db);
@@ -164,42 +328,81 @@ int db_lookup_merch_quantity_in_locations(merch_t *merch);
 
 /// @brief Checks the total amount of a merchandise in the Webstore's carts
 /// @param db The webstore
-/// @param merch_name The sought merchandise
+/// @param merch The sought merchandise
 /// @return The sum of all quantities of a merchandise in the Webstore's carts.
-int db_lookup_merch_quantity_in_carts(webstore_t *db, char *merch_name);
+int db_lookup_merch_quantity_in_carts(webstore_t *db, merch_t *merch);
+
+/// @brief Counts the carts that currently hold a merchandise, using the merchandise's reverse index
+/// @param merch The merchandise
+/// @return The number of carts with a line for merch
+int db_carts_holding_merch(merch_t *merch);
+
+/// @brief Applies a function to every cart that holds a merchandise, e.g. to notify them of a price change.
+/// Carts that do not hold the merchandise are never touched.
+/// @param merch The merchandise
+/// @param fun Called with key=>cart and value=>cart, the function must not change the carts' contents
+/// @param extra An additional argument passed to every call of fun
+void db_apply_to_carts_holding_merch(merch_t *merch, ioopm_apply_function fun, void *extra);
 
 /// @brief Checks if a cart has a merchandise
 /// @param cart The shopping cart
-/// @param merch_name The merchandise name
+/// @param merch The merchandise
 /// @return True if the merchandise exists in the cart
-bool db_cart_has_key(shopping_carts_t *cart, char *merch_name);
+bool db_cart_has_key(shopping_carts_t *cart, merch_t *merch);
 
-/// @brief Reinserts the total sum of existing and new quantity of a merchandise
+/// @brief Stores the total sum of existing and new quantity of a merchandise
 /// @param cart The shopping cart
-/// @param merch_name The merchandise's name
+/// @param merch The merchandise
 /// @param new_quantity The additional quantity
-void db_update_merch_quantity_in_cart(shopping_carts_t *cart, char *merch_name, int new_quantity);
+void db_update_merch_quantity_in_cart(shopping_carts_t *cart, merch_t *merch, int new_quantity);
 
 /// @brief Adds the given quantity of a merchandise in the shopping cart
 /// @param cart The shopping cart
-/// @param merch_name The merchandise's name
+/// @param merch The merchandise
 /// @param new_quantity The quantity of the merchandise
-void db_add_merch_to_cart(shopping_carts_t *cart, char *merch_name, int new_quantity);
+/// @pre merch has been added to the Webstore, the cart line refers to it by its handle
+void db_add_merch_to_cart(shopping_carts_t *cart, merch_t *merch, int new_quantity);
+
+/// @brief Reserves units of a merchandise and adds them to a cart, unless other carts got them first.
+/// The check of the available quantity and the reservation is a single compare and swap on the
+/// merchandise's version stamp, so concurrent shoppers never reserve more than is in stock.
+/// @param merch The merchandise
+/// @param cart The shopping cart
+/// @param quantity The quantity to reserve, at least 1
+/// @return True if the units were reserved and added to the cart, false if fewer units are available
+/// @pre merch has been added to the Webstore
+bool db_try_reserve(merch_t *merch, shopping_carts_t *cart, int quantity);
 
-/// @brief Calculates the cost of all merchandises in a shopping cart
+/// @brief Calculates the cost of all merchandises in a shopping cart. Lines whose merchandise has been removed are ignored.
 /// @param db The database
 /// @param cart The shopping cart
 /// @return The total price of all merchandises in a cart
 int db_calculate_cost(webstore_t *db, shopping_carts_t *cart);
 
 /// @brief Removes all of the merchandises and their amounths from the Webstore's merchandise's locations.
+/// The cart is emptied afterwards.
 /// @param db The Webstore
 /// @param cart The Shopping cart
-void db_checkout(webstore_t *db, shopping_carts_t *cart);
+/// @return True if the cart was checked out, false if some merchandise does not have enough units
+/// in its locations, in which case nothing is changed. In a concurrent webstore the check and the
+/// removal are atomic, the merchandises of the cart are locked in handle order.
+bool db_checkout(webstore_t *db, shopping_carts_t *cart);
+
+/// @brief Checks out many carts in one pass. Demand is aggregated per merchandise across the carts,
+/// the stock of every merchandise is looked up once and its locations are decreased once. Carts are
+/// accepted in the given order as long as the stock not already taken by earlier carts in the batch
+/// covers all their lines. Accepted carts are removed from the Webstore.
+/// @param db The Webstore
+/// @param cart_ids The ids of the carts to check out
+/// @param count The number of ids in cart_ids
+/// @param results Array of count bools, results[i] is set to true if cart_ids[i] was checked out
+/// @return The number of carts that were checked out
+int db_checkout_batch(webstore_t *db, int *cart_ids, int count, bool *results);
 
 /// @brief Decreases the locations's(shelves) quantities untill given quantity is zero
 /// @param merch The merchandise
 /// @param quantity The amount of quantity to decrease in locations
+/// @note Not recorded in the write-ahead log, a durable webstore changes stock with db_checkout or db_edit_location_quantity
 void db_decrease_locations_quantities(merch_t *merch, int quantity);
 
 /// @brief Destroys the webstore frees all the memory allocated by the datastructures
@@ -211,8 +414,8 @@ void db_destroy_webstore(webstore_t *db);
 void db_destroy_merchs(ioopm_hash_table_t *merchs);
 
 /// @brief Destroys the shopping carts in the database and frees the memories allocated by them
-/// @param db Key-value pairs are key=>cart_id, value=>shopping_cart. The shopping_cart itslef is key=>name, value=>quantity
-void db_destroy_carts(ioopm_hash_table_t *carts);
+/// @param db The webstore, whose cart slots are left empty
+void db_destroy_carts(webstore_t *db);
 
 /// @brief Destroys a cart and frees all the memory associated with it. It does not destroy the merchandises.
 /// @param db The shopping cart struct
@@ -222,9 +425,8 @@ void db_destroy_a_cart(shopping_carts_t *cart);
 /// @brief Calculates the valid quantity an user can enter
 /// @param db The webstore
 /// @param merch The merchandise 
-/// @param merch_name The merchandise's name
 /// @return The viable quantity that can be chosen
-int db_lookup_valid_quantity(webstore_t *db, merch_t *merch, char *merch_name);
+int db_lookup_valid_quantity(webstore_t *db, merch_t *merch);
 
 
 //### functions for testing ###
@@ -233,4 +435,6 @@ char *db_get_name(merch_t *merch);
 char *db_get_desc(merch_t *merch);
 int db_get_price(merch_t *merch);
 int db_get_merch_location_quantity(merch_t *merch, char *shelf_name);
-int db_get_merch_quantity_in_a_cart(shopping_carts_t *cart, char *merch_name);
+merch_id_t db_get_merch_id(merch_t *merch);
+int db_get_merch_quantity_in_a_cart(shopping_carts_t *cart, merch_t *merch);
+int db_get_cart_id(shopping_carts_t *cart);
@@ -0,0 +1,120 @@
+#define _POSIX_C_SOURCE 200809L
+#include <time.h>
+#include "bench.h"
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * @file bench.c
+ * @author Erdem Garip
+ * @date 18 Oct 2026
+ * @brief A harness for microbenchmarks
+ */
+
+typedef struct bench_sample bench_sample_t;
+
+struct bench_sample
+{
+  double ns;     // per operation
+  double cycles; // per operation
+};
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t now_cycles(void)
+{
+#if defined(__x86_64__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+static int compare_samples(const void *a, const void *b)
+{
+  double x = ((const bench_sample_t *)a)->ns;
+  double y = ((const bench_sample_t *)b)->ns;
+  return (x > y) - (x < y);
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+bench_result_t bench_run(const bench_t *bench, size_t scale, int repetitions)
+{
+  size_t ops = bench->max_ops > 0 && bench->max_ops < scale ? bench->max_ops : scale;
+  size_t batch = bench->batch > 0 ? bench->batch : BENCH_DEFAULT_BATCH;
+  size_t batches = (ops + batch - 1) / batch;
+
+  bench_sample_t *samples = calloc(batches * repetitions, sizeof(bench_sample_t));
+  size_t sample_count = 0;
+  double *cycles = calloc(batches * repetitions, sizeof(double));
+
+  for (int rep = -1; rep < repetitions; rep++)
+  {
+    void *state = bench->setup(scale);
+
+    for (size_t first = 0; first < ops; first += batch)
+    {
+      size_t end = first + batch < ops ? first + batch : ops;
+      uint64_t start_ns = now_ns();
+      uint64_t start_cycles = now_cycles();
+      bench->run(state, first, end);
+      uint64_t elapsed_cycles = now_cycles() - start_cycles;
+      uint64_t elapsed_ns = now_ns() - start_ns;
+
+      if (rep >= 0)
+      {
+        samples[sample_count] = (bench_sample_t){.ns = (double)elapsed_ns / (end - first),
+                                                 .cycles = (double)elapsed_cycles / (end - first)};
+        cycles[sample_count] = samples[sample_count].cycles;
+        sample_count++;
+      }
+    }
+
+    bench->teardown(state);
+  }
+
+  qsort(samples, sample_count, sizeof(bench_sample_t), compare_samples);
+  qsort(cycles, sample_count, sizeof(double), compare_doubles);
+  size_t p99 = sample_count * 99 / 100;
+
+  bench_result_t result = {.name = bench->name, .scale = scale, .ops = ops, .repetitions = repetitions,
+                           .ns_median = samples[sample_count / 2].ns,
+                           .ns_p99 = samples[p99 < sample_count ? p99 : sample_count - 1].ns,
+                           .ns_min = samples[0].ns,
+                           .cycles_median = cycles[sample_count / 2]};
+  free(samples);
+  free(cycles);
+  return result;
+}
+
+void bench_print(FILE *out, const bench_result_t *result)
+{
+  fprintf(out, "%-24s %10zu | %10.1f ns/op median | %10.1f ns/op p99 | %10.1f ns/op min | %10.0f cycles/op\n",
+          result->name, result->scale, result->ns_median, result->ns_p99, result->ns_min, result->cycles_median);
+}
+
+void bench_print_json(FILE *out, const bench_result_t *results, size_t count)
+{
+  fprintf(out, "[\n");
+  for (size_t i = 0; i < count; i++)
+  {
+    const bench_result_t *result = &results[i];
+    fprintf(out, "  {\"name\": \"%s\", \"scale\": %zu, \"ops\": %zu, \"repetitions\": %d, "
+                 "\"ns_per_op\": {\"median\": %.2f, \"p99\": %.2f, \"min\": %.2f}, \"cycles_per_op\": {\"median\": %.1f}}%s\n",
+            result->name, result->scale, result->ops, result->repetitions,
+            result->ns_median, result->ns_p99, result->ns_min, result->cycles_median, i + 1 < count ? "," : "");
+  }
+  fprintf(out, "]\n");
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @file bench.h
+ * @author Erdem Garip
+ * @date 18 Oct 2026
+ * @brief A harness for microbenchmarks
+ *
+ * A benchmark builds its state untimed, then runs a number of operations on it. The operations
+ * are timed in batches, and the time per operation of every batch is one sample, so the median
+ * and the 99th percentile describe how steady the operations are and not only their mean. The
+ * first repetition warms the caches and the allocator and is not counted.
+ *
+ * Cycles are read with rdtsc on x86-64 and are 0 elsewhere.
+ */
+
+#define BENCH_DEFAULT_BATCH 256 // operations per sample, so reading the clock is a small part of a sample
+
+typedef struct bench bench_t;
+typedef struct bench_result bench_result_t;
+
+/// @brief Builds the state of a benchmark at a scale, untimed
+/// @return The state handed to run and teardown
+typedef void *(*bench_setup_function)(size_t scale);
+
+/// @brief Runs operations first, first + 1, ..., end - 1 on the state
+typedef void (*bench_run_function)(void *state, size_t first, size_t end);
+
+/// @brief Frees the state, untimed
+typedef void (*bench_teardown_function)(void *state);
+
+struct bench
+{
+  const char *name;
+  bench_setup_function setup;
+  bench_run_function run;
+  bench_teardown_function teardown;
+  size_t max_scale;  // the largest scale it runs at, 0 for no limit
+  size_t max_ops;    // the operations run at any scale, 0 for as many as the scale
+  size_t batch;      // the operations timed together, 0 for BENCH_DEFAULT_BATCH
+};
+
+struct bench_result
+{
+  const char *name;
+  size_t scale;
+  size_t ops;          // per repetition
+  int repetitions;     // counted, without the warmup
+  double ns_median;    // per operation
+  double ns_p99;
+  double ns_min;
+  double cycles_median;
+};
+
+/// @brief Runs a benchmark at a scale
+/// @param bench The benchmark
+/// @param scale The scale
+/// @param repetitions The repetitions counted, after one warmup
+/// @return The result
+bench_result_t bench_run(const bench_t *bench, size_t scale, int repetitions);
+
+/// @brief Prints a result as a row of a table
+/// @param out The file printed to
+/// @param result The result
+void bench_print(FILE *out, const bench_result_t *result);
+
+/// @brief Prints results as a JSON array of objects
+/// @param out The file printed to
+/// @param results The results
+/// @param count The number of results
+void bench_print_json(FILE *out, const bench_result_t *results, size_t count);
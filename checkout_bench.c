@@ -0,0 +1,110 @@
+#define _POSIX_C_SOURCE 200809L
+#include <time.h>
+#include "backend.h"
+
+/**
+ * @file checkout_bench.c
+ * @author Erdem Garip
+ * @date 18 Oct 2026
+ * @brief Throughput of db_checkout_batch compared to calling db_checkout once per cart
+ *
+ * Usage: ./checkoutbench [carts] [batch size]
+ */
+
+#define BENCH_MERCHS 2000
+#define BENCH_LINES_PER_CART 3
+#define BENCH_STOCK 1000000000
+
+static double now_seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/// Builds a webstore with BENCH_MERCHS merchandises on one shelf each and carts_count carts
+static webstore_t *build_webstore(int carts_count)
+{
+  webstore_t *db = db_create_webstore();
+  merch_t *merchs[BENCH_MERCHS];
+  char buffer[16];
+
+  for (int i = 0; i < BENCH_MERCHS; i++)
+  {
+    snprintf(buffer, sizeof(buffer), "merch%d", i);
+    merchs[i] = db_create_merch(strdup(buffer), strdup("bench"), 1 + i % 100);
+    db_add_merch(db, merchs[i]);
+
+    db_first_free_shelf(db, buffer);
+    db_add_location_to_merch(db, merchs[i], strdup(buffer), BENCH_STOCK);
+  }
+
+  srand(42);
+  for (int i = 0; i < carts_count; i++)
+  {
+    shopping_carts_t *cart = db_create_cart();
+    db_add_cart(db, cart);
+
+    for (int j = 0; j < BENCH_LINES_PER_CART; j++)
+    {
+      db_update_merch_quantity_in_cart(cart, merchs[rand() % BENCH_MERCHS], 1 + rand() % 3);
+    }
+  }
+  return db;
+}
+
+static double bench_single(int carts_count)
+{
+  webstore_t *db = build_webstore(carts_count);
+  double start = now_seconds();
+
+  for (int id = 1; id <= carts_count; id++)
+  {
+    if (db_checkout(db, db_get_cart_from_id(db, id)))
+    {
+      db_remove_cart(db, id);
+    }
+  }
+
+  double elapsed = now_seconds() - start;
+  db_destroy_webstore(db);
+  return elapsed;
+}
+
+static double bench_batch(int carts_count, int batch_size)
+{
+  webstore_t *db = build_webstore(carts_count);
+  int *ids = calloc(batch_size, sizeof(int));
+  bool *results = calloc(batch_size, sizeof(bool));
+  double start = now_seconds();
+
+  for (int first = 1; first <= carts_count; first += batch_size)
+  {
+    int count = 0;
+    for (int id = first; id < first + batch_size && id <= carts_count; id++)
+    {
+      ids[count++] = id;
+    }
+    db_checkout_batch(db, ids, count, results);
+  }
+
+  double elapsed = now_seconds() - start;
+  free(ids);
+  free(results);
+  db_destroy_webstore(db);
+  return elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+  int carts_count = argc > 1 ? atoi(argv[1]) : 100000;
+  int batch_size = argc > 2 ? atoi(argv[2]) : 1000;
+
+  double single = bench_single(carts_count);
+  double batch = bench_batch(carts_count, batch_size);
+
+  printf("carts: %d, lines per cart: %d, merchs: %d\n", carts_count, BENCH_LINES_PER_CART, BENCH_MERCHS);
+  printf("db_checkout loop:          %10.0f carts/s\n", carts_count / single);
+  printf("db_checkout_batch (%5d): %10.0f carts/s\n", batch_size, carts_count / batch);
+  return 0;
+}
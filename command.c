@@ -0,0 +1,501 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "command.h"
+#include "import.h"
+#include "inbuf.h"
+#include "trace.h"
+#include "metrics.h"
+#include "memstats.h"
+
+/**
+ * @file command.c
+ * @author Erdem Garip
+ * @date 18 Oct 2026
+ * @brief One-line commands on a webstore, without prompts or menus
+ */
+
+#define COMMAND_EXPORT_BUFFER_SIZE (1 << 20)
+#define COMMAND_SCRIPT_BUFFER_SIZE (1 << 16)
+#define COMMAND_INDEX_SIZE (2 * COMMAND_COUNT)
+
+static bool command_ok(outbuf_t *out)
+{
+  outbuf_puts(out, "ok\n");
+  return true;
+}
+
+static bool command_ok_int(outbuf_t *out, int64_t value)
+{
+  outbuf_puts(out, "ok ");
+  outbuf_int(out, value);
+  outbuf_putc(out, '\n');
+  return true;
+}
+
+static bool command_error(outbuf_t *out, const char *message)
+{
+  outbuf_puts(out, "err ");
+  outbuf_puts(out, message);
+  outbuf_putc(out, '\n');
+  return false;
+}
+
+static bool cmd_add(webstore_t *db, command_arg_t *args, outbuf_t *out)
+{
+  if (!is_positive(args[2].i))
+  {
+    return command_error(out, "the price must be positive");
+  }
+  if (db_has_key(db, args[0].s))
+  {
+    return command_error(out, "the merchandise already exists");
+  }
+
+  db_add_merch(db, db_create_merch(strdup(args[0].s), strdup(args[1].s), args[2].i));
+  return command_ok(out);
+}
+
+static bool cmd_remove(webstore_t *db, command_arg_t *args, outbuf_t *out)
+{
+  if (!db_has_key(db, args[0].s))
+  {
+    return command_error(out, "no such merchandise");
+  }
+
+  db_remove_merch(db, args[0].s);
+  return command_ok(out);
+}
+
+static bool cmd_edit(webstore_t *db, command_arg_t *args, outbuf_t *out)
+{
+  merch_t *merch = db_get_merch(db, args[0].s);
+  bool renamed = strcmp(args[0].s, args[1].s) != 0;
+
+  if (merch == NULL)
+  {
+    return command_error(out, "no such merchandise");
+  }
+  if (renamed && db_has_key(db, args[1].s))
+  {
+    return command_error(out, "the new name already exists");
+  }
+  if (!is_positive(args[3].i))
+  {
+    return command_error(out, "the price must be positive");
+  }
+
+  db_update_merch(db, merch, renamed ? strdup(args[1].s) : NULL, strdup(args[2].s), args[3].i);
+  return command_ok(out);
+}
+
+static bool cmd_list(webstore_t *db, command_arg_t *args, outbuf_t *out)
+{
+  outbuf_puts(out, "ok ");
+  db_export_merchs(db, out);
+  return true;
+}
+
+static bool cmd_show(webstore_t *db, command_arg_t *args, outbuf_t *out)
+{
+  merch_t *merch = db_get_merch(db, args[0].s);
+
+  if (merch == NULL)
+  {
+    return command_error(out, "no such merchandise");
+  }
+
+  outbuf_puts(out, "ok ");
+  db_export_merch(merch, out);
+  return true;
+}
+
+/// Adds the shelf to the merchandise, or sets its quantity if the merchandise has it already
+static bool cmd_replenish(webstore_t *db, command_arg_t *args, outbuf_t *out)
+{
+  merch_t *merch = db_get_merch(db, args[0].s);
+
+  if (merch == NULL)
+  {
+    return command_error(out, "no such merchandise");
+  }
+  if (!is_valid_shelf(args[1].s))
+  {
+    return command_error(out, "not a shelf");
+  }
+  if (!is_positive(args[2].i))
+  {
+    return command_error(out, "the quantity must be positive");
+  }
+
+  merch_t *owner = db_get_merch_on_shelf(db, args[1].s);
+  if (owner == NULL)
+  {
+    db_add_location_to_merch(db, merch, strdup(args[1].s), args[2].i);
+  }
+  else if (owner != merch || !db_edit_location_quantity(db, merch, args[1].s, args[2].i))
+  {
+    return command_error(out, "the shelf is taken");
+  }
+  return command_ok(out);
+}
+
+static bool cmd_cart(webstore_t *db, command_arg_t *args, outbuf_t *out)
+{
+  shopping_carts_t *cart = db_create_cart();
+  if (!db_add_cart(db, cart))
+  {
+    db_destroy_a_cart(cart);
+    return command_error(out, "there is no room for another cart");
+  }
+  return command_ok_int(out, db_get_cart_id(cart));
+}
+
+static bool cmd_remove_cart(webstore_t *db, command_arg_t *args, outbuf_t *out)
+{
+  return db_remove_cart(db, args[0].i) ? command_ok(out) : command_error(out, "no such cart");
+}
+
+static bool cmd_add_to_cart(webstore_t *db, command_arg_t *args, outbuf_t *out)
+{
+  shopping_carts_t *cart = db_get_cart_from_id(db, args[0].i);
+  merch_t *merch = db_get_merch(db, args[1].s);
+
+  if (cart == NULL)
+  {
+    return command_error(out, "no such cart");
+  }
+  if (merch == NULL)
+  {
+    return command_error(out, "no such merchandise");
+  }
+  if (!is_positive(args[2].i))
+  {
+    return command_error(out, "the quantity must be positive");
+  }
+
+  return db_try_reserve(merch, cart, args[2].i) ? command_ok(out) : command_error(out, "not enough units available");
+}
+
+static bool cmd_remove_from_cart(webstore_t *db, command_arg_t *args, outbuf_t *out)
+{
+  shopping_carts_t *cart = db_get_cart_from_id(db, args[0].i);
+  merch_t *merch = db_get_merch(db, args[1].s);
+
+  if (cart == NULL)
+  {
+    return command_error(out, "no such cart");
+  }
+  if (merch == NULL || !db_cart_has_key(cart, merch))
+  {
+    return command_error(out, "the cart does not hold the merchandise");
+  }
+
+  db_remove_merch_from_cart(cart, merch);
+  return command_ok(out);
+}
+
+static bool cmd_cost(webstore_t *db, command_arg_t *args, outbuf_t *out)
+{
+  shopping_carts_t *cart = db_get_cart_from_id(db, args[0].i);
+  return cart != NULL ? command_ok_int(out, db_calculate_cost(db, cart)) : command_error(out, "no such cart");
+}
+
+static bool cmd_checkout(webstore_t *db, command_arg_t *args, outbuf_t *out)
+{
+  shopping_carts_t *cart = db_get_cart_from_id(db, args[0].i);
+
+  if (cart == NULL)
+  {
+    return command_error(out, "no such cart");
+  }
+  if (!db_checkout(db, cart))
+  {
+    return command_error(out, "not enough units in stock");
+  }
+
+  db_remove_cart(db, args[0].i);
+  return command_ok(out);
+}
+
+static bool cmd_save(webstore_t *db, command_arg_t *args, outbuf_t *out)
+{
+  return db_save_snapshot(db, args[0].s) ? command_ok(out) : command_error(out, "the snapshot could not be saved");
+}
+
+static bool cmd_bgsave(webstore_t *db, command_arg_t *args, outbuf_t *out)
+{
+  return db_save_snapshot_background(db, args[0].s) ? command_ok(out) : command_error(out, "a snapshot is being saved");
+}
+
+static bool cmd_sync(webstore_t *db, command_arg_t *args, outbuf_t *out)
+{
+  return db_sync(db) ? command_ok(out) : command_error(out, "the log could not be written");
+}
+
+/// Answers with the rows read, the merchandises and shelves added and the rows rejected
+static bool cmd_import(webstore_t *db, command_arg_t *args, outbuf_t *out)
+{
+  import_report_t report;
+
+  if (!import_merchs(db, args[0].s, (int)sysconf(_SC_NPROCESSORS_ONLN), &report))
+  {
+    return command_error(out, "the file could not be read");
+  }
+
+  outbuf_puts(out, "ok ");
+  outbuf_int(out, report.rows);
+  outbuf_putc(out, ' ');
+  outbuf_int(out, report.merchs_added);
+  outbuf_putc(out, ' ');
+  outbuf_int(out, report.shelves_added);
+  outbuf_putc(out, ' ');
+  outbuf_int(out, report.rejected);
+  outbuf_putc(out, '\n');
+  return true;
+}
+
+static bool cmd_export(webstore_t *db, command_arg_t *args, outbuf_t *out)
+{
+  static const char *formats[] = {"csv", "jsonl", "snapshot"};
+  static const export_format_t format_values[] = {EXPORT_CSV, EXPORT_JSONL, EXPORT_SNAPSHOT};
+  int format = -1;
+
+  for (int i = 0; i < 3; i++)
+  {
+    format = strcmp(args[0].s, formats[i]) == 0 ? i : format;
+  }
+  if (format < 0)
+  {
+    return command_error(out, "the format is not csv, jsonl or snapshot");
+  }
+
+  int fd = open(args[1].s, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+  {
+    return command_error(out, "the file could not be opened");
+  }
+
+  outbuf_t *file = outbuf_create(fd, COMMAND_EXPORT_BUFFER_SIZE);
+  bool written = db_export(db, file, format_values[format]);
+  written = outbuf_destroy(file) && written;
+  written = close(fd) == 0 && written;
+  return written ? command_ok(out) : command_error(out, "the file could not be written");
+}
+
+/// Answers with the latency of every backend operation, see metrics.h
+static bool cmd_stats(webstore_t *db, command_arg_t *args, outbuf_t *out)
+{
+  outbuf_puts(out, "ok ");
+  outbuf_int(out, METRIC_COUNT);
+  outbuf_putc(out, '\n');
+  metrics_write(out);
+  return true;
+}
+
+/// Answers with the heap memory of every kind of structure and the total, see memstats.h
+static bool cmd_memory(webstore_t *db, command_arg_t *args, outbuf_t *out)
+{
+  outbuf_puts(out, "ok ");
+  outbuf_int(out, MEMSTATS_CATEGORY_COUNT + 1);
+  outbuf_putc(out, '\n');
+  memstats_write(out);
+  return true;
+}
+
+const command_t command_table[COMMAND_COUNT] = {
+    [COMMAND_ADD] = {"add", "ssi", cmd_add, "add NAME DESC PRICE", "Add merchandise"},
+    [COMMAND_LIST] = {"list", "", cmd_list, "list", "List merchandise"},
+    [COMMAND_REMOVE] = {"remove", "s", cmd_remove, "remove NAME", "Remove merchandise"},
+    [COMMAND_EDIT] = {"edit", "sssi", cmd_edit, "edit NAME NEW_NAME NEW_DESC NEW_PRICE", "Edit merchandise"},
+    [COMMAND_SHOW] = {"show", "s", cmd_show, "show NAME", "Show stock"},
+    [COMMAND_REPLENISH] = {"replenish", "ssi", cmd_replenish, "replenish NAME SHELF QUANTITY", "Replenish"},
+    [COMMAND_CART] = {"cart", "", cmd_cart, "cart", "Create cart"},
+    [COMMAND_REMOVE_CART] = {"remove-cart", "i", cmd_remove_cart, "remove-cart CART", "Remove cart"},
+    [COMMAND_ADD_TO_CART] = {"add-to-cart", "isi", cmd_add_to_cart, "add-to-cart CART NAME QUANTITY", "Add to cart"},
+    [COMMAND_REMOVE_FROM_CART] = {"remove-from-cart", "is", cmd_remove_from_cart, "remove-from-cart CART NAME", "Remove from cart"},
+    [COMMAND_COST] = {"cost", "i", cmd_cost, "cost CART", "Calculate cost"},
+    [COMMAND_CHECKOUT] = {"checkout", "i", cmd_checkout, "checkout CART", "Checkout"},
+    [COMMAND_SAVE] = {"save", "s", cmd_save, "save PATH", NULL},
+    [COMMAND_BGSAVE] = {"bgsave", "s", cmd_bgsave, "bgsave PATH", "Save snapshot"},
+    [COMMAND_SYNC] = {"sync", "", cmd_sync, "sync", NULL},
+    [COMMAND_IMPORT] = {"import", "s", cmd_import, "import PATH", "Import merchandise"},
+    [COMMAND_EXPORT] = {"export", "ss", cmd_export, "export csv|jsonl|snapshot PATH", NULL},
+    [COMMAND_STATS] = {"stats", "", cmd_stats, "stats", "Show latencies"},
+    [COMMAND_MEMORY] = {"memory", "", cmd_memory, "memory", "Show memory"}};
+
+// The names hashed into a table twice as large as the number of commands, built once
+static int8_t command_index[COMMAND_INDEX_SIZE];
+static pthread_once_t command_index_once = PTHREAD_ONCE_INIT;
+
+static uint32_t command_hash(const char *name)
+{
+  uint32_t hash = 2166136261u;
+  for (const char *c = name; *c != '\0'; c++)
+  {
+    hash = (hash ^ (uint8_t)*c) * 16777619u;
+  }
+  return hash;
+}
+
+static void build_command_index(void)
+{
+  memset(command_index, -1, sizeof(command_index));
+  for (int id = 0; id < COMMAND_COUNT; id++)
+  {
+    uint32_t slot = command_hash(command_table[id].name) % COMMAND_INDEX_SIZE;
+    while (command_index[slot] >= 0)
+    {
+      slot = (slot + 1) % COMMAND_INDEX_SIZE;
+    }
+    command_index[slot] = id;
+  }
+}
+
+const command_t *command_find(const char *name)
+{
+  pthread_once(&command_index_once, build_command_index);
+
+  for (uint32_t slot = command_hash(name) % COMMAND_INDEX_SIZE; command_index[slot] >= 0; slot = (slot + 1) % COMMAND_INDEX_SIZE)
+  {
+    if (strcmp(command_table[command_index[slot]].name, name) == 0)
+    {
+      return &command_table[command_index[slot]];
+    }
+  }
+  return NULL;
+}
+
+/// Splits off the next token of a line in place. Returns NULL at the end of the line, or
+/// sets *malformed if a quoted token is not closed.
+static char *next_token(char **cursor, bool *malformed)
+{
+  char *c = *cursor;
+  while (*c == ' ' || *c == '\t')
+  {
+    c++;
+  }
+  if (*c == '\0')
+  {
+    *cursor = c;
+    return NULL;
+  }
+
+  char *token = c;
+  if (*c != '"')
+  {
+    while (*c != '\0' && *c != ' ' && *c != '\t')
+    {
+      c++;
+    }
+    if (*c != '\0')
+    {
+      *c++ = '\0';
+    }
+    *cursor = c;
+    return token;
+  }
+
+  // Unescaped in place, the token is never longer than its quoted form
+  char *dest = token;
+  c++;
+  while (*c != '\0' && *c != '"')
+  {
+    if (*c == '\\' && (c[1] == '"' || c[1] == '\\'))
+    {
+      c++;
+    }
+    *dest++ = *c++;
+  }
+  if (*c != '"' || (c[1] != '\0' && c[1] != ' ' && c[1] != '\t'))
+  {
+    *malformed = true;
+    return NULL;
+  }
+  *dest = '\0';
+  *cursor = c[1] != '\0' ? c + 2 : c + 1;
+  return token;
+}
+
+/// Parses an int of an optional minus and digits
+static bool parse_int(const char *str, int *result)
+{
+  char *end;
+  errno = 0;
+  long value = strtol(str, &end, 10);
+
+  if (!is_valid_number((char *)str) || *str == '\0' || *end != '\0' || errno != 0 || value < INT_MIN || value > INT_MAX)
+  {
+    return false;
+  }
+  *result = (int)value;
+  return true;
+}
+
+bool command_execute(webstore_t *db, char *line, outbuf_t *out)
+{
+  bool malformed = false;
+  char *cursor = line;
+  char *name = next_token(&cursor, &malformed);
+
+  if (name == NULL || *name == '#')
+  {
+    return malformed ? command_error(out, "a quote is not closed") : true;
+  }
+
+  const command_t *command = command_find(name);
+  if (command == NULL)
+  {
+    return command_error(out, "unknown command");
+  }
+
+  command_arg_t args[COMMAND_MAX_ARGS];
+  size_t arg_count = strlen(command->schema);
+
+  for (size_t i = 0; i < arg_count; i++)
+  {
+    char *token = next_token(&cursor, &malformed);
+
+    if (token == NULL)
+    {
+      return command_error(out, malformed ? "a quote is not closed" : command->help);
+    }
+    if (command->schema[i] == 'i' && !parse_int(token, &args[i].i))
+    {
+      return command_error(out, "an argument is not a number");
+    }
+    if (command->schema[i] == 's')
+    {
+      args[i].s = token;
+    }
+  }
+
+  if (next_token(&cursor, &malformed) != NULL || malformed)
+  {
+    return command_error(out, "too many arguments");
+  }
+  trace_capture_command(command - command_table, args);
+  return command->handler(db, args, out);
+}
+
+size_t command_run_script(webstore_t *db, int fd, outbuf_t *out)
+{
+  inbuf_t *in = inbuf_create(fd, COMMAND_SCRIPT_BUFFER_SIZE);
+  size_t failed = 0;
+  char *line;
+
+  while ((line = inbuf_line(in, NULL)) != NULL)
+  {
+    if (!command_execute(db, line, out))
+    {
+      failed++;
+    }
+  }
+
+  inbuf_destroy(in);
+  outbuf_flush(out);
+  return failed;
+}
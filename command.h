@@ -0,0 +1,99 @@
+#pragma once
+
+#include "backend.h"
+#include "outbuf.h"
+
+/**
+ * @file command.h
+ * @author Erdem Garip
+ * @date 18 Oct 2026
+ * @brief One-line commands on a webstore, without prompts or menus
+ *
+ * A command is a name followed by its arguments, separated by spaces. An argument with spaces
+ * is quoted, with \" and \\ for a quote and a backslash inside the quotes. Empty lines and
+ * lines starting with # are skipped.
+ *
+ *     add adidas "bra skor" 100
+ *     replenish adidas A01 60
+ *     cart
+ *     add-to-cart 1 adidas 3
+ *     checkout 1
+ *
+ * Every command answers with one line, "ok" with an optional value or "err" and a message,
+ * except list, stats and memory whose "ok" line holds the number of lines that follow. See
+ * command_table for every command.
+ */
+
+#define COMMAND_MAX_ARGS 4
+
+typedef struct command command_t;
+typedef union command_arg command_arg_t;
+
+/// The commands. Those with a menu alternative are listed in this order in the interactive menu.
+typedef enum command_id
+{
+  COMMAND_ADD,
+  COMMAND_LIST,
+  COMMAND_REMOVE,
+  COMMAND_EDIT,
+  COMMAND_SHOW,
+  COMMAND_REPLENISH,
+  COMMAND_CART,
+  COMMAND_REMOVE_CART,
+  COMMAND_ADD_TO_CART,
+  COMMAND_REMOVE_FROM_CART,
+  COMMAND_COST,
+  COMMAND_CHECKOUT,
+  COMMAND_SAVE,
+  COMMAND_BGSAVE,
+  COMMAND_SYNC,
+  COMMAND_IMPORT,
+  COMMAND_EXPORT,
+  COMMAND_STATS,
+  COMMAND_MEMORY,
+  COMMAND_COUNT
+} command_id_t;
+
+union command_arg
+{
+  char *s; // points into the line, copied by the handler if it is stored
+  int i;
+};
+
+/// @brief Runs a command whose arguments match its schema
+/// @param db The webstore
+/// @param args The arguments
+/// @param out The answer is appended here
+/// @return True if the command succeeded
+typedef bool (*command_handler)(webstore_t *db, command_arg_t *args, outbuf_t *out);
+
+struct command
+{
+  const char *name;
+  const char *schema; // one character per argument, 's' for a string and 'i' for an int
+  command_handler handler;
+  const char *help;
+  const char *menu; // the alternative in the interactive menu, NULL if it is not in the menu
+};
+
+/// @brief The commands, indexed by their id
+extern const command_t command_table[COMMAND_COUNT];
+
+/// @brief Finds a command by its name in constant time
+/// @param name The name
+/// @return The command, or NULL if there is no command with the name
+const command_t *command_find(const char *name);
+
+/// @brief Runs one line. The line is split in place, so it is changed.
+/// @param db The webstore
+/// @param line The line, without the line end
+/// @param out The answer is appended here, nothing for an empty line or a comment
+/// @return False if the command failed, its usage is the message if arguments are missing
+bool command_execute(webstore_t *db, char *line, outbuf_t *out);
+
+/// @brief Runs every line of a script
+/// @param db The webstore
+/// @param fd The script is read from here until its end, lines of any length
+/// @param out The answers are appended here
+/// @return The number of commands that failed
+size_t command_run_script(webstore_t *db, int fd, outbuf_t *out);
@@ -1,4 +1,8 @@
+#include <unistd.h>
 #include "common.h"
+#include "inbuf.h"
+
+#define STDIN_BUFFER_SIZE (1 << 16) // stdin is read in blocks this large
 
 bool ioopm_compare_bool_elems(elem_t a, elem_t b)
 {
@@ -63,17 +67,22 @@ bool valid_quantity(int choice, int max)
 
 answer_t ask_question(char *question, check_func check, convert_func convert)
 {
-  int buffer_size = 255;
-  char buffer[buffer_size];
+  char *answer;
 
   do
   {
     printf("%s\n", question);
-    read_string(buffer, buffer_size);
+    answer = read_line();
 
-  } while (!check(buffer));
+    if (answer == NULL)
+    {
+      // Nothing more can be answered, asking again would loop forever
+      printf("--- The input has ended. ---\n");
+      exit(EXIT_FAILURE);
+    }
+  } while (!check(answer));
 
-  return convert(buffer);
+  return convert(answer);
 }
 
 int ask_question_int(char *question)
@@ -87,6 +96,16 @@ char *ask_question_string(char *question)
   return ask_question(question, is_valid_string, (convert_func)strdup).string_value;
 }
 
+static answer_t string_view(char *str)
+{
+  return (answer_t){.string_value = str};
+}
+
+char *ask_question_view(char *question)
+{
+  return ask_question(question, is_valid_string, string_view).string_value;
+}
+
 char *ask_question_shelf(char *question)
 {
   return ask_question(question, is_valid_shelf, (convert_func)strdup).string_value;
@@ -157,19 +176,27 @@ bool is_valid_shelf(char *shelf)
   }
 }
 
+char *read_line(void)
+{
+  static inbuf_t *in = NULL;
+
+  if (in == NULL)
+  {
+    in = inbuf_create(STDIN_FILENO, STDIN_BUFFER_SIZE);
+  }
+  return inbuf_line(in, NULL);
+}
+
 int read_string(char *buf, int buf_siz)
 {
-  int c = getchar();
+  char *line = read_line();
   int counter = 0;
-  do
-  {
-    if (counter < buf_siz - 1)
-    {
-      buf[counter++] = c;
-      c = getchar();
-    }
 
-  } while (c != '\n' && c != EOF);
+  while (line != NULL && line[counter] != '\0' && counter < buf_siz - 1)
+  {
+    buf[counter] = line[counter];
+    counter++;
+  }
 
   buf[counter] = '\0';
 
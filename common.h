@@ -29,6 +29,10 @@ typedef bool (*check_func)(char *);
 typedef answer_t (*convert_func)(char *);
 int read_string(char *buf, int buf_siz);
 
+/// @brief Reads a line from stdin, in blocks rather than a character at a time
+/// @return The line without its line end, valid until the next line is read, or NULL at the end of the input
+char *read_line(void);
+
 #define empty_elem() \
     (elem_t) { .__dummy = 0 }
 #define bool_elem(x) \
@@ -118,6 +122,11 @@ int ask_question_int(char *question);
 /// @return A string
 char *ask_question_string(char *question);
 
+/// @brief Prompts the user to input a string that is only looked at, not kept
+/// @param  question The question prompted to user
+/// @return The answer, valid until the next question is asked. Copy it to keep it.
+char *ask_question_view(char *question);
+
 /// @brief A function that prompts the user to input a Shelf
 /// @param  question The question prompted to user
 /// @return A shelf
@@ -0,0 +1,135 @@
+#define _POSIX_C_SOURCE 200809L
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "backend.h"
+
+/**
+ * @file concurrency_bench.c
+ * @author Erdem Garip
+ * @date 18 Oct 2026
+ * @brief Throughput of a concurrent webstore under a browse, add to cart and checkout mix
+ *
+ * Every thread owns its carts and runs the same number of operations. The run is repeated
+ * for 1, 2, 4, ... threads up to the number of cores, or the given maximum.
+ *
+ * Usage: ./concurrencybench [operations per thread] [max threads]
+ */
+
+#define BENCH_MERCHS 2000
+#define BENCH_STOCK 1000000000
+#define BENCH_BROWSE_PERCENT 70
+#define BENCH_ADD_PERCENT 25 // the rest are checkouts
+
+typedef struct bench_thread bench_thread_t;
+
+struct bench_thread
+{
+  pthread_t thread;
+  webstore_t *db;
+  char **names;
+  int operations;
+  unsigned int seed;
+};
+
+static double now_seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/// Builds a concurrent webstore with BENCH_MERCHS merchandises on one shelf each
+static webstore_t *build_webstore(char **names)
+{
+  webstore_t *db = db_create_concurrent_webstore();
+  char buffer[16];
+
+  for (int i = 0; i < BENCH_MERCHS; i++)
+  {
+    snprintf(buffer, sizeof(buffer), "merch%d", i);
+    merch_t *merch = db_create_merch(strdup(buffer), strdup("bench"), 1 + i % 100);
+    db_add_merch(db, merch);
+    names[i] = db_get_name(merch);
+
+    db_first_free_shelf(db, buffer);
+    db_add_location_to_merch(db, merch, strdup(buffer), BENCH_STOCK);
+  }
+  return db;
+}
+
+static void *bench_worker(void *arg)
+{
+  bench_thread_t *self = arg;
+  shopping_carts_t *cart = db_create_cart();
+  db_add_cart(self->db, cart);
+
+  for (int i = 0; i < self->operations; i++)
+  {
+    int op = rand_r(&self->seed) % 100;
+    merch_t *merch = db_get_merch(self->db, self->names[rand_r(&self->seed) % BENCH_MERCHS]);
+
+    if (op < BENCH_BROWSE_PERCENT)
+    {
+      db_lookup_valid_quantity(self->db, merch);
+    }
+    else if (op < BENCH_BROWSE_PERCENT + BENCH_ADD_PERCENT)
+    {
+      db_try_reserve(merch, cart, 1);
+    }
+    else
+    {
+      db_checkout(self->db, cart);
+    }
+  }
+
+  db_remove_cart(self->db, db_get_cart_id(cart));
+  return NULL;
+}
+
+static double bench_threads(webstore_t *db, char **names, int threads, int operations)
+{
+  bench_thread_t *workers = calloc(threads, sizeof(bench_thread_t));
+  double start = now_seconds();
+
+  for (int i = 0; i < threads; i++)
+  {
+    workers[i] = (bench_thread_t){.db = db, .names = names, .operations = operations, .seed = 42 + i};
+    pthread_create(&workers[i].thread, NULL, bench_worker, &workers[i]);
+  }
+  for (int i = 0; i < threads; i++)
+  {
+    pthread_join(workers[i].thread, NULL);
+  }
+
+  double elapsed = now_seconds() - start;
+  free(workers);
+  return elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+  int operations = argc > 1 ? atoi(argv[1]) : 500000;
+  int max_threads = argc > 2 ? atoi(argv[2]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  char *names[BENCH_MERCHS];
+  webstore_t *db = build_webstore(names);
+
+  printf("operations per thread: %d, merchs: %d, mix: %d%% browse, %d%% add, %d%% checkout\n",
+         operations, BENCH_MERCHS, BENCH_BROWSE_PERCENT, BENCH_ADD_PERCENT,
+         100 - BENCH_BROWSE_PERCENT - BENCH_ADD_PERCENT);
+
+  for (int threads = 1; threads <= max_threads; threads = threads < max_threads && threads * 2 > max_threads ? max_threads : threads * 2)
+  {
+    double elapsed = bench_threads(db, names, threads, operations);
+    double total = (double)threads * operations / elapsed;
+    printf("threads: %3d | %12.0f ops/s | %12.0f ops/s per thread\n", threads, total, total / threads);
+
+    if (threads == max_threads)
+    {
+      break;
+    }
+  }
+
+  db_destroy_webstore(db);
+  return 0;
+}
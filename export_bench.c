@@ -0,0 +1,95 @@
+#define _POSIX_C_SOURCE 200809L
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "backend.h"
+
+/**
+ * @file export_bench.c
+ * @author Erdem Garip
+ * @date 18 Oct 2026
+ * @brief Time to export a large catalog in every format, compared to a printf per item
+ *
+ * Usage: ./exportbench [merchs] [output path]
+ */
+
+#define BENCH_SHELVED_MERCHS 2000 // every shelf can not be taken, so only the first merchs get one
+#define BENCH_BUFFER_SIZE (1 << 20)
+
+static double now_seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *label, double seconds, off_t size)
+{
+  printf("%-16s %8.3f s | %8.1f MB/s\n", label, seconds, size / seconds / 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+  int merch_count = argc > 1 ? atoi(argv[1]) : 1000000;
+  char *path = argc > 2 ? argv[2] : "bench_export.out";
+  webstore_t *db = db_create_webstore();
+  merch_t **merchs = calloc(merch_count, sizeof(merch_t *));
+  char buffer[32];
+
+  for (int i = 0; i < merch_count; i++)
+  {
+    snprintf(buffer, sizeof(buffer), "merch%d", i);
+    merch_t *merch = db_create_merch(strdup(buffer), strdup("a piece of merchandise"), 1 + i % 1000);
+    db_add_merch(db, merch);
+    merchs[i] = merch;
+
+    if (i < BENCH_SHELVED_MERCHS)
+    {
+      db_first_free_shelf(db, buffer);
+      db_add_location_to_merch(db, merch, strdup(buffer), 100);
+    }
+  }
+
+  // The same CSV as db_export writes, through stdio with a printf per merchandise
+  double start = now_seconds();
+  FILE *file = fopen(path, "w");
+  fprintf(file, "name,desc,price,shelf,quantity\n");
+  for (int i = 0; i < merch_count; i++)
+  {
+    fprintf(file, "%s,%s,%d,,\n", db_get_name(merchs[i]), db_get_desc(merchs[i]), db_get_price(merchs[i]));
+  }
+  fclose(file);
+  double printf_seconds = now_seconds() - start;
+
+  struct stat st;
+  stat(path, &st);
+  printf("merchs: %d\n", merch_count);
+  report("printf csv:", printf_seconds, st.st_size);
+
+  const char *labels[] = {"export csv:", "export jsonl:", "export snapshot:"};
+  export_format_t formats[] = {EXPORT_CSV, EXPORT_JSONL, EXPORT_SNAPSHOT};
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  outbuf_t *out = outbuf_create(fd, BENCH_BUFFER_SIZE);
+
+  for (int i = 0; i < 3; i++)
+  {
+    int next_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    outbuf_reset(out, next_fd);
+    close(fd);
+    fd = next_fd;
+
+    start = now_seconds();
+    db_export(db, out, formats[i]);
+    double seconds = now_seconds() - start;
+    fstat(fd, &st);
+    report(labels[i], seconds, st.st_size);
+  }
+
+  outbuf_destroy(out);
+  close(fd);
+  db_destroy_webstore(db);
+  free(merchs);
+  remove(path);
+  return 0;
+}
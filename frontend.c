@@ -1,42 +1,84 @@
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
 #include "frontend.h"
+#include "import.h"
+#include "command.h"
+#include "server.h"
+#include "trace.h"
+#include "metrics.h"
+#include "memstats.h"
+
+#define WEBSTORE_SNAPSHOT "webstore.snapshot" // the webstore as it was when it was last shut down
+#define WEBSTORE_LOG "webstore.wal"   // every change to the webstore is recorded here and replayed on start
+#define WEBSTORE_LOG_LATENCY_MS 10    // changes are synced to the log in batches at most this old
+#define SCRIPT_BUFFER_SIZE (1 << 16)  // the script is answered in blocks this large
+#define STATS_INTERVAL_MS 10000       // how often --stats replaces its file
 
 // ### Internal ###
 static void print_menu(void);
 static int menu_choice(void);
 static void ui_event_loop(webstore_t *db);
 
+typedef void (*ui_handler)(webstore_t *db);
+
+/// How the interactive menu performs a command, by asking for its arguments one at a time
+static const ui_handler ui_handlers[COMMAND_COUNT] = {
+    [COMMAND_ADD] = ui_create_merch,
+    [COMMAND_LIST] = ui_list_merchs,
+    [COMMAND_REMOVE] = ui_remove_merch,
+    [COMMAND_EDIT] = ui_edit_merch,
+    [COMMAND_SHOW] = ui_show_stock,
+    [COMMAND_REPLENISH] = ui_replenish,
+    [COMMAND_CART] = ui_create_cart,
+    [COMMAND_REMOVE_CART] = ui_remove_cart,
+    [COMMAND_ADD_TO_CART] = ui_add_to_cart,
+    [COMMAND_REMOVE_FROM_CART] = ui_remove_from_cart,
+    [COMMAND_COST] = ui_calculate_cost,
+    [COMMAND_CHECKOUT] = ui_checkout,
+    [COMMAND_BGSAVE] = ui_save_snapshot,
+    [COMMAND_IMPORT] = ui_import_merchs,
+    [COMMAND_STATS] = ui_show_stats,
+    [COMMAND_MEMORY] = ui_show_memory};
+
+// The command of each menu alternative, the commands with a menu text in command_table order.
+// The alternative after the last is Quit.
+static command_id_t menu_commands[COMMAND_COUNT];
+static int menu_size = 0;
+
+static void build_menu(void)
+{
+  for (int id = 0; id < COMMAND_COUNT; id++)
+  {
+    if (command_table[id].menu != NULL && ui_handlers[id] != NULL)
+    {
+      menu_commands[menu_size++] = id;
+    }
+  }
+}
+
 static void print_menu(void)
 {
   printf("***\n"
-         "Choose one of the listed alternatives: \n"
-         "1. Add merchandise \n"
-         "2. List merchandise\n"
-         "3. Remove merchandise\n"
-         "4. Edit merchandise\n"
-         "5. Show stock\n"
-         "6. Replenish\n"
-         "7. Create cart\n"
-         "8. Remove cart\n"
-         "9. Add to cart\n"
-         "10. Remove from cart\n"
-         "11. Calculate cost\n"
-         "12. Checkout\n"
-         "13. Quit\n"
-         "***\n");
+         "Choose one of the listed alternatives: \n");
+  for (int i = 0; i < menu_size; i++)
+  {
+    printf("%d. %s\n", i + 1, command_table[menu_commands[i]].menu);
+  }
+  printf("%d. Quit\n"
+         "***\n",
+         menu_size + 1);
 }
 
 static int menu_choice(void)
 {
-  char *raw_choice;
   int choice = 0;
 
   do
   {
-    raw_choice = ask_question_string("State the choice: ");
-    choice = atoi(raw_choice);
-  } while (!(choice <= 13 && choice >= 1));
+    choice = atoi(ask_question_view("State the choice: "));
+  } while (!(choice <= menu_size + 1 && choice >= 1));
 
-  free(raw_choice);
   return choice;
 }
 
@@ -51,23 +93,52 @@ void ui_create_merch(webstore_t *db)
   if (!is_positive(price))
   {
     printf("The price of the merchandise must be positive. Try again from the beginning.\n");
+    free(name);
+    free(desc);
   }
   else if (db_has_key(db, name))
   {
     printf("The given name already exists in the Webstore. Try again from the beginning.\n");
+    free(name);
+    free(desc);
   }
   else
   {
+    trace_capture_command(COMMAND_ADD, (command_arg_t[]){{.s = name}, {.s = desc}, {.i = price}});
     merch_t *merch = db_create_merch(name, desc, price);
     db_add_merch(db, merch);
     printf("--- The merchandise has been successfully added ---\n");
   }
 }
 
+void ui_import_merchs(webstore_t *db)
+{
+  char *path = ask_question_view("State the path of the CSV or TSV file: ");
+  import_report_t report;
+
+  trace_capture_command(COMMAND_IMPORT, (command_arg_t[]){{.s = path}});
+  if (!import_merchs(db, path, (int)sysconf(_SC_NPROCESSORS_ONLN), &report))
+  {
+    printf("--- The file could not be read. Try again from the beginning. ---\n");
+  }
+  else
+  {
+    double seconds = report.parse_seconds + report.insert_seconds;
+    printf("--- %zu rows read, %zu merchandises and %zu shelves added in %.2f s (%.0f rows/s). ---\n",
+           report.rows, report.merchs_added, report.shelves_added, seconds, seconds > 0 ? report.rows / seconds : 0.0);
+
+    if (report.rejected > 0)
+    {
+      printf("--- %zu rows were rejected, the first on line %zu. ---\n", report.rejected, report.first_rejected_line);
+    }
+  }
+}
+
 void ui_list_merchs(webstore_t *db)
 {
   int merch_count = db_merch_count(db);
 
+  trace_capture_command(COMMAND_LIST, NULL);
   if (merch_count == 0)
   {
     printf("--- The Webstore is empty. There is nothing to display. ---\n");
@@ -81,10 +152,11 @@ void ui_list_merchs(webstore_t *db)
 
 void ui_remove_merch(webstore_t *db)
 {
-  char *name = ask_question_string("State the name of the merchandise to remove: ");
+  char *name = ask_question_view("State the name of the merchandise to remove: ");
 
   if (db_has_key(db, name))
   {
+    trace_capture_command(COMMAND_REMOVE, (command_arg_t[]){{.s = name}});
     db_remove_merch(db, name);
     printf("--- The merchandise has been removed. ---\n");
   }
@@ -96,10 +168,10 @@ void ui_remove_merch(webstore_t *db)
 
 void ui_edit_merch(webstore_t *db)
 {
-  char *current_name = ask_question_string("State the name of the merchandise to edit: ");
-  bool has_current_name = db_has_key(db, current_name);
+  // The name is looked up before the next question replaces it
+  merch_t *current_merch = db_get_merch(db, ask_question_view("State the name of the merchandise to edit: "));
 
-  if (has_current_name)
+  if (current_merch != NULL)
   {
     char *new_name = ask_question_string("State the new name of the merchandise: ");
     char *new_desc = ask_question_string("State the new description of the merchandise: ");
@@ -109,15 +181,22 @@ void ui_edit_merch(webstore_t *db)
 
     if (has_new_name)
     {
-      printf("--- It is not possible to edit the name '%s' to '%s' since the latter already exists in the Webstore ---\n", current_name, new_name);
+      printf("--- It is not possible to edit the name '%s' to '%s' since the latter already exists in the Webstore ---\n", db_get_name(current_merch), new_name);
+      free(new_name);
+      free(new_desc);
     }
     else
     {
-      merch_t *current_merch = db_get_merch(db, current_name);
-      merch_t *edited_merch = db_edit_merch(db, current_merch, new_name, new_desc, new_price);
+      bool price_changed = db_get_price(current_merch) != new_price;
+      trace_capture_command(COMMAND_EDIT, (command_arg_t[]){{.s = db_get_name(current_merch)}, {.s = new_name},
+                                                            {.s = new_desc}, {.i = new_price}});
+      db_update_merch(db, current_merch, new_name, new_desc, new_price);
+      printf("--- The merchandise has been successfully edited ---\n");
 
-      db_remove_merch(db, current_name);
-      db_add_merch(db, edited_merch);
+      if (price_changed && db_carts_holding_merch(current_merch) > 0)
+      {
+        printf("--- The new price applies to %d active carts holding the merchandise ---\n", db_carts_holding_merch(current_merch));
+      }
     }
   }
   else
@@ -128,10 +207,11 @@ void ui_edit_merch(webstore_t *db)
 
 void ui_show_stock(webstore_t *db)
 {
-  char *merch_name = ask_question_string("State the name of the merchandise: ");
+  char *merch_name = ask_question_view("State the name of the merchandise: ");
 
   if (db_has_key(db, merch_name))
   {
+    trace_capture_command(COMMAND_SHOW, (command_arg_t[]){{.s = merch_name}});
     merch_t *merch = db_get_merch(db, merch_name);
     int size = db_merch_locations_size(merch);
 
@@ -153,7 +233,7 @@ void ui_show_stock(webstore_t *db)
 
 void ui_replenish(webstore_t *db)
 {
-  char *merch_name = ask_question_string("State the name of the merchandise: ");
+  char *merch_name = ask_question_view("State the name of the merchandise: ");
 
   if (db_has_key(db, merch_name))
   {
@@ -185,20 +265,30 @@ void ui_replenish(webstore_t *db)
 
 void ui_add_new_location(webstore_t *db, merch_t *merch)
 {
+  char free_shelf[4];
+
+  if (db_first_free_shelf(db, free_shelf))
+  {
+    printf("The first free shelf is %s.\n", free_shelf);
+  }
+
   char *shelf_name = ask_question_shelf("State the name of the new shelf: ");
   int new_quantity = ask_question_int("State the quantity of the shelf: ");
 
   if (!is_positive(new_quantity))
   {
     printf("The quantity must be positive. Try again from the beginning.\n");
+    free(shelf_name);
   }
   else if (db_location_name_exists_in_webstore(db, shelf_name))
   {
-    printf("There is already a merchandise that does have the given shelf name. Try again from the beginning.\n");
+    printf("The shelf is already used by the merchandise '%s'. Try again from the beginning.\n", db_get_name(db_get_merch_on_shelf(db, shelf_name)));
+    free(shelf_name);
   }
   else
   {
-    db_add_location_to_merch(merch, shelf_name, new_quantity);
+    trace_capture_command(COMMAND_REPLENISH, (command_arg_t[]){{.s = db_get_name(merch)}, {.s = shelf_name}, {.i = new_quantity}});
+    db_add_location_to_merch(db, merch, shelf_name, new_quantity);
     printf("--- The new location(shelf) has been successfully added to the merchandise. ---\n");
   }
 }
@@ -212,20 +302,32 @@ void ui_edit_location(webstore_t *db, merch_t *merch)
   {
     printf("The quantity must be positive. Try again from the beginning.\n");
   }
-  else if (db_edit_location_quantity(merch, shelf_name, new_quantity))
-  {
-    printf("--- Quantity successfully changed. ---\n");
-  }
   else
   {
-    printf("---A shelf with the given name does not exist. Try again from the beginning.---\n");
+    trace_capture_command(COMMAND_REPLENISH, (command_arg_t[]){{.s = db_get_name(merch)}, {.s = shelf_name}, {.i = new_quantity}});
+
+    if (db_edit_location_quantity(db, merch, shelf_name, new_quantity))
+    {
+      printf("--- Quantity successfully changed. ---\n");
+    }
+    else
+    {
+      printf("---A shelf with the given name does not exist. Try again from the beginning.---\n");
+    }
   }
+  free(shelf_name);
 }
 
 void ui_create_cart(webstore_t *db)
 {
+  trace_capture_command(COMMAND_CART, NULL);
   shopping_carts_t *cart = db_create_cart();
-  db_add_cart(db, cart);
+  if (!db_add_cart(db, cart))
+  {
+    db_destroy_a_cart(cart);
+    printf("--- There is no room for another cart. Try again from the beginning. ---\n");
+    return;
+  }
   printf("--- The cart has been successfully added. ---\n");
 }
 
@@ -245,6 +347,7 @@ void ui_remove_cart(webstore_t *db)
     db_display_cart_ids(db);
 
     int id_choice = ask_question_int("State the cart id you wish to remove: ");
+    trace_capture_command(COMMAND_REMOVE_CART, (command_arg_t[]){{.i = id_choice}});
 
     bool result = db_remove_cart(db, id_choice);
 
@@ -266,7 +369,7 @@ void ui_add_to_cart(webstore_t *db)
   if (carts_size == 0)
   {
     printf("--- There are no active shopping carts in the Webstore. Try again from the beginning. ---\n");
-    ui_event_loop(db);
+    return;
   }
 
   printf("There are %d active carts in the Webstore.\n", carts_size);
@@ -282,7 +385,7 @@ void ui_add_to_cart(webstore_t *db)
   }
   else
   {
-    char *merch_name = ask_question_string("State the name of the merch you wish to add to cart: ");
+    char *merch_name = ask_question_view("State the name of the merch you wish to add to cart: ");
     bool merch_exists = db_has_key(db, merch_name);
 
     if (!merch_exists)
@@ -292,30 +395,19 @@ void ui_add_to_cart(webstore_t *db)
     else
     {
       merch_t *merch = db_get_merch_from_name(db, merch_name);
-
-      int quantity_in_locations = db_lookup_merch_quantity_in_locations(merch);
-      int quantity_in_carts = db_lookup_merch_quantity_in_carts(db, merch_name);
-
-      int valid_quantity = quantity_in_locations - quantity_in_carts;
+      int valid_quantity = db_lookup_valid_quantity(db, merch);
 
       printf("There %d units available.\n", valid_quantity);
 
       int quantity_choice = ask_question_int("State how many units to add to the cart: ");
 
-      if (quantity_choice > valid_quantity)
+      trace_capture_command(COMMAND_ADD_TO_CART, (command_arg_t[]){{.i = id_choice}, {.s = db_get_name(merch)}, {.i = quantity_choice}});
+
+      // Another session may reserve units while the question is asked, so the reservation checks again
+      if (quantity_choice > valid_quantity || !db_try_reserve(merch, cart, quantity_choice))
       {
         printf("--- The input exceeds available units. Try again from the beginning.---\n");
       }
-      else if (db_cart_has_key(cart, merch_name))
-      {
-        db_update_merch_quantity_in_cart(cart, merch_name, quantity_choice);
-      }
-      else
-      {
-        {
-          db_add_merch_to_cart(cart, merch_name, quantity_choice);
-        }
-      }
     }
   }
 }
@@ -327,7 +419,7 @@ void ui_remove_from_cart(webstore_t *db)
   if (carts_size == 0)
   {
     printf("--- There are no active shopping carts in the Webstore. Try again from the beginning. ---\n");
-    ui_event_loop(db);
+    return;
   }
 
   printf("There are %d active carts in the Webstore.\n", carts_size);
@@ -343,7 +435,7 @@ void ui_remove_from_cart(webstore_t *db)
   }
   else
   {
-    char *merch_name = ask_question_string("State the name of the merch you wish to remove from the cart: ");
+    char *merch_name = ask_question_view("State the name of the merch you wish to remove from the cart: ");
     bool merch_exists = db_has_key(db, merch_name);
 
     if (!merch_exists)
@@ -352,13 +444,16 @@ void ui_remove_from_cart(webstore_t *db)
     }
     else
     {
-      if (!db_cart_has_key(cart, merch_name))
+      merch_t *merch = db_get_merch_from_name(db, merch_name);
+
+      if (!db_cart_has_key(cart, merch))
       {
         printf("--- The cart does not contain a merchandise with given name. Try again from the beginning. -- \n");
       }
       else
       {
-        db_remove_merch_from_cart(cart, merch_name);
+        trace_capture_command(COMMAND_REMOVE_FROM_CART, (command_arg_t[]){{.i = id_choice}, {.s = db_get_name(merch)}});
+        db_remove_merch_from_cart(cart, merch);
         printf("--- The merchandise have been successfully removed from the cart ---");
       }
     }
@@ -372,7 +467,7 @@ void ui_calculate_cost(webstore_t *db)
   if (carts_size == 0)
   {
     printf("--- There are no active shopping carts in the Webstore. Try again from the beginning. ---\n");
-    ui_event_loop(db);
+    return;
   }
 
   printf("There are %d active carts in the Webstore.\n", carts_size);
@@ -388,6 +483,7 @@ void ui_calculate_cost(webstore_t *db)
   }
   else
   {
+    trace_capture_command(COMMAND_COST, (command_arg_t[]){{.i = id_choice}});
     int cost = db_calculate_cost(db, cart);
     printf("--- The total cost of all merchandises in the shopping cart is: %d\n", cost);
   }
@@ -400,7 +496,7 @@ void ui_checkout(webstore_t *db)
   if (carts_size == 0)
   {
     printf("--- There are no active shopping carts in the Webstore. Try again from the beginning. ---\n");
-    ui_event_loop(db);
+    return;
   }
 
   printf("There are %d active carts in the Webstore.\n", carts_size);
@@ -413,13 +509,68 @@ void ui_checkout(webstore_t *db)
   if (cart == NULL)
   {
     printf("--- There is not a cart with the given id. Try again from the beginning. ---\n");
+    return;
   }
-  else
+
+  trace_capture_command(COMMAND_CHECKOUT, (command_arg_t[]){{.i = id_choice}});
+  if (db_checkout(db, cart))
   {
-    db_checkout(db, cart);
     db_remove_cart(db, id_choice);
     printf("--- Transactiong successfull. ---\n");
   }
+  else
+  {
+    printf("--- There are not enough units in stock to check out the cart. ---\n");
+  }
+}
+
+void ui_save_snapshot(webstore_t *db)
+{
+  snapshot_status_t status = db_snapshot_status(db);
+
+  if (status.state == SNAPSHOT_RUNNING)
+  {
+    printf("--- A snapshot is being saved, %zu of %zu merchandises are written. ---\n",
+           status.merchs_written, status.merch_count);
+    return;
+  }
+
+  if (status.state == SNAPSHOT_FAILED)
+  {
+    printf("--- The last snapshot failed, the changes are kept in %s. ---\n", WEBSTORE_LOG);
+  }
+
+  trace_capture_command(COMMAND_BGSAVE, (command_arg_t[]){{.s = WEBSTORE_SNAPSHOT}});
+  if (db_save_snapshot_background(db, WEBSTORE_SNAPSHOT))
+  {
+    printf("--- The snapshot is saved in the background. ---\n");
+  }
+  else
+  {
+    printf("--- The snapshot could not be started. ---\n");
+  }
+}
+
+void ui_show_stats(webstore_t *db)
+{
+  trace_capture_command(COMMAND_STATS, NULL);
+  printf("--- Latencies of the backend operations since the start, in nanoseconds: ---\n");
+  fflush(stdout);
+
+  outbuf_t *out = outbuf_create(STDOUT_FILENO, SCRIPT_BUFFER_SIZE);
+  metrics_write(out);
+  outbuf_destroy(out);
+}
+
+void ui_show_memory(webstore_t *db)
+{
+  trace_capture_command(COMMAND_MEMORY, NULL);
+  printf("--- Heap memory of the webstore by kind of structure, in bytes: ---\n");
+  fflush(stdout);
+
+  outbuf_t *out = outbuf_create(STDOUT_FILENO, SCRIPT_BUFFER_SIZE);
+  memstats_write(out);
+  outbuf_destroy(out);
 }
 
 ///
@@ -427,6 +578,11 @@ void ui_checkout(webstore_t *db)
 ///
 void ui_destroy_webstore(webstore_t *db)
 {
+  // The next start loads the snapshot instead of replaying the whole log
+  if (!db_save_snapshot(db, WEBSTORE_SNAPSHOT))
+  {
+    printf("--- The snapshot could not be saved, the changes are kept in %s. ---\n", WEBSTORE_LOG);
+  }
   db_destroy_webstore(db);
   printf("--- The Webstore is now shut down. ---\n");
   exit(0); // utan den terminerar inte programmet
@@ -434,68 +590,162 @@ void ui_destroy_webstore(webstore_t *db)
 
 static void ui_event_loop(webstore_t *db)
 {
+  build_menu();
+
   while (true)
   {
     print_menu();
     int choice = menu_choice();
 
-    if (choice == 1)
-    {
-      ui_create_merch(db);
-    }
-    else if (choice == 2)
-    {
-      ui_list_merchs(db);
-    }
-    else if (choice == 3)
-    {
-      ui_remove_merch(db);
-    }
-    else if (choice == 4)
-    {
-      ui_edit_merch(db);
-    }
-    else if (choice == 5)
-    {
-      ui_show_stock(db);
-    }
-    else if (choice == 6)
-    {
-      ui_replenish(db);
-    }
-    else if (choice == 7)
-    {
-      ui_create_cart(db);
-    }
-    else if (choice == 8)
-    {
-      ui_remove_cart(db);
-    }
-    else if (choice == 9)
-    {
-      ui_add_to_cart(db);
-    }
-    else if (choice == 10)
-    {
-      ui_remove_from_cart(db);
-    }
-    else if (choice == 11)
-    {
-      ui_calculate_cost(db);
-    }
-    else if (choice == 12)
-    {
-      ui_checkout(db);
-    }
-    else if (choice == 13)
+    if (choice == menu_size + 1)
     {
       ui_destroy_webstore(db);
     }
+    ui_handlers[menu_commands[choice - 1]](db);
+  }
+}
+
+/// Saves a snapshot of a webstore that is not run interactively, and frees it
+static void shut_down(webstore_t *db)
+{
+  if (!db_save_snapshot(db, WEBSTORE_SNAPSHOT))
+  {
+    fprintf(stderr, "db: the snapshot could not be saved, the changes are kept in %s\n", WEBSTORE_LOG);
+  }
+  db_destroy_webstore(db);
+}
+
+/// Runs the commands of a script, "-" for stdin, and answers on stdout, see command.h
+static int run_script(webstore_t *db, const char *path)
+{
+  int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    fprintf(stderr, "db: %s could not be opened\n", path);
+    db_destroy_webstore(db);
+    return 2;
+  }
+
+  outbuf_t *out = outbuf_create(STDOUT_FILENO, SCRIPT_BUFFER_SIZE);
+  size_t failed = command_run_script(db, fd, out);
+  outbuf_destroy(out);
+
+  if (fd != STDIN_FILENO)
+  {
+    close(fd);
   }
+  shut_down(db);
+  return failed > 0 ? 1 : 0;
 }
 
-int main(void)
+// A lock-free atomic, so the handler may store to it
+static atomic_int stop_serving = 0;
+
+static void handle_stop(int signal_number)
 {
-  webstore_t *db = db_create_webstore();
+  atomic_store(&stop_serving, 1);
+}
+
+/// Serves the webstore until SIGINT or SIGTERM, see server.h
+static int serve(webstore_t *db, const char *address)
+{
+  signal(SIGINT, handle_stop);
+  signal(SIGTERM, handle_stop);
+
+  if (!server_run(db, address, &stop_serving))
+  {
+    fprintf(stderr, "db: could not listen on %s\n", address);
+    db_destroy_webstore(db);
+    return 2;
+  }
+  shut_down(db);
+  return 0;
+}
+
+static trace_t *capture = NULL;
+
+static void stop_capture(void)
+{
+  trace_capture(NULL);
+  if (!trace_close(capture))
+  {
+    fprintf(stderr, "db: the trace could not be written\n");
+  }
+}
+
+/// Captures every command from now on to a trace, see trace.h. The webstore the commands start
+/// from is saved beside the trace, as PATH.snapshot, so a replay starts from the same webstore.
+static bool start_capture(webstore_t *db, const char *path)
+{
+  char snapshot[strlen(path) + sizeof(".snapshot")];
+  snprintf(snapshot, sizeof(snapshot), "%s.snapshot", path);
+
+  if (!db_save_snapshot(db, snapshot) || (capture = trace_create(path)) == NULL)
+  {
+    fprintf(stderr, "db: %s could not be created\n", path);
+    return false;
+  }
+  trace_capture(capture);
+  atexit(stop_capture); // the menu quits with exit
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  const char *program = argv[0];
+  const char *capture_path = NULL;
+  const char *stats_path = NULL;
+  const char *cart_ttl = NULL;
+
+  // The options that go with any mode come first
+  while (argc >= 3 && (strcmp(argv[1], "--capture") == 0 || strcmp(argv[1], "--stats") == 0 ||
+                       strcmp(argv[1], "--cart-ttl") == 0))
+  {
+    *(strcmp(argv[1], "--capture") == 0 ? &capture_path : strcmp(argv[1], "--stats") == 0 ? &stats_path : &cart_ttl) = argv[2];
+    argc -= 2;
+    argv += 2;
+  }
+  bool script = argc == 3 && strcmp(argv[1], "--script") == 0;
+  bool server = argc == 3 && strcmp(argv[1], "--serve") == 0;
+  char *ttl_end = NULL;
+  long ttl_seconds = cart_ttl != NULL ? strtol(cart_ttl, &ttl_end, 10) : 0;
+  // Carts are only expired while serving, the server checks them between commands
+  if ((argc != 1 && !script && !server) || (cart_ttl != NULL && (!server || *ttl_end != '\0' || ttl_seconds <= 0)))
+  {
+    fprintf(stderr, "usage: %s [--capture TRACE] [--stats FILE] [--script FILE|- | [--cart-ttl SECONDS] --serve unix:PATH|[HOST:]PORT]\n", program);
+    return 2;
+  }
+  if (stats_path != NULL)
+  {
+    // Replaced every STATS_INTERVAL_MS for a monitor to read, and a last time when the process exits
+    metrics_dump_start(stats_path, STATS_INTERVAL_MS);
+    atexit(metrics_dump_stop);
+  }
+
+  webstore_t *db = db_open_webstore(WEBSTORE_SNAPSHOT, WEBSTORE_LOG, WEBSTORE_LOG_LATENCY_MS);
+  if (db == NULL)
+  {
+    // Starting empty would overwrite the snapshot with nothing when the webstore is saved
+    fprintf(stderr, "%s: the webstore could not be opened, %s and %s are left as they are\n", program, WEBSTORE_SNAPSHOT, WEBSTORE_LOG);
+    return 2;
+  }
+  if (capture_path != NULL && !start_capture(db, capture_path))
+  {
+    db_destroy_webstore(db);
+    return 2;
+  }
+  if (ttl_seconds > 0)
+  {
+    db_set_cart_ttl(db, (uint64_t)ttl_seconds * 1000, db_now_ms());
+  }
+
+  if (script)
+  {
+    return run_script(db, argv[2]);
+  }
+  if (server)
+  {
+    return serve(db, argv[2]);
+  }
   ui_event_loop(db);
-}
\ No newline at end of file
+}
@@ -13,6 +13,10 @@
 /// @param db The webstore
 void ui_create_merch(webstore_t *db);
 
+/// @brief Adds the merchandise of a CSV or TSV file to the Webstore, see import.h
+/// @param db The webstore
+void ui_import_merchs(webstore_t *db);
+
 /// @brief Lists the merchandises in the Webstore
 /// @param db The webstore
 void ui_list_merchs(webstore_t *db);
@@ -25,6 +29,10 @@ void ui_remove_merch(webstore_t *db);
 /// @param db The webstore
 void ui_edit_merch(webstore_t *db);
 
+/// @brief Shows the locations of a merchandise
+/// @param db The webstore
+void ui_show_stock(webstore_t *db);
+
 /// @brief Propmpts the user to either add a new location to a merchandise or edit an existing location of a merchandise
 /// @param db The Webstore
 void ui_replenish(webstore_t *db);
@@ -55,6 +63,26 @@ void ui_add_to_cart(webstore_t *db);
 /// @param db The webstore
 void ui_remove_from_cart(webstore_t *db);
 
+/// @brief Shows the total cost of a shopping cart
+/// @param db The webstore
+void ui_calculate_cost(webstore_t *db);
+
+/// @brief Checks out a shopping cart and removes it
+/// @param db The webstore
+void ui_checkout(webstore_t *db);
+
+/// @brief Starts saving a snapshot in the background, or shows how far the running one has come
+/// @param db The webstore
+void ui_save_snapshot(webstore_t *db);
+
+/// @brief Shows the count and latency percentiles of every backend operation, see metrics.h
+/// @param db The webstore
+void ui_show_stats(webstore_t *db);
+
+/// @brief Shows the allocations, live and peak bytes of every kind of structure, see memstats.h
+/// @param db The webstore
+void ui_show_memory(webstore_t *db);
+
 
 //
 //
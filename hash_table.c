@@ -5,6 +5,8 @@
 #include "hash_table.h"
 #include "linked_list.h"
 #include "iterator.h"
+#include "span.h"
+#include "memstats.h"
 
 #define DEFAULT_INITIAL_CAPACITY 17
 #define DEFAULT_LOAD_FACTOR 0.75
@@ -18,6 +20,7 @@ struct entry
 {
     elem_t key;    // holds the key
     elem_t value;  // holds the value
+    int hash;      // the hash of the key, so chains are walked and resized without rehashing
     entry_t* next; // points to the next entry (possibly NULL)
 };
 
@@ -30,36 +33,34 @@ struct hash_table
     ioopm_eq_function key_eq;           // aux function that compares key equality
     ioopm_eq_function value_eq;         // aux function that compares value equality
     ioopm_hash_table_hash_key hash_key; // aux function that will hash a key from the hash table
+    memstats_category_t account;        // the category the struct is counted in, the buckets and entries in the two after it
 };
 
 typedef struct lookup lookup_t;
 
-/// Used in has_key and has_value functions.
+/// Used in the has_value function.
 struct lookup
 {
     const ioopm_hash_table_t* ht; // the hash table, so that we can access aux functions
     elem_t element;               // the element to look for
 };
 
-/// @brief gets all the entries in ht
-/// @param ht the hash table to get all the entries from
-/// @return list of all entries
-static ioopm_list_t* hash_table_entries(const ioopm_hash_table_t* ht);
-
 static int default_hash_key(elem_t key)
 {
     return key.i;
 }
 
-static entry_t* entry_create(elem_t key, elem_t value, entry_t* next)
+static entry_t* entry_create(const ioopm_hash_table_t* ht, elem_t key, elem_t value, int hash, entry_t* next)
 {
     entry_t* entry = calloc(1, sizeof(entry_t));
-    *entry = (entry_t){ .key = key, .value = value, .next = next };
+    memstats_alloc(ht->account + 2, sizeof(entry_t));
+    *entry = (entry_t){ .key = key, .value = value, .hash = hash, .next = next };
     return entry;
 }
 
-static void entry_destroy(entry_t* entry)
+static void entry_destroy(const ioopm_hash_table_t* ht, entry_t* entry)
 {
+    memstats_free(ht->account + 2, sizeof(entry_t));
     free(entry);
 }
 
@@ -68,47 +69,52 @@ static bool should_resize(const ioopm_hash_table_t* ht)
     return ht->count >= ht->capacity * ht->load_factor;
 }
 
-static void resize(ioopm_hash_table_t* ht, size_t new_capacity)
+static entry_t* get_bucket_from_hash(const ioopm_hash_table_t* ht, int hash)
 {
-    ioopm_list_t*          entries = NULL;
-    ioopm_list_iterator_t* iter    = NULL;
+    return &ht->buckets[(unsigned int)hash % ht->capacity];
+}
 
-    if (ht->buckets != NULL)
+/// Links an entry into its bucket, keeping the chain sorted by hash
+static void link_entry(ioopm_hash_table_t* ht, entry_t* entry)
+{
+    entry_t* current = get_bucket_from_hash(ht, entry->hash);
+    while (current->next != NULL && current->next->hash < entry->hash)
     {
-        entries = hash_table_entries(ht);
-        iter    = ioopm_list_iterator(entries);
-
-        // Free previous dummy entries
-        free(ht->buckets);
+        current = current->next;
     }
+    entry->next   = current->next;
+    current->next = entry;
+}
+
+static void resize(ioopm_hash_table_t* ht, size_t new_capacity)
+{
+    SPAN_BEGIN(span, "ht_resize");
+    entry_t* old_buckets  = ht->buckets;
+    size_t   old_capacity = ht->capacity;
 
+    // The zeroed buckets are the dummy entries
     ht->capacity = new_capacity;
     ht->buckets  = calloc(ht->capacity, sizeof(entry_t));
-    
-    // Create all dummy entries
-    for (size_t i = 0; i < ht->capacity; i++)
-    {
-        entry_t* entry = entry_create(ptr_elem(NULL), ptr_elem(NULL), NULL);
-        ht->buckets[i] = *entry;
-        entry_destroy(entry);
-    }
+    memstats_alloc(ht->account + 1, ht->capacity * sizeof(entry_t));
 
-    if (iter != NULL)
+    // Move the entries over, their hashes are stored so nothing is rehashed
+    for (size_t i = 0; i < old_capacity && old_buckets != NULL; i++)
     {
-        // Reset count as it's going to increase
-        // with each call to ioopm_hash_table_insert
-        ht->count = 0;
+        entry_t* current = old_buckets[i].next;
 
-        while (ioopm_iterator_has_next(iter))
+        while (current)
         {
-            entry_t* entry = ioopm_iterator_next(iter).p;
-            ioopm_hash_table_insert(ht, entry->key, entry->value);
-            entry_destroy(entry);
+            entry_t* next = current->next;
+            link_entry(ht, current);
+            current = next;
         }
-
-        ioopm_linked_list_destroy(entries);
-        ioopm_iterator_destroy(iter);
     }
+    if (old_buckets != NULL)
+    {
+        memstats_free(ht->account + 1, old_capacity * sizeof(entry_t));
+    }
+    free(old_buckets);
+    SPAN_END(span);
 }
 
 ioopm_hash_table_t* ioopm_hash_table_create(ioopm_eq_function key_eq, ioopm_eq_function value_eq, ioopm_hash_table_hash_key hash_key)
@@ -119,6 +125,8 @@ ioopm_hash_table_t* ioopm_hash_table_create(ioopm_eq_function key_eq, ioopm_eq_f
 ioopm_hash_table_t* ioopm_hash_table_create_complex(ioopm_eq_function key_eq, ioopm_eq_function value_eq, ioopm_hash_table_hash_key hash_key, size_t initial_capacity, double load_factor)
 {
     ioopm_hash_table_t* ht = calloc(1, sizeof(ioopm_hash_table_t));
+    ht->account = MEMSTATS_HASH_TABLES;
+    memstats_alloc(ht->account, sizeof(ioopm_hash_table_t));
     ht->load_factor = load_factor;
     resize(ht, initial_capacity);
 
@@ -132,22 +140,30 @@ ioopm_hash_table_t* ioopm_hash_table_create_complex(ioopm_eq_function key_eq, io
 void ioopm_hash_table_destroy(ioopm_hash_table_t* ht)
 {
     ioopm_hash_table_clear(ht);
+    memstats_free(ht->account + 1, ht->capacity * sizeof(entry_t));
+    memstats_free(ht->account, sizeof(ioopm_hash_table_t));
     free(ht->buckets);
     free(ht);
 }
 
-static entry_t* get_bucket_from_key(const ioopm_hash_table_t* ht, elem_t key)
+void ioopm_hash_table_account_to(ioopm_hash_table_t* ht, memstats_category_t account)
 {
-    ioopm_hash_table_t* ht_non_const = (ioopm_hash_table_t*)ht;
-    entry_t* buckets = (ht_non_const)->buckets;
-    int hash = ht->hash_key(key);
-    return &(buckets[hash % ht->capacity]);
+    memstats_move(ht->account, account, 1, sizeof(ioopm_hash_table_t));
+    memstats_move(ht->account + 1, account + 1, 1, ht->capacity * sizeof(entry_t));
+    memstats_move(ht->account + 2, account + 2, ht->count, ht->count * sizeof(entry_t));
+    ht->account = account;
 }
 
-static entry_t* find_previous_entry_for_key(const ioopm_hash_table_t* ht, entry_t* current, elem_t key)
+static entry_t* find_previous_entry_for_key(const ioopm_hash_table_t* ht, int hash, elem_t key)
 {
-    int hash = ht->hash_key(key);
-    while (current->next != NULL && ht->hash_key(current->next->key) < hash)
+    entry_t* current = get_bucket_from_hash(ht, hash);
+
+    while (current->next != NULL && current->next->hash < hash)
+    {
+        current = current->next;
+    }
+    /// Keys with equal hashes are next to each other, skip past the ones that are not key
+    while (current->next != NULL && current->next->hash == hash && !ht->key_eq(current->next->key, key))
     {
         current = current->next;
     }
@@ -155,9 +171,14 @@ static entry_t* find_previous_entry_for_key(const ioopm_hash_table_t* ht, entry_
 }
 
 void ioopm_hash_table_insert(ioopm_hash_table_t* ht, elem_t key, elem_t value)
+{
+    ioopm_hash_table_insert_hashed(ht, ht->hash_key(key), key, value);
+}
+
+void ioopm_hash_table_insert_hashed(ioopm_hash_table_t* ht, int hash, elem_t key, elem_t value)
 {
     /// Search for an existing entry for a key
-    entry_t* entry = find_previous_entry_for_key(ht, get_bucket_from_key(ht, key), key);
+    entry_t* entry = find_previous_entry_for_key(ht, hash, key);
     entry_t* next  = entry->next;
 
     /// Check if the next entry should be updated or not
@@ -167,7 +188,7 @@ void ioopm_hash_table_insert(ioopm_hash_table_t* ht, elem_t key, elem_t value)
     }
     else
     {
-        entry->next = entry_create(key, value, next);
+        entry->next = entry_create(ht, key, value, hash, next);
         ht->count++;
 
         if (should_resize(ht))
@@ -177,10 +198,18 @@ void ioopm_hash_table_insert(ioopm_hash_table_t* ht, elem_t key, elem_t value)
     }
 }
 
+void ioopm_hash_table_reserve(ioopm_hash_table_t* ht, size_t count)
+{
+    if (count >= ht->capacity * ht->load_factor)
+    {
+        resize(ht, (size_t)(count / ht->load_factor) + 1);
+    }
+}
+
 bool ioopm_hash_table_lookup(const ioopm_hash_table_t* ht, elem_t key, elem_t* result)
 {
     /// Find the previous entry for key
-    entry_t* entry = find_previous_entry_for_key(ht, get_bucket_from_key(ht, key), key);
+    entry_t* entry = find_previous_entry_for_key(ht, ht->hash_key(key), key);
     entry_t* next  = entry->next;
 
     bool key_found = next != NULL && ht->key_eq(next->key, key);
@@ -201,7 +230,7 @@ bool ioopm_hash_table_lookup(const ioopm_hash_table_t* ht, elem_t key, elem_t* r
 
 bool ioopm_hash_table_remove(ioopm_hash_table_t* ht, elem_t key, elem_t* result)
 {
-    entry_t* entry = find_previous_entry_for_key(ht, get_bucket_from_key(ht, key), key);
+    entry_t* entry = find_previous_entry_for_key(ht, ht->hash_key(key), key);
     entry_t* next  = entry->next;
 
     if (next != NULL && ht->key_eq(next->key, key))
@@ -215,7 +244,7 @@ bool ioopm_hash_table_remove(ioopm_hash_table_t* ht, elem_t key, elem_t* result)
         {
             errno = EPERM;
         }
-        entry_destroy(next);
+        entry_destroy(ht, next);
         ht->count--;
         return true;
     }
@@ -245,30 +274,12 @@ void ioopm_hash_table_clear(ioopm_hash_table_t* ht)
         {
             entry_t* tmp = current;
             current = current->next;
-            entry_destroy(tmp);
+            entry_destroy(ht, tmp);
         }
     }
     ht->count = 0;
 }
 
-static ioopm_list_t* hash_table_entries(const ioopm_hash_table_t* ht)
-{
-    ioopm_list_t* list = ioopm_linked_list_create(ioopm_compare_ptr_elems);
-
-    for (int i = 0; i < ht->capacity; i++)
-    {
-        entry_t* current = (&ht->buckets[i])->next;
-
-        while (current)
-        {
-            ioopm_linked_list_append(list, ptr_elem(current));
-            current = current->next;
-        }
-    }
-
-    return list;
-}
-
 ioopm_list_t* ioopm_hash_table_keys(const ioopm_hash_table_t* ht)
 {
     ioopm_list_t* list = ioopm_linked_list_create(ht->key_eq);
@@ -305,16 +316,11 @@ ioopm_list_t* ioopm_hash_table_values(const ioopm_hash_table_t* ht)
     return list;
 }
 
-static bool key_equal(elem_t key, elem_t value_ignored, void* lookup_ptr)
-{
-    lookup_t* lookup = (lookup_t*)lookup_ptr;
-    return lookup->ht->key_eq(key, lookup->element);
-}
-
 bool ioopm_hash_table_has_key(const ioopm_hash_table_t* ht, elem_t key)
 {
-    lookup_t lookup = (lookup_t){ .ht = ht, .element = key };
-    return ioopm_hash_table_any(ht, (ioopm_predicate)key_equal, &lookup);
+    /// Only the bucket of the key is searched, not the whole table
+    entry_t* next = find_previous_entry_for_key(ht, ht->hash_key(key), key)->next;
+    return next != NULL && ht->key_eq(next->key, key);
 }
 
 static bool value_equal(elem_t key_ignored, elem_t value, void* lookup_ptr)
@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include "linked_list.h"
+#include "memstats.h"
 
 /**
  * @file hash_table.h
@@ -42,12 +43,31 @@ ioopm_hash_table_t* ioopm_hash_table_create_complex(ioopm_eq_function key_eq, io
 /// @param ht a hash table to be deleted
 void ioopm_hash_table_destroy(ioopm_hash_table_t* ht);
 
+/// @brief Count the memory of hash table ht in other categories of memstats.h, together with
+/// what it has allocated so far
+/// @param ht hash table operated upon
+/// @param account the category of its struct, its buckets and entries are counted in the two after it
+void ioopm_hash_table_account_to(ioopm_hash_table_t* ht, memstats_category_t account);
+
 /// @brief Add key => value entry in hash table ht
 /// @param ht hash table operated upon
 /// @param key key to insert
 /// @param value value to insert
 void ioopm_hash_table_insert(ioopm_hash_table_t* ht, elem_t key, elem_t value);
 
+/// @brief add key => value entry in hash table ht, where the hash of key is already known,
+/// for example because it was stored together with the key
+/// @param ht hash table operated upon
+/// @param hash the hash of key, the same as the hash table's hash function gives
+/// @param key key to insert
+/// @param value value to insert
+void ioopm_hash_table_insert_hashed(ioopm_hash_table_t* ht, int hash, elem_t key, elem_t value);
+
+/// @brief grows hash table ht so count entries fit without a resize, for example before a bulk insert
+/// @param ht hash table operated upon
+/// @param count the number of entries ht will hold
+void ioopm_hash_table_reserve(ioopm_hash_table_t* ht, size_t count);
+
 /// @brief Lookup value for key in hash table ht
 /// @exception EPERM if result is NULL
 /// @param ht hash table operated upon
@@ -0,0 +1,422 @@
+#define _POSIX_C_SOURCE 200809L
+#include <time.h>
+#include <stddef.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "import.h"
+
+/**
+ * @file import.c
+ * @author Erdem Garip
+ * @date 18 Oct 2026
+ * @brief Bulk import of merchandise from CSV or TSV files
+ */
+
+#define IMPORT_MAX_FIELDS 5
+#define IMPORT_ROWS_INITIAL_CAPACITY 1024
+
+typedef struct import_field import_field_t;
+typedef struct import_row import_row_t;
+typedef struct import_chunk import_chunk_t;
+
+/// A field of a line, still in the mapped file
+struct import_field
+{
+  const char *start;
+  size_t length;
+  bool quoted; // quotes inside are still doubled
+};
+
+/// A row that passed the checks that need no webstore
+struct import_row
+{
+  char *name;
+  char *desc;
+  int price;
+  int quantity; // 0 if the row has no shelf
+  char shelf[4];
+  size_t line;  // the line in the chunk, counted from 1
+};
+
+/// The lines parsed by one thread
+struct import_chunk
+{
+  pthread_t thread;
+  const char *begin;
+  const char *end;
+  char separator;
+  import_row_t *rows;
+  size_t row_count;
+  size_t row_capacity;
+  size_t lines;
+  size_t rows_read;            // non-empty lines
+  size_t rejected;
+  size_t first_rejected_line;  // counted from the start of the chunk, 0 if none was
+};
+
+static double now_seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/// Splits a line in fields, returns the number of fields or -1 if the line has more than
+/// max_fields or a quoted field is not closed
+static int split_line(const char *line, const char *line_end, char separator, import_field_t *fields, int max_fields)
+{
+  int count = 0;
+  const char *cursor = line;
+
+  while (true)
+  {
+    if (count == max_fields)
+    {
+      return -1;
+    }
+
+    import_field_t *field = &fields[count++];
+    field->quoted = separator == ',' && cursor < line_end && *cursor == '"';
+
+    if (field->quoted)
+    {
+      field->start = ++cursor;
+      while (cursor < line_end && !(*cursor == '"' && (cursor + 1 == line_end || cursor[1] != '"')))
+      {
+        cursor = cursor + (*cursor == '"' ? 2 : 1);
+      }
+      if (cursor >= line_end)
+      {
+        return -1;
+      }
+      field->length = cursor - field->start;
+      cursor++; // the closing quote
+    }
+    else
+    {
+      field->start = cursor;
+      while (cursor < line_end && *cursor != separator)
+      {
+        cursor++;
+      }
+      field->length = cursor - field->start;
+    }
+
+    if (cursor == line_end)
+    {
+      return count;
+    }
+    if (*cursor != separator)
+    {
+      return -1; // text after a closing quote
+    }
+    cursor++;
+  }
+}
+
+/// A newly allocated copy of a field, without the quotes
+static char *copy_field(import_field_t *field)
+{
+  char *copy = malloc(field->length + 1);
+  size_t length = 0;
+
+  for (size_t i = 0; i < field->length; i++)
+  {
+    copy[length++] = field->start[i];
+    if (field->quoted && field->start[i] == '"')
+    {
+      i++; // "" is one quote
+    }
+  }
+  copy[length] = '\0';
+  return copy;
+}
+
+/// Parses a field of only digits, false if it is empty or does not fit an int
+static bool parse_int(import_field_t *field, int *result)
+{
+  long value = 0;
+
+  if (field->length == 0 || field->quoted)
+  {
+    return false;
+  }
+  for (size_t i = 0; i < field->length; i++)
+  {
+    if (field->start[i] < '0' || field->start[i] > '9')
+    {
+      return false;
+    }
+    value = value * 10 + (field->start[i] - '0');
+    if (value > INT_MAX)
+    {
+      return false;
+    }
+  }
+  *result = (int)value;
+  return true;
+}
+
+/// Checks the fields of a line and fills in row, false if the row is rejected
+static bool parse_row(import_field_t *fields, int count, import_row_t *row)
+{
+  if (count != 3 && count != IMPORT_MAX_FIELDS)
+  {
+    return false;
+  }
+  if (fields[0].length == 0 || !parse_int(&fields[2], &row->price) || !is_positive(row->price))
+  {
+    return false;
+  }
+
+  row->quantity = 0;
+  if (count == IMPORT_MAX_FIELDS && (fields[3].length > 0 || fields[4].length > 0))
+  {
+    if (fields[3].length != 3 || fields[3].quoted)
+    {
+      return false;
+    }
+    memcpy(row->shelf, fields[3].start, 3);
+    row->shelf[3] = '\0';
+
+    if (!is_valid_shelf(row->shelf) || !parse_int(&fields[4], &row->quantity) || !is_positive(row->quantity))
+    {
+      return false;
+    }
+  }
+
+  row->name = copy_field(&fields[0]);
+  if (!is_valid_string(row->name))
+  {
+    free(row->name);
+    return false;
+  }
+  row->desc = copy_field(&fields[1]);
+  return true;
+}
+
+static void reject_line(import_chunk_t *chunk)
+{
+  chunk->rejected++;
+  if (chunk->first_rejected_line == 0)
+  {
+    chunk->first_rejected_line = chunk->lines;
+  }
+}
+
+static void *parse_chunk(void *arg)
+{
+  import_chunk_t *chunk = arg;
+  import_field_t fields[IMPORT_MAX_FIELDS];
+  const char *line = chunk->begin;
+
+  while (line < chunk->end)
+  {
+    const char *newline = memchr(line, '\n', chunk->end - line);
+    const char *line_end = newline != NULL ? newline : chunk->end;
+    const char *next = newline != NULL ? newline + 1 : chunk->end;
+    chunk->lines++;
+
+    if (line_end > line && line_end[-1] == '\r')
+    {
+      line_end--;
+    }
+    if (line_end == line)
+    {
+      line = next;
+      continue;
+    }
+    chunk->rows_read++;
+
+    if (chunk->row_count == chunk->row_capacity)
+    {
+      chunk->row_capacity *= 2;
+      chunk->rows = realloc(chunk->rows, chunk->row_capacity * sizeof(import_row_t));
+    }
+
+    import_row_t *row = &chunk->rows[chunk->row_count];
+    int count = split_line(line, line_end, chunk->separator, fields, IMPORT_MAX_FIELDS);
+
+    if (count > 0 && parse_row(fields, count, row))
+    {
+      row->line = chunk->lines;
+      chunk->row_count++;
+    }
+    else
+    {
+      reject_line(chunk);
+    }
+    line = next;
+  }
+  return NULL;
+}
+
+/// True if the first line of the file is a header
+static bool is_header(const char *data, const char *end, char separator)
+{
+  return end - data >= 5 && strncasecmp(data, "name", 4) == 0 && data[4] == separator;
+}
+
+/// Adds the rows of a chunk to the webstore in order
+static void insert_chunk(webstore_t *db, import_chunk_t *chunk, size_t first_line, import_report_t *report)
+{
+  for (size_t i = 0; i < chunk->row_count; i++)
+  {
+    import_row_t *row = &chunk->rows[i];
+    merch_t *merch = db_get_merch(db, row->name);
+    bool shelf_taken = row->quantity > 0 && db_location_name_exists_in_webstore(db, row->shelf);
+
+    // A row that adds nothing, or only a shelf that is taken, is rejected as a whole
+    if (shelf_taken || (merch != NULL && row->quantity == 0))
+    {
+      free(row->name);
+      free(row->desc);
+      report->rejected++;
+      if (report->first_rejected_line == 0 || first_line + row->line < report->first_rejected_line)
+      {
+        report->first_rejected_line = first_line + row->line;
+      }
+      continue;
+    }
+
+    if (merch == NULL)
+    {
+      merch = db_create_merch(row->name, row->desc, row->price);
+      db_add_merch(db, merch);
+      report->merchs_added++;
+    }
+    else
+    {
+      free(row->name);
+      free(row->desc);
+    }
+
+    if (row->quantity > 0)
+    {
+      db_add_location_to_merch(db, merch, strdup(row->shelf), row->quantity);
+      report->shelves_added++;
+    }
+  }
+}
+
+bool import_merchs(webstore_t *db, const char *path, int threads, import_report_t *report)
+{
+  import_report_t ignored;
+  report = report != NULL ? report : &ignored;
+  *report = (import_report_t){0};
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+  {
+    close(fd);
+    return false;
+  }
+
+  size_t size = (size_t)st.st_size;
+  if (size == 0)
+  {
+    close(fd);
+    return true;
+  }
+
+  char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+  {
+    return false;
+  }
+
+  double start = now_seconds();
+  const char *end = data + size;
+  const char *first_newline = memchr(data, '\n', size);
+  const char *first_line_end = first_newline != NULL ? first_newline : end;
+  char separator = memchr(data, '\t', first_line_end - data) != NULL ? '\t' : ',';
+  const char *begin = data;
+  size_t header_lines = 0;
+
+  if (is_header(data, end, separator))
+  {
+    begin = first_line_end < end ? first_line_end + 1 : end;
+    header_lines = 1;
+  }
+
+  // Chunks end after a newline, so no line is split between threads
+  threads = threads < 1 ? 1 : threads;
+  import_chunk_t *chunks = calloc(threads, sizeof(import_chunk_t));
+  size_t chunk_size = (end - begin) / threads + 1;
+  const char *chunk_begin = begin;
+
+  for (int i = 0; i < threads; i++)
+  {
+    const char *chunk_end = end - chunk_begin > (ptrdiff_t)chunk_size ? chunk_begin + chunk_size : end;
+    const char *newline = chunk_end < end ? memchr(chunk_end, '\n', end - chunk_end) : NULL;
+    chunk_end = newline != NULL ? newline + 1 : end;
+
+    chunks[i] = (import_chunk_t){.begin = chunk_begin, .end = chunk_end, .separator = separator,
+                                 .row_capacity = IMPORT_ROWS_INITIAL_CAPACITY};
+    chunks[i].rows = malloc(chunks[i].row_capacity * sizeof(import_row_t));
+    chunk_begin = chunk_end;
+  }
+
+  // A chunk whose thread could not be started is parsed by this thread
+  bool *started = calloc(threads, sizeof(bool));
+  for (int i = 0; i < threads; i++)
+  {
+    started[i] = pthread_create(&chunks[i].thread, NULL, parse_chunk, &chunks[i]) == 0;
+  }
+  for (int i = 0; i < threads; i++)
+  {
+    if (started[i])
+    {
+      pthread_join(chunks[i].thread, NULL);
+    }
+    else
+    {
+      parse_chunk(&chunks[i]);
+    }
+  }
+
+  size_t parsed = 0;
+  size_t first_line = header_lines;
+  for (int i = 0; i < threads; i++)
+  {
+    report->rows += chunks[i].rows_read;
+    report->rejected += chunks[i].rejected;
+    parsed += chunks[i].row_count;
+
+    if (report->first_rejected_line == 0 && chunks[i].first_rejected_line > 0)
+    {
+      report->first_rejected_line = first_line + chunks[i].first_rejected_line;
+    }
+    first_line += chunks[i].lines;
+  }
+  report->parse_seconds = now_seconds() - start;
+
+  // Presized, so the merch table is not rehashed while the rows are added
+  start = now_seconds();
+  db_reserve_merchs(db, parsed);
+  first_line = header_lines;
+  for (int i = 0; i < threads; i++)
+  {
+    insert_chunk(db, &chunks[i], first_line, report);
+    first_line += chunks[i].lines;
+    free(chunks[i].rows);
+  }
+  report->insert_seconds = now_seconds() - start;
+
+  free(started);
+  free(chunks);
+  munmap(data, size);
+  return true;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "backend.h"
+
+/**
+ * @file import.h
+ * @author Erdem Garip
+ * @date 18 Oct 2026
+ * @brief Bulk import of merchandise from CSV or TSV files
+ *
+ * Every line is a row of name, description, price and optionally shelf and quantity:
+ *
+ *     adidas,"bra skor, storlek 42",100,A01,60
+ *
+ * The separator is a tab if the first line holds one, otherwise a comma. In a CSV file a field
+ * may be quoted, with "" for a quote inside it, but no field spans lines. A first line starting
+ * with the field name "name" is a header and skipped. A merchandise that is already in the
+ * webstore, or earlier in the file, only gets the shelf of the row.
+ *
+ * The file is split in chunks at line ends that are parsed by one thread each, the rows are
+ * then added in file order.
+ */
+
+typedef struct import_report import_report_t;
+
+struct import_report
+{
+  size_t rows;          // the rows in the file, without the header
+  size_t merchs_added;
+  size_t shelves_added;
+  size_t rejected;      // rows with invalid fields, a taken shelf or nothing new
+  size_t first_rejected_line; // the line number of the first rejected row, 0 if none was
+  double parse_seconds;
+  double insert_seconds;
+};
+
+/// @brief Imports the merchandise of a CSV or TSV file into a webstore. A row is rejected if
+/// the name is empty, the price is not positive, the shelf is not a valid shelf name or is
+/// taken by another merchandise, or the quantity of a shelf is not positive.
+/// @param db The webstore
+/// @param path The path of the file
+/// @param threads The number of threads that parse the file, at least 1
+/// @param report Filled in with what was imported, may be NULL
+/// @return False if the file could not be read
+bool import_merchs(webstore_t *db, const char *path, int threads, import_report_t *report);
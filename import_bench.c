@@ -0,0 +1,66 @@
+#define _POSIX_C_SOURCE 200809L
+#include <unistd.h>
+#include "import.h"
+
+/**
+ * @file import_bench.c
+ * @author Erdem Garip
+ * @date 18 Oct 2026
+ * @brief Rows per second of a bulk import of a generated CSV catalog
+ *
+ * Usage: ./importbench [rows] [threads] [csv path]
+ */
+
+#define BENCH_SHELVED_ROWS 2000 // every shelf can not be taken, so only the first rows get one
+
+/// Writes a catalog of rows merchandises, some with quoted descriptions
+static bool write_catalog(const char *path, int rows)
+{
+  FILE *file = fopen(path, "w");
+  if (file == NULL)
+  {
+    return false;
+  }
+
+  fprintf(file, "name,desc,price,shelf,quantity\n");
+  for (int i = 0; i < rows; i++)
+  {
+    if (i < BENCH_SHELVED_ROWS)
+    {
+      fprintf(file, "merch%d,\"a piece, of merchandise\",%d,%c%02d,%d\n", i, 1 + i % 1000, 'A' + i / 100, i % 100, 100);
+    }
+    else
+    {
+      fprintf(file, "merch%d,a piece of merchandise,%d,,\n", i, 1 + i % 1000);
+    }
+  }
+  return fclose(file) == 0;
+}
+
+int main(int argc, char *argv[])
+{
+  int rows = argc > 1 ? atoi(argv[1]) : 10000000;
+  int threads = argc > 2 ? atoi(argv[2]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  char *path = argc > 3 ? argv[3] : "bench_import.csv";
+
+  if (!write_catalog(path, rows))
+  {
+    printf("could not write %s\n", path);
+    return 1;
+  }
+
+  webstore_t *db = db_create_webstore();
+  import_report_t report;
+  import_merchs(db, path, threads, &report);
+  double total = report.parse_seconds + report.insert_seconds;
+
+  printf("rows: %zu, merchs: %zu, shelves: %zu, rejected: %zu, threads: %d\n",
+         report.rows, report.merchs_added, report.shelves_added, report.rejected, threads);
+  printf("parse:  %8.3f s\n", report.parse_seconds);
+  printf("insert: %8.3f s\n", report.insert_seconds);
+  printf("total:  %8.3f s | %12.0f rows/s\n", total, report.rows / total);
+
+  db_destroy_webstore(db);
+  remove(path);
+  return 0;
+}
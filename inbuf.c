@@ -0,0 +1,101 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include "inbuf.h"
+
+/**
+ * @file inbuf.c
+ * @author Erdem Garip
+ * @date 18 Oct 2026
+ * @brief Buffered line input from a file descriptor
+ */
+
+struct inbuf
+{
+  int fd;
+  char *buffer;
+  size_t start;    // the first byte not yet handed out
+  size_t scanned;  // the bytes from start on that are known to hold no line end
+  size_t end;      // the end of the bytes read
+  size_t capacity; // one more than the bytes that are read, so a last line can be terminated
+  bool eof;
+};
+
+inbuf_t *inbuf_create(int fd, size_t capacity)
+{
+  inbuf_t *in = calloc(1, sizeof(inbuf_t));
+  in->fd = fd;
+  in->capacity = capacity > 2 ? capacity : 2;
+  in->buffer = malloc(in->capacity);
+  return in;
+}
+
+/// Reads more input after what is buffered, false at the end of the input
+static bool inbuf_fill(inbuf_t *in)
+{
+  // The bytes handed out are dropped, and the buffer grows only for a line that fills it
+  if (in->start > 0)
+  {
+    memmove(in->buffer, in->buffer + in->start, in->end - in->start);
+    in->end -= in->start;
+    in->start = 0;
+  }
+  if (in->end + 1 == in->capacity)
+  {
+    in->capacity = in->capacity * 2;
+    in->buffer = realloc(in->buffer, in->capacity);
+  }
+
+  ssize_t got;
+  do
+  {
+    got = read(in->fd, in->buffer + in->end, in->capacity - 1 - in->end);
+  } while (got < 0 && errno == EINTR);
+
+  in->eof = got <= 0;
+  in->end += got > 0 ? got : 0;
+  return !in->eof;
+}
+
+char *inbuf_line(inbuf_t *in, size_t *size)
+{
+  char *line_end;
+
+  while ((line_end = memchr(in->buffer + in->start + in->scanned, '\n', in->end - in->start - in->scanned)) == NULL)
+  {
+    in->scanned = in->end - in->start;
+    if (in->eof || !inbuf_fill(in))
+    {
+      if (in->start == in->end)
+      {
+        return NULL;
+      }
+      line_end = in->buffer + in->end; // the last line has no line end, there is room for the NUL
+      break;
+    }
+  }
+
+  char *line = in->buffer + in->start;
+  size_t length = line_end - line;
+  in->start = line_end - in->buffer + (line_end < in->buffer + in->end ? 1 : 0);
+  in->scanned = 0;
+
+  if (length > 0 && line[length - 1] == '\r')
+  {
+    length--;
+  }
+  line[length] = '\0';
+
+  if (size != NULL)
+  {
+    *size = length;
+  }
+  return line;
+}
+
+void inbuf_destroy(inbuf_t *in)
+{
+  free(in->buffer);
+  free(in);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+/**
+ * @file inbuf.h
+ * @author Erdem Garip
+ * @date 18 Oct 2026
+ * @brief Buffered line input from a file descriptor
+ *
+ * Input is read with read in large blocks and split into lines in place, so a line is handed
+ * out without being copied. The line is a view into the buffer: it is valid until the next
+ * line is read, and whoever keeps it copies it. A line longer than the buffer grows the
+ * buffer, so there is no limit on the length of a line.
+ */
+
+typedef struct inbuf inbuf_t;
+
+/// @brief Creates an input buffer
+/// @param fd The file descriptor read from
+/// @param capacity The initial size of the buffer in bytes
+/// @return The buffer
+inbuf_t *inbuf_create(int fd, size_t capacity);
+
+/// @brief Reads the next line
+/// @param in The buffer
+/// @param size Set to the length of the line if it is not NULL
+/// @return The line without its \n or \r\n, NUL terminated and valid until the next line is
+///         read, or NULL at the end of the input. The last line does not need a line end.
+char *inbuf_line(inbuf_t *in, size_t *size);
+
+/// @brief Frees a buffer, the file descriptor is not closed
+/// @param in The buffer
+void inbuf_destroy(inbuf_t *in);
@@ -2,6 +2,7 @@
 #include <errno.h>
 #include "linked_list.h"
 #include "iterator.h"
+#include "memstats.h"
 
 extern int errno;
 
@@ -45,6 +46,7 @@ static bool default_eq(elem_t a, elem_t b)
 ioopm_list_t* ioopm_linked_list_create(ioopm_eq_function eq)
 {
     ioopm_list_t* list = calloc(1, sizeof(ioopm_list_t));
+    memstats_alloc(MEMSTATS_LISTS, sizeof(ioopm_list_t));
     list->eq = eq != NULL ? eq : default_eq;
     return list;
 }
@@ -52,6 +54,7 @@ ioopm_list_t* ioopm_linked_list_create(ioopm_eq_function eq)
 static node_t* node_create(ioopm_list_t* list, elem_t value, node_t* previous, node_t* next)
 {
     node_t* node = calloc(1, sizeof(node_t));
+    memstats_alloc(MEMSTATS_LIST_NODES, sizeof(node_t));
     *node = (node_t) { .value = value, .previous = previous, .next = next };
 
     if (list->first == NULL)
@@ -76,12 +79,14 @@ static node_t* node_create(ioopm_list_t* list, elem_t value, node_t* previous, n
 
 static void node_destroy(node_t* node)
 {
+    memstats_free(MEMSTATS_LIST_NODES, sizeof(node_t));
     free(node);
 }
 
 void ioopm_linked_list_destroy(ioopm_list_t* list)
 {
     ioopm_linked_list_clear(list);
+    memstats_free(MEMSTATS_LISTS, sizeof(ioopm_list_t));
     free(list);
 }
 
@@ -276,6 +281,7 @@ void ioopm_linked_list_apply_to_all(ioopm_list_t* list, ioopm_apply_function fun
 ioopm_list_iterator_t* ioopm_list_iterator(const ioopm_list_t* list)
 {
     ioopm_list_iterator_t* iter = calloc(1, sizeof(ioopm_list_iterator_t));
+    memstats_alloc(MEMSTATS_LIST_ITERATORS, sizeof(ioopm_list_iterator_t));
     *iter = (ioopm_list_iterator_t){ .list = (ioopm_list_t*)list, .current = list->first, .index = 0 };
     return iter;
 }
@@ -328,5 +334,6 @@ elem_t ioopm_iterator_current(const ioopm_list_iterator_t* iter)
 
 void ioopm_iterator_destroy(ioopm_list_iterator_t* iter)
 {
+    memstats_free(MEMSTATS_LIST_ITERATORS, sizeof(ioopm_list_iterator_t));
     free(iter);
 }
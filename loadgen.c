@@ -0,0 +1,384 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <netdb.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/**
+ * @file loadgen.c
+ * @author Erdem Garip
+ * @date 18 Oct 2026
+ * @brief Throughput and latency of a webstore served with db --serve
+ *
+ * Every connection owns a cart and keeps a number of requests in flight, a browse and add to
+ * cart mix on merchandise the load generator adds first. The latency of a request is the time
+ * from it being sent until its answer arrives, so it includes the wait behind the requests
+ * before it on the same connection.
+ *
+ * Usage: ./loadgen unix:PATH|[HOST:]PORT [connections] [requests per connection] [pipeline depth] [threads]
+ */
+
+#define LOADGEN_MERCHS 1000 // named loadgen0 ..., each on its own shelf
+#define LOADGEN_STOCK 1000000000
+#define LOADGEN_BROWSE_PERCENT 80 // the rest add to the cart
+#define LOADGEN_LINE 128
+#define LOADGEN_READ_SIZE (1 << 16)
+
+typedef struct loadgen_conn loadgen_conn_t;
+typedef struct loadgen_thread loadgen_thread_t;
+
+struct loadgen_conn
+{
+  int fd;
+  int cart;
+  int sent;
+  int answered;
+  uint64_t *sent_at; // ring of the send times of the requests in flight
+};
+
+struct loadgen_thread
+{
+  pthread_t thread;
+  loadgen_conn_t *conns;
+  int conn_count;
+  int requests; // per connection
+  int depth;
+  unsigned int seed;
+  uint64_t *latencies; // nanoseconds, requests * conn_count of them once the thread is done
+  size_t latency_count;
+  bool failed;
+};
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/// Connects a blocking socket, -1 if it fails
+static int loadgen_connect(const char *address)
+{
+  if (strncmp(address, "unix:", 5) == 0)
+  {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strncpy(addr.sun_path, address + 5, sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+      close(fd);
+      return -1;
+    }
+    return fd;
+  }
+
+  char host[256] = "127.0.0.1";
+  const char *port = strrchr(address, ':');
+  if (port != NULL && (size_t)(port - address) < sizeof(host))
+  {
+    memcpy(host, address, port - address);
+    host[port - address] = '\0';
+    port++;
+  }
+  else
+  {
+    port = address;
+  }
+
+  struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+  struct addrinfo *addrs;
+  if (getaddrinfo(host, port, &hints, &addrs) != 0)
+  {
+    return -1;
+  }
+
+  int fd = -1;
+  for (struct addrinfo *addr = addrs; addr != NULL && fd < 0; addr = addr->ai_next)
+  {
+    fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+    if (fd >= 0 && connect(fd, addr->ai_addr, addr->ai_addrlen) != 0)
+    {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(addrs);
+
+  int nodelay = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+  return fd;
+}
+
+static bool send_all(int fd, const char *data, size_t size)
+{
+  while (size > 0)
+  {
+    ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+    if (sent <= 0)
+    {
+      return false;
+    }
+    data += sent;
+    size -= sent;
+  }
+  return true;
+}
+
+/// Reads until count answers have arrived, the last one is left in last if it is given
+static bool read_answers(int fd, int count, char *last, size_t last_size)
+{
+  char buffer[LOADGEN_READ_SIZE];
+  size_t line = 0;
+
+  while (count > 0)
+  {
+    ssize_t got = read(fd, buffer, sizeof(buffer));
+    if (got <= 0)
+    {
+      return false;
+    }
+    for (ssize_t i = 0; i < got; i++)
+    {
+      if (last != NULL && line < last_size - 1)
+      {
+        last[line++] = buffer[i];
+      }
+      if (buffer[i] == '\n')
+      {
+        count--;
+        line = count > 0 ? 0 : line;
+      }
+    }
+  }
+
+  if (last != NULL)
+  {
+    last[line] = '\0';
+  }
+  return true;
+}
+
+/// Adds the merchandise, the answers are not checked since it is there from an earlier run
+static bool loadgen_setup(const char *address)
+{
+  int fd = loadgen_connect(address);
+  if (fd < 0)
+  {
+    return false;
+  }
+
+  char *script = malloc(LOADGEN_MERCHS * 2 * LOADGEN_LINE);
+  size_t size = 0;
+  for (int i = 0; i < LOADGEN_MERCHS; i++)
+  {
+    size += sprintf(script + size, "add loadgen%d \"load generator merchandise\" %d\n", i, 1 + i % 500);
+    size += sprintf(script + size, "replenish loadgen%d %c%02d %d\n", i, 'A' + i / 100, i % 100, LOADGEN_STOCK);
+  }
+
+  bool done = send_all(fd, script, size) && read_answers(fd, LOADGEN_MERCHS * 2, NULL, 0);
+  free(script);
+  close(fd);
+  return done;
+}
+
+/// Sends requests until depth of them are in flight
+static bool loadgen_fill(loadgen_thread_t *thread, loadgen_conn_t *conn)
+{
+  char batch[LOADGEN_LINE * 64];
+  size_t size = 0;
+
+  while (conn->sent < thread->requests && conn->sent - conn->answered < thread->depth)
+  {
+    int merch = rand_r(&thread->seed) % LOADGEN_MERCHS;
+    if (rand_r(&thread->seed) % 100 < LOADGEN_BROWSE_PERCENT)
+    {
+      size += sprintf(batch + size, "show loadgen%d\n", merch);
+    }
+    else
+    {
+      size += sprintf(batch + size, "add-to-cart %d loadgen%d 1\n", conn->cart, merch);
+    }
+    conn->sent_at[conn->sent % thread->depth] = now_ns();
+    conn->sent++;
+
+    if (size > sizeof(batch) - LOADGEN_LINE)
+    {
+      if (!send_all(conn->fd, batch, size))
+      {
+        return false;
+      }
+      size = 0;
+    }
+  }
+  return send_all(conn->fd, batch, size);
+}
+
+static void *loadgen_thread(void *arg)
+{
+  loadgen_thread_t *thread = arg;
+  int epoll_fd = epoll_create1(0);
+  int open = thread->conn_count;
+  char buffer[LOADGEN_READ_SIZE];
+
+  for (int i = 0; i < thread->conn_count; i++)
+  {
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = &thread->conns[i]};
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, thread->conns[i].fd, &event);
+    thread->failed = thread->failed || !loadgen_fill(thread, &thread->conns[i]);
+  }
+
+  while (open > 0 && !thread->failed)
+  {
+    struct epoll_event events[64];
+    int ready = epoll_wait(epoll_fd, events, 64, -1);
+
+    for (int i = 0; i < ready; i++)
+    {
+      loadgen_conn_t *conn = events[i].data.ptr;
+      ssize_t got = read(conn->fd, buffer, sizeof(buffer));
+      if (got <= 0)
+      {
+        thread->failed = true;
+        break;
+      }
+
+      uint64_t now = now_ns();
+      for (ssize_t j = 0; j < got; j++)
+      {
+        if (buffer[j] == '\n')
+        {
+          thread->latencies[thread->latency_count++] = now - conn->sent_at[conn->answered % thread->depth];
+          conn->answered++;
+        }
+      }
+
+      if (conn->answered == thread->requests)
+      {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+        open--;
+      }
+      else
+      {
+        thread->failed = !loadgen_fill(thread, conn);
+      }
+    }
+  }
+
+  close(epoll_fd);
+  return NULL;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static double percentile_us(uint64_t *sorted, size_t count, double percent)
+{
+  size_t index = (size_t)(count * percent / 100);
+  return sorted[index < count ? index : count - 1] / 1e3;
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc < 2)
+  {
+    fprintf(stderr, "usage: %s unix:PATH|[HOST:]PORT [connections] [requests per connection] [pipeline depth] [threads]\n", argv[0]);
+    return 2;
+  }
+  const char *address = argv[1];
+  int conn_count = argc > 2 ? atoi(argv[2]) : 64;
+  int requests = argc > 3 ? atoi(argv[3]) : 20000;
+  int depth = argc > 4 ? atoi(argv[4]) : 16;
+  int thread_count = argc > 5 ? atoi(argv[5]) : 4;
+  thread_count = thread_count < conn_count ? thread_count : conn_count;
+
+  if (!loadgen_setup(address))
+  {
+    fprintf(stderr, "loadgen: could not connect to %s\n", address);
+    return 1;
+  }
+
+  // Every connection gets its cart before the clock starts
+  loadgen_conn_t *conns = calloc(conn_count, sizeof(loadgen_conn_t));
+  for (int i = 0; i < conn_count; i++)
+  {
+    char answer[LOADGEN_LINE];
+    conns[i].fd = loadgen_connect(address);
+    conns[i].sent_at = calloc(depth, sizeof(uint64_t));
+    if (conns[i].fd < 0 || !send_all(conns[i].fd, "cart\n", 5) || !read_answers(conns[i].fd, 1, answer, sizeof(answer)) ||
+        sscanf(answer, "ok %d", &conns[i].cart) != 1)
+    {
+      fprintf(stderr, "loadgen: connection %d could not get a cart\n", i);
+      return 1;
+    }
+  }
+
+  printf("connections: %d, requests per connection: %d, pipeline depth: %d, threads: %d, mix: %d%% browse, %d%% add\n",
+         conn_count, requests, depth, thread_count, LOADGEN_BROWSE_PERCENT, 100 - LOADGEN_BROWSE_PERCENT);
+
+  loadgen_thread_t *threads = calloc(thread_count, sizeof(loadgen_thread_t));
+  uint64_t start = now_ns();
+  for (int i = 0, first = 0; i < thread_count; i++)
+  {
+    int count = conn_count / thread_count + (i < conn_count % thread_count ? 1 : 0);
+    threads[i] = (loadgen_thread_t){.conns = conns + first, .conn_count = count, .requests = requests,
+                                    .depth = depth, .seed = 1 + i,
+                                    .latencies = malloc(sizeof(uint64_t) * count * requests)};
+    first += count;
+    pthread_create(&threads[i].thread, NULL, loadgen_thread, &threads[i]);
+  }
+
+  uint64_t *latencies = malloc(sizeof(uint64_t) * conn_count * requests);
+  size_t latency_count = 0;
+  bool failed = false;
+  for (int i = 0; i < thread_count; i++)
+  {
+    pthread_join(threads[i].thread, NULL);
+    memcpy(latencies + latency_count, threads[i].latencies, sizeof(uint64_t) * threads[i].latency_count);
+    latency_count += threads[i].latency_count;
+    failed = failed || threads[i].failed;
+    free(threads[i].latencies);
+  }
+  double seconds = (now_ns() - start) / 1e9;
+
+  if (failed || latency_count == 0)
+  {
+    fprintf(stderr, "loadgen: a connection was closed by the server\n");
+    return 1;
+  }
+
+  qsort(latencies, latency_count, sizeof(uint64_t), compare_u64);
+  printf("requests: %zu in %.2f s | %12.0f requests/s\n", latency_count, seconds, latency_count / seconds);
+  printf("latency: p50 %.1f us | p99 %.1f us | p99.9 %.1f us | max %.1f us\n",
+         percentile_us(latencies, latency_count, 50), percentile_us(latencies, latency_count, 99),
+         percentile_us(latencies, latency_count, 99.9), latencies[latency_count - 1] / 1e3);
+
+  // The reserved units are given back
+  for (int i = 0; i < conn_count; i++)
+  {
+    char remove[LOADGEN_LINE];
+    int size = sprintf(remove, "remove-cart %d\n", conns[i].cart);
+    send_all(conns[i].fd, remove, size);
+    read_answers(conns[i].fd, 1, NULL, 0);
+    close(conns[i].fd);
+    free(conns[i].sent_at);
+  }
+  free(conns);
+  free(threads);
+  free(latencies);
+  return 0;
+}
@@ -0,0 +1,114 @@
+#include <stdatomic.h>
+#include "memstats.h"
+
+/**
+ * @file memstats.c
+ * @author Erdem Garip
+ * @date 18 Oct 2026
+ * @brief Heap memory of the webstore, counted per kind of structure
+ */
+
+#define MEMSTATS_CACHE_LINE 64
+
+typedef struct memstats_counters memstats_counters_t;
+
+/// The counters of a category, a cache line of their own so threads allocating different kinds
+/// of structures do not contend
+struct memstats_counters
+{
+  _Alignas(MEMSTATS_CACHE_LINE) _Atomic uint64_t allocations;
+  _Atomic uint64_t frees;
+  _Atomic uint64_t live_bytes;
+  _Atomic uint64_t peak_bytes;
+};
+
+const char *memstats_names[MEMSTATS_CATEGORY_COUNT] = {
+    [MEMSTATS_HASH_TABLES] = "hash_tables",
+    [MEMSTATS_HASH_BUCKETS] = "hash_buckets",
+    [MEMSTATS_HASH_ENTRIES] = "hash_entries",
+    [MEMSTATS_CART_TABLES] = "cart_tables",
+    [MEMSTATS_CART_BUCKETS] = "cart_buckets",
+    [MEMSTATS_CART_ENTRIES] = "cart_entries",
+    [MEMSTATS_LISTS] = "lists",
+    [MEMSTATS_LIST_NODES] = "list_nodes",
+    [MEMSTATS_LIST_ITERATORS] = "list_iterators",
+    [MEMSTATS_MERCHS] = "merchs",
+    [MEMSTATS_MERCH_STRINGS] = "merch_strings",
+    [MEMSTATS_SHELVES] = "shelves",
+    [MEMSTATS_CARTS] = "carts",
+    [MEMSTATS_CART_SLOTS] = "cart_slots",
+    [MEMSTATS_MERCH_SLOTS] = "merch_slots",
+    [MEMSTATS_CHECKOUT_SCRATCH] = "checkout_scratch",
+};
+
+static memstats_counters_t counters[MEMSTATS_CATEGORY_COUNT];
+
+/// Raises the peak of a category to the live bytes it just reached, unless another thread
+/// raised it higher first
+static void raise_peak(memstats_counters_t *category, uint64_t live)
+{
+  uint64_t peak = atomic_load_explicit(&category->peak_bytes, memory_order_relaxed);
+  while (peak < live &&
+         !atomic_compare_exchange_weak_explicit(&category->peak_bytes, &peak, live, memory_order_relaxed, memory_order_relaxed))
+  {
+  }
+}
+
+void memstats_alloc(memstats_category_t category, size_t bytes)
+{
+  memstats_counters_t *counter = &counters[category];
+  atomic_fetch_add_explicit(&counter->allocations, 1, memory_order_relaxed);
+  uint64_t live = atomic_fetch_add_explicit(&counter->live_bytes, bytes, memory_order_relaxed) + bytes;
+  raise_peak(counter, live);
+}
+
+void memstats_free(memstats_category_t category, size_t bytes)
+{
+  memstats_counters_t *counter = &counters[category];
+  atomic_fetch_add_explicit(&counter->frees, 1, memory_order_relaxed);
+  atomic_fetch_sub_explicit(&counter->live_bytes, bytes, memory_order_relaxed);
+}
+
+void memstats_move(memstats_category_t from, memstats_category_t to, uint64_t allocations, size_t bytes)
+{
+  atomic_fetch_sub_explicit(&counters[from].allocations, allocations, memory_order_relaxed);
+  atomic_fetch_sub_explicit(&counters[from].live_bytes, bytes, memory_order_relaxed);
+  atomic_fetch_add_explicit(&counters[to].allocations, allocations, memory_order_relaxed);
+  uint64_t live = atomic_fetch_add_explicit(&counters[to].live_bytes, bytes, memory_order_relaxed) + bytes;
+  raise_peak(&counters[to], live);
+}
+
+memstats_t memstats_get(memstats_category_t category)
+{
+  memstats_counters_t *counter = &counters[category];
+  return (memstats_t){
+      .allocations = atomic_load_explicit(&counter->allocations, memory_order_relaxed),
+      .frees = atomic_load_explicit(&counter->frees, memory_order_relaxed),
+      .live_bytes = atomic_load_explicit(&counter->live_bytes, memory_order_relaxed),
+      .peak_bytes = atomic_load_explicit(&counter->peak_bytes, memory_order_relaxed),
+  };
+}
+
+void memstats_write(outbuf_t *out)
+{
+  static const char *fields[] = {" allocations=", " frees=", " live_bytes=", " peak_bytes="};
+  uint64_t total = 0;
+
+  for (int category = 0; category < MEMSTATS_CATEGORY_COUNT; category++)
+  {
+    memstats_t stats = memstats_get(category);
+    uint64_t values[] = {stats.allocations, stats.frees, stats.live_bytes, stats.peak_bytes};
+    total += stats.live_bytes;
+
+    outbuf_puts(out, memstats_names[category]);
+    for (int i = 0; i < 4; i++)
+    {
+      outbuf_puts(out, fields[i]);
+      outbuf_int(out, (int64_t)values[i]);
+    }
+    outbuf_putc(out, '\n');
+  }
+  outbuf_puts(out, "total live_bytes=");
+  outbuf_int(out, (int64_t)total);
+  outbuf_putc(out, '\n');
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "outbuf.h"
+
+/**
+ * @file memstats.h
+ * @author Erdem Garip
+ * @date 18 Oct 2026
+ * @brief Heap memory of the webstore, counted per kind of structure
+ *
+ * Every allocation of the hash tables, the linked lists and the backend is counted in the
+ * category of the structure it holds: the number of allocations and frees, the bytes that are
+ * live now and the most that have been live at once. The bytes are those asked of malloc, the
+ * bookkeeping malloc adds to each block is not counted.
+ *
+ * The hash tables of the shopping carts with more lines than a cart holds in itself are counted
+ * apart from the other hash tables, in MEMSTATS_CART_TABLES and the two categories after it, since
+ * there may be one per cart. Strings in a mapped snapshot are not on the heap and are not counted
+ * until they are replaced.
+ *
+ * The counters are shared by every thread and only ever changed by atomic adds, so they are
+ * exact at any moment no allocation is in progress.
+ */
+
+typedef struct memstats memstats_t;
+
+/// The kinds of structures. A hash table is counted in three categories in this order: its
+/// struct, its array of buckets and its entries.
+typedef enum memstats_category
+{
+  MEMSTATS_HASH_TABLES,
+  MEMSTATS_HASH_BUCKETS,
+  MEMSTATS_HASH_ENTRIES,
+  MEMSTATS_CART_TABLES,
+  MEMSTATS_CART_BUCKETS,
+  MEMSTATS_CART_ENTRIES,
+  MEMSTATS_LISTS,
+  MEMSTATS_LIST_NODES,
+  MEMSTATS_LIST_ITERATORS,
+  MEMSTATS_MERCHS,
+  MEMSTATS_MERCH_STRINGS, // names and descriptions
+  MEMSTATS_SHELVES,       // the shelves and their names
+  MEMSTATS_CARTS,
+  MEMSTATS_CART_SLOTS,       // the array the carts are found by their ids in
+  MEMSTATS_MERCH_SLOTS,      // the array the merchandises are found by their handles in
+  MEMSTATS_CHECKOUT_SCRATCH, // the arrays db_checkout_batch adds up the demand for each merchandise in
+  MEMSTATS_CATEGORY_COUNT
+} memstats_category_t;
+
+struct memstats
+{
+  uint64_t allocations;
+  uint64_t frees;
+  uint64_t live_bytes;
+  uint64_t peak_bytes;
+};
+
+/// @brief The names of the categories, indexed by category
+extern const char *memstats_names[MEMSTATS_CATEGORY_COUNT];
+
+/// @brief Counts an allocation
+/// @param category The kind of structure allocated
+/// @param bytes The size asked for
+void memstats_alloc(memstats_category_t category, size_t bytes);
+
+/// @brief Counts a free
+/// @param category The category the allocation was counted in
+/// @param bytes The size it was allocated with
+void memstats_free(memstats_category_t category, size_t bytes);
+
+/// @brief Moves live allocations to another category, as if they were freed and allocated there,
+/// without counting a free or an allocation more
+/// @param from The category they were counted in
+/// @param to The category they are counted in from now on
+/// @param allocations The number of allocations moved
+/// @param bytes Their size together
+void memstats_move(memstats_category_t from, memstats_category_t to, uint64_t allocations, size_t bytes);
+
+/// @brief Reads the counters of a category
+/// @param category The category
+/// @return The counters since the start of the process
+memstats_t memstats_get(memstats_category_t category);
+
+/// @brief Writes one line per category and a last line with the live bytes of all of them:
+///     cart_buckets allocations=10 frees=2 live_bytes=3264 peak_bytes=3264
+///     total live_bytes=10432
+/// @param out The lines are appended here
+void memstats_write(outbuf_t *out);
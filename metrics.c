@@ -0,0 +1,336 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include "metrics.h"
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * @file metrics.c
+ * @author Erdem Garip
+ * @date 18 Oct 2026
+ * @brief Latency histograms of the backend operations
+ */
+
+#define METRICS_DUMP_BUFFER_SIZE 4096
+#define METRICS_MAX_TICKS ((UINT64_C(1) << METRICS_MAX_BITS) - 1)
+#define METRICS_MIN_CALIBRATION_NS 10000000 // the rate of the ticks is measured over at least this
+
+typedef struct metrics_shard metrics_shard_t;
+
+/// The histograms of one thread. Only that thread writes it, so relaxed loads and stores are
+/// enough; readers see every count eventually and never a torn one.
+struct metrics_shard
+{
+  _Atomic uint64_t counts[METRIC_COUNT][METRICS_BUCKETS];
+  _Atomic uint64_t sum[METRIC_COUNT]; // ticks
+  _Atomic uint64_t max[METRIC_COUNT];
+  metrics_shard_t *next;
+};
+
+const char *metric_names[METRIC_COUNT] = {
+    [METRIC_HAS_KEY] = "db_has_key",
+    [METRIC_GET_MERCH] = "db_get_merch",
+    [METRIC_ADD_MERCH] = "db_add_merch",
+    [METRIC_REMOVE_MERCH] = "db_remove_merch",
+    [METRIC_UPDATE_MERCH] = "db_update_merch",
+    [METRIC_ADD_LOCATION] = "db_add_location_to_merch",
+    [METRIC_EDIT_LOCATION] = "db_edit_location_quantity",
+    [METRIC_ADD_CART] = "db_add_cart",
+    [METRIC_REMOVE_CART] = "db_remove_cart",
+    [METRIC_GET_CART] = "db_get_cart_from_id",
+    [METRIC_TRY_RESERVE] = "db_try_reserve",
+    [METRIC_ADD_TO_CART] = "db_add_merch_to_cart",
+    [METRIC_REMOVE_FROM_CART] = "db_remove_merch_from_cart",
+    [METRIC_CALCULATE_COST] = "db_calculate_cost",
+    [METRIC_CHECKOUT] = "db_checkout",
+    [METRIC_CHECKOUT_BATCH] = "db_checkout_batch",
+    [METRIC_EXPIRE_CARTS] = "db_expire_carts",
+};
+
+// The shards of every thread that has counted, kept after the thread ends so its counts stay
+static _Atomic(metrics_shard_t *) shards = NULL;
+static _Thread_local metrics_shard_t *thread_shard = NULL;
+
+// The ticks and the monotonic clock when the first shard was created, to measure the rate of the ticks
+static pthread_once_t calibration_once = PTHREAD_ONCE_INIT;
+static uint64_t calibration_ticks;
+static uint64_t calibration_ns;
+
+static struct
+{
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wakeup;
+  char *path;
+  int interval_ms;
+  bool running;
+  bool stopping;
+} dump = {.lock = PTHREAD_MUTEX_INITIALIZER, .wakeup = PTHREAD_COND_INITIALIZER};
+
+static uint64_t monotonic_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+uint64_t metrics_now(void)
+{
+#if defined(__x86_64__)
+  return __rdtsc();
+#else
+  return monotonic_ns();
+#endif
+}
+
+static void calibrate(void)
+{
+  calibration_ticks = metrics_now();
+  calibration_ns = monotonic_ns();
+}
+
+/// The nanoseconds per tick since the first shard was created, waiting for the rate to settle if
+/// that was just now
+static double ns_per_tick(void)
+{
+  pthread_once(&calibration_once, calibrate);
+  uint64_t elapsed_ns = monotonic_ns() - calibration_ns;
+
+  if (elapsed_ns < METRICS_MIN_CALIBRATION_NS)
+  {
+    uint64_t wait_ns = METRICS_MIN_CALIBRATION_NS - elapsed_ns;
+    nanosleep(&(struct timespec){.tv_sec = 0, .tv_nsec = (long)wait_ns}, NULL);
+  }
+
+  uint64_t ticks = metrics_now();
+  uint64_t ns = monotonic_ns();
+  return ticks > calibration_ticks ? (double)(ns - calibration_ns) / (ticks - calibration_ticks) : 1.0;
+}
+
+/// The bucket of a latency: the sub-bucket bits below the highest set bit pick the linear bucket
+/// within its power of two
+static size_t bucket_of(uint64_t ticks)
+{
+  ticks = ticks < METRICS_MAX_TICKS ? ticks : METRICS_MAX_TICKS;
+  int exponent = 0;
+
+  if (ticks >= METRICS_SUB_BUCKETS)
+  {
+    exponent = (63 - __builtin_clzll(ticks)) - METRICS_SUB_BUCKET_BITS;
+  }
+  return ((size_t)exponent << METRICS_SUB_BUCKET_BITS) + (size_t)(ticks >> exponent);
+}
+
+/// The largest latency counted in a bucket, in ticks
+static uint64_t bucket_upper(size_t bucket)
+{
+  if (bucket < 2 * METRICS_SUB_BUCKETS)
+  {
+    return bucket;
+  }
+  int exponent = (int)(bucket >> METRICS_SUB_BUCKET_BITS) - 1;
+  uint64_t mantissa = bucket - ((size_t)exponent << METRICS_SUB_BUCKET_BITS);
+  return ((mantissa + 1) << exponent) - 1;
+}
+
+static metrics_shard_t *shard_create(void)
+{
+  pthread_once(&calibration_once, calibrate);
+  metrics_shard_t *shard = calloc(1, sizeof(metrics_shard_t));
+  shard->next = atomic_load(&shards);
+
+  // Pushed on the list without a lock, retried if another thread pushed first
+  while (!atomic_compare_exchange_weak(&shards, &shard->next, shard))
+  {
+  }
+  return shard;
+}
+
+static void add_relaxed(_Atomic uint64_t *counter, uint64_t value)
+{
+  atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+void metrics_record(metric_t metric, uint64_t started)
+{
+  uint64_t ticks = metrics_now() - started;
+
+  if (thread_shard == NULL)
+  {
+    thread_shard = shard_create();
+  }
+
+  add_relaxed(&thread_shard->counts[metric][bucket_of(ticks)], 1);
+  add_relaxed(&thread_shard->sum[metric], ticks);
+  if (ticks > atomic_load_explicit(&thread_shard->max[metric], memory_order_relaxed))
+  {
+    atomic_store_explicit(&thread_shard->max[metric], ticks, memory_order_relaxed);
+  }
+}
+
+/// The upper end of the bucket of a percentile, in ticks
+static uint64_t percentile(const uint64_t *counts, uint64_t count, double fraction)
+{
+  // The rank of the percentile, counted from 1
+  uint64_t rank = (uint64_t)(fraction * count);
+  rank = rank < count ? rank + 1 : count;
+  uint64_t seen = 0;
+
+  for (size_t bucket = 0; bucket < METRICS_BUCKETS; bucket++)
+  {
+    seen += counts[bucket];
+    if (seen >= rank)
+    {
+      return bucket_upper(bucket);
+    }
+  }
+  return 0;
+}
+
+metrics_summary_t metrics_summarize(metric_t metric)
+{
+  uint64_t *counts = calloc(METRICS_BUCKETS, sizeof(uint64_t));
+  metrics_summary_t summary = {0};
+  uint64_t sum = 0;
+  uint64_t max = 0;
+
+  for (metrics_shard_t *shard = atomic_load(&shards); shard != NULL; shard = shard->next)
+  {
+    for (size_t bucket = 0; bucket < METRICS_BUCKETS; bucket++)
+    {
+      uint64_t count = atomic_load_explicit(&shard->counts[metric][bucket], memory_order_relaxed);
+      counts[bucket] += count;
+      summary.count += count;
+    }
+    sum += atomic_load_explicit(&shard->sum[metric], memory_order_relaxed);
+    uint64_t shard_max = atomic_load_explicit(&shard->max[metric], memory_order_relaxed);
+    max = shard_max > max ? shard_max : max;
+  }
+
+  if (summary.count > 0)
+  {
+    double rate = ns_per_tick();
+    // A bucket's upper end may be above every latency in it
+    uint64_t p50 = percentile(counts, summary.count, 0.50);
+    uint64_t p99 = percentile(counts, summary.count, 0.99);
+    uint64_t p999 = percentile(counts, summary.count, 0.999);
+
+    summary.mean_ns = (uint64_t)(rate * sum / summary.count);
+    summary.p50_ns = (uint64_t)(rate * (p50 < max ? p50 : max));
+    summary.p99_ns = (uint64_t)(rate * (p99 < max ? p99 : max));
+    summary.p999_ns = (uint64_t)(rate * (p999 < max ? p999 : max));
+    summary.max_ns = (uint64_t)(rate * max);
+  }
+  free(counts);
+  return summary;
+}
+
+void metrics_write(outbuf_t *out)
+{
+  static const char *fields[] = {" count=", " mean_ns=", " p50_ns=", " p99_ns=", " p999_ns=", " max_ns="};
+
+  for (int metric = 0; metric < METRIC_COUNT; metric++)
+  {
+    metrics_summary_t summary = metrics_summarize(metric);
+    uint64_t values[] = {summary.count, summary.mean_ns, summary.p50_ns, summary.p99_ns, summary.p999_ns, summary.max_ns};
+
+    outbuf_puts(out, metric_names[metric]);
+    for (int i = 0; i < 6; i++)
+    {
+      outbuf_puts(out, fields[i]);
+      outbuf_int(out, (int64_t)values[i]);
+    }
+    outbuf_putc(out, '\n');
+  }
+}
+
+static bool dump_file(const char *path)
+{
+  char temporary[strlen(path) + sizeof(".tmp")];
+  snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+
+  int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+  {
+    return false;
+  }
+  outbuf_t *out = outbuf_create(fd, METRICS_DUMP_BUFFER_SIZE);
+  metrics_write(out);
+  bool written = outbuf_destroy(out);
+  written = close(fd) == 0 && written;
+  return written && rename(temporary, path) == 0;
+}
+
+static void *dump_loop(void *ignored)
+{
+  pthread_mutex_lock(&dump.lock);
+  bool stopping = false;
+
+  while (!stopping)
+  {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += dump.interval_ms / 1000;
+    deadline.tv_nsec += (long)(dump.interval_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+
+    // Woken early only to stop, and the file is written a last time then
+    while (!dump.stopping && pthread_cond_timedwait(&dump.wakeup, &dump.lock, &deadline) == 0)
+    {
+    }
+    stopping = dump.stopping;
+    dump_file(dump.path);
+  }
+  pthread_mutex_unlock(&dump.lock);
+  return NULL;
+}
+
+bool metrics_dump_start(const char *path, int interval_ms)
+{
+  pthread_mutex_lock(&dump.lock);
+  bool started = false;
+
+  if (!dump.running)
+  {
+    dump.path = strdup(path);
+    dump.interval_ms = interval_ms;
+    dump.stopping = false;
+    started = pthread_create(&dump.thread, NULL, dump_loop, NULL) == 0;
+    dump.running = started;
+    if (!started)
+    {
+      free(dump.path);
+    }
+  }
+  pthread_mutex_unlock(&dump.lock);
+  return started;
+}
+
+void metrics_dump_stop(void)
+{
+  pthread_mutex_lock(&dump.lock);
+  if (!dump.running)
+  {
+    pthread_mutex_unlock(&dump.lock);
+    return;
+  }
+  dump.stopping = true;
+  pthread_cond_signal(&dump.wakeup);
+  pthread_mutex_unlock(&dump.lock);
+
+  pthread_join(dump.thread, NULL);
+  dump.running = false;
+  free(dump.path);
+}
@@ -0,0 +1,397 @@
+#define _POSIX_C_SOURCE 200809L
+#include <string.h>
+#include "bench.h"
+#include "hash_table.h"
+#include "linked_list.h"
+#include "iterator.h"
+#include "backend.h"
+
+/**
+ * @file micro_bench.c
+ * @author Erdem Garip
+ * @date 18 Oct 2026
+ * @brief Microbenchmarks of the hash table, the linked list and the backend
+ *
+ * Every benchmark runs at the scales 1e3, 1e4, ... up to the given maximum, which its memory
+ * allows. The table is printed as it goes and the results are written as JSON at the end.
+ *
+ * Usage: ./microbench [max scale] [repetitions] [JSON file] [name filter]
+ */
+
+#define BENCH_MERCHS 1000
+#define BENCH_STOCK 1000000000
+#define BENCH_LINES_PER_CART 8
+#define BENCH_LIST_GETS 1000 // get is linear in the index, so a fixed number are run at every scale
+
+typedef struct keys_state keys_state_t;
+typedef struct list_state list_state_t;
+typedef struct store_state store_state_t;
+
+struct keys_state
+{
+  ioopm_hash_table_t *ht;
+  int *keys; // 0 ... scale - 1 shuffled
+  size_t count;
+};
+
+struct list_state
+{
+  ioopm_list_t *list;
+  size_t count;
+};
+
+struct store_state
+{
+  webstore_t *db;
+  merch_t **merchs;
+  size_t merch_count;
+  shopping_carts_t **carts;
+  size_t cart_count;
+};
+
+// Keeps results from being optimized away
+static volatile int64_t sink;
+
+static int *shuffled_keys(size_t count)
+{
+  int *keys = malloc(sizeof(int) * count);
+  unsigned int seed = 42;
+
+  for (size_t i = 0; i < count; i++)
+  {
+    keys[i] = (int)i;
+  }
+  for (size_t i = count - 1; i > 0; i--)
+  {
+    size_t j = ((size_t)rand_r(&seed) * RAND_MAX + rand_r(&seed)) % (i + 1);
+    int key = keys[i];
+    keys[i] = keys[j];
+    keys[j] = key;
+  }
+  return keys;
+}
+
+// ### Hash table ###
+
+static void *ht_empty_setup(size_t scale)
+{
+  keys_state_t *state = calloc(1, sizeof(keys_state_t));
+  state->ht = ioopm_hash_table_create(NULL, NULL, NULL);
+  state->keys = shuffled_keys(scale);
+  state->count = scale;
+  return state;
+}
+
+static void *ht_full_setup(size_t scale)
+{
+  keys_state_t *state = ht_empty_setup(scale);
+  for (size_t i = 0; i < scale; i++)
+  {
+    ioopm_hash_table_insert(state->ht, int_elem(state->keys[i]), int_elem(i));
+  }
+  // Looked up and removed in another order than they were inserted in
+  for (size_t i = 0; i < scale / 2; i++)
+  {
+    int key = state->keys[i];
+    state->keys[i] = state->keys[scale - 1 - i];
+    state->keys[scale - 1 - i] = key;
+  }
+  return state;
+}
+
+static void ht_teardown(void *state_ptr)
+{
+  keys_state_t *state = state_ptr;
+  ioopm_hash_table_destroy(state->ht);
+  free(state->keys);
+  free(state);
+}
+
+static void ht_insert_run(void *state_ptr, size_t first, size_t end)
+{
+  keys_state_t *state = state_ptr;
+  for (size_t i = first; i < end; i++)
+  {
+    ioopm_hash_table_insert(state->ht, int_elem(state->keys[i]), int_elem(i));
+  }
+}
+
+static void ht_lookup_run(void *state_ptr, size_t first, size_t end)
+{
+  keys_state_t *state = state_ptr;
+  elem_t value;
+  for (size_t i = first; i < end; i++)
+  {
+    ioopm_hash_table_lookup(state->ht, int_elem(state->keys[i]), &value);
+    sink += value.i;
+  }
+}
+
+static void ht_remove_run(void *state_ptr, size_t first, size_t end)
+{
+  keys_state_t *state = state_ptr;
+  elem_t value;
+  for (size_t i = first; i < end; i++)
+  {
+    ioopm_hash_table_remove(state->ht, int_elem(state->keys[i]), &value);
+  }
+}
+
+/// One operation lists every key
+static void ht_keys_run(void *state_ptr, size_t first, size_t end)
+{
+  keys_state_t *state = state_ptr;
+  for (size_t i = first; i < end; i++)
+  {
+    ioopm_list_t *keys = ioopm_hash_table_keys(state->ht);
+    sink += ioopm_linked_list_size(keys);
+    ioopm_linked_list_destroy(keys);
+  }
+}
+
+// ### Linked list ###
+
+static void *list_empty_setup(size_t scale)
+{
+  list_state_t *state = calloc(1, sizeof(list_state_t));
+  state->list = ioopm_linked_list_create(NULL);
+  state->count = scale;
+  return state;
+}
+
+static void *list_full_setup(size_t scale)
+{
+  list_state_t *state = list_empty_setup(scale);
+  for (size_t i = 0; i < scale; i++)
+  {
+    ioopm_linked_list_append(state->list, int_elem(i));
+  }
+  return state;
+}
+
+static void list_teardown(void *state_ptr)
+{
+  list_state_t *state = state_ptr;
+  ioopm_linked_list_destroy(state->list);
+  free(state);
+}
+
+static void list_append_run(void *state_ptr, size_t first, size_t end)
+{
+  list_state_t *state = state_ptr;
+  for (size_t i = first; i < end; i++)
+  {
+    ioopm_linked_list_append(state->list, int_elem(i));
+  }
+}
+
+/// Gets spread over the whole list, the average get walks half of it
+static void list_get_run(void *state_ptr, size_t first, size_t end)
+{
+  list_state_t *state = state_ptr;
+  for (size_t i = first; i < end; i++)
+  {
+    sink += ioopm_linked_list_get(state->list, (i * 7919) % state->count).i;
+  }
+}
+
+/// One operation iterates over every element
+static void list_iterate_run(void *state_ptr, size_t first, size_t end)
+{
+  list_state_t *state = state_ptr;
+  for (size_t i = first; i < end; i++)
+  {
+    ioopm_list_iterator_t *iter = ioopm_list_iterator(state->list);
+    while (ioopm_iterator_has_next(iter))
+    {
+      sink += ioopm_iterator_next(iter).i;
+    }
+    ioopm_iterator_destroy(iter);
+  }
+}
+
+// ### Backend ###
+
+static merch_t *create_bench_merch(size_t i)
+{
+  char name[32];
+  snprintf(name, sizeof(name), "merch%zu", i);
+  return db_create_merch(strdup(name), strdup("bench"), 1 + i % 100);
+}
+
+/// scale merchandises created but not added
+static void *merchs_setup(size_t scale)
+{
+  store_state_t *state = calloc(1, sizeof(store_state_t));
+  state->db = db_create_webstore();
+  state->merchs = malloc(sizeof(merch_t *) * scale);
+  state->merch_count = scale;
+  for (size_t i = 0; i < scale; i++)
+  {
+    state->merchs[i] = create_bench_merch(i);
+  }
+  return state;
+}
+
+/// BENCH_MERCHS merchandises in stock and carts, empty or with BENCH_LINES_PER_CART lines each
+static store_state_t *store_setup(size_t cart_count, bool fill)
+{
+  store_state_t *state = calloc(1, sizeof(store_state_t));
+  state->db = db_create_webstore();
+  state->merchs = malloc(sizeof(merch_t *) * BENCH_MERCHS);
+  state->merch_count = BENCH_MERCHS;
+  state->carts = malloc(sizeof(shopping_carts_t *) * cart_count);
+  state->cart_count = cart_count;
+  char shelf[4];
+
+  for (size_t i = 0; i < BENCH_MERCHS; i++)
+  {
+    state->merchs[i] = create_bench_merch(i);
+    db_add_merch(state->db, state->merchs[i]);
+    db_first_free_shelf(state->db, shelf);
+    db_add_location_to_merch(state->db, state->merchs[i], strdup(shelf), BENCH_STOCK);
+  }
+
+  for (size_t i = 0; i < cart_count; i++)
+  {
+    state->carts[i] = db_create_cart();
+    db_add_cart(state->db, state->carts[i]);
+    for (size_t j = 0; j < BENCH_LINES_PER_CART && fill; j++)
+    {
+      db_add_merch_to_cart(state->carts[i], state->merchs[(i * 31 + j * 7919) % BENCH_MERCHS], 1 + j % 3);
+    }
+  }
+  return state;
+}
+
+static void *empty_carts_setup(size_t scale)
+{
+  return store_setup(scale / BENCH_LINES_PER_CART > 0 ? scale / BENCH_LINES_PER_CART : 1, false);
+}
+
+static void *full_carts_setup(size_t scale)
+{
+  return store_setup(scale, true);
+}
+
+static void store_teardown(void *state_ptr)
+{
+  store_state_t *state = state_ptr;
+  db_destroy_webstore(state->db);
+  free(state->merchs);
+  free(state->carts);
+  free(state);
+}
+
+/// The merchandises are destroyed with the webstore only if they were all added
+static void merchs_teardown(void *state_ptr)
+{
+  store_state_t *state = state_ptr;
+  for (size_t i = db_merch_count(state->db); i < state->merch_count; i++)
+  {
+    db_destroy_a_merch(state->merchs[i]);
+  }
+  store_teardown(state);
+}
+
+static void add_merch_run(void *state_ptr, size_t first, size_t end)
+{
+  store_state_t *state = state_ptr;
+  for (size_t i = first; i < end; i++)
+  {
+    db_add_merch(state->db, state->merchs[i]);
+  }
+}
+
+/// Fills the carts in turn, BENCH_LINES_PER_CART lines each
+static void add_to_cart_run(void *state_ptr, size_t first, size_t end)
+{
+  store_state_t *state = state_ptr;
+  for (size_t i = first; i < end; i++)
+  {
+    db_add_merch_to_cart(state->carts[(i / BENCH_LINES_PER_CART) % state->cart_count],
+                         state->merchs[(i * 7919) % BENCH_MERCHS], 1);
+  }
+}
+
+static void cost_run(void *state_ptr, size_t first, size_t end)
+{
+  store_state_t *state = state_ptr;
+  for (size_t i = first; i < end; i++)
+  {
+    sink += db_calculate_cost(state->db, state->carts[i]);
+  }
+}
+
+static void checkout_run(void *state_ptr, size_t first, size_t end)
+{
+  store_state_t *state = state_ptr;
+  for (size_t i = first; i < end; i++)
+  {
+    sink += db_checkout(state->db, state->carts[i]);
+  }
+}
+
+static const bench_t benches[] = {
+    {"ht_insert", ht_empty_setup, ht_insert_run, ht_teardown, 0, 0, 0},
+    {"ht_lookup", ht_full_setup, ht_lookup_run, ht_teardown, 0, 0, 0},
+    {"ht_remove", ht_full_setup, ht_remove_run, ht_teardown, 0, 0, 0},
+    {"ht_keys", ht_full_setup, ht_keys_run, ht_teardown, 0, 1, 1},
+    {"list_append", list_empty_setup, list_append_run, list_teardown, 0, 0, 0},
+    {"list_get", list_full_setup, list_get_run, list_teardown, 0, BENCH_LIST_GETS, 16},
+    {"list_iterate", list_full_setup, list_iterate_run, list_teardown, 0, 1, 1},
+    {"db_add_merch", merchs_setup, add_merch_run, merchs_teardown, 1000000, 0, 0},
+    {"db_add_merch_to_cart", empty_carts_setup, add_to_cart_run, store_teardown, 1000000, 0, 0},
+    {"db_calculate_cost", full_carts_setup, cost_run, store_teardown, 100000, 0, 0},
+    {"db_checkout", full_carts_setup, checkout_run, store_teardown, 100000, 0, 0},
+};
+
+int main(int argc, char *argv[])
+{
+  size_t max_scale = argc > 1 ? strtoull(argv[1], NULL, 10) : 100000;
+  int repetitions = argc > 2 ? atoi(argv[2]) : 5;
+  const char *json_path = argc > 3 ? argv[3] : NULL;
+  const char *filter = argc > 4 ? argv[4] : NULL;
+  if (repetitions < 1)
+  {
+    fprintf(stderr, "usage: %s [max scale] [repetitions, at least 1] [JSON file] [name filter]\n", argv[0]);
+    return 2;
+  }
+
+  size_t bench_count = sizeof(benches) / sizeof(benches[0]);
+  bench_result_t *results = calloc(bench_count * 8, sizeof(bench_result_t));
+  size_t result_count = 0;
+
+  printf("max scale: %zu, repetitions: %d after one warmup, %d operations per sample\n",
+         max_scale, repetitions, BENCH_DEFAULT_BATCH);
+  for (size_t b = 0; b < bench_count; b++)
+  {
+    const bench_t *bench = &benches[b];
+    if (filter != NULL && strstr(bench->name, filter) == NULL)
+    {
+      continue;
+    }
+
+    for (size_t scale = 1000; scale <= max_scale && (bench->max_scale == 0 || scale <= bench->max_scale); scale *= 10)
+    {
+      results[result_count] = bench_run(bench, scale, repetitions);
+      bench_print(stdout, &results[result_count]);
+      fflush(stdout);
+      result_count++;
+    }
+  }
+
+  if (json_path != NULL)
+  {
+    FILE *json = fopen(json_path, "w");
+    if (json == NULL)
+    {
+      fprintf(stderr, "microbench: %s could not be opened\n", json_path);
+      return 1;
+    }
+    bench_print_json(json, results, result_count);
+    fclose(json);
+  }
+  free(results);
+  return 0;
+}
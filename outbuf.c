@@ -0,0 +1,165 @@
+#define _POSIX_C_SOURCE 200809L
+#include <string.h>
+#include <unistd.h>
+#include "outbuf.h"
+
+/**
+ * @file outbuf.c
+ * @author Erdem Garip
+ * @date 18 Oct 2026
+ * @brief Buffered output to a file descriptor
+ */
+
+#define OUTBUF_INT_DIGITS 20 // the digits of the longest int64_t
+
+struct outbuf
+{
+  int fd;
+  char *buffer;
+  size_t size;
+  size_t capacity;
+  uint64_t flushed; // bytes written since the buffer was created or reset
+  bool failed;      // a write failed since the buffer was created or reset
+};
+
+outbuf_t *outbuf_create(int fd, size_t capacity)
+{
+  outbuf_t *out = calloc(1, sizeof(outbuf_t));
+  out->fd = fd;
+  out->capacity = capacity > OUTBUF_INT_DIGITS + 1 ? capacity : OUTBUF_INT_DIGITS + 1;
+  out->buffer = malloc(out->capacity);
+  return out;
+}
+
+bool outbuf_flush(outbuf_t *out)
+{
+  if (out->fd < 0)
+  {
+    return true; // kept in memory until it is consumed
+  }
+
+  const char *data = out->buffer;
+  size_t size = out->size;
+
+  while (size > 0 && !out->failed)
+  {
+    ssize_t written = write(out->fd, data, size);
+    out->failed = written < 0;
+    data = data + (written > 0 ? written : 0);
+    size = size - (written > 0 ? written : 0);
+  }
+
+  out->flushed += out->size;
+  out->size = 0;
+  return !out->failed;
+}
+
+bool outbuf_reset(outbuf_t *out, int fd)
+{
+  bool flushed = outbuf_flush(out);
+  out->fd = fd;
+  out->flushed = 0;
+  out->failed = false;
+  return flushed;
+}
+
+/// Grows a buffer without a file descriptor so size more bytes fit
+static void outbuf_grow(outbuf_t *out, size_t size)
+{
+  while (out->size + size > out->capacity)
+  {
+    out->capacity = out->capacity * 2;
+  }
+  out->buffer = realloc(out->buffer, out->capacity);
+}
+
+void outbuf_write(outbuf_t *out, const void *data, size_t size)
+{
+  if (out->size + size > out->capacity && out->fd < 0)
+  {
+    outbuf_grow(out, size);
+  }
+  else if (out->size + size > out->capacity)
+  {
+    outbuf_flush(out);
+  }
+
+  // Larger than the whole buffer, so it is not copied
+  if (size > out->capacity)
+  {
+    const char *bytes = data;
+    while (size > 0 && !out->failed)
+    {
+      ssize_t written = write(out->fd, bytes, size);
+      out->failed = written < 0;
+      out->flushed += written > 0 ? written : 0;
+      bytes = bytes + (written > 0 ? written : 0);
+      size = size - (written > 0 ? written : 0);
+    }
+    return;
+  }
+
+  memcpy(out->buffer + out->size, data, size);
+  out->size += size;
+}
+
+void outbuf_puts(outbuf_t *out, const char *str)
+{
+  outbuf_write(out, str, strlen(str));
+}
+
+void outbuf_putc(outbuf_t *out, char c)
+{
+  if (out->size == out->capacity)
+  {
+    outbuf_write(out, &c, 1);
+    return;
+  }
+  out->buffer[out->size++] = c;
+}
+
+void outbuf_int(outbuf_t *out, int64_t value)
+{
+  char digits[OUTBUF_INT_DIGITS + 1];
+  char *cursor = digits + sizeof(digits);
+  // Negated as unsigned, so INT64_MIN has a magnitude too
+  uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+
+  do
+  {
+    *--cursor = (char)('0' + magnitude % 10);
+    magnitude = magnitude / 10;
+  } while (magnitude > 0);
+
+  if (value < 0)
+  {
+    *--cursor = '-';
+  }
+  outbuf_write(out, cursor, digits + sizeof(digits) - cursor);
+}
+
+const char *outbuf_data(outbuf_t *out, size_t *size)
+{
+  *size = out->size;
+  return out->buffer;
+}
+
+void outbuf_consume(outbuf_t *out, size_t size)
+{
+  memmove(out->buffer, out->buffer + size, out->size - size);
+  out->size -= size;
+  out->flushed += size;
+}
+
+uint64_t outbuf_offset(outbuf_t *out)
+{
+  return out->flushed + out->size;
+}
+
+bool outbuf_destroy(outbuf_t *out)
+{
+  bool flushed = outbuf_flush(out);
+  free(out->buffer);
+  free(out);
+  return flushed;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @file outbuf.h
+ * @author Erdem Garip
+ * @date 18 Oct 2026
+ * @brief Buffered output to a file descriptor
+ *
+ * Output is gathered in one large buffer that is written to the file descriptor with write
+ * when it is full, so dumping a large webstore costs few system calls. Integers are formatted
+ * by hand instead of through printf. A buffer can be pointed at another file descriptor and
+ * reused, so the memory is allocated once.
+ *
+ * A buffer without a file descriptor, fd -1, grows instead and keeps everything until it is
+ * consumed, for output that is sent when the receiver is ready.
+ */
+
+typedef struct outbuf outbuf_t;
+
+/// @brief Creates an output buffer
+/// @param fd The file descriptor written to, -1 to keep the output in memory
+/// @param capacity The size of the buffer in bytes, the initial size without a file descriptor
+/// @return The buffer
+outbuf_t *outbuf_create(int fd, size_t capacity);
+
+/// @brief Flushes a buffer and points it at another file descriptor
+/// @param out The buffer
+/// @param fd The file descriptor written to from now on
+/// @return False if a write to the previous file descriptor failed
+bool outbuf_reset(outbuf_t *out, int fd);
+
+/// @brief Appends bytes to a buffer
+/// @param out The buffer
+/// @param data The bytes
+/// @param size The number of bytes
+void outbuf_write(outbuf_t *out, const void *data, size_t size);
+
+/// @brief Appends a NUL terminated string, without the NUL
+void outbuf_puts(outbuf_t *out, const char *str);
+
+/// @brief Appends a character
+void outbuf_putc(outbuf_t *out, char c);
+
+/// @brief Appends an integer in decimal
+void outbuf_int(outbuf_t *out, int64_t value);
+
+/// @brief Returns the bytes buffered and not yet written or consumed
+/// @param out The buffer
+/// @param size Set to the number of bytes
+/// @return The first byte, valid until the buffer is changed
+const char *outbuf_data(outbuf_t *out, size_t *size);
+
+/// @brief Drops bytes from the start of the buffered bytes, once they have been sent elsewhere
+/// @param out The buffer
+/// @param size The number of bytes, at most the number buffered
+void outbuf_consume(outbuf_t *out, size_t size);
+
+/// @brief Returns the number of bytes appended since the buffer was created or reset
+/// @param out The buffer
+uint64_t outbuf_offset(outbuf_t *out);
+
+/// @brief Writes what is buffered to the file descriptor, nothing without one
+/// @param out The buffer
+/// @return False if a write failed since the buffer was created or reset
+bool outbuf_flush(outbuf_t *out);
+
+/// @brief Flushes and frees a buffer, the file descriptor is not closed
+/// @param out The buffer
+/// @return False if a write failed since the buffer was created or reset
+bool outbuf_destroy(outbuf_t *out);
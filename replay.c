@@ -0,0 +1,245 @@
+#define _POSIX_C_SOURCE 200809L
+#include <time.h>
+#include "trace.h"
+#include "span.h"
+
+/**
+ * @file replay.c
+ * @author Erdem Garip
+ * @date 18 Oct 2026
+ * @brief Runs the commands of a captured session again and times every one of them
+ *
+ * A session captured with `db --capture TRACE` is replayed on the webstore it started from,
+ * TRACE.snapshot, so every command meets the same merchandise and carts and gets the same cart
+ * ids as when it was captured. Two builds replaying the same trace run identical traffic.
+ *
+ * The commands run one after the other as fast as they can, or, with paced, at the times they
+ * were captured at relative to the start. The webstore is not durable unless a log is given,
+ * and the commands that write files, save, bgsave and export, are skipped so a replay does not
+ * replace the files of the webstore it was captured from.
+ *
+ * Usage: ./replay TRACE [paced] [log=PATH] [csv=PATH] [spans=PATH]
+ *
+ * csv=PATH writes the offset, command and latency of every command, in nanoseconds. spans=PATH
+ * writes the spans of the replay as a Chrome trace, when built with `make SPANS=1`.
+ */
+
+#define REPLAY_LOG_LATENCY_MS 10
+
+typedef struct command_stats command_stats_t;
+
+struct command_stats
+{
+  uint64_t *latencies; // nanoseconds
+  size_t count;
+  size_t capacity;
+  size_t failed;
+  size_t skipped;
+};
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t deadline_ns)
+{
+  struct timespec ts = {.tv_sec = deadline_ns / 1000000000, .tv_nsec = deadline_ns % 1000000000};
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+  {
+  }
+}
+
+static bool writes_files(command_id_t id)
+{
+  return id == COMMAND_SAVE || id == COMMAND_BGSAVE || id == COMMAND_EXPORT;
+}
+
+static void add_latency(command_stats_t *stats, uint64_t latency)
+{
+  if (stats->count == stats->capacity)
+  {
+    stats->capacity = stats->capacity == 0 ? 1024 : 2 * stats->capacity;
+    stats->latencies = realloc(stats->latencies, sizeof(uint64_t) * stats->capacity);
+  }
+  stats->latencies[stats->count++] = latency;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static uint64_t percentile(command_stats_t *stats, double percent)
+{
+  size_t index = (size_t)(stats->count * percent / 100);
+  return stats->latencies[index < stats->count ? index : stats->count - 1];
+}
+
+int main(int argc, char *argv[])
+{
+  bool paced = false;
+  const char *log_path = NULL;
+  const char *csv_path = NULL;
+  const char *spans_path = NULL;
+
+  for (int i = 2; i < argc; i++)
+  {
+    if (strcmp(argv[i], "paced") == 0)
+    {
+      paced = true;
+    }
+    else if (strncmp(argv[i], "log=", 4) == 0)
+    {
+      log_path = argv[i] + 4;
+    }
+    else if (strncmp(argv[i], "csv=", 4) == 0)
+    {
+      csv_path = argv[i] + 4;
+    }
+    else if (strncmp(argv[i], "spans=", 6) == 0)
+    {
+      spans_path = argv[i] + 6;
+    }
+    else
+    {
+      argc = 0;
+    }
+  }
+  if (argc < 2)
+  {
+    fprintf(stderr, "usage: replay TRACE [paced] [log=PATH] [csv=PATH] [spans=PATH]\n");
+    return 2;
+  }
+
+  uint64_t started_at;
+  trace_t *trace = trace_open(argv[1], &started_at);
+  if (trace == NULL)
+  {
+    fprintf(stderr, "replay: %s is not a trace\n", argv[1]);
+    return 2;
+  }
+  FILE *csv = csv_path != NULL ? fopen(csv_path, "w") : NULL;
+  if (csv_path != NULL && csv == NULL)
+  {
+    fprintf(stderr, "replay: %s could not be created\n", csv_path);
+    trace_close(trace);
+    return 2;
+  }
+
+  char snapshot[strlen(argv[1]) + sizeof(".snapshot")];
+  snprintf(snapshot, sizeof(snapshot), "%s.snapshot", argv[1]);
+  webstore_t *db = db_open_webstore(snapshot, log_path, REPLAY_LOG_LATENCY_MS);
+  if (db == NULL)
+  {
+    fprintf(stderr, "replay: %s could not be opened\n", snapshot);
+    trace_close(trace);
+    if (csv != NULL)
+    {
+      fclose(csv);
+    }
+    return 2;
+  }
+  outbuf_t *out = outbuf_create(-1, 4096); // the answers are thrown away
+  command_stats_t stats[COMMAND_COUNT] = {{0}};
+  trace_record_t record;
+  size_t total = 0;
+  uint64_t late_max = 0; // how far behind the captured times a paced replay fell
+
+  if (csv != NULL)
+  {
+    fprintf(csv, "offset_ns,command,latency_ns,ok\n");
+  }
+
+  uint64_t run_start = now_ns();
+  while (trace_next(trace, &record))
+  {
+    command_stats_t *s = &stats[record.id];
+
+    if (writes_files(record.id))
+    {
+      s->skipped++;
+      continue;
+    }
+    if (paced)
+    {
+      uint64_t due = run_start + record.offset_ns;
+      uint64_t now = now_ns();
+      if (now < due)
+      {
+        sleep_until(due);
+      }
+      else if (now - due > late_max)
+      {
+        late_max = now - due;
+      }
+    }
+
+    uint64_t start = now_ns();
+    bool ok = command_table[record.id].handler(db, record.args, out);
+    uint64_t latency = now_ns() - start;
+
+    size_t answered;
+    outbuf_data(out, &answered);
+    outbuf_consume(out, answered);
+
+    add_latency(s, latency);
+    s->failed += ok ? 0 : 1;
+    total++;
+    if (csv != NULL)
+    {
+      fprintf(csv, "%lu,%s,%lu,%d\n", (unsigned long)record.offset_ns, command_table[record.id].name,
+              (unsigned long)latency, ok);
+    }
+  }
+  double seconds = (now_ns() - run_start) / 1e9;
+
+  time_t captured = (time_t)(started_at / 1000000000);
+  printf("trace %s, captured %s", argv[1], ctime(&captured));
+  printf("%zu commands in %.3f s | %12.0f commands/s%s", total, seconds, seconds > 0 ? total / seconds : 0.0,
+         paced ? "" : "\n");
+  if (paced)
+  {
+    printf(" | paced, at most %.3f ms late\n", late_max / 1e6);
+  }
+  for (int id = 0; id < COMMAND_COUNT; id++)
+  {
+    command_stats_t *s = &stats[id];
+    if (s->skipped > 0)
+    {
+      printf("%-16s %9zu skipped, it writes files\n", command_table[id].name, s->skipped);
+    }
+    if (s->count == 0)
+    {
+      continue;
+    }
+    qsort(s->latencies, s->count, sizeof(uint64_t), compare_u64);
+    printf("%-16s %9zu | %7zu failed | p50 %9lu ns | p99 %9lu ns | max %10lu ns\n", command_table[id].name, s->count,
+           s->failed, (unsigned long)percentile(s, 50), (unsigned long)percentile(s, 99),
+           (unsigned long)s->latencies[s->count - 1]);
+    free(s->latencies);
+  }
+
+  if (csv != NULL)
+  {
+    fclose(csv);
+  }
+#ifndef WEBSTORE_SPANS
+  if (spans_path != NULL)
+  {
+    printf("no spans were recorded, build with make clean && make SPANS=1 replay\n");
+  }
+#endif
+  if (spans_path != NULL && !span_export_chrome(spans_path))
+  {
+    fprintf(stderr, "replay: %s could not be written\n", spans_path);
+  }
+  outbuf_destroy(out);
+  db_destroy_webstore(db);
+  trace_close(trace);
+  return 0;
+}
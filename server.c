@@ -0,0 +1,311 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "server.h"
+#include "command.h"
+
+/**
+ * @file server.c
+ * @author Erdem Garip
+ * @date 18 Oct 2026
+ * @brief The webstore served over a TCP or Unix socket
+ */
+
+#define SERVER_EVENTS 256            // the events taken from epoll at a time
+#define SERVER_READ_SIZE (1 << 16)   // the bytes read from a connection at a time
+#define SERVER_MAX_PENDING (1 << 22) // a connection is not read while more answers than this wait
+
+typedef struct connection connection_t;
+
+struct connection
+{
+  int fd;
+  char *input; // bytes read and not yet run
+  size_t input_size;
+  size_t input_capacity;
+  outbuf_t *output;   // answers not yet sent
+  uint32_t events;    // the events epoll waits for
+  bool closed;        // the client sends nothing more, the connection is closed once it is answered
+  connection_t *prev; // the open connections, so they are closed when the server stops
+  connection_t *next;
+};
+
+/// Opens a listening, non-blocking socket, -1 if the address can not be listened on
+static int server_listen(const char *address)
+{
+  if (strncmp(address, "unix:", 5) == 0)
+  {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(address + 5) >= sizeof(addr.sun_path))
+    {
+      return -1;
+    }
+    strcpy(addr.sun_path, address + 5);
+    unlink(addr.sun_path); // left behind by a server that was killed
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0))
+    {
+      close(fd);
+      return -1;
+    }
+    return fd;
+  }
+
+  // "PORT" or "HOST:PORT", the last colon separates the port
+  char host[256] = "";
+  const char *port = strrchr(address, ':');
+  if (port != NULL && (size_t)(port - address) < sizeof(host))
+  {
+    memcpy(host, address, port - address);
+    host[port - address] = '\0';
+    port++;
+  }
+  else
+  {
+    port = address;
+  }
+
+  struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM, .ai_flags = AI_PASSIVE};
+  struct addrinfo *addrs;
+  if (getaddrinfo(*host != '\0' ? host : NULL, port, &hints, &addrs) != 0)
+  {
+    return -1;
+  }
+
+  int fd = -1;
+  for (struct addrinfo *addr = addrs; addr != NULL && fd < 0; addr = addr->ai_next)
+  {
+    int reuse = 1;
+    fd = socket(addr->ai_family, addr->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, addr->ai_protocol);
+    if (fd >= 0 && (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0 ||
+                    bind(fd, addr->ai_addr, addr->ai_addrlen) != 0 || listen(fd, SOMAXCONN) != 0))
+    {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(addrs);
+  return fd;
+}
+
+static void server_accept(int epoll_fd, int listen_fd, connection_t **conns)
+{
+  int fd;
+  while ((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+  {
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay)); // fails for Unix sockets
+
+    connection_t *conn = calloc(1, sizeof(connection_t));
+    conn->fd = fd;
+    conn->output = outbuf_create(-1, SERVER_READ_SIZE);
+    conn->events = EPOLLIN;
+    conn->next = *conns;
+    if (*conns != NULL)
+    {
+      (*conns)->prev = conn;
+    }
+    *conns = conn;
+
+    struct epoll_event event = {.events = conn->events, .data.ptr = conn};
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+  }
+}
+
+static void connection_destroy(connection_t **conns, connection_t *conn)
+{
+  if (conn->prev != NULL)
+  {
+    conn->prev->next = conn->next;
+  }
+  else
+  {
+    *conns = conn->next;
+  }
+  if (conn->next != NULL)
+  {
+    conn->next->prev = conn->prev;
+  }
+
+  close(conn->fd); // also removes it from epoll
+  outbuf_destroy(conn->output);
+  free(conn->input);
+  free(conn);
+}
+
+static size_t connection_pending(connection_t *conn)
+{
+  size_t pending;
+  outbuf_data(conn->output, &pending);
+  return pending;
+}
+
+static bool connection_has_line(connection_t *conn)
+{
+  return memchr(conn->input, '\n', conn->input_size) != NULL;
+}
+
+/// Reads what has arrived, false if the connection is broken
+static bool connection_read(connection_t *conn)
+{
+  while (conn->input_size < SERVER_MAX_LINE)
+  {
+    if (conn->input_capacity - conn->input_size < SERVER_READ_SIZE)
+    {
+      conn->input_capacity = conn->input_size + SERVER_READ_SIZE;
+      conn->input = realloc(conn->input, conn->input_capacity);
+    }
+
+    ssize_t got = read(conn->fd, conn->input + conn->input_size, SERVER_READ_SIZE);
+    if (got <= 0)
+    {
+      conn->closed = got == 0;
+      return got == 0 || errno == EAGAIN || errno == EINTR;
+    }
+
+    conn->input_size += got;
+    // A short read means nothing more has arrived, so it is not read again to find out
+    if (got < SERVER_READ_SIZE)
+    {
+      return true;
+    }
+  }
+  return true;
+}
+
+/// Runs every complete line of the input, until too many answers wait to be sent
+static void connection_run(webstore_t *db, connection_t *conn)
+{
+  size_t start = 0;
+  char *end;
+
+  while (connection_pending(conn) < SERVER_MAX_PENDING &&
+         (end = memchr(conn->input + start, '\n', conn->input_size - start)) != NULL)
+  {
+    *end = '\0';
+    if (end > conn->input + start && end[-1] == '\r')
+    {
+      end[-1] = '\0';
+    }
+    command_execute(db, conn->input + start, conn->output);
+    start = end - conn->input + 1;
+  }
+
+  memmove(conn->input, conn->input + start, conn->input_size - start);
+  conn->input_size -= start;
+}
+
+/// Sends what the socket takes, false if the connection is broken
+static bool connection_write(connection_t *conn)
+{
+  size_t size;
+  const char *data = outbuf_data(conn->output, &size);
+
+  while (size > 0)
+  {
+    ssize_t sent = send(conn->fd, data, size, MSG_NOSIGNAL);
+    if (sent < 0)
+    {
+      return errno == EAGAIN || errno == EINTR;
+    }
+    outbuf_consume(conn->output, sent);
+    data = outbuf_data(conn->output, &size);
+  }
+  return true;
+}
+
+/// Serves one ready connection, false once it should be closed
+static bool connection_serve(webstore_t *db, int epoll_fd, connection_t *conn, uint32_t ready)
+{
+  if ((ready & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !conn->closed && !connection_read(conn))
+  {
+    return false;
+  }
+
+  // Lines held back while answers waited are run once the answers have been sent
+  do
+  {
+    connection_run(db, conn);
+    if (!connection_write(conn))
+    {
+      return false;
+    }
+  } while (connection_pending(conn) < SERVER_MAX_PENDING && connection_has_line(conn));
+
+  if (conn->input_size >= SERVER_MAX_LINE || (conn->closed && connection_pending(conn) == 0))
+  {
+    return false;
+  }
+
+  size_t pending = connection_pending(conn);
+  uint32_t events = (pending < SERVER_MAX_PENDING && !conn->closed ? EPOLLIN : 0) | (pending > 0 ? EPOLLOUT : 0);
+  if (events != conn->events)
+  {
+    struct epoll_event event = {.events = events, .data.ptr = conn};
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+    conn->events = events;
+  }
+  return true;
+}
+
+bool server_run(webstore_t *db, const char *address, atomic_int *stop)
+{
+  int listen_fd = server_listen(address);
+  if (listen_fd < 0)
+  {
+    return false;
+  }
+
+  int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  struct epoll_event listen_event = {.events = EPOLLIN, .data.ptr = NULL};
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &listen_event);
+
+  connection_t *conns = NULL;
+  struct epoll_event events[SERVER_EVENTS];
+  uint64_t expired_at = db_now_ms();
+
+  while (!atomic_load(stop))
+  {
+    int ready = epoll_wait(epoll_fd, events, SERVER_EVENTS, SERVER_POLL_MS);
+
+    // Idle carts are removed between commands, so no command sees a cart vanish under it
+    uint64_t now = db_now_ms();
+    if (now - expired_at >= SERVER_POLL_MS)
+    {
+      db_expire_carts(db, now);
+      expired_at = now;
+    }
+
+    for (int i = 0; i < ready; i++)
+    {
+      connection_t *conn = events[i].data.ptr;
+      if (conn == NULL)
+      {
+        server_accept(epoll_fd, listen_fd, &conns);
+      }
+      else if (!connection_serve(db, epoll_fd, conn, events[i].events))
+      {
+        connection_destroy(&conns, conn);
+      }
+    }
+  }
+
+  while (conns != NULL)
+  {
+    connection_destroy(&conns, conns);
+  }
+  close(epoll_fd);
+  close(listen_fd);
+  if (strncmp(address, "unix:", 5) == 0)
+  {
+    unlink(address + 5);
+  }
+  return true;
+}
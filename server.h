@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdatomic.h>
+#include "backend.h"
+
+/**
+ * @file server.h
+ * @author Erdem Garip
+ * @date 18 Oct 2026
+ * @brief The webstore served over a TCP or Unix socket
+ *
+ * Clients send the commands of command.h, one per line, and get the same answers back in the
+ * same order. A client may send many commands without waiting for the answers, they are run
+ * and answered as soon as their lines have arrived. Every connection is served by one thread
+ * that waits on all of them with epoll, so the webstore is never used concurrently.
+ *
+ * Between commands the same thread calls db_expire_carts every SERVER_POLL_MS milliseconds, on
+ * the clock of db_now_ms, to remove the carts idle for longer than the TTL of db_set_cart_ttl.
+ */
+
+#define SERVER_MAX_LINE (1 << 20) // a connection sending a longer line is closed
+#define SERVER_POLL_MS 100        // the longest wait before the stop flag is checked
+
+/// @brief Serves a webstore until stop is set
+/// @param db The webstore
+/// @param address "unix:PATH" for a Unix socket, "HOST:PORT" or "PORT" for TCP
+/// @param stop Checked at least every SERVER_POLL_MS milliseconds, set by a signal handler or
+/// another thread for example
+/// @return False if the address could not be listened on
+bool server_run(webstore_t *db, const char *address, atomic_int *stop);
@@ -0,0 +1,93 @@
+#define _POSIX_C_SOURCE 200809L
+#include <time.h>
+#include "backend.h"
+
+/**
+ * @file snapshot_bench.c
+ * @author Erdem Garip
+ * @date 18 Oct 2026
+ * @brief Time to write a snapshot of a large catalog and to start a webstore from it, and how
+ * long changes wait when the snapshot is written in the background instead
+ *
+ * Usage: ./snapshotbench [merchs] [snapshot path]
+ */
+
+#define BENCH_SHELVED_MERCHS 2000 // every shelf can not be taken, so only the first merchs get one
+#define BENCH_CARTS 10000
+
+static double now_seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+  int merch_count = argc > 1 ? atoi(argv[1]) : 5000000;
+  char *path = argc > 2 ? argv[2] : "bench.snapshot";
+  webstore_t *db = db_create_webstore();
+  merch_t *shelved[BENCH_SHELVED_MERCHS];
+  char buffer[32];
+
+  double start = now_seconds();
+  for (int i = 0; i < merch_count; i++)
+  {
+    snprintf(buffer, sizeof(buffer), "merch%d", i);
+    merch_t *merch = db_create_merch(strdup(buffer), strdup("a piece of merchandise"), 1 + i % 1000);
+    db_add_merch(db, merch);
+
+    if (i < BENCH_SHELVED_MERCHS)
+    {
+      shelved[i] = merch;
+      db_first_free_shelf(db, buffer);
+      db_add_location_to_merch(db, merch, strdup(buffer), 100);
+    }
+  }
+  for (int i = 0; i < BENCH_CARTS; i++)
+  {
+    shopping_carts_t *cart = db_create_cart();
+    db_add_cart(db, cart);
+    db_add_merch_to_cart(cart, shelved[i % BENCH_SHELVED_MERCHS], 1);
+  }
+  double built = now_seconds() - start;
+
+  start = now_seconds();
+  bool saved = db_save_snapshot(db, path);
+  double save = now_seconds() - start;
+  db_destroy_webstore(db);
+
+  if (!saved)
+  {
+    printf("could not write %s\n", path);
+    return 1;
+  }
+
+  start = now_seconds();
+  db = db_open_webstore(path, NULL, 0);
+  double load = now_seconds() - start;
+  if (db == NULL)
+  {
+    printf("could not load %s\n", path);
+    return 1;
+  }
+
+  start = now_seconds();
+  bool forked = db_save_snapshot_background(db, path);
+  double fork_pause = now_seconds() - start;
+  snapshot_status_t status = db_wait_snapshot(db);
+  double background = now_seconds() - start;
+
+  printf("merchs: %d, carts: %d\n", db_merch_count(db), db_carts_size(db));
+  printf("build by inserts: %8.3f s\n", built);
+  printf("save snapshot:    %8.3f s\n", save);
+  printf("load snapshot:    %8.3f s\n", load);
+  if (forked && status.state == SNAPSHOT_DONE)
+  {
+    printf("background save:  %8.3f s, changes wait %.3f s for the fork\n", background, fork_pause);
+  }
+
+  db_destroy_webstore(db);
+  remove(path);
+  return 0;
+}
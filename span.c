@@ -0,0 +1,120 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "span.h"
+
+/**
+ * @file span.c
+ * @author Erdem Garip
+ * @date 18 Oct 2026
+ * @brief Timed spans in the hot paths, exported as a Chrome trace
+ */
+
+typedef struct span_event span_event_t;
+typedef struct span_ring span_ring_t;
+
+struct span_event
+{
+  const char *name;
+  uint64_t start_ns;
+  uint64_t duration_ns;
+};
+
+/// The spans of one thread. Only that thread writes it, the exporter reads it.
+struct span_ring
+{
+  span_event_t events[SPAN_RING_CAPACITY];
+  _Atomic uint64_t recorded; // spans ever recorded, the next one goes to recorded % SPAN_RING_CAPACITY
+  int thread;                // the tid of the trace, in the order the threads first recorded
+  span_ring_t *next;
+};
+
+// The rings of every thread that has recorded, kept after the thread ends so its spans are exported
+static _Atomic(span_ring_t *) rings = NULL;
+static atomic_int ring_count = 0;
+static _Thread_local span_ring_t *thread_ring = NULL;
+
+uint64_t span_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static span_ring_t *ring_create(void)
+{
+  span_ring_t *ring = malloc(sizeof(span_ring_t));
+  atomic_init(&ring->recorded, 0);
+  ring->thread = atomic_fetch_add(&ring_count, 1) + 1;
+  ring->next = atomic_load(&rings);
+
+  // Pushed on the list without a lock, retried if another thread pushed first
+  while (!atomic_compare_exchange_weak(&rings, &ring->next, ring))
+  {
+  }
+  return ring;
+}
+
+void span_record(const span_t *span)
+{
+  uint64_t end = span_now();
+
+  if (thread_ring == NULL)
+  {
+    thread_ring = ring_create();
+  }
+
+  uint64_t recorded = atomic_load_explicit(&thread_ring->recorded, memory_order_relaxed);
+  thread_ring->events[recorded % SPAN_RING_CAPACITY] =
+      (span_event_t){.name = span->name, .start_ns = span->start_ns, .duration_ns = end - span->start_ns};
+  // The exporter sees the event before it sees it counted
+  atomic_store_explicit(&thread_ring->recorded, recorded + 1, memory_order_release);
+}
+
+bool span_export_chrome(const char *path)
+{
+  FILE *file = fopen(path, "w");
+  if (file == NULL)
+  {
+    return false;
+  }
+
+  uint64_t origin = UINT64_MAX; // the first span starts at 0 on the timeline
+  uint64_t dropped = 0;
+  for (span_ring_t *ring = atomic_load(&rings); ring != NULL; ring = ring->next)
+  {
+    uint64_t recorded = atomic_load_explicit(&ring->recorded, memory_order_acquire);
+    uint64_t first = recorded > SPAN_RING_CAPACITY ? recorded - SPAN_RING_CAPACITY : 0;
+    for (uint64_t i = first; i < recorded; i++)
+    {
+      uint64_t start = ring->events[i % SPAN_RING_CAPACITY].start_ns;
+      origin = start < origin ? start : origin;
+    }
+  }
+
+  fprintf(file, "{\"traceEvents\": [\n");
+  const char *separator = "";
+  for (span_ring_t *ring = atomic_load(&rings); ring != NULL; ring = ring->next)
+  {
+    uint64_t recorded = atomic_load_explicit(&ring->recorded, memory_order_acquire);
+    uint64_t first = recorded > SPAN_RING_CAPACITY ? recorded - SPAN_RING_CAPACITY : 0;
+    dropped += first;
+
+    fprintf(file, "%s  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"thread %d\"}}",
+            separator, ring->thread, ring->thread);
+    separator = ",\n";
+    for (uint64_t i = first; i < recorded; i++)
+    {
+      span_event_t *event = &ring->events[i % SPAN_RING_CAPACITY];
+      // Chrome wants microseconds, the fractions keep the nanoseconds
+      fprintf(file, ",\n  {\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+              event->name, ring->thread, (event->start_ns - origin) / 1e3, event->duration_ns / 1e3);
+    }
+  }
+  fprintf(file, "\n], \"displayTimeUnit\": \"ns\", \"otherData\": {\"dropped_spans\": %lu}}\n", (unsigned long)dropped);
+
+  bool written = !ferror(file);
+  return fclose(file) == 0 && written;
+}
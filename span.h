@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @file span.h
+ * @author Erdem Garip
+ * @date 18 Oct 2026
+ * @brief Timed spans in the hot paths, exported as a Chrome trace
+ *
+ * A span times the code between SPAN_BEGIN and SPAN_END:
+ *
+ *     SPAN_BEGIN(span, "checkout");
+ *     ...
+ *     SPAN_END(span);
+ *
+ * Spans are only compiled in with -DWEBSTORE_SPANS, `make SPANS=1` after `make clean`. Without
+ * it both macros expand to nothing, so the hot paths are exactly as fast as without spans.
+ *
+ * Every thread records its spans into a ring buffer of its own, so recording takes no lock and
+ * no atomic read-modify-write, only two clock reads and a store. When a ring is full the oldest
+ * spans are overwritten. span_export_chrome writes the spans as trace events that
+ * chrome://tracing and Perfetto show on a timeline, one row per thread, nested spans beneath
+ * the spans they are in.
+ */
+
+#define SPAN_RING_CAPACITY (1 << 16) // spans kept per thread
+
+#ifdef WEBSTORE_SPANS
+#define SPAN_BEGIN(span, label) const span_t span = {.name = (label), .start_ns = span_now()}
+#define SPAN_END(span) span_record(&(span))
+#else
+#define SPAN_BEGIN(span, label)
+#define SPAN_END(span)
+#endif
+
+typedef struct span span_t;
+
+struct span
+{
+  const char *name; // a string literal, it is not copied
+  uint64_t start_ns;
+};
+
+/// @brief Reads the clock spans are timed with
+/// @return Nanoseconds on the monotonic clock
+uint64_t span_now(void);
+
+/// @brief Records a span that ends now in the ring of the calling thread
+/// @param span The span, from SPAN_BEGIN
+void span_record(const span_t *span);
+
+/// @brief Writes the recorded spans of every thread as Chrome trace event JSON. The threads
+/// should not record while this runs, or the spans being overwritten may be written torn.
+/// @param path The file, replaced if it exists
+/// @return False if the file could not be written
+bool span_export_chrome(const char *path);
@@ -1,10 +1,29 @@
 #include <CUnit/Basic.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <signal.h>
 #include "linked_list.h"
 #include "hash_table.h"
 #include "iterator.h"
 #include "common.h"
 #include "frontend.h"
 #include "backend.h"
+#include "import.h"
+#include "command.h"
+#include "server.h"
+#include "inbuf.h"
+#include "trace.h"
+#include "span.h"
+#include "metrics.h"
+#include "memstats.h"
+#include "timer_wheel.h"
+#include "wal.h"
 
 char *ioopm_strdup(char *str);
 char *ioopm_strdup(char *str)
@@ -91,6 +110,17 @@ void test2_create_merch(void)
   free(nameC);
   db_destroy_a_merch(adidas);
   db_destroy_a_merch(nixe);
+
+  // Namn med samma hash ska gå att hitta allihop
+  webstore_t *db = db_create_webstore();
+  db_add_merch(db, db_create_merch(ioopm_strdup("ab"), ioopm_strdup("x"), 1));
+  db_add_merch(db, db_create_merch(ioopm_strdup("ba"), ioopm_strdup("y"), 2));
+  CU_ASSERT_EQUAL(1, db_get_price(db_get_merch(db, "ab")));
+  CU_ASSERT_EQUAL(2, db_get_price(db_get_merch(db, "ba")));
+  db_remove_merch(db, "ab");
+  CU_ASSERT_PTR_NULL(db_get_merch(db, "ab"));
+  CU_ASSERT_EQUAL(2, db_get_price(db_get_merch(db, "ba")));
+  db_destroy_webstore(db);
 }
 
 void test3_remove_merch(void)
@@ -108,7 +138,7 @@ void test3_remove_merch(void)
   db_remove_merch(db, db_get_name(adidas));
   // CU_ASSERT_FALSE(db_has_key(db, db_get_name(adidas)));
   // Ovanstående test ger invalid read eftersom db_get_name förutsätter att en merch existerar
-  CU_ASSERT_FALSE(db_has_key(db, nameA));
+  CU_ASSERT_FALSE(db_has_key(db, "adidas")); // nameA frigjordes med merchen
 
   // TODO: add merch to cart
 
@@ -129,22 +159,37 @@ void test4_edit_merch(void)
   merch_t *adidas = db_create_merch(nameA, descA, priceA);
 
   db_add_merch(db, adidas);
+  db_add_location_to_merch(db, adidas, ioopm_strdup("A01"), 10);
   CU_ASSERT_TRUE(db_has_key(db, nameA));
   CU_ASSERT_EQUAL(1, db_merch_count(db));
 
+  shopping_carts_t *cartA = db_create_cart();
+  db_add_cart(db, cartA);
+  db_add_merch_to_cart(cartA, adidas, 2);
+  merch_id_t adidas_id = db_get_merch_id(adidas);
+
   char *new_nameA = ioopm_strdup("nixe");
   char *new_descA = ioopm_strdup("byxor");
   int new_priceA = 55;
-  merch_t *nixe = db_edit_merch(db, adidas, new_nameA, new_descA, new_priceA);
+  db_update_merch(db, adidas, new_nameA, new_descA, new_priceA);
 
-  db_remove_merch(db, nameA);
-  CU_ASSERT_EQUAL(0, db_merch_count(db));
-  db_add_merch(db, nixe);
   CU_ASSERT_EQUAL(1, db_merch_count(db));
   CU_ASSERT_FALSE(db_has_key(db, nameAcopy)); // (x)
   CU_ASSERT_TRUE(db_has_key(db, new_nameA));
+  CU_ASSERT_PTR_EQUAL(adidas, db_get_merch(db, new_nameA));
+  CU_ASSERT_STRING_EQUAL("byxor", db_get_desc(adidas));
+  CU_ASSERT_EQUAL(55, db_get_price(adidas));
 
-  // TODO: lägg till test för shelf också
+  // Hyllorna och kundvagnarna ska fortfarande peka på samma merch
+  CU_ASSERT_EQUAL(adidas_id, db_get_merch_id(adidas));
+  CU_ASSERT_PTR_EQUAL(adidas, db_get_merch_on_shelf(db, "A01"));
+  CU_ASSERT_EQUAL(10, db_get_merch_location_quantity(adidas, "A01"));
+  CU_ASSERT_EQUAL(110, db_calculate_cost(db, cartA));
+
+  db_rename_merch(db, adidas, ioopm_strdup("puma"));
+  CU_ASSERT_FALSE(db_has_key(db, "nixe"));
+  CU_ASSERT_TRUE(db_has_key(db, "puma"));
+  CU_ASSERT_STRING_EQUAL("byxor", db_get_desc(adidas));
 
   free(nameAcopy);
   db_destroy_webstore(db);
@@ -166,7 +211,7 @@ void test5_replenish_new(void)
   CU_ASSERT_TRUE(db_has_key(db, nameA));
   CU_ASSERT_FALSE(db_location_name_exists_in_webstore(db, locationA));
 
-  db_add_location_to_merch(adidas, locationA, location_quantityA);
+  db_add_location_to_merch(db, adidas, locationA, location_quantityA);
   CU_ASSERT_TRUE(db_location_name_exists_in_webstore(db, locationA));
 
   db_destroy_webstore(db);
@@ -190,11 +235,11 @@ void test6_replenish_edit(void)
   CU_ASSERT_TRUE(db_has_key(db, nameA));
   CU_ASSERT_FALSE(db_location_name_exists_in_webstore(db, locationA));
 
-  db_add_location_to_merch(adidas, locationA, location_quantityA);
+  db_add_location_to_merch(db, adidas, locationA, location_quantityA);
   CU_ASSERT_TRUE(db_location_name_exists_in_webstore(db, locationA));
 
   CU_ASSERT_FALSE(db_location_name_exists_in_webstore(db, location_does_not_exist));
-  CU_ASSERT_FALSE(db_edit_location_quantity(adidas, location_does_not_exist, dummy));
+  CU_ASSERT_FALSE(db_edit_location_quantity(db, adidas, location_does_not_exist, dummy));
   CU_ASSERT_FALSE(db_location_name_exists_in_webstore(db, location_does_not_exist));
 
   char *nameB = ioopm_strdup("nixe");
@@ -207,11 +252,11 @@ void test6_replenish_edit(void)
   merch_t *nixe = db_create_merch(nameB, descB, priceB);
   db_add_merch(db, nixe);
 
-  CU_ASSERT_FALSE(db_edit_location_quantity(nixe, locationB, quantityB));
+  CU_ASSERT_FALSE(db_edit_location_quantity(db, nixe, locationB, quantityB));
   CU_ASSERT_EQUAL(-1, db_get_merch_location_quantity(nixe, locationB));
-  db_add_location_to_merch(nixe, locationB, quantityB);
+  db_add_location_to_merch(db, nixe, locationB, quantityB);
   CU_ASSERT_EQUAL(11, db_get_merch_location_quantity(nixe, locationB));
-  CU_ASSERT_TRUE(db_edit_location_quantity(nixe, locationB, quantityBnew));
+  CU_ASSERT_TRUE(db_edit_location_quantity(db, nixe, locationB, quantityBnew));
   CU_ASSERT_EQUAL(25, db_get_merch_location_quantity(nixe, locationB));
 
   free(location_does_not_exist);
@@ -255,25 +300,25 @@ void test8_add_and_remove_cart(void)
   int location_quantityA2 = 100;
   merch_t *adidas = db_create_merch(nameA, descA, priceA);
   db_add_merch(db, adidas);
-  db_add_location_to_merch(adidas, locationA1, location_quantityA1);
-  db_add_location_to_merch(adidas, locationA2, location_quantityA2);
+  db_add_location_to_merch(db, adidas, locationA1, location_quantityA1);
+  db_add_location_to_merch(db, adidas, locationA2, location_quantityA2);
   // Nu borde det vara så här:
   //  adidas -> (adidas, bra skor, 100) locations -> ([A01, 200], [A31, 100])
   // Totalt 300 exemplar i två shelf
 
-  int lookup_cart_1a = db_get_merch_quantity_in_a_cart(cartA, nameA);
+  int lookup_cart_1a = db_get_merch_quantity_in_a_cart(cartA, adidas);
   int lookup_cart_1b = db_lookup_merch_quantity_in_locations(adidas);
   CU_ASSERT_EQUAL(0, lookup_cart_1a);
   CU_ASSERT_EQUAL(300, lookup_cart_1b);
 
-  db_add_merch_to_cart(cartA, nameA, 250);
-  int lookup_cart_2a = db_get_merch_quantity_in_a_cart(cartA, nameA);
+  db_add_merch_to_cart(cartA, adidas, 250);
+  int lookup_cart_2a = db_get_merch_quantity_in_a_cart(cartA, adidas);
   int lookup_cart_2b = db_lookup_merch_quantity_in_locations(adidas);
   CU_ASSERT_EQUAL(300, lookup_cart_2b);
   CU_ASSERT_EQUAL(250, lookup_cart_2a);
 
-  db_remove_merch_from_cart(cartA, nameA);
-  int lookup_cart_3a = db_get_merch_quantity_in_a_cart(cartA, nameA);
+  db_remove_merch_from_cart(cartA, adidas);
+  int lookup_cart_3a = db_get_merch_quantity_in_a_cart(cartA, adidas);
   CU_ASSERT_EQUAL(0, lookup_cart_3a);
 
   db_destroy_webstore(db);
@@ -297,11 +342,11 @@ void test9_calculate_cost(void)
   int location_quantityA2 = 100;
   merch_t *adidas = db_create_merch(nameA, descA, priceA);
   db_add_merch(db, adidas);
-  db_add_location_to_merch(adidas, locationA1, location_quantityA1);
-  db_add_location_to_merch(adidas, locationA2, location_quantityA2);
+  db_add_location_to_merch(db, adidas, locationA1, location_quantityA1);
+  db_add_location_to_merch(db, adidas, locationA2, location_quantityA2);
 
   CU_ASSERT_EQUAL(0, db_calculate_cost(db, cartA));
-  db_add_merch_to_cart(cartA, nameA, 2);
+  db_add_merch_to_cart(cartA, adidas, 2);
   CU_ASSERT_EQUAL(200, db_calculate_cost(db, cartA));
 
   db_destroy_webstore(db);
@@ -327,16 +372,16 @@ void test10_checkout(void)
   int location_quantityA3 = 80;
   merch_t *adidas = db_create_merch(nameA, descA, priceA);
   db_add_merch(db, adidas);
-  db_add_location_to_merch(adidas, locationA1, location_quantityA1);
-  db_add_location_to_merch(adidas, locationA2, location_quantityA2);
-  db_add_location_to_merch(adidas, locationA3, location_quantityA3);
+  db_add_location_to_merch(db, adidas, locationA1, location_quantityA1);
+  db_add_location_to_merch(db, adidas, locationA2, location_quantityA2);
+  db_add_location_to_merch(db, adidas, locationA3, location_quantityA3);
 
   CU_ASSERT_PTR_NOT_NULL(cartA);
   CU_ASSERT_EQUAL(db_lookup_merch_quantity_in_locations(adidas), 330);
-  db_add_merch_to_cart(cartA, nameA, 100);
-  CU_ASSERT_EQUAL(100, db_get_merch_quantity_in_a_cart(cartA, nameA));
-  db_update_merch_quantity_in_cart(cartA, nameA, 160);
-  CU_ASSERT_EQUAL(260, db_get_merch_quantity_in_a_cart(cartA, nameA));
+  db_add_merch_to_cart(cartA, adidas, 100);
+  CU_ASSERT_EQUAL(100, db_get_merch_quantity_in_a_cart(cartA, adidas));
+  db_update_merch_quantity_in_cart(cartA, adidas, 160);
+  CU_ASSERT_EQUAL(260, db_get_merch_quantity_in_a_cart(cartA, adidas));
   CU_ASSERT_EQUAL(db_get_merch_location_quantity(adidas, "A01"), 200);
   CU_ASSERT_EQUAL(db_get_merch_location_quantity(adidas, "A31"), 50);
   CU_ASSERT_EQUAL(db_get_merch_location_quantity(adidas, "C88"), 80);
@@ -366,11 +411,11 @@ void test11_checkout_without_update(void)
   int location_quantityA2 = 100;
   merch_t *adidas = db_create_merch(nameA, descA, priceA);
   db_add_merch(db, adidas);
-  db_add_location_to_merch(adidas, locationA1, location_quantityA1);
-  db_add_location_to_merch(adidas, locationA2, location_quantityA2);
+  db_add_location_to_merch(db, adidas, locationA1, location_quantityA1);
+  db_add_location_to_merch(db, adidas, locationA2, location_quantityA2);
 
   CU_ASSERT_EQUAL(db_lookup_merch_quantity_in_locations(adidas), 300);
-  db_add_merch_to_cart(cartA, nameA, 230);
+  db_add_merch_to_cart(cartA, adidas, 230);
   CU_ASSERT_EQUAL(db_get_merch_location_quantity(adidas, "A01"), 200);
   CU_ASSERT_EQUAL(db_get_merch_location_quantity(adidas, "A31"), 100);
 
@@ -400,8 +445,8 @@ void test12_checkout_with_update(void)
   int location_quantityA2 = 100;
   merch_t *adidas = db_create_merch(nameA, descA, priceA);
   db_add_merch(db, adidas);
-  db_add_location_to_merch(adidas, locationA1, location_quantityA1);
-  db_add_location_to_merch(adidas, locationA2, location_quantityA2);
+  db_add_location_to_merch(db, adidas, locationA1, location_quantityA1);
+  db_add_location_to_merch(db, adidas, locationA2, location_quantityA2);
 
   char *nameB = ioopm_strdup("nixe");
   char *descB = ioopm_strdup("bra byx");
@@ -414,15 +459,15 @@ void test12_checkout_with_update(void)
   char *locationB3 = ioopm_strdup("A99");
   int location_quantityB3 = 50;
   db_add_merch(db, nixe);
-  db_add_location_to_merch(nixe, locationB1, location_quantityB1);
-  db_add_location_to_merch(nixe, locationB2, location_quantityB2);
-  db_add_location_to_merch(nixe, locationB3, location_quantityB3);
+  db_add_location_to_merch(db, nixe, locationB1, location_quantityB1);
+  db_add_location_to_merch(db, nixe, locationB2, location_quantityB2);
+  db_add_location_to_merch(db, nixe, locationB3, location_quantityB3);
 
   CU_ASSERT_EQUAL(db_lookup_merch_quantity_in_locations(adidas), 300);
   CU_ASSERT_EQUAL(db_lookup_merch_quantity_in_locations(nixe), 450);
 
-  db_add_merch_to_cart(cartA, nameA, 10);
-  db_update_merch_quantity_in_cart(cartA, nameA, 40);
+  db_add_merch_to_cart(cartA, adidas, 10);
+  db_update_merch_quantity_in_cart(cartA, adidas, 40);
   CU_ASSERT_EQUAL(db_lookup_merch_quantity_in_locations(adidas), 300);
   CU_ASSERT_EQUAL(db_lookup_merch_quantity_in_locations(nixe), 450);
   CU_ASSERT_EQUAL(db_get_merch_location_quantity(adidas, "A01"), 200);
@@ -435,9 +480,9 @@ void test12_checkout_with_update(void)
   CU_ASSERT_EQUAL(db_get_merch_location_quantity(adidas, "A31"), 100);
 
   CU_ASSERT_PTR_NOT_NULL(cartB);
-  db_add_merch_to_cart(cartB, nameA, 200);
-  db_add_merch_to_cart(cartB, nameB, 200);
-  db_update_merch_quantity_in_cart(cartB, nameB, 50);
+  db_add_merch_to_cart(cartB, adidas, 200);
+  db_add_merch_to_cart(cartB, nixe, 200);
+  db_update_merch_quantity_in_cart(cartB, nixe, 50);
   CU_ASSERT_EQUAL(db_lookup_merch_quantity_in_locations(adidas), 250);
   CU_ASSERT_EQUAL(db_lookup_merch_quantity_in_locations(nixe), 450);
 
@@ -471,21 +516,21 @@ void test13_costs_and_valid_quantities(void)
   int location_quantityA2 = 100;
   merch_t *adidas = db_create_merch(nameA, descA, priceA);
   db_add_merch(db, adidas);
-  db_add_location_to_merch(adidas, locationA1, location_quantityA1);
-  db_add_location_to_merch(adidas, locationA2, location_quantityA2);
+  db_add_location_to_merch(db, adidas, locationA1, location_quantityA1);
+  db_add_location_to_merch(db, adidas, locationA2, location_quantityA2);
 
-  CU_ASSERT_EQUAL(300, db_lookup_valid_quantity(db, adidas, nameA));
+  CU_ASSERT_EQUAL(300, db_lookup_valid_quantity(db, adidas));
   CU_ASSERT_EQUAL(300, db_lookup_merch_quantity_in_locations(adidas));
-  CU_ASSERT_EQUAL(0, db_lookup_merch_quantity_in_carts(db, nameA));
+  CU_ASSERT_EQUAL(0, db_lookup_merch_quantity_in_carts(db, adidas));
 
-  db_add_merch_to_cart(cartA, nameA, 100);
-  CU_ASSERT_EQUAL(200, db_lookup_valid_quantity(db, adidas, nameA));
-  CU_ASSERT_EQUAL(100, db_lookup_merch_quantity_in_carts(db, nameA));
+  db_add_merch_to_cart(cartA, adidas, 100);
+  CU_ASSERT_EQUAL(200, db_lookup_valid_quantity(db, adidas));
+  CU_ASSERT_EQUAL(100, db_lookup_merch_quantity_in_carts(db, adidas));
 
-  db_add_merch_to_cart(cartB, nameA, 150);
+  db_add_merch_to_cart(cartB, adidas, 150);
   CU_ASSERT_EQUAL(300, db_lookup_merch_quantity_in_locations(adidas));
-  CU_ASSERT_EQUAL(250, db_lookup_merch_quantity_in_carts(db, nameA));
-  CU_ASSERT_EQUAL(50, db_lookup_valid_quantity(db, adidas, nameA));
+  CU_ASSERT_EQUAL(250, db_lookup_merch_quantity_in_carts(db, adidas));
+  CU_ASSERT_EQUAL(50, db_lookup_valid_quantity(db, adidas));
 
   db_destroy_webstore(db);
 }
@@ -504,26 +549,721 @@ void test14_something(void)
   int location_quantityA1 = 200;
   merch_t *adidas = db_create_merch(nameA, descA, priceA);
   db_add_merch(db, adidas);
-  db_add_location_to_merch(adidas, locationA1, location_quantityA1);
+  db_add_location_to_merch(db, adidas, locationA1, location_quantityA1);
 
   // CU_ASSERT_EQUAL(200, db_lookup_merch_quantity_in_locations(adidas));
-  // CU_ASSERT_EQUAL(0, db_lookup_merch_quantity_in_carts(db, nameA));
-  // CU_ASSERT_EQUAL(200, db_lookup_valid_quantity(db, adidas, nameA));
+  // CU_ASSERT_EQUAL(0, db_lookup_merch_quantity_in_carts(db, adidas));
+  // CU_ASSERT_EQUAL(200, db_lookup_valid_quantity(db, adidas));
 
-  db_add_merch_to_cart(cartA, nameA, 100);
+  db_add_merch_to_cart(cartA, adidas, 100);
   CU_ASSERT_EQUAL(300, db_calculate_cost(db, cartA));
-  db_remove_merch_from_cart(cartA, nameA);
+  db_remove_merch_from_cart(cartA, adidas);
   CU_ASSERT_EQUAL(0, db_calculate_cost(db, cartA));
   
   // CU_ASSERT_EQUAL(200, db_lookup_merch_quantity_in_locations(adidas));
-  // CU_ASSERT_EQUAL(100, db_lookup_merch_quantity_in_carts(db, nameA));
-  // CU_ASSERT_EQUAL(100, db_lookup_valid_quantity(db, adidas, nameA));
+  // CU_ASSERT_EQUAL(100, db_lookup_merch_quantity_in_carts(db, adidas));
+  // CU_ASSERT_EQUAL(100, db_lookup_valid_quantity(db, adidas));
+
+  db_lookup_merch_quantity_in_carts(db, adidas);
+
+  db_destroy_webstore(db);
+}
+
+void test15_shelf_index(void)
+{
+  webstore_t *db = db_create_webstore();
+  char free_shelf[4];
+
+  CU_ASSERT_TRUE(db_first_free_shelf(db, free_shelf));
+  CU_ASSERT_STRING_EQUAL(free_shelf, "A00");
+
+  merch_t *adidas = db_create_merch(ioopm_strdup("adidas"), ioopm_strdup("bra skor"), 100);
+  merch_t *nixe = db_create_merch(ioopm_strdup("nixe"), ioopm_strdup("bra byx"), 50);
+  db_add_merch(db, adidas);
+  db_add_merch(db, nixe);
+
+  db_add_location_to_merch(db, adidas, ioopm_strdup("A00"), 10);
+  db_add_location_to_merch(db, adidas, ioopm_strdup("A01"), 10);
+  db_add_location_to_merch(db, nixe, ioopm_strdup("B25"), 5);
+
+  CU_ASSERT_PTR_EQUAL(db_get_merch_on_shelf(db, "A00"), adidas);
+  CU_ASSERT_PTR_EQUAL(db_get_merch_on_shelf(db, "B25"), nixe);
+  CU_ASSERT_PTR_NULL(db_get_merch_on_shelf(db, "B26"));
+  CU_ASSERT_PTR_NULL(db_get_merch_on_shelf(db, "B255"));
+  CU_ASSERT_TRUE(db_first_free_shelf(db, free_shelf));
+  CU_ASSERT_STRING_EQUAL(free_shelf, "A02");
+
+  // En merch får inte ändra en hylla som tillhör en annan merch
+  CU_ASSERT_FALSE(db_edit_location_quantity(db, adidas, "B25", 99));
+  CU_ASSERT_EQUAL(5, db_get_merch_location_quantity(nixe, "B25"));
+
+  db_remove_merch(db, "adidas");
+  CU_ASSERT_FALSE(db_location_name_exists_in_webstore(db, "A00"));
+  CU_ASSERT_FALSE(db_location_name_exists_in_webstore(db, "A01"));
+  CU_ASSERT_TRUE(db_location_name_exists_in_webstore(db, "B25"));
+  CU_ASSERT_TRUE(db_first_free_shelf(db, free_shelf));
+  CU_ASSERT_STRING_EQUAL(free_shelf, "A00");
+
+  db_destroy_webstore(db);
+}
+
+void test16_merch_ids(void)
+{
+  webstore_t *db = db_create_webstore();
+
+  shopping_carts_t *cartA = db_create_cart();
+  db_add_cart(db, cartA);
+
+  merch_t *adidas = db_create_merch(ioopm_strdup("adidas"), ioopm_strdup("bra skor"), 100);
+  merch_t *nixe = db_create_merch(ioopm_strdup("nixe"), ioopm_strdup("bra byx"), 50);
+  CU_ASSERT_EQUAL(DB_NO_MERCH_ID, db_get_merch_id(adidas));
+
+  db_add_merch(db, adidas);
+  db_add_merch(db, nixe);
+  merch_id_t adidas_id = db_get_merch_id(adidas);
+  merch_id_t nixe_id = db_get_merch_id(nixe);
+
+  CU_ASSERT_NOT_EQUAL(adidas_id, nixe_id);
+  CU_ASSERT_PTR_EQUAL(db_get_merch_from_id(db, adidas_id), adidas);
+  CU_ASSERT_PTR_EQUAL(db_get_merch_from_id(db, nixe_id), nixe);
+  CU_ASSERT_PTR_NULL(db_get_merch_from_id(db, DB_NO_MERCH_ID));
+
+  db_add_merch_to_cart(cartA, adidas, 1);
+  db_add_merch_to_cart(cartA, nixe, 2);
+  CU_ASSERT_EQUAL(200, db_calculate_cost(db, cartA));
 
-  db_lookup_merch_quantity_in_carts(db, nameA);
+  // Handtaget till en borttagen merch ska inte kunna återanvändas av en ny merch på samma plats
+  db_remove_merch(db, "adidas");
+  CU_ASSERT_PTR_NULL(db_get_merch_from_id(db, adidas_id));
+  CU_ASSERT_EQUAL(100, db_calculate_cost(db, cartA));
+
+  merch_t *puma = db_create_merch(ioopm_strdup("puma"), ioopm_strdup("snabba skor"), 10);
+  db_add_merch(db, puma);
+  CU_ASSERT_NOT_EQUAL(adidas_id, db_get_merch_id(puma));
+  CU_ASSERT_PTR_NULL(db_get_merch_from_id(db, adidas_id));
+  CU_ASSERT_PTR_EQUAL(db_get_merch_from_id(db, db_get_merch_id(puma)), puma);
+  CU_ASSERT_EQUAL(0, db_get_merch_quantity_in_a_cart(cartA, puma));
+
+  db_destroy_webstore(db);
+}
+
+static void count_carts(elem_t key, elem_t *cart, void *counter)
+{
+  *(int *)counter += db_get_cart_id(cart->p);
+}
+
+void test17_carts_holding_merch(void)
+{
+  webstore_t *db = db_create_webstore();
+
+  shopping_carts_t *cartA = db_create_cart();
+  db_add_cart(db, cartA);
+  shopping_carts_t *cartB = db_create_cart();
+  db_add_cart(db, cartB);
+  shopping_carts_t *cartC = db_create_cart();
+  db_add_cart(db, cartC);
+
+  merch_t *adidas = db_create_merch(ioopm_strdup("adidas"), ioopm_strdup("bra skor"), 100);
+  merch_t *nixe = db_create_merch(ioopm_strdup("nixe"), ioopm_strdup("bra byx"), 50);
+  db_add_merch(db, adidas);
+  db_add_merch(db, nixe);
+  db_add_location_to_merch(db, adidas, ioopm_strdup("A01"), 100);
+
+  CU_ASSERT_EQUAL(0, db_carts_holding_merch(adidas));
+  db_add_merch_to_cart(cartA, adidas, 10);
+  db_add_merch_to_cart(cartB, adidas, 20);
+  db_update_merch_quantity_in_cart(cartB, adidas, 5);
+  db_add_merch_to_cart(cartC, nixe, 1);
+  CU_ASSERT_EQUAL(2, db_carts_holding_merch(adidas));
+  CU_ASSERT_EQUAL(1, db_carts_holding_merch(nixe));
+  CU_ASSERT_EQUAL(35, db_lookup_merch_quantity_in_carts(db, adidas));
+
+  int id_sum = 0;
+  db_apply_to_carts_holding_merch(adidas, count_carts, &id_sum);
+  CU_ASSERT_EQUAL(1 + 2, id_sum);
+
+  db_remove_merch_from_cart(cartA, adidas);
+  CU_ASSERT_EQUAL(1, db_carts_holding_merch(adidas));
+  CU_ASSERT_EQUAL(25, db_lookup_merch_quantity_in_carts(db, adidas));
+
+  // Efter checkout är kundvagnen tom och håller inte längre i merchen
+  db_checkout(db, cartB);
+  CU_ASSERT_EQUAL(0, db_carts_holding_merch(adidas));
+  CU_ASSERT_EQUAL(0, db_calculate_cost(db, cartB));
+  CU_ASSERT_EQUAL(75, db_lookup_merch_quantity_in_locations(adidas));
+
+  db_remove_cart(db, 3);
+  CU_ASSERT_EQUAL(0, db_carts_holding_merch(nixe));
+
+  db_add_merch_to_cart(cartA, nixe, 3);
+  db_remove_merch(db, "nixe");
+  CU_ASSERT_EQUAL(0, db_calculate_cost(db, cartA));
+
+  // En kundvagn som fylls innan den läggs till har inget id än, den ska ändå släppas när den tas bort
+  shopping_carts_t *cartD = db_create_cart();
+  db_add_merch_to_cart(cartD, adidas, 4);
+  CU_ASSERT_EQUAL(1, db_carts_holding_merch(adidas));
+  db_add_cart(db, cartD);
+  CU_ASSERT_EQUAL(1, db_carts_holding_merch(adidas));
+  db_remove_cart(db, db_get_cart_id(cartD));
+  CU_ASSERT_EQUAL(0, db_carts_holding_merch(adidas));
+  db_remove_merch(db, "adidas");
+
+  db_destroy_webstore(db);
+}
+
+void test18_checkout_batch(void)
+{
+  webstore_t *db = db_create_webstore();
+
+  merch_t *adidas = db_create_merch(ioopm_strdup("adidas"), ioopm_strdup("bra skor"), 100);
+  merch_t *nixe = db_create_merch(ioopm_strdup("nixe"), ioopm_strdup("bra byx"), 50);
+  db_add_merch(db, adidas);
+  db_add_merch(db, nixe);
+  db_add_location_to_merch(db, adidas, ioopm_strdup("A01"), 60);
+  db_add_location_to_merch(db, adidas, ioopm_strdup("A02"), 40);
+  db_add_location_to_merch(db, nixe, ioopm_strdup("B01"), 10);
+
+  for (int i = 0; i < 4; i++)
+  {
+    db_add_cart(db, db_create_cart());
+  }
+  db_add_merch_to_cart(db_get_cart_from_id(db, 1), adidas, 70);
+  db_add_merch_to_cart(db_get_cart_from_id(db, 1), nixe, 5);
+  db_add_merch_to_cart(db_get_cart_from_id(db, 2), adidas, 40); // får inte plats efter kundvagn 1
+  db_add_merch_to_cart(db_get_cart_from_id(db, 3), adidas, 30);
+  db_add_merch_to_cart(db_get_cart_from_id(db, 3), nixe, 5);
+  db_add_merch_to_cart(db_get_cart_from_id(db, 4), nixe, 1); // får inte plats efter kundvagn 1 och 3
+
+  int ids[6] = {1, 2, 3, 4, 99, 1};
+  bool results[6];
+  CU_ASSERT_EQUAL(2, db_checkout_batch(db, ids, 6, results));
+  CU_ASSERT_TRUE(results[0]);
+  CU_ASSERT_FALSE(results[1]);
+  CU_ASSERT_TRUE(results[2]);
+  CU_ASSERT_FALSE(results[3]);
+  CU_ASSERT_FALSE(results[4]);
+  CU_ASSERT_FALSE(results[5]);
+
+  CU_ASSERT_EQUAL(0, db_lookup_merch_quantity_in_locations(adidas));
+  CU_ASSERT_EQUAL(0, db_lookup_merch_quantity_in_locations(nixe));
+  CU_ASSERT_EQUAL(2, db_carts_size(db));
+  CU_ASSERT_PTR_NULL(db_get_cart_from_id(db, 1));
+  CU_ASSERT_PTR_NULL(db_get_cart_from_id(db, 3));
+  CU_ASSERT_EQUAL(40, db_lookup_merch_quantity_in_carts(db, adidas));
+
+  // En vanlig checkout ändrar ingenting om lagret inte räcker
+  CU_ASSERT_FALSE(db_checkout(db, db_get_cart_from_id(db, 4)));
+  CU_ASSERT_EQUAL(1, db_get_merch_quantity_in_a_cart(db_get_cart_from_id(db, 4), nixe));
 
   db_destroy_webstore(db);
 }
 
+typedef struct checkout_thread checkout_thread_t;
+
+struct checkout_thread
+{
+  pthread_t thread;
+  webstore_t *db;
+  merch_t *first;
+  merch_t *second;
+  int checkouts;
+};
+
+static void *checkout_worker(void *arg)
+{
+  checkout_thread_t *self = arg;
+  shopping_carts_t *cart = db_create_cart();
+  db_add_cart(self->db, cart);
+
+  for (int i = 0; i < 500; i++)
+  {
+    db_update_merch_quantity_in_cart(cart, self->first, 1);
+    db_update_merch_quantity_in_cart(cart, self->second, 1);
+
+    if (db_checkout(self->db, cart))
+    {
+      self->checkouts++;
+    }
+    else
+    {
+      db_remove_merch_from_cart(cart, self->first);
+      db_remove_merch_from_cart(cart, self->second);
+    }
+  }
+  return NULL;
+}
+
+void test19_concurrent_checkout(void)
+{
+  webstore_t *db = db_create_concurrent_webstore();
+
+  merch_t *adidas = db_create_merch(ioopm_strdup("adidas"), ioopm_strdup("bra skor"), 100);
+  merch_t *nixe = db_create_merch(ioopm_strdup("nixe"), ioopm_strdup("bra byx"), 50);
+  db_add_merch(db, adidas);
+  db_add_merch(db, nixe);
+  db_add_location_to_merch(db, adidas, ioopm_strdup("A01"), 600);
+  db_add_location_to_merch(db, adidas, ioopm_strdup("A02"), 400);
+  db_add_location_to_merch(db, nixe, ioopm_strdup("B01"), 1000);
+
+  // Fyra trådar tävlar om 1000 av varje vara, hälften lägger dem i omvänd ordning
+  checkout_thread_t threads[4];
+  for (int i = 0; i < 4; i++)
+  {
+    threads[i] = (checkout_thread_t){.db = db, .first = i % 2 ? nixe : adidas, .second = i % 2 ? adidas : nixe};
+    pthread_create(&threads[i].thread, NULL, checkout_worker, &threads[i]);
+  }
+
+  int checkouts = 0;
+  for (int i = 0; i < 4; i++)
+  {
+    pthread_join(threads[i].thread, NULL);
+    checkouts = checkouts + threads[i].checkouts;
+  }
+
+  CU_ASSERT_EQUAL(1000, checkouts);
+  CU_ASSERT_EQUAL(0, db_lookup_merch_quantity_in_locations(adidas));
+  CU_ASSERT_EQUAL(0, db_lookup_merch_quantity_in_locations(nixe));
+  CU_ASSERT_EQUAL(0, db_lookup_merch_quantity_in_carts(db, adidas));
+  CU_ASSERT_EQUAL(0, db_carts_holding_merch(nixe));
+
+  // En borttagen vara går inte att lägga i en kundvagn
+  shopping_carts_t *cart = db_get_cart_from_id(db, 1);
+  db_remove_merch(db, "adidas");
+  db_add_merch_to_cart(cart, adidas, 1);
+  CU_ASSERT_FALSE(db_cart_has_key(cart, adidas));
+  CU_ASSERT_EQUAL(1, db_merch_count(db));
+
+  db_destroy_webstore(db);
+}
+
+typedef struct reserve_thread reserve_thread_t;
+
+struct reserve_thread
+{
+  pthread_t thread;
+  merch_t *merch;
+  shopping_carts_t *cart;
+  int reserved;
+};
+
+static void *reserve_worker(void *arg)
+{
+  reserve_thread_t *self = arg;
+
+  for (int i = 0; i < 400; i++)
+  {
+    if (db_try_reserve(self->merch, self->cart, 1))
+    {
+      self->reserved++;
+    }
+  }
+  return NULL;
+}
+
+void test20_try_reserve(void)
+{
+  webstore_t *db = db_create_concurrent_webstore();
+
+  merch_t *adidas = db_create_merch(ioopm_strdup("adidas"), ioopm_strdup("bra skor"), 100);
+  db_add_merch(db, adidas);
+  db_add_location_to_merch(db, adidas, ioopm_strdup("A01"), 600);
+  db_add_location_to_merch(db, adidas, ioopm_strdup("A02"), 400);
+
+  // Fyra trådar försöker reservera 1600 enheter av 1000
+  reserve_thread_t threads[4];
+  for (int i = 0; i < 4; i++)
+  {
+    threads[i] = (reserve_thread_t){.merch = adidas, .cart = db_create_cart()};
+    db_add_cart(db, threads[i].cart);
+    pthread_create(&threads[i].thread, NULL, reserve_worker, &threads[i]);
+  }
+
+  int reserved = 0;
+  for (int i = 0; i < 4; i++)
+  {
+    pthread_join(threads[i].thread, NULL);
+    reserved = reserved + threads[i].reserved;
+    CU_ASSERT_EQUAL(threads[i].reserved, db_get_merch_quantity_in_a_cart(threads[i].cart, adidas));
+  }
+
+  CU_ASSERT_EQUAL(1000, reserved);
+  CU_ASSERT_EQUAL(1000, db_lookup_merch_quantity_in_carts(db, adidas));
+  CU_ASSERT_EQUAL(0, db_lookup_valid_quantity(db, adidas));
+  CU_ASSERT_FALSE(db_try_reserve(adidas, threads[0].cart, 1));
+
+  // När lagret fylls på går det att reservera igen
+  CU_ASSERT_TRUE(db_edit_location_quantity(db, adidas, "A02", 405));
+  CU_ASSERT_FALSE(db_try_reserve(adidas, threads[0].cart, 6));
+  CU_ASSERT_FALSE(db_try_reserve(adidas, threads[0].cart, 0));
+  CU_ASSERT_TRUE(db_try_reserve(adidas, threads[0].cart, 5));
+  CU_ASSERT_TRUE(db_checkout(db, threads[0].cart));
+  CU_ASSERT_EQUAL(1005 - threads[0].reserved - 5, db_lookup_merch_quantity_in_locations(adidas));
+  CU_ASSERT_EQUAL(0, db_lookup_valid_quantity(db, adidas));
+
+  db_destroy_webstore(db);
+}
+
+void test21_write_ahead_log(void)
+{
+  char *path = "tests_webstore.wal";
+  remove(path);
+  webstore_t *db = db_open_webstore(NULL, path, 5);
+
+  merch_t *adidas = db_create_merch(ioopm_strdup("adidas"), ioopm_strdup("bra skor"), 100);
+  merch_t *nixe = db_create_merch(ioopm_strdup("nixe"), ioopm_strdup("bra byx"), 50);
+  merch_t *puma = db_create_merch(ioopm_strdup("puma"), ioopm_strdup("katt"), 10);
+  db_add_merch(db, adidas);
+  db_add_merch(db, nixe);
+  db_add_merch(db, puma);
+  db_add_location_to_merch(db, adidas, ioopm_strdup("A01"), 60);
+  db_add_location_to_merch(db, nixe, ioopm_strdup("B01"), 10);
+  db_edit_location_quantity(db, nixe, "B01", 20);
+  db_update_merch(db, adidas, ioopm_strdup("adidas2"), NULL, 120);
+  db_remove_merch(db, "puma");
+
+  db_add_cart(db, db_create_cart());
+  db_add_cart(db, db_create_cart());
+  db_add_cart(db, db_create_cart());
+  db_add_merch_to_cart(db_get_cart_from_id(db, 1), adidas, 10);
+  db_update_merch_quantity_in_cart(db_get_cart_from_id(db, 1), adidas, 5);
+  db_try_reserve(nixe, db_get_cart_from_id(db, 1), 3);
+  CU_ASSERT_TRUE(db_checkout(db, db_get_cart_from_id(db, 1)));
+  db_add_merch_to_cart(db_get_cart_from_id(db, 2), nixe, 4);
+  db_add_merch_to_cart(db_get_cart_from_id(db, 3), adidas, 7);
+  db_remove_merch_from_cart(db_get_cart_from_id(db, 3), adidas);
+  db_remove_cart(db, 3);
+  db_destroy_webstore(db);
+
+  // Allt ska finnas kvar när loggen spelas upp
+  db = db_open_webstore(NULL, path, 5);
+  CU_ASSERT_EQUAL(2, db_merch_count(db));
+  CU_ASSERT_PTR_NULL(db_get_merch(db, "puma"));
+  CU_ASSERT_PTR_NULL(db_get_merch(db, "adidas"));
+  adidas = db_get_merch(db, "adidas2");
+  nixe = db_get_merch(db, "nixe");
+  CU_ASSERT_EQUAL(120, db_get_price(adidas));
+  CU_ASSERT_STRING_EQUAL("bra skor", db_get_desc(adidas));
+  CU_ASSERT_EQUAL(45, db_get_merch_location_quantity(adidas, "A01"));
+  CU_ASSERT_EQUAL(17, db_get_merch_location_quantity(nixe, "B01"));
+  CU_ASSERT_EQUAL(4, db_lookup_merch_quantity_in_carts(db, nixe));
+  CU_ASSERT_EQUAL(2, db_carts_size(db));
+  CU_ASSERT_PTR_NULL(db_get_cart_from_id(db, 3));
+  CU_ASSERT_EQUAL(4, db_get_merch_quantity_in_a_cart(db_get_cart_from_id(db, 2), nixe));
+
+  // En ny kundvagn får den borttagnas plats men inte dess id
+  shopping_carts_t *cart = db_create_cart();
+  db_add_cart(db, cart);
+  CU_ASSERT_PTR_NULL(db_get_cart_from_id(db, 3));
+  CU_ASSERT_NOT_EQUAL(3, db_get_cart_id(cart));
+  CU_ASSERT_PTR_EQUAL(cart, db_get_cart_from_id(db, db_get_cart_id(cart)));
+  CU_ASSERT_TRUE(db_sync(db));
+  db_destroy_webstore(db);
+
+  // En halvskriven post i slutet av loggen kastas bort
+  FILE *file = fopen(path, "ab");
+  fwrite("\x20\0\0\0\x01half", 1, 9, file);
+  fclose(file);
+
+  db = db_open_webstore(NULL, path, 5);
+  CU_ASSERT_EQUAL(2, db_merch_count(db));
+  CU_ASSERT_EQUAL(3, db_carts_size(db));
+  db_destroy_webstore(db);
+  remove(path);
+
+  // En logg som lägger till en kundvagn med ett annat id än den får hör inte till webbutiken
+  wal_t *wal = wal_open(path, 0);
+  wal_append(wal, 6, "i", 5); // LOG_ADD_CART
+  wal_close(wal);
+  struct stat before, after;
+  stat(path, &before);
+  CU_ASSERT_PTR_NULL(db_open_webstore(NULL, path, 5));
+  stat(path, &after);
+  CU_ASSERT_EQUAL(before.st_size, after.st_size);
+  remove(path);
+}
+
+static ssize_t read_at(int fd, void *bytes, size_t size, off_t offset)
+{
+  lseek(fd, offset, SEEK_SET);
+  return read(fd, bytes, size);
+}
+
+static ssize_t write_at(int fd, const void *bytes, size_t size, off_t offset)
+{
+  lseek(fd, offset, SEEK_SET);
+  return write(fd, bytes, size);
+}
+
+void test22_snapshot(void)
+{
+  char *snapshot_path = "tests_webstore.snapshot";
+  char *wal_path = "tests_snapshot.wal";
+  remove(snapshot_path);
+  remove(wal_path);
+  webstore_t *db = db_open_webstore(snapshot_path, wal_path, 5);
+
+  merch_t *adidas = db_create_merch(ioopm_strdup("adidas"), ioopm_strdup("bra skor"), 100);
+  merch_t *nixe = db_create_merch(ioopm_strdup("nixe"), ioopm_strdup("bra byx"), 50);
+  db_add_merch(db, adidas);
+  db_add_merch(db, nixe);
+  db_add_location_to_merch(db, adidas, ioopm_strdup("A01"), 60);
+  db_add_location_to_merch(db, adidas, ioopm_strdup("A02"), 40);
+  db_add_location_to_merch(db, nixe, ioopm_strdup("B01"), 10);
+  db_add_cart(db, db_create_cart());
+  db_add_cart(db, db_create_cart());
+  db_remove_cart(db, 1);
+  db_add_merch_to_cart(db_get_cart_from_id(db, 2), adidas, 30);
+  db_add_merch_to_cart(db_get_cart_from_id(db, 2), nixe, 2);
+  CU_ASSERT_TRUE(db_save_snapshot(db, snapshot_path));
+
+  // Det som händer efter snapshoten hamnar i loggen
+  db_update_merch(db, nixe, ioopm_strdup("nixe2"), NULL, 55);
+  db_destroy_webstore(db);
+
+  db = db_open_webstore(snapshot_path, wal_path, 5);
+  adidas = db_get_merch(db, "adidas");
+  nixe = db_get_merch(db, "nixe2");
+  CU_ASSERT_PTR_NOT_NULL_FATAL(adidas);
+  CU_ASSERT_PTR_NOT_NULL_FATAL(nixe);
+  CU_ASSERT_PTR_NULL(db_get_merch(db, "nixe"));
+  CU_ASSERT_STRING_EQUAL("bra skor", db_get_desc(adidas));
+  CU_ASSERT_EQUAL(55, db_get_price(nixe));
+  CU_ASSERT_EQUAL(40, db_get_merch_location_quantity(adidas, "A02"));
+  CU_ASSERT_EQUAL(100, db_lookup_merch_quantity_in_locations(adidas));
+  CU_ASSERT_PTR_EQUAL(nixe, db_get_merch_on_shelf(db, "B01"));
+  CU_ASSERT_EQUAL(70, db_lookup_valid_quantity(db, adidas));
+  CU_ASSERT_EQUAL(1, db_carts_size(db));
+  CU_ASSERT_EQUAL(2, db_get_merch_quantity_in_a_cart(db_get_cart_from_id(db, 2), nixe));
+
+  // Namn från snapshoten går att byta och ta bort
+  db_update_merch(db, adidas, ioopm_strdup("adidas2"), ioopm_strdup("ännu bättre skor"), 110);
+  CU_ASSERT_TRUE(db_checkout(db, db_get_cart_from_id(db, 2)));
+  shopping_carts_t *cart = db_create_cart();
+  db_add_cart(db, cart);
+  int cart_id = db_get_cart_id(cart);
+  CU_ASSERT_PTR_NULL(db_get_cart_from_id(db, 1));
+  CU_ASSERT_PTR_EQUAL(cart, db_get_cart_from_id(db, cart_id));
+  CU_ASSERT_TRUE(db_save_snapshot(db, snapshot_path));
+  db_remove_merch(db, "nixe2");
+  db_destroy_webstore(db);
+
+  db = db_open_webstore(snapshot_path, wal_path, 5);
+  CU_ASSERT_EQUAL(1, db_merch_count(db));
+  adidas = db_get_merch(db, "adidas2");
+  CU_ASSERT_PTR_NOT_NULL_FATAL(adidas);
+  CU_ASSERT_STRING_EQUAL("ännu bättre skor", db_get_desc(adidas));
+  CU_ASSERT_EQUAL(70, db_lookup_merch_quantity_in_locations(adidas));
+  CU_ASSERT_FALSE(db_location_name_exists_in_webstore(db, "B01"));
+
+  // Kundvagnarnas platser följer med snapshoten, så nästa kundvagn får samma id som den skulle ha fått
+  CU_ASSERT_PTR_NOT_NULL(db_get_cart_from_id(db, cart_id));
+  CU_ASSERT_PTR_NULL(db_get_cart_from_id(db, 1));
+  db_add_cart(db, db_create_cart());
+  CU_ASSERT_PTR_NOT_NULL(db_get_cart_from_id(db, 3));
+  db_destroy_webstore(db);
+
+  // En snapshot som inte går att läsa öppnas inte, och den lämnas orörd
+  struct stat st;
+  stat(snapshot_path, &st);
+  uint32_t version = 0;
+  uint32_t huge = 0xFFFFFF;
+  int32_t no_id = 0;
+  uint64_t carts_offset = 0;
+  int fd = open(snapshot_path, O_RDWR);
+  CU_ASSERT_EQUAL(4, read_at(fd, &version, 4, 8));
+  CU_ASSERT_EQUAL(8, read_at(fd, &carts_offset, 8, st.st_size - 88 + 24)); // footer.carts_offset
+  CU_ASSERT_EQUAL(4, write_at(fd, &(uint32_t){version - 1}, 4, 8));
+  CU_ASSERT_PTR_NULL(db_open_webstore(snapshot_path, wal_path, 5));
+  CU_ASSERT_EQUAL(4, write_at(fd, &version, 4, 8));
+
+  // Avklippt i den andra varan eller i en kundvagn: det som redan lästs in kastas
+  uint32_t first[4]; // pris, namnets och beskrivningens längd och antal hyllor
+  CU_ASSERT_EQUAL(16, read_at(fd, first, 16, 16));
+  off_t second = 16 + 16 + ((first[1] + 1 + first[2] + 1 + 3) & ~3) + first[3] * 8;
+  uint32_t name_length;
+  CU_ASSERT_EQUAL(4, read_at(fd, &name_length, 4, second + 4));
+  CU_ASSERT_EQUAL(4, write_at(fd, &huge, 4, second + 4));
+  CU_ASSERT_PTR_NULL(db_open_webstore(snapshot_path, wal_path, 5));
+  CU_ASSERT_EQUAL(4, write_at(fd, &name_length, 4, second + 4));
+  CU_ASSERT_EQUAL(4, write_at(fd, &no_id, 4, (off_t)carts_offset));
+  CU_ASSERT_PTR_NULL(db_open_webstore(snapshot_path, wal_path, 5));
+  close(fd);
+  struct stat after;
+  stat(snapshot_path, &after);
+  CU_ASSERT_EQUAL(st.st_size, after.st_size);
+
+  remove(snapshot_path);
+  remove(wal_path);
+}
+
+void test23_background_snapshot(void)
+{
+  char *snapshot_path = "tests_background.snapshot";
+  char *wal_path = "tests_background.wal";
+  remove(snapshot_path);
+  remove(wal_path);
+  webstore_t *db = db_open_webstore(snapshot_path, wal_path, 5);
+  CU_ASSERT_EQUAL(SNAPSHOT_IDLE, db_snapshot_status(db).state);
+
+  merch_t *adidas = db_create_merch(ioopm_strdup("adidas"), ioopm_strdup("bra skor"), 100);
+  merch_t *nixe = db_create_merch(ioopm_strdup("nixe"), ioopm_strdup("bra byx"), 50);
+  db_add_merch(db, adidas);
+  db_add_merch(db, nixe);
+  db_add_location_to_merch(db, adidas, ioopm_strdup("A01"), 60);
+  db_add_cart(db, db_create_cart());
+  db_add_merch_to_cart(db_get_cart_from_id(db, 1), adidas, 10);
+  CU_ASSERT_TRUE(db_save_snapshot_background(db, snapshot_path));
+
+  // Ändringar under tiden hamnar bara i loggen, inte i snapshoten
+  db_update_merch_quantity_in_cart(db_get_cart_from_id(db, 1), adidas, 5);
+  db_edit_location_quantity(db, adidas, "A01", 65);
+  db_add_location_to_merch(db, nixe, ioopm_strdup("B01"), 7);
+
+  snapshot_status_t status = db_wait_snapshot(db);
+  CU_ASSERT_EQUAL(SNAPSHOT_DONE, status.state);
+  CU_ASSERT_EQUAL(2, status.merch_count);
+  CU_ASSERT_EQUAL(2, status.merchs_written);
+  db_remove_merch(db, "nixe");
+  db_destroy_webstore(db);
+
+  // Inget får tappas eller spelas upp två gånger
+  db = db_open_webstore(snapshot_path, wal_path, 5);
+  adidas = db_get_merch(db, "adidas");
+  CU_ASSERT_PTR_NOT_NULL_FATAL(adidas);
+  CU_ASSERT_PTR_NULL(db_get_merch(db, "nixe"));
+  CU_ASSERT_EQUAL(65, db_get_merch_location_quantity(adidas, "A01"));
+  CU_ASSERT_EQUAL(15, db_get_merch_quantity_in_a_cart(db_get_cart_from_id(db, 1), adidas));
+  CU_ASSERT_FALSE(db_location_name_exists_in_webstore(db, "B01"));
+
+  // En snapshot i förgrunden väntar in den i bakgrunden
+  CU_ASSERT_TRUE(db_save_snapshot_background(db, snapshot_path));
+  db_update_merch_quantity_in_cart(db_get_cart_from_id(db, 1), adidas, 1);
+  CU_ASSERT_TRUE(db_save_snapshot(db, snapshot_path));
+  CU_ASSERT_NOT_EQUAL(SNAPSHOT_RUNNING, db_snapshot_status(db).state);
+  db_destroy_webstore(db);
+
+  db = db_open_webstore(snapshot_path, wal_path, 5);
+  CU_ASSERT_EQUAL(16, db_get_merch_quantity_in_a_cart(db_get_cart_from_id(db, 1), db_get_merch(db, "adidas")));
+  db_destroy_webstore(db);
+
+  remove(snapshot_path);
+  remove(wal_path);
+}
+
+void test24_import(void)
+{
+  char *path = "tests_import.csv";
+  FILE *file = fopen(path, "w");
+  fprintf(file, "name,desc,price,shelf,quantity\n"
+                "adidas,\"bra skor, \"\"nya\"\"\",100,A01,60\n"
+                "nixe,bra byx,50\r\n"
+                "\n"
+                "adidas,bra skor,100,A02,40\n"
+                "puma,billiga skor,-5,B01,10\n"
+                "puma,billiga skor,5,B1,10\n"
+                "puma,billiga skor,5,A01,10\n"
+                "nixe,bra byx,50\n"
+                "puma,billiga skor,5,,\n"
+                "reebok,\"inte stängd,5\n");
+  fclose(file);
+
+  webstore_t *db = db_create_webstore();
+  import_report_t report;
+  CU_ASSERT_TRUE(import_merchs(db, path, 3, &report));
+  CU_ASSERT_EQUAL(9, report.rows);
+  CU_ASSERT_EQUAL(3, report.merchs_added);
+  CU_ASSERT_EQUAL(2, report.shelves_added);
+  CU_ASSERT_EQUAL(5, report.rejected);
+  CU_ASSERT_EQUAL(6, report.first_rejected_line);
+
+  merch_t *adidas = db_get_merch(db, "adidas");
+  CU_ASSERT_PTR_NOT_NULL_FATAL(adidas);
+  CU_ASSERT_STRING_EQUAL("bra skor, \"nya\"", db_get_desc(adidas));
+  CU_ASSERT_EQUAL(100, db_lookup_merch_quantity_in_locations(adidas));
+  CU_ASSERT_EQUAL(50, db_get_price(db_get_merch(db, "nixe")));
+  CU_ASSERT_EQUAL(0, db_lookup_merch_quantity_in_locations(db_get_merch(db, "puma")));
+  CU_ASSERT_PTR_NULL(db_get_merch(db, "reebok"));
+
+  // Tabbar och ingen rubrik
+  file = fopen(path, "w");
+  fprintf(file, "gucci\tdyr, väldigt\t999\tC03\t2\n");
+  fclose(file);
+  CU_ASSERT_TRUE(import_merchs(db, path, 1, &report));
+  CU_ASSERT_EQUAL(1, report.merchs_added);
+  CU_ASSERT_EQUAL(0, report.first_rejected_line);
+  CU_ASSERT_STRING_EQUAL("dyr, väldigt", db_get_desc(db_get_merch(db, "gucci")));
+  CU_ASSERT_PTR_EQUAL(db_get_merch(db, "gucci"), db_get_merch_on_shelf(db, "C03"));
+
+  CU_ASSERT_FALSE(import_merchs(db, "finns_inte.csv", 1, &report));
+  db_destroy_webstore(db);
+  remove(path);
+}
+
+/// Läser in en hel fil som en sträng
+static char *read_file(char *path)
+{
+  FILE *file = fopen(path, "r");
+  char *content = calloc(4096, sizeof(char));
+  fread(content, 1, 4095, file);
+  fclose(file);
+  return content;
+}
+
+void test25_export(void)
+{
+  char *path = "tests_export.out";
+  webstore_t *db = db_create_webstore();
+  merch_t *adidas = db_create_merch(ioopm_strdup("adidas"), ioopm_strdup("bra skor, \"nya\""), 100);
+  merch_t *nixe = db_create_merch(ioopm_strdup("nixe"), ioopm_strdup("bra\tbyx"), 50);
+  db_add_merch(db, adidas);
+  db_add_merch(db, nixe);
+  db_add_location_to_merch(db, adidas, ioopm_strdup("A01"), 60);
+  db_add_location_to_merch(db, adidas, ioopm_strdup("A02"), 40);
+  db_add_cart(db, db_create_cart());
+  db_add_merch_to_cart(db_get_cart_from_id(db, 1), adidas, 3);
+
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  outbuf_t *out = outbuf_create(fd, 16); // mindre än en rad, så bufferten töms mitt i
+  CU_ASSERT_TRUE(db_export(db, out, EXPORT_CSV));
+  char *csv = read_file(path);
+  CU_ASSERT_STRING_EQUAL("name,desc,price,shelf,quantity\n"
+                         "adidas,\"bra skor, \"\"nya\"\"\",100,A01,60\n"
+                         "adidas,\"bra skor, \"\"nya\"\"\",100,A02,40\n"
+                         "nixe,bra\tbyx,50,,\n", csv);
+
+  // Samma buffert återanvänds för nästa export
+  int json_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  CU_ASSERT_TRUE(outbuf_reset(out, json_fd));
+  close(fd);
+  CU_ASSERT_TRUE(db_export(db, out, EXPORT_JSONL));
+  char *json = read_file(path);
+  CU_ASSERT_STRING_EQUAL("{\"name\":\"adidas\",\"desc\":\"bra skor, \\\"nya\\\"\",\"price\":100,"
+                         "\"shelves\":[{\"shelf\":\"A01\",\"quantity\":60},{\"shelf\":\"A02\",\"quantity\":40}]}\n"
+                         "{\"name\":\"nixe\",\"desc\":\"bra\\u0009byx\",\"price\":50,\"shelves\":[]}\n"
+                         "{\"cart\":1,\"lines\":[{\"name\":\"adidas\",\"quantity\":3}]}\n", json);
+  CU_ASSERT_TRUE(outbuf_destroy(out));
+  close(json_fd);
+
+  // En exporterad snapshot går att öppna
+  fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  out = outbuf_create(fd, 1 << 16);
+  CU_ASSERT_TRUE(db_export(db, out, EXPORT_SNAPSHOT));
+  outbuf_destroy(out);
+  close(fd);
+  db_destroy_webstore(db);
+
+  db = db_open_webstore(path, NULL, 0);
+  CU_ASSERT_EQUAL(2, db_merch_count(db));
+  CU_ASSERT_EQUAL(100, db_lookup_merch_quantity_in_locations(db_get_merch(db, "adidas")));
+  CU_ASSERT_EQUAL(3, db_get_merch_quantity_in_a_cart(db_get_cart_from_id(db, 1), db_get_merch(db, "adidas")));
+  db_destroy_webstore(db);
+
+  free(csv);
+  free(json);
+  remove(path);
+}
+
 int init_suite(void)
 {
   return 0;
@@ -534,6 +1274,698 @@ int clean_suite(void)
   return 0;
 }
 
+void test26_commands(void)
+{
+  char *path = "tests_commands.out";
+  char *script_path = "tests_commands.script";
+  webstore_t *db = db_create_webstore();
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  outbuf_t *out = outbuf_create(fd, 1 << 16);
+  // Raderna delas upp på plats, så de ligger i skrivbart minne
+  char lines[][64] = {
+      "add adidas \"bra skor \\\"nya\\\"\" 100",
+      "add adidas skor 100",
+      "replenish adidas A01 60",
+      "  # en kommentar",
+      "",
+      "cart",
+      "add-to-cart 1 adidas 70",
+      "add-to-cart 1 adidas 3",
+      "cost 1",
+      "show adidas",
+      "edit adidas nixe byxor 50",
+      "list",
+      "checkout 1",
+      "cost 1",
+      "add nixe",
+      "add puma skor tio",
+      "add puma \"skor",
+      "sync sync",
+      "fly"};
+  bool expected[] = {true, false, true, true, true, true, false, true, true, true, true, true, true, false, false, false, false, false, false};
+
+  for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++)
+  {
+    CU_ASSERT_EQUAL(expected[i], command_execute(db, lines[i], out));
+  }
+  outbuf_flush(out);
+  char *answers = read_file(path);
+  CU_ASSERT_STRING_EQUAL("ok\n"
+                         "err the merchandise already exists\n"
+                         "ok\n"
+                         "ok 1\n"
+                         "err not enough units available\n"
+                         "ok\n"
+                         "ok 300\n"
+                         "ok {\"name\":\"adidas\",\"desc\":\"bra skor \\\"nya\\\"\",\"price\":100,\"shelves\":[{\"shelf\":\"A01\",\"quantity\":60}]}\n"
+                         "ok\n"
+                         "ok 1\n"
+                         "{\"name\":\"nixe\",\"desc\":\"byxor\",\"price\":50,\"shelves\":[{\"shelf\":\"A01\",\"quantity\":60}]}\n"
+                         "ok\n"
+                         "err no such cart\n"
+                         "err add NAME DESC PRICE\n"
+                         "err an argument is not a number\n"
+                         "err a quote is not closed\n"
+                         "err too many arguments\n"
+                         "err unknown command\n", answers);
+  CU_ASSERT_EQUAL(57, db_lookup_merch_quantity_in_locations(db_get_merch(db, "nixe")));
+
+  // Varje kommando hittas på sitt namn
+  for (int id = 0; id < COMMAND_COUNT; id++)
+  {
+    CU_ASSERT_PTR_EQUAL(&command_table[id], command_find(command_table[id].name));
+  }
+  CU_ASSERT_PTR_NULL(command_find("fly"));
+  CU_ASSERT_PTR_NULL(command_find(""));
+
+  // Ett helt skript, där två kommandon misslyckas
+  FILE *script = fopen(script_path, "w");
+  fputs("cart\r\nremove-cart 3\nreplenish nixe A02 5\nreplenish nixe A01 10\nremove nixe\nremove nixe\n", script);
+  fclose(script);
+  int script_fd = open(script_path, O_RDONLY);
+  CU_ASSERT_TRUE(outbuf_reset(out, fd));
+  CU_ASSERT_EQUAL(2, command_run_script(db, script_fd, out));
+  close(script_fd);
+  CU_ASSERT_EQUAL(0, db_merch_count(db));
+
+  outbuf_destroy(out);
+  close(fd);
+  db_destroy_webstore(db);
+  free(answers);
+  remove(path);
+  remove(script_path);
+}
+
+typedef struct server_test server_test_t;
+
+struct server_test
+{
+  webstore_t *db;
+  atomic_int stop;
+  bool listened;
+};
+
+static void *run_test_server(void *arg)
+{
+  server_test_t *test = arg;
+  test->listened = server_run(test->db, "unix:tests_server.sock", &test->stop);
+  return NULL;
+}
+
+void test27_server(void)
+{
+  server_test_t test = {.db = db_create_webstore()};
+  pthread_t thread;
+  pthread_create(&thread, NULL, run_test_server, &test);
+
+  struct sockaddr_un addr = {.sun_family = AF_UNIX, .sun_path = "tests_server.sock"};
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  // Servern lyssnar inte förrän tråden har kommit igång
+  while (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+  {
+    sched_yield();
+  }
+
+  // Flera kommandon i samma skrivning, och ett som delas mellan två skrivningar
+  char *first = "add adidas skor 100\nreplenish adidas A01 60\r\ncart\nadd-to-cart 1 adi";
+  char *second = "das 3\ncost 1\nfly\n";
+  CU_ASSERT_EQUAL(strlen(first), write(fd, first, strlen(first)));
+  CU_ASSERT_EQUAL(strlen(second), write(fd, second, strlen(second)));
+  shutdown(fd, SHUT_WR); // svaren skickas ändå innan servern stänger
+
+  char answers[256];
+  size_t size = 0;
+  ssize_t got;
+  while ((got = read(fd, answers + size, sizeof(answers) - 1 - size)) > 0)
+  {
+    size += got;
+  }
+  answers[size] = '\0';
+  CU_ASSERT_STRING_EQUAL("ok\nok\nok 1\nok\nok 300\nerr unknown command\n", answers);
+  close(fd);
+
+  atomic_store(&test.stop, 1);
+  pthread_join(thread, NULL);
+  CU_ASSERT_TRUE(test.listened);
+  CU_ASSERT_EQUAL(57, db_lookup_valid_quantity(test.db, db_get_merch(test.db, "adidas")));
+  db_destroy_webstore(test.db);
+}
+
+void test28_inbuf(void)
+{
+  char *path = "tests_inbuf.in";
+  char long_line[1000];
+  memset(long_line, 'x', sizeof(long_line) - 1);
+  long_line[sizeof(long_line) - 1] = '\0';
+
+  FILE *file = fopen(path, "w");
+  fprintf(file, "add adidas\r\n\n%s\nsista", long_line);
+  fclose(file);
+
+  // En buffert på fyra byte måste växa för den långa raden
+  int fd = open(path, O_RDONLY);
+  inbuf_t *in = inbuf_create(fd, 4);
+  size_t size;
+  CU_ASSERT_STRING_EQUAL("add adidas", inbuf_line(in, &size));
+  CU_ASSERT_EQUAL(10, size);
+  CU_ASSERT_STRING_EQUAL("", inbuf_line(in, &size));
+  CU_ASSERT_EQUAL(0, size);
+  CU_ASSERT_STRING_EQUAL(long_line, inbuf_line(in, &size));
+  CU_ASSERT_EQUAL(sizeof(long_line) - 1, size);
+  CU_ASSERT_STRING_EQUAL("sista", inbuf_line(in, NULL)); // sista raden saknar radslut
+  CU_ASSERT_PTR_NULL(inbuf_line(in, NULL));
+  CU_ASSERT_PTR_NULL(inbuf_line(in, NULL));
+
+  inbuf_destroy(in);
+  close(fd);
+  remove(path);
+}
+
+void test29_trace(void)
+{
+  char *path = "tests_trace.trace";
+  webstore_t *db = db_create_webstore();
+  outbuf_t *out = outbuf_create(-1, 64);
+  char lines[][64] = {"add adidas \"bra skor\" 100", "okänt kommando", "replenish adidas A01 60", "cart",
+                      "add-to-cart 1 adidas 3", "remove-cart -7", "cost 1"};
+
+  // Bara kommandon som körs fångas, inte de som inte går att tolka
+  trace_t *trace = trace_create(path);
+  CU_ASSERT_PTR_NOT_NULL(trace);
+  trace_capture(trace);
+  for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++)
+  {
+    command_execute(db, lines[i], out);
+  }
+  trace_capture(NULL);
+  command_execute(db, (char[]){"checkout 1"}, out);
+  CU_ASSERT_TRUE(trace_close(trace));
+
+  uint64_t started_at;
+  trace = trace_open(path, &started_at);
+  CU_ASSERT_PTR_NOT_NULL(trace);
+  CU_ASSERT_TRUE(started_at > 0);
+
+  trace_record_t record;
+  command_id_t ids[] = {COMMAND_ADD, COMMAND_REPLENISH, COMMAND_CART, COMMAND_ADD_TO_CART, COMMAND_REMOVE_CART, COMMAND_COST};
+  uint64_t offset = 0;
+  for (size_t i = 0; i < sizeof(ids) / sizeof(ids[0]); i++)
+  {
+    CU_ASSERT_TRUE(trace_next(trace, &record));
+    CU_ASSERT_EQUAL(ids[i], record.id);
+    CU_ASSERT_TRUE(record.offset_ns >= offset);
+    offset = record.offset_ns;
+
+    if (i == 0)
+    {
+      CU_ASSERT_STRING_EQUAL("adidas", record.args[0].s);
+      CU_ASSERT_STRING_EQUAL("bra skor", record.args[1].s);
+      CU_ASSERT_EQUAL(100, record.args[2].i);
+    }
+    if (i == 3)
+    {
+      CU_ASSERT_EQUAL(1, record.args[0].i);
+      CU_ASSERT_STRING_EQUAL("adidas", record.args[1].s);
+      CU_ASSERT_EQUAL(3, record.args[2].i);
+    }
+    if (i == 4)
+    {
+      CU_ASSERT_EQUAL(-7, record.args[0].i);
+    }
+  }
+  CU_ASSERT_FALSE(trace_next(trace, &record));
+  trace_close(trace);
+
+  // Uppspelningen på en tom webbutik ger samma vagn och samma kostnad
+  webstore_t *replayed = db_create_webstore();
+  trace = trace_open(path, &started_at);
+  while (trace_next(trace, &record))
+  {
+    command_table[record.id].handler(replayed, record.args, out);
+  }
+  trace_close(trace);
+  shopping_carts_t *cart = db_get_cart_from_id(replayed, 1);
+  CU_ASSERT_PTR_NOT_NULL(cart);
+  CU_ASSERT_EQUAL(300, db_calculate_cost(replayed, cart));
+
+  // En fil som inte är ett spår öppnas inte
+  FILE *file = fopen(path, "w");
+  fprintf(file, "inget spår här");
+  fclose(file);
+  CU_ASSERT_PTR_NULL(trace_open(path, &started_at));
+
+  outbuf_destroy(out);
+  db_destroy_webstore(replayed);
+  db_destroy_webstore(db);
+  remove(path);
+}
+
+static void *record_span_thread(void *ignored)
+{
+  span_t span = {.name = "tråd", .start_ns = span_now()};
+  span_record(&span);
+  return NULL;
+}
+
+void test30_spans(void)
+{
+  char *path = "tests_spans.json";
+
+  // Spannen registreras direkt, så testet går även när makron inte är inkompilerade
+  span_t outer = {.name = "yttre", .start_ns = span_now()};
+  span_t inner = {.name = "inre", .start_ns = span_now()};
+  span_record(&inner);
+  span_record(&outer);
+
+  pthread_t thread;
+  pthread_create(&thread, NULL, record_span_thread, NULL);
+  pthread_join(thread, NULL);
+
+  webstore_t *db = db_create_webstore();
+  db_add_merch(db, db_create_merch(strdup("adidas"), strdup("skor"), 100));
+  db_add_location_to_merch(db, db_get_merch(db, "adidas"), strdup("A01"), 10);
+  shopping_carts_t *cart = db_create_cart();
+  db_add_cart(db, cart);
+  db_try_reserve(db_get_merch(db, "adidas"), cart, 2);
+  CU_ASSERT_TRUE(db_checkout(db, cart));
+  db_destroy_webstore(db);
+
+  CU_ASSERT_TRUE(span_export_chrome(path));
+  // Med inkompilerade spann finns spannen från alla tidigare test också i filen
+  FILE *file = fopen(path, "r");
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  rewind(file);
+  char *json = calloc(size + 1, 1);
+  CU_ASSERT_EQUAL(size, (long)fread(json, 1, size, file));
+  fclose(file);
+
+  CU_ASSERT_TRUE(size > 0);
+  CU_ASSERT_PTR_NOT_NULL(strstr(json, "{\"traceEvents\": ["));
+  CU_ASSERT_PTR_NOT_NULL(strstr(json, "\"name\": \"yttre\", \"ph\": \"X\""));
+  CU_ASSERT_PTR_NOT_NULL(strstr(json, "\"name\": \"inre\", \"ph\": \"X\""));
+  CU_ASSERT_PTR_NOT_NULL(strstr(json, "\"name\": \"tråd\", \"ph\": \"X\""));
+  CU_ASSERT_PTR_NOT_NULL(strstr(json, "\"dropped_spans\": 0"));
+#ifdef WEBSTORE_SPANS
+  CU_ASSERT_PTR_NOT_NULL(strstr(json, "\"name\": \"checkout:scan_cart\""));
+#else
+  CU_ASSERT_PTR_NULL(strstr(json, "\"name\": \"checkout\""));
+#endif
+  free(json);
+  remove(path);
+}
+
+static void *record_slow_checkout_batch(void *ignored)
+{
+  uint64_t started = metrics_now();
+  nanosleep(&(struct timespec){.tv_sec = 0, .tv_nsec = 2000000}, NULL);
+  metrics_record(METRIC_CHECKOUT_BATCH, started);
+  return NULL;
+}
+
+void test31_metrics(void)
+{
+  char *path = "tests_metrics.txt";
+  metrics_summary_t checkouts = metrics_summarize(METRIC_CHECKOUT);
+  metrics_summary_t lookups = metrics_summarize(METRIC_GET_MERCH);
+
+  webstore_t *db = db_create_webstore();
+  db_add_merch(db, db_create_merch(strdup("adidas"), strdup("skor"), 100));
+  db_add_location_to_merch(db, db_get_merch(db, "adidas"), strdup("A01"), 100);
+  for (int i = 0; i < 10; i++)
+  {
+    shopping_carts_t *cart = db_create_cart();
+    db_add_cart(db, cart);
+    db_try_reserve(db_get_merch(db, "adidas"), cart, 1);
+    db_checkout(db, cart);
+  }
+
+  // Räknarna växer bara, så skillnaden är det som gjordes här
+  metrics_summary_t after = metrics_summarize(METRIC_CHECKOUT);
+  CU_ASSERT_EQUAL(checkouts.count + 10, after.count);
+  CU_ASSERT_EQUAL(lookups.count + 11, metrics_summarize(METRIC_GET_MERCH).count);
+  CU_ASSERT_TRUE(after.p50_ns <= after.p99_ns);
+  CU_ASSERT_TRUE(after.p99_ns <= after.p999_ns);
+  CU_ASSERT_TRUE(after.p999_ns <= after.max_ns);
+  CU_ASSERT_TRUE(after.mean_ns <= after.max_ns);
+
+  // En latens från en annan tråd räknas in när histogrammen läses
+  pthread_t thread;
+  pthread_create(&thread, NULL, record_slow_checkout_batch, NULL);
+  pthread_join(thread, NULL);
+  metrics_summary_t batch = metrics_summarize(METRIC_CHECKOUT_BATCH);
+  CU_ASSERT_TRUE(batch.max_ns >= 2000000 * 0.97);
+  CU_ASSERT_TRUE(batch.max_ns < 100000000);
+
+  outbuf_t *out = outbuf_create(-1, 64);
+  CU_ASSERT_TRUE(command_execute(db, (char[]){"stats"}, out));
+  size_t size;
+  const char *answer = outbuf_data(out, &size);
+  CU_ASSERT_EQUAL(0, strncmp(answer, "ok 17\ndb_has_key count=", 23));
+  CU_ASSERT_PTR_NOT_NULL(strstr(answer, "\ndb_checkout count="));
+  int lines = 0;
+  for (size_t i = 0; i < size; i++)
+  {
+    lines += answer[i] == '\n';
+  }
+  CU_ASSERT_EQUAL(1 + METRIC_COUNT, lines);
+  outbuf_destroy(out);
+
+  // Filen skrivs en sista gång när tråden stoppas
+  remove(path);
+  CU_ASSERT_TRUE(metrics_dump_start(path, 60000));
+  CU_ASSERT_FALSE(metrics_dump_start(path, 60000));
+  metrics_dump_stop();
+  FILE *file = fopen(path, "r");
+  CU_ASSERT_PTR_NOT_NULL(file);
+  char line[256] = {0};
+  CU_ASSERT_PTR_NOT_NULL(fgets(line, sizeof(line), file));
+  CU_ASSERT_EQUAL(0, strncmp(line, "db_has_key count=", 17));
+  fclose(file);
+
+  db_destroy_webstore(db);
+  remove(path);
+}
+
+void test32_memstats(void)
+{
+  memstats_t before[MEMSTATS_CATEGORY_COUNT];
+  for (int i = 0; i < MEMSTATS_CATEGORY_COUNT; i++)
+  {
+    before[i] = memstats_get(i);
+  }
+
+  webstore_t *db = db_create_webstore();
+  memstats_t strings = memstats_get(MEMSTATS_MERCH_STRINGS);
+  db_add_merch(db, db_create_merch(strdup("adidas"), strdup("skor"), 100));
+  merch_t *merch = db_get_merch(db, "adidas");
+  db_add_location_to_merch(db, merch, strdup("A01"), 10);
+
+  // Namnet och beskrivningen räknas med sina nollor
+  CU_ASSERT_EQUAL(strings.live_bytes + 12, memstats_get(MEMSTATS_MERCH_STRINGS).live_bytes);
+  CU_ASSERT_EQUAL(before[MEMSTATS_MERCHS].allocations + 1, memstats_get(MEMSTATS_MERCHS).allocations);
+  CU_ASSERT_TRUE(memstats_get(MEMSTATS_SHELVES).live_bytes > before[MEMSTATS_SHELVES].live_bytes + 4);
+
+  // En liten kundvagn har sina rader i sig själv, utan hashtabell
+  memstats_t tables = memstats_get(MEMSTATS_HASH_TABLES);
+  shopping_carts_t *cart = db_create_cart();
+  db_add_cart(db, cart);
+  db_add_merch_to_cart(cart, merch, 2);
+  CU_ASSERT_EQUAL(before[MEMSTATS_CARTS].allocations + 1, memstats_get(MEMSTATS_CARTS).allocations);
+  CU_ASSERT_EQUAL(before[MEMSTATS_CART_TABLES].allocations, memstats_get(MEMSTATS_CART_TABLES).allocations);
+  CU_ASSERT_EQUAL(before[MEMSTATS_CART_ENTRIES].allocations, memstats_get(MEMSTATS_CART_ENTRIES).allocations);
+  CU_ASSERT_EQUAL(tables.allocations, memstats_get(MEMSTATS_HASH_TABLES).allocations - 1); // merchens kundvagnar
+
+  // Ett nytt namn ersätter det gamla
+  db_update_merch(db, merch, strdup("nike"), NULL, 100);
+  CU_ASSERT_EQUAL(strings.live_bytes + 10, memstats_get(MEMSTATS_MERCH_STRINGS).live_bytes);
+
+  // Varornas platser och kassans kladdminne räknas när de växer
+  memstats_t slots = memstats_get(MEMSTATS_MERCH_SLOTS);
+  db_reserve_merchs(db, 100);
+  CU_ASSERT_TRUE(memstats_get(MEMSTATS_MERCH_SLOTS).live_bytes > slots.live_bytes);
+  CU_ASSERT_EQUAL(slots.frees + 1, memstats_get(MEMSTATS_MERCH_SLOTS).frees);
+  int cart_id = db_get_cart_id(cart);
+  bool checked_out;
+  CU_ASSERT_EQUAL(1, db_checkout_batch(db, &cart_id, 1, &checked_out));
+  CU_ASSERT_EQUAL(before[MEMSTATS_CHECKOUT_SCRATCH].allocations + 2, memstats_get(MEMSTATS_CHECKOUT_SCRATCH).allocations);
+
+  outbuf_t *out = outbuf_create(-1, 64);
+  CU_ASSERT_TRUE(command_execute(db, (char[]){"memory"}, out));
+  size_t size;
+  const char *answer = outbuf_data(out, &size);
+  CU_ASSERT_EQUAL(0, strncmp(answer, "ok 17\nhash_tables allocations=", 30));
+  CU_ASSERT_PTR_NOT_NULL(strstr(answer, "\ntotal live_bytes="));
+  outbuf_destroy(out);
+
+  // Allt som allokerades är frigjort igen
+  db_destroy_webstore(db);
+  for (int i = 0; i < MEMSTATS_CATEGORY_COUNT; i++)
+  {
+    memstats_t after = memstats_get(i);
+    CU_ASSERT_EQUAL(before[i].live_bytes, after.live_bytes);
+    CU_ASSERT_EQUAL(after.allocations - before[i].allocations, after.frees - before[i].frees);
+    CU_ASSERT_TRUE(after.peak_bytes >= after.live_bytes);
+  }
+}
+
+void test33_small_carts(void)
+{
+  webstore_t *db = db_create_webstore();
+  merch_t *merchs[7];
+  char name[16];
+  char shelf[4];
+  for (int i = 0; i < 7; i++)
+  {
+    snprintf(name, sizeof(name), "merch%d", i);
+    snprintf(shelf, sizeof(shelf), "A%02d", i);
+    db_add_merch(db, db_create_merch(strdup(name), strdup("desc"), 10 * (i + 1)));
+    merchs[i] = db_get_merch(db, name);
+    db_add_location_to_merch(db, merchs[i], strdup(shelf), 100);
+  }
+
+  shopping_carts_t *cart = db_create_cart();
+  db_add_cart(db, cart);
+  memstats_t tables = memstats_get(MEMSTATS_CART_TABLES);
+
+  // De fem första raderna ligger i kundvagnen, den sjätte flyttar alla till en hashtabell
+  for (int i = 0; i < 5; i++)
+  {
+    db_add_merch_to_cart(cart, merchs[i], i + 1);
+  }
+  CU_ASSERT_EQUAL(tables.allocations, memstats_get(MEMSTATS_CART_TABLES).allocations);
+  db_remove_merch_from_cart(cart, merchs[1]);
+  CU_ASSERT_EQUAL(0, db_get_merch_quantity_in_a_cart(cart, merchs[1]));
+  CU_ASSERT_EQUAL(5, db_get_merch_quantity_in_a_cart(cart, merchs[4]));
+  db_add_merch_to_cart(cart, merchs[1], 2);
+  db_update_merch_quantity_in_cart(cart, merchs[0], 1);
+  CU_ASSERT_EQUAL(2, db_get_merch_quantity_in_a_cart(cart, merchs[0]));
+  CU_ASSERT_EQUAL(tables.allocations, memstats_get(MEMSTATS_CART_TABLES).allocations);
+
+  db_add_merch_to_cart(cart, merchs[5], 6);
+  db_add_merch_to_cart(cart, merchs[6], 7);
+  CU_ASSERT_EQUAL(tables.allocations + 1, memstats_get(MEMSTATS_CART_TABLES).allocations);
+  for (int i = 1; i < 7; i++)
+  {
+    CU_ASSERT_EQUAL(i + 1, db_get_merch_quantity_in_a_cart(cart, merchs[i]));
+    CU_ASSERT_TRUE(db_cart_has_key(cart, merchs[i]));
+  }
+  // 10*2 + 20*2 + 30*3 + 40*4 + 50*5 + 60*6 + 70*7
+  CU_ASSERT_EQUAL(1410, db_calculate_cost(db, cart));
+  CU_ASSERT_EQUAL(2, db_lookup_merch_quantity_in_carts(db, merchs[1]));
+
+  // Efter utcheckningen är hashtabellen borta och raderna ligger i kundvagnen igen
+  CU_ASSERT_TRUE(db_checkout(db, cart));
+  CU_ASSERT_EQUAL(tables.live_bytes, memstats_get(MEMSTATS_CART_TABLES).live_bytes);
+  CU_ASSERT_EQUAL(0, db_calculate_cost(db, cart));
+  CU_ASSERT_EQUAL(93, db_get_merch_location_quantity(merchs[6], "A06"));
+  db_add_merch_to_cart(cart, merchs[3], 1);
+  CU_ASSERT_EQUAL(40, db_calculate_cost(db, cart));
+
+  db_destroy_webstore(db);
+}
+
+void test34_cart_ids(void)
+{
+  webstore_t *db = db_create_webstore();
+  shopping_carts_t *first = db_create_cart();
+  db_add_cart(db, first);
+  CU_ASSERT_EQUAL(1, db_get_cart_id(first));
+  CU_ASSERT_PTR_NULL(db_get_cart_from_id(db, 0));
+  CU_ASSERT_PTR_NULL(db_get_cart_from_id(db, 2));
+  CU_ASSERT_PTR_NULL(db_get_cart_from_id(db, -1));
+
+  // Lediga platser används igen i den ordning de frigjordes, med ett nytt id
+  shopping_carts_t *second = db_create_cart();
+  db_add_cart(db, second);
+  CU_ASSERT_EQUAL(2, db_get_cart_id(second));
+  CU_ASSERT_TRUE(db_remove_cart(db, 2));
+  CU_ASSERT_TRUE(db_remove_cart(db, 1));
+  CU_ASSERT_FALSE(db_remove_cart(db, 1));
+  shopping_carts_t *third = db_create_cart();
+  db_add_cart(db, third);
+  CU_ASSERT_EQUAL(2, db_get_cart_id(third) & 0xFFFFFF);
+  CU_ASSERT_NOT_EQUAL(2, db_get_cart_id(third));
+  CU_ASSERT_TRUE(db_get_cart_id(third) > 0);
+  CU_ASSERT_PTR_NULL(db_get_cart_from_id(db, 2));
+  CU_ASSERT_PTR_EQUAL(third, db_get_cart_from_id(db, db_get_cart_id(third)));
+  CU_ASSERT_EQUAL(1, db_carts_size(db));
+  db_destroy_webstore(db);
+
+  // Ett id kommer tillbaka först när dess plats har använts 128 gånger
+  db = db_create_webstore();
+  shopping_carts_t *cart = db_create_cart();
+  db_add_cart(db, cart);
+  for (int i = 1; i <= 128; i++)
+  {
+    CU_ASSERT_TRUE(db_remove_cart(db, db_get_cart_id(cart)));
+    cart = db_create_cart();
+    CU_ASSERT_TRUE(db_add_cart(db, cart));
+    CU_ASSERT_EQUAL(i == 128, db_get_cart_id(cart) == 1);
+  }
+  db_destroy_webstore(db);
+}
+
+void test35_timer_wheel(void)
+{
+  timer_wheel_t wheel;
+  timer_wheel_init(&wheel, 1000);
+  wheel_timer_t soon = {0}, later = {0}, cancelled = {0}, far = {0}, past = {0};
+  CU_ASSERT_FALSE(timer_wheel_is_scheduled(&soon));
+
+  timer_wheel_schedule(&wheel, &soon, 1010);
+  timer_wheel_schedule(&wheel, &later, 1100);
+  timer_wheel_schedule(&wheel, &cancelled, 6000);
+  timer_wheel_schedule(&wheel, &far, 1000 + 2 * TIMER_WHEEL_SPAN);
+  CU_ASSERT_EQUAL(4, timer_wheel_size(&wheel));
+  CU_ASSERT_PTR_NULL(timer_wheel_advance(&wheel, 1009));
+  CU_ASSERT_PTR_EQUAL(&soon, timer_wheel_advance(&wheel, 1010));
+  CU_ASSERT_PTR_NULL(soon.next);
+  CU_ASSERT_FALSE(timer_wheel_is_scheduled(&soon));
+
+  timer_wheel_cancel(&wheel, &cancelled);
+  timer_wheel_cancel(&wheel, &cancelled);
+  CU_ASSERT_EQUAL(2, timer_wheel_size(&wheel));
+  CU_ASSERT_PTR_EQUAL(&later, timer_wheel_advance(&wheel, 7000));
+
+  // En timer längre bort än hjulet når väntar på översta nivån tills den är nära nog
+  CU_ASSERT_PTR_NULL(timer_wheel_advance(&wheel, 1000 + 2 * TIMER_WHEEL_SPAN - 1));
+  CU_ASSERT_TRUE(timer_wheel_is_scheduled(&far));
+  CU_ASSERT_PTR_EQUAL(&far, timer_wheel_advance(&wheel, 1000 + 2 * TIMER_WHEEL_SPAN));
+
+  // En tid som redan har passerat går ut vid nästa tick
+  timer_wheel_schedule(&wheel, &past, 5);
+  CU_ASSERT_PTR_EQUAL(&past, timer_wheel_advance(&wheel, wheel.now + 1));
+  CU_ASSERT_EQUAL(0, timer_wheel_size(&wheel));
+
+  // Varje timer går ut i det första steget som når den, hur långa stegen än är
+  enum { TIMERS = 2000 };
+  wheel_timer_t *timers = calloc(TIMERS, sizeof(wheel_timer_t));
+  uint64_t start = wheel.now;
+  uint64_t seed = 12345;
+  for (int i = 0; i < TIMERS; i++)
+  {
+    seed = seed * 6364136223846793005u + 1442695040888963407u;
+    timer_wheel_schedule(&wheel, &timers[i], start + 1 + (seed >> 33) % 300000);
+  }
+  int fired = 0;
+  bool in_order = true;
+  for (uint64_t now = start, step = 1; fired < TIMERS; step = step * 3 % 2000 + 1)
+  {
+    uint64_t before = now;
+    now += step;
+    for (wheel_timer_t *timer = timer_wheel_advance(&wheel, now); timer != NULL; timer = timer->next)
+    {
+      in_order = in_order && timer->expires > before && timer->expires <= now;
+      fired++;
+    }
+  }
+  CU_ASSERT_TRUE(in_order);
+  CU_ASSERT_EQUAL(TIMERS, fired);
+  free(timers);
+}
+
+void test36_cart_expiry(void)
+{
+  webstore_t *db = db_create_webstore();
+  merch_t *merch = db_create_merch(strdup("boll"), strdup("rund"), 10);
+  db_add_merch(db, merch);
+  db_add_location_to_merch(db, merch, strdup("A01"), 10);
+
+  // Utan TTL går inga kundvagnar ut
+  shopping_carts_t *kept = db_create_cart();
+  db_add_cart(db, kept);
+  CU_ASSERT_EQUAL(0, db_expire_carts(db, 1000000));
+  CU_ASSERT_EQUAL(1, db_carts_size(db));
+  CU_ASSERT_TRUE(db_remove_cart(db, db_get_cart_id(kept)));
+
+  db_set_cart_ttl(db, 1000, 5000);
+  shopping_carts_t *idle = db_create_cart();
+  shopping_carts_t *busy = db_create_cart();
+  db_add_cart(db, idle);
+  db_add_cart(db, busy);
+  int idle_id = db_get_cart_id(idle);
+  int busy_id = db_get_cart_id(busy);
+  CU_ASSERT_TRUE(db_try_reserve(merch, idle, 3));
+  CU_ASSERT_TRUE(db_try_reserve(merch, busy, 2));
+  CU_ASSERT_EQUAL(5, db_lookup_merch_quantity_in_carts(db, merch));
+
+  CU_ASSERT_EQUAL(0, db_expire_carts(db, 5500));
+  CU_ASSERT_TRUE(db_try_reserve(merch, busy, 1));
+
+  // Den orörda vagnen går ut och släpper det den reserverade, den använda får en ny TTL
+  CU_ASSERT_EQUAL(1, db_expire_carts(db, 6000));
+  CU_ASSERT_PTR_NULL(db_get_cart_from_id(db, idle_id));
+  CU_ASSERT_PTR_EQUAL(busy, db_get_cart_from_id(db, busy_id));
+  CU_ASSERT_EQUAL(3, db_lookup_merch_quantity_in_carts(db, merch));
+  CU_ASSERT_EQUAL(0, db_expire_carts(db, 6499));
+  CU_ASSERT_EQUAL(3, db_calculate_cost(db, busy) / 10);
+  CU_ASSERT_EQUAL(0, db_expire_carts(db, 7000));
+  CU_ASSERT_EQUAL(1, db_expire_carts(db, 7500));
+  CU_ASSERT_EQUAL(0, db_carts_size(db));
+  CU_ASSERT_EQUAL(0, db_lookup_merch_quantity_in_carts(db, merch));
+  CU_ASSERT_EQUAL(10, db_lookup_valid_quantity(db, merch));
+
+  // En vagn som tas bort för hand går inte ut igen, och att stänga av TTL behåller resten
+  shopping_carts_t *removed = db_create_cart();
+  shopping_carts_t *stays = db_create_cart();
+  db_add_cart(db, removed);
+  db_add_cart(db, stays);
+  CU_ASSERT_TRUE(db_remove_cart(db, db_get_cart_id(removed)));
+  db_set_cart_ttl(db, 0, 8000);
+  CU_ASSERT_EQUAL(0, db_expire_carts(db, 100000));
+  CU_ASSERT_EQUAL(1, db_carts_size(db));
+
+  // Många vagnar med en lång TTL går ut samtidigt
+  db_set_cart_ttl(db, 3600000, 100000);
+  for (int i = 0; i < 1000; i++)
+  {
+    db_add_cart(db, db_create_cart());
+  }
+  CU_ASSERT_EQUAL(0, db_expire_carts(db, 3699999));
+  CU_ASSERT_EQUAL(1001, db_expire_carts(db, 3700000));
+  CU_ASSERT_EQUAL(0, db_carts_size(db));
+  db_destroy_webstore(db);
+}
+
+static bool count_wal_record(wal_record_t *record, void *counter)
+{
+  (*(int *)counter)++;
+  return true;
+}
+
+void test37_wal_write_error(void)
+{
+  char *path = "tests_failing.wal";
+  remove(path);
+  wal_t *wal = wal_open(path, 0);
+  wal_append(wal, 1, "s", "first");
+  CU_ASSERT_TRUE(wal_sync(wal));
+
+  // Filen får inte växa mer, så nästa batch kan inte skrivas
+  struct stat st;
+  stat(path, &st);
+  struct rlimit limit;
+  getrlimit(RLIMIT_FSIZE, &limit);
+  void (*previous)(int) = signal(SIGXFSZ, SIG_IGN);
+  setrlimit(RLIMIT_FSIZE, &(struct rlimit){.rlim_cur = (rlim_t)st.st_size, .rlim_max = limit.rlim_max});
+  wal_append(wal, 1, "s", "lost");
+  CU_ASSERT_FALSE(wal_sync(wal));
+  setrlimit(RLIMIT_FSIZE, &limit);
+  signal(SIGXFSZ, previous);
+
+  // Felet består, inget skrivs efter en batch som gick förlorad
+  wal_append(wal, 1, "s", "after");
+  CU_ASSERT_FALSE(wal_sync(wal));
+  CU_ASSERT_FALSE(wal_discard(wal, wal_position(wal)));
+  wal_close(wal);
+
+  int records = 0;
+  CU_ASSERT_EQUAL(1, wal_replay(path, NULL, count_wal_record, &records));
+  CU_ASSERT_EQUAL(1, records);
+  remove(path);
+}
+
 int main()
 {
   CU_pSuite test_suite1 = NULL;
@@ -563,7 +1995,30 @@ int main()
       (NULL == CU_add_test(test_suite1, "test 11 checkout without update", test11_checkout_without_update)) ||
       (NULL == CU_add_test(test_suite1, "test 12 checkout with update", test12_checkout_with_update)) ||
       (NULL == CU_add_test(test_suite1, "test 13 costs and valid quantities", test13_costs_and_valid_quantities)) ||
-      (NULL == CU_add_test(test_suite1, "test 14 something", test14_something))
+      (NULL == CU_add_test(test_suite1, "test 14 something", test14_something)) ||
+      (NULL == CU_add_test(test_suite1, "test 15 shelf index", test15_shelf_index)) ||
+      (NULL == CU_add_test(test_suite1, "test 16 merch ids", test16_merch_ids)) ||
+      (NULL == CU_add_test(test_suite1, "test 17 carts holding merch", test17_carts_holding_merch)) ||
+      (NULL == CU_add_test(test_suite1, "test 18 checkout batch", test18_checkout_batch)) ||
+      (NULL == CU_add_test(test_suite1, "test 19 concurrent checkout", test19_concurrent_checkout)) ||
+      (NULL == CU_add_test(test_suite1, "test 20 try reserve", test20_try_reserve)) ||
+      (NULL == CU_add_test(test_suite1, "test 21 write ahead log", test21_write_ahead_log)) ||
+      (NULL == CU_add_test(test_suite1, "test 22 snapshot", test22_snapshot)) ||
+      (NULL == CU_add_test(test_suite1, "test 23 background snapshot", test23_background_snapshot)) ||
+      (NULL == CU_add_test(test_suite1, "test 24 import", test24_import)) ||
+      (NULL == CU_add_test(test_suite1, "test 25 export", test25_export)) ||
+      (NULL == CU_add_test(test_suite1, "test 26 commands", test26_commands)) ||
+      (NULL == CU_add_test(test_suite1, "test 27 server", test27_server)) ||
+      (NULL == CU_add_test(test_suite1, "test 28 inbuf", test28_inbuf)) ||
+      (NULL == CU_add_test(test_suite1, "test 29 trace", test29_trace)) ||
+      (NULL == CU_add_test(test_suite1, "test 30 spans", test30_spans)) ||
+      (NULL == CU_add_test(test_suite1, "test 31 metrics", test31_metrics)) ||
+      (NULL == CU_add_test(test_suite1, "test 32 memstats", test32_memstats)) ||
+      (NULL == CU_add_test(test_suite1, "test 33 small carts", test33_small_carts)) ||
+      (NULL == CU_add_test(test_suite1, "test 34 cart ids", test34_cart_ids)) ||
+      (NULL == CU_add_test(test_suite1, "test 35 timer wheel", test35_timer_wheel)) ||
+      (NULL == CU_add_test(test_suite1, "test 36 cart expiry", test36_cart_expiry)) ||
+      (NULL == CU_add_test(test_suite1, "test 37 wal write error", test37_wal_write_error))
 
   )
   {
@@ -0,0 +1,145 @@
+#include <string.h>
+#include "timer_wheel.h"
+
+/**
+ * @file timer_wheel.c
+ * @author Erdem Garip
+ * @date 18 Oct 2026
+ * @brief Hierarchical timer wheel
+ */
+
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+#define LEVEL_SHIFT(level) (TIMER_WHEEL_BITS * (level))
+
+/// Puts a timer in the lowest level that reaches it. The timer expires at the wheel's time or later.
+static void place(timer_wheel_t *wheel, wheel_timer_t *timer)
+{
+  uint64_t delta = timer->expires - wheel->now;
+  // A timer beyond the top level is placed as if it expired at its last tick
+  uint64_t expires = delta < TIMER_WHEEL_SPAN ? timer->expires : wheel->now + TIMER_WHEEL_SPAN - 1;
+  delta = expires - wheel->now;
+
+  int level = 0;
+  while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (UINT64_C(1) << LEVEL_SHIFT(level + 1)))
+  {
+    level++;
+  }
+
+  wheel_timer_t **slot = &wheel->slots[level][(expires >> LEVEL_SHIFT(level)) & TIMER_WHEEL_MASK];
+  timer->next = *slot;
+  if (timer->next != NULL)
+  {
+    timer->next->pprev = &timer->next;
+  }
+  timer->pprev = slot;
+  timer->level = level;
+  *slot = timer;
+  wheel->counts[level]++;
+}
+
+/// Empties a slot and returns its timers, chained through next and no longer scheduled
+static wheel_timer_t *take_slot(timer_wheel_t *wheel, int level, size_t index)
+{
+  wheel_timer_t *timers = wheel->slots[level][index];
+  wheel->slots[level][index] = NULL;
+
+  for (wheel_timer_t *timer = timers; timer != NULL; timer = timer->next)
+  {
+    timer->pprev = NULL;
+    wheel->counts[level]--;
+  }
+  return timers;
+}
+
+void timer_wheel_init(timer_wheel_t *wheel, uint64_t now)
+{
+  memset(wheel, 0, sizeof(timer_wheel_t));
+  wheel->now = now;
+}
+
+void timer_wheel_schedule(timer_wheel_t *wheel, wheel_timer_t *timer, uint64_t expires)
+{
+  timer_wheel_cancel(wheel, timer);
+  timer->expires = expires > wheel->now ? expires : wheel->now + 1;
+  place(wheel, timer);
+}
+
+void timer_wheel_cancel(timer_wheel_t *wheel, wheel_timer_t *timer)
+{
+  if (timer->pprev == NULL)
+  {
+    return;
+  }
+  *timer->pprev = timer->next;
+  if (timer->next != NULL)
+  {
+    timer->next->pprev = timer->pprev;
+  }
+  timer->pprev = NULL;
+  wheel->counts[timer->level]--;
+}
+
+bool timer_wheel_is_scheduled(const wheel_timer_t *timer)
+{
+  return timer->pprev != NULL;
+}
+
+size_t timer_wheel_size(const timer_wheel_t *wheel)
+{
+  size_t size = 0;
+  for (int level = 0; level < TIMER_WHEEL_LEVELS; level++)
+  {
+    size += wheel->counts[level];
+  }
+  return size;
+}
+
+wheel_timer_t *timer_wheel_advance(timer_wheel_t *wheel, uint64_t now)
+{
+  wheel_timer_t *expired = NULL;
+
+  while (wheel->now < now)
+  {
+    int lowest = 0;
+    while (lowest < TIMER_WHEEL_LEVELS && wheel->counts[lowest] == 0)
+    {
+      lowest++;
+    }
+    if (lowest == TIMER_WHEEL_LEVELS)
+    {
+      wheel->now = now;
+      break;
+    }
+
+    // Nothing happens before the level the lowest timers are in turns a slot
+    uint64_t next = ((wheel->now >> LEVEL_SHIFT(lowest)) + 1) << LEVEL_SHIFT(lowest);
+    if (next > now)
+    {
+      wheel->now = now;
+      break;
+    }
+    wheel->now = next;
+
+    // Every level turns a slot when the level below it has gone all the way round
+    for (int level = 1; level < TIMER_WHEEL_LEVELS && (wheel->now & ((UINT64_C(1) << LEVEL_SHIFT(level)) - 1)) == 0; level++)
+    {
+      wheel_timer_t *timer = take_slot(wheel, level, (wheel->now >> LEVEL_SHIFT(level)) & TIMER_WHEEL_MASK);
+      while (timer != NULL)
+      {
+        wheel_timer_t *next_timer = timer->next;
+        place(wheel, timer);
+        timer = next_timer;
+      }
+    }
+
+    wheel_timer_t *timer = take_slot(wheel, 0, wheel->now & TIMER_WHEEL_MASK);
+    while (timer != NULL)
+    {
+      wheel_timer_t *next_timer = timer->next;
+      timer->next = expired;
+      expired = timer;
+      timer = next_timer;
+    }
+  }
+  return expired;
+}
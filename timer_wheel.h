@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file timer_wheel.h
+ * @author Erdem Garip
+ * @date 18 Oct 2026
+ * @brief Hierarchical timer wheel
+ *
+ * Timers expire at a tick, in whatever unit the owner counts time in. The wheel has
+ * TIMER_WHEEL_LEVELS levels of TIMER_WHEEL_SLOTS slots: a slot of level 0 holds the timers of one
+ * tick and a slot of every level above it spans a whole turn of the level below. A timer is put
+ * in the lowest level that reaches its tick, and moved down when the wheel turns to its slot, so
+ * it is moved at most TIMER_WHEEL_LEVELS - 1 times before it expires. Scheduling and cancelling
+ * are O(1), and advancing skips the ticks below the lowest level that holds a timer.
+ *
+ * Timers further away than TIMER_WHEEL_SPAN ticks wait in the top level and are placed again
+ * each time it turns to them, until they are close enough.
+ *
+ * Timers are embedded in the structures they belong to, so the wheel never allocates. A timer
+ * filled with zeros is not scheduled. A wheel is not thread safe, its owner locks it.
+ */
+
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_SPAN (UINT64_C(1) << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) // ticks the levels reach together
+
+typedef struct wheel_timer wheel_timer_t;
+typedef struct timer_wheel timer_wheel_t;
+
+struct wheel_timer
+{
+  wheel_timer_t *next;   // the next timer in the same slot, or in the list of expired timers
+  wheel_timer_t **pprev; // the pointer to this timer in its slot, NULL while it is not scheduled
+  uint64_t expires;      // the tick it expires at
+  int level;
+};
+
+struct timer_wheel
+{
+  wheel_timer_t *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+  size_t counts[TIMER_WHEEL_LEVELS]; // the timers in each level
+  uint64_t now;                      // the last tick advanced to
+};
+
+/// @brief Makes an empty wheel
+/// @param wheel The wheel, no timer may be scheduled in it
+/// @param now The current tick
+void timer_wheel_init(timer_wheel_t *wheel, uint64_t now);
+
+/// @brief Schedules a timer, moving it if it is scheduled already
+/// @param wheel The wheel
+/// @param timer The timer, not scheduled in another wheel
+/// @param expires The tick it expires at, a tick that has passed is taken as the next one
+void timer_wheel_schedule(timer_wheel_t *wheel, wheel_timer_t *timer, uint64_t expires);
+
+/// @brief Cancels a timer, nothing happens if it is not scheduled
+/// @param wheel The wheel it is scheduled in
+/// @param timer The timer
+void timer_wheel_cancel(timer_wheel_t *wheel, wheel_timer_t *timer);
+
+/// @brief Checks if a timer is scheduled
+/// @param timer The timer
+/// @return True if it is in a wheel and has not expired yet
+bool timer_wheel_is_scheduled(const wheel_timer_t *timer);
+
+/// @brief The number of timers scheduled
+/// @param wheel The wheel
+/// @return The timers in every level
+size_t timer_wheel_size(const timer_wheel_t *wheel);
+
+/// @brief Advances the time of a wheel and takes out the timers that expire on the way
+/// @param wheel The wheel
+/// @param now The tick to advance to, nothing happens if it is not after the wheel's time
+/// @return The expired timers, chained through next and no longer scheduled, NULL if none
+wheel_timer_t *timer_wheel_advance(timer_wheel_t *wheel, uint64_t now);
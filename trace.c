@@ -0,0 +1,252 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "trace.h"
+
+/**
+ * @file trace.c
+ * @author Erdem Garip
+ * @date 18 Oct 2026
+ * @brief A compact binary record of the commands of a session, for replaying it
+ */
+
+#define TRACE_MAGIC "WEBTRACE"
+#define TRACE_HEADER_SIZE 16 // magic and start time
+#define TRACE_BUFFER_SIZE (1 << 16)
+#define TRACE_VARINT_MAX 10
+
+struct trace
+{
+  outbuf_t *out;       // NULL when reading
+  int fd;
+  uint64_t last_ns;    // monotonic time of the last record written, the offset of the last one read
+  const char *data;    // the mapped file when reading
+  size_t size;
+  size_t position;
+  char *strings[COMMAND_MAX_ARGS]; // the string arguments of the last record read, with a NUL
+  size_t capacities[COMMAND_MAX_ARGS];
+};
+
+static trace_t *capture = NULL;
+
+static uint64_t monotonic_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t wall_clock_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void put_varint(outbuf_t *out, uint64_t value)
+{
+  unsigned char bytes[TRACE_VARINT_MAX];
+  size_t size = 0;
+
+  do
+  {
+    bytes[size] = value & 0x7f;
+    value >>= 7;
+    bytes[size] |= value != 0 ? 0x80 : 0;
+    size++;
+  } while (value != 0);
+  outbuf_write(out, bytes, size);
+}
+
+static bool get_varint(trace_t *trace, uint64_t *value)
+{
+  *value = 0;
+  for (int shift = 0; shift < 7 * TRACE_VARINT_MAX && trace->position < trace->size; shift += 7)
+  {
+    unsigned char byte = trace->data[trace->position++];
+    *value |= (uint64_t)(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+trace_t *trace_create(const char *path)
+{
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+  {
+    return NULL;
+  }
+
+  trace_t *trace = calloc(1, sizeof(trace_t));
+  trace->fd = fd;
+  trace->out = outbuf_create(fd, TRACE_BUFFER_SIZE);
+  trace->last_ns = monotonic_ns();
+
+  uint64_t started_at = wall_clock_ns();
+  unsigned char header[TRACE_HEADER_SIZE - 8];
+  for (int i = 0; i < 8; i++)
+  {
+    header[i] = (unsigned char)(started_at >> (8 * i));
+  }
+  outbuf_write(trace->out, TRACE_MAGIC, 8);
+  outbuf_write(trace->out, header, sizeof(header));
+  return trace;
+}
+
+void trace_command(trace_t *trace, command_id_t id, command_arg_t *args)
+{
+  uint64_t now = monotonic_ns();
+  const char *schema = command_table[id].schema;
+
+  put_varint(trace->out, now - trace->last_ns);
+  trace->last_ns = now;
+  outbuf_putc(trace->out, (char)id);
+  for (size_t i = 0; schema[i] != '\0'; i++)
+  {
+    if (schema[i] == 's')
+    {
+      size_t length = strlen(args[i].s);
+      put_varint(trace->out, length);
+      outbuf_write(trace->out, args[i].s, length);
+    }
+    else
+    {
+      // Zigzag, so a small negative number is a small varint too
+      int64_t value = args[i].i;
+      put_varint(trace->out, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+    }
+  }
+}
+
+bool trace_close(trace_t *trace)
+{
+  bool success = true;
+
+  if (trace->out != NULL)
+  {
+    success = outbuf_destroy(trace->out);
+    success = close(trace->fd) == 0 && success;
+  }
+  else
+  {
+    munmap((void *)trace->data, trace->size);
+  }
+  for (int i = 0; i < COMMAND_MAX_ARGS; i++)
+  {
+    free(trace->strings[i]);
+  }
+  free(trace);
+  return success;
+}
+
+trace_t *trace_open(const char *path, uint64_t *started_at)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    return NULL;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < TRACE_HEADER_SIZE)
+  {
+    close(fd);
+    return NULL;
+  }
+  const char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+  {
+    return NULL;
+  }
+  if (memcmp(data, TRACE_MAGIC, 8) != 0)
+  {
+    munmap((void *)data, st.st_size);
+    return NULL;
+  }
+
+  *started_at = 0;
+  for (int i = 0; i < 8; i++)
+  {
+    *started_at |= (uint64_t)(unsigned char)data[8 + i] << (8 * i);
+  }
+
+  trace_t *trace = calloc(1, sizeof(trace_t));
+  trace->fd = -1;
+  trace->data = data;
+  trace->size = st.st_size;
+  trace->position = TRACE_HEADER_SIZE;
+  return trace;
+}
+
+bool trace_next(trace_t *trace, trace_record_t *record)
+{
+  uint64_t delta;
+
+  if (trace->position >= trace->size || !get_varint(trace, &delta) || trace->position >= trace->size)
+  {
+    return false;
+  }
+  trace->last_ns += delta;
+  record->offset_ns = trace->last_ns;
+
+  unsigned char id = trace->data[trace->position++];
+  if (id >= COMMAND_COUNT)
+  {
+    return false;
+  }
+  record->id = id;
+
+  const char *schema = command_table[id].schema;
+  for (size_t i = 0; schema[i] != '\0'; i++)
+  {
+    uint64_t value;
+    if (!get_varint(trace, &value))
+    {
+      return false;
+    }
+
+    if (schema[i] == 's')
+    {
+      // The string is copied so it ends with a NUL, into a buffer that is reused by the next record
+      if (value > trace->size - trace->position)
+      {
+        return false;
+      }
+      if (value + 1 > trace->capacities[i])
+      {
+        trace->capacities[i] = value + 1 > 2 * trace->capacities[i] ? value + 1 : 2 * trace->capacities[i];
+        trace->strings[i] = realloc(trace->strings[i], trace->capacities[i]);
+      }
+      memcpy(trace->strings[i], trace->data + trace->position, value);
+      trace->strings[i][value] = '\0';
+      record->args[i].s = trace->strings[i];
+      trace->position += value;
+    }
+    else
+    {
+      record->args[i].i = (int)((value >> 1) ^ -(value & 1));
+    }
+  }
+  return true;
+}
+
+void trace_capture(trace_t *trace)
+{
+  capture = trace;
+}
+
+void trace_capture_command(command_id_t id, command_arg_t *args)
+{
+  if (capture != NULL)
+  {
+    trace_command(capture, id, args);
+  }
+}
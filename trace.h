@@ -0,0 +1,68 @@
+#pragma once
+
+#include "command.h"
+
+/**
+ * @file trace.h
+ * @author Erdem Garip
+ * @date 18 Oct 2026
+ * @brief A compact binary record of the commands of a session, for replaying it
+ *
+ * The file starts with the magic "WEBTRACE" and the wall clock time the capture started, in
+ * nanoseconds since the epoch. Every record after it is
+ *
+ *     varint  nanoseconds since the record before, or since the start
+ *     u8      the command id
+ *     ...     the arguments in the order of the command's schema: a string as a varint
+ *             length and its bytes, an int as a zigzag varint
+ *
+ * where a varint is 7 bits per byte, least significant first, with the high bit set on every
+ * byte but the last. A command in a menu session is a few bytes plus its strings.
+ */
+
+typedef struct trace trace_t;
+typedef struct trace_record trace_record_t;
+
+struct trace_record
+{
+  uint64_t offset_ns; // since the capture started
+  command_id_t id;
+  command_arg_t args[COMMAND_MAX_ARGS]; // strings are valid until the next record is read
+};
+
+/// @brief Starts capturing to a file
+/// @param path The file, replaced if it exists
+/// @return The trace, or NULL if the file could not be created
+trace_t *trace_create(const char *path);
+
+/// @brief Appends a command, timed now
+/// @param trace The trace
+/// @param id The command
+/// @param args The arguments of the command, as its schema says
+void trace_command(trace_t *trace, command_id_t id, command_arg_t *args);
+
+/// @brief Writes what is buffered and closes the file
+/// @param trace The trace
+/// @return False if a write failed
+bool trace_close(trace_t *trace);
+
+/// @brief Opens a trace for reading
+/// @param path The file
+/// @param started_at Set to the wall clock time the capture started, in nanoseconds since the epoch
+/// @return The trace, or NULL if the file is not a trace
+trace_t *trace_open(const char *path, uint64_t *started_at);
+
+/// @brief Reads the next record
+/// @param trace The trace
+/// @param record The record is read into this
+/// @return False at the end of the trace, or if the rest of it is cut off or damaged
+bool trace_next(trace_t *trace, trace_record_t *record);
+
+/// @brief Sets the trace that the commands run from now on are captured to
+/// @param trace The trace, NULL to stop capturing
+void trace_capture(trace_t *trace);
+
+/// @brief Captures a command that is about to run, if a trace is set with trace_capture
+/// @param id The command
+/// @param args The arguments of the command, as its schema says
+void trace_capture_command(command_id_t id, command_arg_t *args);
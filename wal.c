@@ -0,0 +1,535 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "wal.h"
+
+/**
+ * @file wal.c
+ * @author Erdem Garip
+ * @date 18 Oct 2026
+ * @brief Append-only binary write-ahead log with group commit
+ */
+
+#define WAL_MAGIC "WEBWAL\0\0"
+#define WAL_FILE_HEADER_SIZE 16 // magic and generation
+#define WAL_HEADER_SIZE 5  // payload size and type
+#define WAL_TRAILER_SIZE 4 // checksum
+#define WAL_BUFFER_INITIAL_CAPACITY 4096
+#define WAL_BUFFER_FLUSH_SIZE (1 << 20) // a batch this large is written without waiting for the budget
+#define WAL_COPY_SIZE (1 << 16)
+
+struct wal
+{
+  int fd;
+  int latency_ms;
+  char *path;
+  pthread_t flusher;
+  pthread_mutex_t lock;   // guards everything below
+  pthread_cond_t wakeup;  // signalled on the first record of a batch, a full batch, sync and close
+  pthread_cond_t synced;  // signalled when a batch is on disk
+  char *buffer;           // records not yet handed to the flusher
+  size_t size;
+  size_t capacity;
+  uint64_t appended;      // bytes appended since the log was opened
+  uint64_t durable;       // bytes written and synced since the log was opened
+  uint64_t start;         // the file offset of the first byte appended, less any bytes discarded since
+  uint64_t generation;    // changed every time records are discarded, see wal_position_t
+  bool sync_wanted;
+  bool closing;
+  bool failed;            // a batch could not be written or synced, nothing is written after it
+};
+
+static void put_u32(char *dest, uint32_t value)
+{
+  for (int i = 0; i < 4; i++)
+  {
+    dest[i] = (char)(value >> (8 * i));
+  }
+}
+
+static uint32_t get_u32(const char *src)
+{
+  uint32_t value = 0;
+  for (int i = 0; i < 4; i++)
+  {
+    value |= (uint32_t)(unsigned char)src[i] << (8 * i);
+  }
+  return value;
+}
+
+static void put_u64(char *dest, uint64_t value)
+{
+  put_u32(dest, (uint32_t)value);
+  put_u32(dest + 4, (uint32_t)(value >> 32));
+}
+
+static uint64_t get_u64(const char *src)
+{
+  return get_u32(src) | (uint64_t)get_u32(src + 4) << 32;
+}
+
+/// A generation that differs from the previous one and, as it is taken from the clock, from
+/// the generation of a log that was deleted and created again
+static uint64_t next_generation(uint64_t previous)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  uint64_t now = (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+  return now > previous ? now : previous + 1;
+}
+
+/// Reads the generation of a log, false if the file does not start with a log header
+static bool read_file_header(int fd, uint64_t *generation)
+{
+  char header[WAL_FILE_HEADER_SIZE];
+  if (pread(fd, header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+      memcmp(header, WAL_MAGIC, 8) != 0)
+  {
+    return false;
+  }
+  *generation = get_u64(header + 8);
+  return true;
+}
+
+/// FNV-1a over the type and the payload
+static uint32_t checksum(const char *data, size_t size)
+{
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < size; i++)
+  {
+    hash = (hash ^ (unsigned char)data[i]) * 16777619u;
+  }
+  return hash;
+}
+
+static void reserve(wal_t *wal, size_t extra)
+{
+  if (wal->size + extra > wal->capacity)
+  {
+    while (wal->size + extra > wal->capacity)
+    {
+      wal->capacity = wal->capacity * 2;
+    }
+    wal->buffer = realloc(wal->buffer, wal->capacity);
+  }
+}
+
+static bool write_all(int fd, const char *data, size_t size)
+{
+  while (size > 0)
+  {
+    ssize_t written = write(fd, data, size);
+    if (written < 0)
+    {
+      return false;
+    }
+    data = data + written;
+    size = size - written;
+  }
+  return true;
+}
+
+static bool write_file_header(int fd, uint64_t generation)
+{
+  char header[WAL_FILE_HEADER_SIZE];
+  memcpy(header, WAL_MAGIC, 8);
+  put_u64(header + 8, generation);
+  return write_all(fd, header, sizeof(header));
+}
+
+static void *wal_flusher(void *arg)
+{
+  wal_t *wal = arg;
+  size_t spare_capacity = WAL_BUFFER_INITIAL_CAPACITY;
+  char *spare = malloc(spare_capacity);
+
+  pthread_mutex_lock(&wal->lock);
+  while (!wal->closing || wal->size > 0)
+  {
+    if (wal->size == 0)
+    {
+      pthread_cond_wait(&wal->wakeup, &wal->lock);
+      continue;
+    }
+
+    // Let the batch grow for the latency budget, unless someone waits for it
+    if (!wal->closing && !wal->sync_wanted && wal->size < WAL_BUFFER_FLUSH_SIZE && wal->latency_ms > 0)
+    {
+      struct timespec deadline;
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_nsec += (long)wal->latency_ms * 1000000;
+      deadline.tv_sec += deadline.tv_nsec / 1000000000;
+      deadline.tv_nsec %= 1000000000;
+      pthread_cond_timedwait(&wal->wakeup, &wal->lock, &deadline);
+    }
+
+    // Swap buffers, so appends continue while the batch is written
+    char *batch = wal->buffer;
+    size_t batch_size = wal->size;
+    size_t batch_capacity = wal->capacity;
+    wal->buffer = spare;
+    wal->capacity = spare_capacity;
+    wal->size = 0;
+    wal->sync_wanted = false;
+    pthread_mutex_unlock(&wal->lock);
+
+    // After a failed batch the file may end in part of it, so later batches are dropped too
+    bool written = !wal->failed && write_all(wal->fd, batch, batch_size) && fdatasync(wal->fd) == 0;
+    if (!written && !wal->failed)
+    {
+      perror("wal");
+    }
+
+    pthread_mutex_lock(&wal->lock);
+    spare = batch;
+    spare_capacity = batch_capacity;
+    if (written)
+    {
+      wal->durable += batch_size;
+    }
+    wal->failed = !written;
+    pthread_cond_broadcast(&wal->synced);
+  }
+  pthread_mutex_unlock(&wal->lock);
+
+  free(spare);
+  return NULL;
+}
+
+wal_t *wal_open(const char *path, int latency_ms)
+{
+  int fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (fd < 0)
+  {
+    return NULL;
+  }
+
+  struct stat st;
+  uint64_t generation = 0;
+  if (fstat(fd, &st) != 0)
+  {
+    close(fd);
+    return NULL;
+  }
+
+  // A new log, or one cut off before its header was written, starts a new generation
+  if (st.st_size < WAL_FILE_HEADER_SIZE)
+  {
+    generation = next_generation(0);
+    if (ftruncate(fd, 0) != 0 || !write_file_header(fd, generation) || fsync(fd) != 0)
+    {
+      close(fd);
+      return NULL;
+    }
+    st.st_size = WAL_FILE_HEADER_SIZE;
+  }
+  else if (!read_file_header(fd, &generation))
+  {
+    fprintf(stderr, "%s is not a write-ahead log\n", path);
+    close(fd);
+    return NULL;
+  }
+
+  wal_t *wal = calloc(1, sizeof(wal_t));
+  wal->fd = fd;
+  wal->path = strdup(path);
+  wal->start = (uint64_t)st.st_size;
+  wal->generation = generation;
+  wal->latency_ms = latency_ms;
+  wal->capacity = WAL_BUFFER_INITIAL_CAPACITY;
+  wal->buffer = malloc(wal->capacity);
+  pthread_mutex_init(&wal->lock, NULL);
+  pthread_cond_init(&wal->wakeup, NULL);
+  pthread_cond_init(&wal->synced, NULL);
+  pthread_create(&wal->flusher, NULL, wal_flusher, wal);
+
+  return wal;
+}
+
+/// The encoded size of the fields, so a record is copied into the buffer in one pass
+static size_t payload_size(const char *fields, va_list args)
+{
+  size_t size = 0;
+  for (const char *field = fields; *field != '\0'; field++)
+  {
+    if (*field == 's')
+    {
+      size = size + 4 + strlen(va_arg(args, char *));
+    }
+    else
+    {
+      va_arg(args, int);
+      size = size + 4;
+    }
+  }
+  return size;
+}
+
+void wal_vappend(wal_t *wal, uint8_t type, const char *fields, va_list args)
+{
+  va_list sizing;
+  va_copy(sizing, args);
+  size_t size = payload_size(fields, sizing);
+  va_end(sizing);
+
+  pthread_mutex_lock(&wal->lock);
+  reserve(wal, WAL_HEADER_SIZE + size + WAL_TRAILER_SIZE);
+
+  char *record = wal->buffer + wal->size;
+  put_u32(record, (uint32_t)size);
+  record[4] = (char)type;
+
+  char *cursor = record + WAL_HEADER_SIZE;
+  for (const char *field = fields; *field != '\0'; field++)
+  {
+    if (*field == 's')
+    {
+      char *str = va_arg(args, char *);
+      uint32_t len = (uint32_t)strlen(str);
+      put_u32(cursor, len);
+      memcpy(cursor + 4, str, len);
+      cursor = cursor + 4 + len;
+    }
+    else
+    {
+      put_u32(cursor, (uint32_t)va_arg(args, int));
+      cursor = cursor + 4;
+    }
+  }
+  put_u32(cursor, checksum(record + 4, 1 + size));
+
+  bool first = wal->size == 0;
+  wal->size += WAL_HEADER_SIZE + size + WAL_TRAILER_SIZE;
+  wal->appended += WAL_HEADER_SIZE + size + WAL_TRAILER_SIZE;
+
+  if (first || wal->size >= WAL_BUFFER_FLUSH_SIZE)
+  {
+    pthread_cond_signal(&wal->wakeup);
+  }
+  pthread_mutex_unlock(&wal->lock);
+}
+
+void wal_append(wal_t *wal, uint8_t type, const char *fields, ...)
+{
+  va_list args;
+  va_start(args, fields);
+  wal_vappend(wal, type, fields, args);
+  va_end(args);
+}
+
+bool wal_sync(wal_t *wal)
+{
+  pthread_mutex_lock(&wal->lock);
+  uint64_t target = wal->appended;
+
+  while (wal->durable < target && !wal->failed)
+  {
+    wal->sync_wanted = true;
+    pthread_cond_signal(&wal->wakeup);
+    pthread_cond_wait(&wal->synced, &wal->lock);
+  }
+  bool synced = !wal->failed;
+  pthread_mutex_unlock(&wal->lock);
+  return synced;
+}
+
+wal_position_t wal_position(wal_t *wal)
+{
+  pthread_mutex_lock(&wal->lock);
+  wal_position_t position = {.generation = wal->generation, .offset = wal->start + wal->appended};
+  pthread_mutex_unlock(&wal->lock);
+  return position;
+}
+
+/// Copies the bytes of the log from offset up to end after a new header
+static bool copy_tail(wal_t *wal, int dest, uint64_t offset, uint64_t end, uint64_t generation)
+{
+  char *chunk = malloc(WAL_COPY_SIZE);
+  bool copied = write_file_header(dest, generation);
+
+  while (copied && offset < end)
+  {
+    size_t wanted = end - offset < WAL_COPY_SIZE ? end - offset : WAL_COPY_SIZE;
+    ssize_t n = pread(wal->fd, chunk, wanted, (off_t)offset);
+    copied = n > 0 && write_all(dest, chunk, (size_t)n);
+    offset = offset + (n > 0 ? n : 0);
+  }
+
+  free(chunk);
+  return copied && fsync(dest) == 0;
+}
+
+bool wal_discard(wal_t *wal, wal_position_t position)
+{
+  pthread_mutex_lock(&wal->lock);
+
+  // Records discarded since the position was taken are gone already
+  if (position.generation != wal->generation)
+  {
+    pthread_mutex_unlock(&wal->lock);
+    return true;
+  }
+
+  // The flusher must be idle, so the file holds every record appended and nothing is written meanwhile
+  while ((wal->size > 0 || wal->durable < wal->appended) && !wal->failed)
+  {
+    wal->sync_wanted = true;
+    pthread_cond_signal(&wal->wakeup);
+    pthread_cond_wait(&wal->synced, &wal->lock);
+  }
+
+  // A log missing records can not be rewritten from the file
+  if (wal->failed)
+  {
+    pthread_mutex_unlock(&wal->lock);
+    return false;
+  }
+
+  // The records after the position are copied to a new file of the next generation that
+  // replaces the log. Until the rename the old log, and after it the new, is complete.
+  uint64_t end = wal->start + wal->appended;
+  position.offset = position.offset < end ? position.offset : end;
+  uint64_t generation = next_generation(wal->generation);
+  char *tmp_path = calloc(strlen(wal->path) + 5, sizeof(char));
+  sprintf(tmp_path, "%s.tmp", wal->path);
+
+  int fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0644);
+  bool discarded = fd >= 0 && copy_tail(wal, fd, position.offset, end, generation) &&
+                   rename(tmp_path, wal->path) == 0;
+
+  if (discarded)
+  {
+    close(wal->fd);
+    wal->fd = fd;
+    wal->generation = generation;
+    wal->start = WAL_FILE_HEADER_SIZE + (end - position.offset) - wal->appended;
+  }
+  else if (fd >= 0)
+  {
+    close(fd);
+    remove(tmp_path);
+  }
+
+  pthread_mutex_unlock(&wal->lock);
+  free(tmp_path);
+  return discarded;
+}
+
+void wal_close(wal_t *wal)
+{
+  pthread_mutex_lock(&wal->lock);
+  wal->closing = true;
+  pthread_cond_signal(&wal->wakeup);
+  pthread_mutex_unlock(&wal->lock);
+
+  pthread_join(wal->flusher, NULL);
+  close(wal->fd);
+  pthread_cond_destroy(&wal->synced);
+  pthread_cond_destroy(&wal->wakeup);
+  pthread_mutex_destroy(&wal->lock);
+  free(wal->buffer);
+  free(wal->path);
+  free(wal);
+}
+
+int wal_replay(const char *path, const wal_position_t *from, wal_replay_function fun, void *extra)
+{
+  int fd = open(path, O_RDWR);
+  uint64_t generation;
+  if (fd < 0)
+  {
+    return 0;
+  }
+  if (!read_file_header(fd, &generation))
+  {
+    close(fd);
+    return 0;
+  }
+
+  struct stat st;
+  fstat(fd, &st);
+  size_t file_size = (size_t)st.st_size;
+  char *data = malloc(file_size + 1);
+  size_t read_size = 0;
+
+  while (read_size < file_size)
+  {
+    ssize_t n = read(fd, data + read_size, file_size - read_size);
+    if (n <= 0)
+    {
+      break;
+    }
+    read_size = read_size + n;
+  }
+
+  // Records before the position are already in the snapshot it was taken for
+  int count = 0;
+  size_t offset = WAL_FILE_HEADER_SIZE;
+  if (from != NULL && from->generation == generation && from->offset > offset)
+  {
+    offset = from->offset < read_size ? (size_t)from->offset : read_size;
+  }
+
+  while (offset + WAL_HEADER_SIZE + WAL_TRAILER_SIZE <= read_size)
+  {
+    uint32_t size = get_u32(data + offset);
+
+    if (size > read_size - offset - WAL_HEADER_SIZE - WAL_TRAILER_SIZE ||
+        get_u32(data + offset + WAL_HEADER_SIZE + size) != checksum(data + offset + 4, 1 + size))
+    {
+      break;
+    }
+
+    wal_record_t record = {.type = (uint8_t)data[offset + 4], .payload = data + offset + WAL_HEADER_SIZE, .size = size, .offset = 0};
+    if (!fun(&record, extra))
+    {
+      free(data);
+      close(fd);
+      return -1;
+    }
+    count++;
+    offset = offset + WAL_HEADER_SIZE + size + WAL_TRAILER_SIZE;
+  }
+
+  // Whatever follows the last valid record is a torn write
+  if (offset < file_size && ftruncate(fd, (off_t)offset) != 0)
+  {
+    perror("wal");
+  }
+
+  free(data);
+  close(fd);
+  return count;
+}
+
+int wal_record_int(wal_record_t *record)
+{
+  if (record->offset + 4 > record->size)
+  {
+    return 0;
+  }
+
+  int value = (int)get_u32(record->payload + record->offset);
+  record->offset += 4;
+  return value;
+}
+
+char *wal_record_string(wal_record_t *record)
+{
+  uint32_t len = (uint32_t)wal_record_int(record);
+
+  if (len > record->size - record->offset)
+  {
+    len = record->size - record->offset;
+  }
+
+  char *str = calloc(len + 1, sizeof(char));
+  memcpy(str, record->payload + record->offset, len);
+  record->offset += len;
+  return str;
+}
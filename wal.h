@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdarg.h>
+
+/**
+ * @file wal.h
+ * @author Erdem Garip
+ * @date 18 Oct 2026
+ * @brief Append-only binary write-ahead log with group commit
+ *
+ * The file starts with a magic and a generation, followed by the records. A record is a type
+ * byte and a list of fields. On disk it is stored as
+ * [payload size (u32)][type (u8)][payload][checksum (u32)], where the fields of the
+ * payload are little endian int32s and strings prefixed by their u32 length.
+ *
+ * Appending only copies the record into a memory buffer. A flusher thread writes the
+ * buffer and calls fdatasync once per batch, at the latest latency_ms after the first
+ * record of the batch was appended, so many records share one sequential write.
+ */
+
+typedef struct wal wal_t;
+typedef struct wal_record wal_record_t;
+typedef struct wal_position wal_position_t;
+
+/// A record read back from a log, the fields are read in the order they were appended
+struct wal_record
+{
+  uint8_t type;
+  const char *payload;
+  uint32_t size;
+  uint32_t offset; // the next field to read
+};
+
+/// A point in a log. The generation changes whenever records are discarded, so a position taken
+/// before that never points into the new file.
+struct wal_position
+{
+  uint64_t generation;
+  uint64_t offset; // the file offset of the first record after the position
+};
+
+/// @brief Called for every valid record when a log is replayed
+/// @return False to stop the replay, if the record does not fit what was replayed before it
+typedef bool (*wal_replay_function)(wal_record_t *record, void *extra);
+
+/// @brief Opens a log for appending, the file is created if it does not exist
+/// @param path The path of the log file
+/// @param latency_ms The longest time a record waits before it is written and synced
+/// @return The log, or NULL if the file can not be opened
+wal_t *wal_open(const char *path, int latency_ms);
+
+/// @brief Appends a record to the log
+/// @param wal The log
+/// @param type The type of the record
+/// @param fields One character per field, 'i' for an int and 's' for a string
+/// @param ... The fields
+void wal_append(wal_t *wal, uint8_t type, const char *fields, ...);
+
+/// @brief Same as wal_append with the fields in a va_list
+void wal_vappend(wal_t *wal, uint8_t type, const char *fields, va_list args);
+
+/// @brief Waits until every record appended so far is written and synced
+/// @param wal The log
+/// @return False if a batch could not be written or synced. The error sticks: the records after
+/// it are not written either and every later call fails.
+bool wal_sync(wal_t *wal);
+
+/// @brief Returns the position after the last record appended so far
+/// @param wal The log
+/// @return The position, the next record appended is the first after it
+wal_position_t wal_position(wal_t *wal);
+
+/// @brief Drops the records before a position from the log file, for instance when a snapshot
+/// holds them. The records after it are copied to a new file that replaces the log, so a crash
+/// leaves either the old or the new log.
+/// @param wal The log
+/// @param position A position taken with wal_position
+/// @return False if the log could not be rewritten or a batch could not be written, the records
+/// are then kept
+bool wal_discard(wal_t *wal, wal_position_t position);
+
+/// @brief Syncs the records appended so far and closes the log
+/// @param wal The log
+void wal_close(wal_t *wal);
+
+/// @brief Calls fun on every record of a log in order. A torn or corrupt tail, left by a
+/// crash in the middle of a write, is cut off the file.
+/// @param path The path of the log file
+/// @param from The records before this position are skipped, if it is in the same generation
+/// as the log. May be NULL.
+/// @param fun The function called on every record
+/// @param extra Passed to fun
+/// @return The number of records replayed, 0 if the file does not exist, -1 if fun stopped the
+/// replay. The file is then left as it is.
+int wal_replay(const char *path, const wal_position_t *from, wal_replay_function fun, void *extra);
+
+/// @brief Reads the next field of a record as an int
+/// @param record The record
+/// @return The int, 0 if the record has no more fields
+int wal_record_int(wal_record_t *record);
+
+/// @brief Reads the next field of a record as a string
+/// @param record The record
+/// @return A newly allocated copy of the string, the caller frees it
+char *wal_record_string(wal_record_t *record);
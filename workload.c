@@ -0,0 +1,343 @@
+#define _POSIX_C_SOURCE 200809L
+#include <math.h>
+#include <time.h>
+#include "backend.h"
+#include "span.h"
+
+/**
+ * @file workload.c
+ * @author Erdem Garip
+ * @date 18 Oct 2026
+ * @brief A synthetic webstore workload where a few merchandises get most of the traffic
+ *
+ * The merchandise of every operation is drawn from a Zipf distribution: the merchandise of
+ * popularity rank k is chosen with a probability proportional to 1 / k^s. The ranks are
+ * shuffled over the merchandises, so the popular ones are not the first ones added. The carts
+ * are chosen uniformly, and a cart that is checked out is replaced by a new empty one so the
+ * number of open carts stays the same.
+ *
+ * There are only 2600 shelf names, [A-Z][0-9][0-9], so the most popular merchandises get their
+ * shelves first and the rest are in the catalog without stock; adding them to a cart fails and
+ * is counted as rejected.
+ *
+ * Usage: ./workload [merchs=N] [shelves=N] [carts=N] [ops=N] [zipf=S] [seed=N]
+ *                   [mix=BROWSE,ADD,REMOVE,CHECKOUT,REPLENISH] [spans=PATH]
+ *
+ * spans=PATH writes the spans of the run as a Chrome trace, when built with `make SPANS=1`.
+ */
+
+#define WORKLOAD_SHELF_NAMES 2600
+#define WORKLOAD_STOCK 1000000
+#define WORKLOAD_LINES_PER_CART 4 // lines in every cart before the run
+
+typedef enum op_type
+{
+  OP_BROWSE,
+  OP_ADD,
+  OP_REMOVE,
+  OP_CHECKOUT,
+  OP_REPLENISH,
+  OP_TYPES
+} op_type_t;
+
+static const char *op_names[OP_TYPES] = {"browse", "add-to-cart", "remove", "checkout", "replenish"};
+
+typedef struct workload workload_t;
+typedef struct op_stats op_stats_t;
+
+struct workload
+{
+  size_t merch_count;
+  int shelves_per_merch;
+  size_t cart_count;
+  size_t ops;
+  double zipf;
+  unsigned int seed;
+  int mix[OP_TYPES]; // percent of the operations
+  const char *spans_path;
+};
+
+struct op_stats
+{
+  uint64_t *latencies; // nanoseconds
+  size_t count;
+  size_t rejected; // the operation could not be done, like adding what is out of stock
+};
+
+typedef struct zipf zipf_t;
+
+/// The cumulative probabilities of the ranks, searched for a uniform draw
+struct zipf
+{
+  double *cdf;
+  size_t count;
+};
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/// A uniform double in [0, 1) from a 64-bit xorshift generator
+static double uniform(uint64_t *state)
+{
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return (*state >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static zipf_t zipf_create(size_t count, double s)
+{
+  zipf_t zipf = {.cdf = malloc(sizeof(double) * count), .count = count};
+  double sum = 0;
+
+  for (size_t k = 0; k < count; k++)
+  {
+    sum += 1.0 / pow(k + 1, s);
+    zipf.cdf[k] = sum;
+  }
+  for (size_t k = 0; k < count; k++)
+  {
+    zipf.cdf[k] /= sum;
+  }
+  return zipf;
+}
+
+/// Draws a rank, 0 being the most popular
+static size_t zipf_draw(zipf_t *zipf, uint64_t *state)
+{
+  double u = uniform(state);
+  size_t low = 0;
+  size_t high = zipf->count - 1;
+
+  while (low < high)
+  {
+    size_t mid = low + (high - low) / 2;
+    if (zipf->cdf[mid] < u)
+    {
+      low = mid + 1;
+    }
+    else
+    {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+static bool parse_option(workload_t *config, const char *arg)
+{
+  if (strncmp(arg, "spans=", 6) == 0)
+  {
+    config->spans_path = arg + 6;
+    return true;
+  }
+  if (sscanf(arg, "merchs=%zu", &config->merch_count) == 1 || sscanf(arg, "shelves=%d", &config->shelves_per_merch) == 1 ||
+      sscanf(arg, "carts=%zu", &config->cart_count) == 1 || sscanf(arg, "ops=%zu", &config->ops) == 1 ||
+      sscanf(arg, "zipf=%lf", &config->zipf) == 1 || sscanf(arg, "seed=%u", &config->seed) == 1)
+  {
+    return true;
+  }
+
+  int *mix = config->mix;
+  return sscanf(arg, "mix=%d,%d,%d,%d,%d", &mix[0], &mix[1], &mix[2], &mix[3], &mix[4]) == OP_TYPES &&
+         mix[0] + mix[1] + mix[2] + mix[3] + mix[4] == 100;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static uint64_t percentile(op_stats_t *stats, double percent)
+{
+  size_t index = (size_t)(stats->count * percent / 100);
+  return stats->latencies[index < stats->count ? index : stats->count - 1];
+}
+
+int main(int argc, char *argv[])
+{
+  workload_t config = {.merch_count = 100000, .shelves_per_merch = 1, .cart_count = 1000, .ops = 1000000,
+                       .zipf = 0.99, .seed = 42, .mix = {60, 25, 5, 5, 5}};
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (!parse_option(&config, argv[i]))
+    {
+      fprintf(stderr, "workload: %s is not an option, see workload.c\n", argv[i]);
+      return 2;
+    }
+  }
+  if (config.merch_count == 0 || config.cart_count == 0 || config.shelves_per_merch < 1)
+  {
+    fprintf(stderr, "workload: there must be merchandise, shelves and carts\n");
+    return 2;
+  }
+
+  // ### Build ###
+  uint64_t build_start = now_ns();
+  webstore_t *db = db_create_webstore();
+  db_reserve_merchs(db, config.merch_count);
+  merch_t **by_rank = malloc(sizeof(merch_t *) * config.merch_count);
+  char ***shelves = calloc(config.merch_count, sizeof(char **)); // the shelf names of each rank
+  uint64_t rng = config.seed * 2654435761u + 1;
+  char name[32];
+
+  for (size_t i = 0; i < config.merch_count; i++)
+  {
+    snprintf(name, sizeof(name), "merch%zu", i);
+    merch_t *merch = db_create_merch(strdup(name), strdup("workload merchandise"), 1 + i % 1000);
+    db_add_merch(db, merch);
+    by_rank[i] = merch;
+  }
+  // The ranks are shuffled over the merchandises
+  for (size_t i = config.merch_count - 1; i > 0; i--)
+  {
+    size_t j = (size_t)(uniform(&rng) * (i + 1));
+    merch_t *merch = by_rank[i];
+    by_rank[i] = by_rank[j];
+    by_rank[j] = merch;
+  }
+
+  size_t stocked = 0;
+  for (int shelf = 0; shelf + config.shelves_per_merch <= WORKLOAD_SHELF_NAMES && stocked < config.merch_count;
+       shelf += config.shelves_per_merch, stocked++)
+  {
+    shelves[stocked] = malloc(sizeof(char *) * config.shelves_per_merch);
+    for (int j = 0; j < config.shelves_per_merch; j++)
+    {
+      snprintf(name, sizeof(name), "%c%02d", 'A' + (shelf + j) / 100, (shelf + j) % 100);
+      shelves[stocked][j] = strdup(name);
+      db_add_location_to_merch(db, by_rank[stocked], strdup(name), WORKLOAD_STOCK);
+    }
+  }
+
+  zipf_t zipf = zipf_create(config.merch_count, config.zipf);
+  shopping_carts_t **carts = malloc(sizeof(shopping_carts_t *) * config.cart_count);
+  for (size_t i = 0; i < config.cart_count; i++)
+  {
+    carts[i] = db_create_cart();
+    db_add_cart(db, carts[i]);
+    for (int j = 0; j < WORKLOAD_LINES_PER_CART; j++)
+    {
+      db_try_reserve(by_rank[zipf_draw(&zipf, &rng)], carts[i], 1);
+    }
+  }
+
+  printf("merchs: %zu (%zu stocked, %d shelves each), carts: %zu, ops: %zu, zipf: %.2f\n"
+         "mix: %d%% browse, %d%% add-to-cart, %d%% remove, %d%% checkout, %d%% replenish\n"
+         "built in %.2f s\n",
+         config.merch_count, stocked, config.shelves_per_merch, config.cart_count, config.ops, config.zipf,
+         config.mix[0], config.mix[1], config.mix[2], config.mix[3], config.mix[4], (now_ns() - build_start) / 1e9);
+
+  // ### Run ###
+  op_stats_t stats[OP_TYPES] = {{0}};
+  for (int type = 0; type < OP_TYPES; type++)
+  {
+    stats[type].latencies = malloc(sizeof(uint64_t) * config.ops);
+  }
+
+  uint64_t run_start = now_ns();
+  for (size_t i = 0; i < config.ops; i++)
+  {
+    int roll = (int)(uniform(&rng) * 100);
+    op_type_t type = OP_BROWSE;
+    int sum = config.mix[OP_BROWSE];
+    while (roll >= sum && type + 1 < OP_TYPES)
+    {
+      type++;
+      sum += config.mix[type];
+    }
+
+    size_t rank = zipf_draw(&zipf, &rng);
+    merch_t *merch = by_rank[rank];
+    size_t cart_index = (size_t)(uniform(&rng) * config.cart_count);
+    shopping_carts_t *cart = carts[cart_index];
+    bool done = true;
+
+    uint64_t start = now_ns();
+    switch (type)
+    {
+    case OP_BROWSE:
+      // What the menu shows before adding to a cart
+      done = db_get_merch(db, db_get_name(merch)) != NULL && db_lookup_valid_quantity(db, merch) >= 0;
+      break;
+    case OP_ADD:
+      done = db_try_reserve(merch, cart, 1);
+      break;
+    case OP_REMOVE:
+      done = db_cart_has_key(cart, merch);
+      if (done)
+      {
+        db_remove_merch_from_cart(cart, merch);
+      }
+      break;
+    case OP_CHECKOUT:
+      done = db_checkout(db, cart);
+      db_remove_cart(db, db_get_cart_id(cart));
+      carts[cart_index] = db_create_cart();
+      db_add_cart(db, carts[cart_index]);
+      break;
+    case OP_REPLENISH:
+      done = rank < stocked && db_edit_location_quantity(db, merch, shelves[rank][0], WORKLOAD_STOCK);
+      break;
+    default:
+      break;
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    stats[type].latencies[stats[type].count++] = elapsed;
+    stats[type].rejected += done ? 0 : 1;
+  }
+  double seconds = (now_ns() - run_start) / 1e9;
+
+  printf("%zu operations in %.2f s | %12.0f ops/s\n", config.ops, seconds, config.ops / seconds);
+  for (int type = 0; type < OP_TYPES; type++)
+  {
+    op_stats_t *s = &stats[type];
+    if (s->count == 0)
+    {
+      continue;
+    }
+    qsort(s->latencies, s->count, sizeof(uint64_t), compare_u64);
+    printf("%-12s %9zu ops | %7zu rejected | p50 %7lu ns | p99 %8lu ns | p99.9 %8lu ns | max %9lu ns\n",
+           op_names[type], s->count, s->rejected, (unsigned long)percentile(s, 50), (unsigned long)percentile(s, 99),
+           (unsigned long)percentile(s, 99.9), (unsigned long)s->latencies[s->count - 1]);
+  }
+
+#ifndef WEBSTORE_SPANS
+  if (config.spans_path != NULL)
+  {
+    printf("no spans were recorded, build with make clean && make SPANS=1 workload\n");
+  }
+#endif
+  if (config.spans_path != NULL && !span_export_chrome(config.spans_path))
+  {
+    fprintf(stderr, "workload: %s could not be written\n", config.spans_path);
+  }
+
+  // ### Clean up ###
+  for (int type = 0; type < OP_TYPES; type++)
+  {
+    free(stats[type].latencies);
+  }
+  for (size_t rank = 0; rank < stocked; rank++)
+  {
+    for (int j = 0; j < config.shelves_per_merch; j++)
+    {
+      free(shelves[rank][j]);
+    }
+    free(shelves[rank]);
+  }
+  free(shelves);
+  free(zipf.cdf);
+  free(carts);
+  free(by_rank);
+  db_destroy_webstore(db);
+  return 0;
+}